@@ -0,0 +1,34 @@
+/**
+ * @file Arduino.h
+ * @brief Tynd erstatning for Arduino-kernen i native-miljøet.
+ *
+ * Kun det firmwarelogikken bruger: ur, GPIO/touch og portMUX. Uret og
+ * indgangene styres af koden der kører logikken (se fake_hw.h).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "fake_hw.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+inline unsigned long millis() { return (unsigned long)(fakeHw.nowUs / 1000); }
+inline unsigned long micros() { return (unsigned long)fakeHw.nowUs; }
+inline int64_t esp_timer_get_time() { return (int64_t)fakeHw.nowUs; }
+inline uint16_t touchRead(uint8_t pin) { return fakeHw.touch(pin); }
+inline int digitalRead(uint8_t pin) { return fakeHw.pins[pin & 63]; }
+inline void digitalWrite(uint8_t pin, uint8_t value) { fakeHw.pins[pin & 63] = value; }
+inline void pinMode(uint8_t, uint8_t) {}
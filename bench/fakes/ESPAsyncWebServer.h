@@ -0,0 +1,67 @@
+/**
+ * @file ESPAsyncWebServer.h
+ * @brief Tynd erstatning for AsyncWebSocket i native-miljøet.
+ *
+ * Klienter sender ingenting; de tæller beskeder og bytes, og en klient kan
+ * sættes til at have fuld kø for at efterligne backpressure.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <Arduino.h>
+
+/**
+ * @brief Falsk WebSocket-klient.
+ */
+class AsyncWebSocketClient {
+public:
+  uint32_t id() const { return id_; }
+  bool queueIsFull() const { return full; }
+  bool canSend() const { return !full; }
+  void binary(const uint8_t*, size_t len) { messages++; bytes += len; }
+  void text(const char*, size_t len) { messages++; bytes += len; }
+  void close() { closed = true; }
+
+  uint32_t id_ = 0;      ///< 0 = ledig plads
+  bool full = false;     ///< Efterlign fuld sendekø
+  bool closed = false;   ///< close() er kaldt
+  uint32_t messages = 0; ///< Sendte beskeder
+  uint64_t bytes = 0;    ///< Sendte bytes
+};
+
+/**
+ * @brief Falsk WebSocket-endepunkt med plads til kMaxClients klienter.
+ */
+class AsyncWebSocket {
+public:
+  static const uint8_t kMaxClients = 8;
+
+  explicit AsyncWebSocket(const char*) {}
+
+  /** @brief Tilslutter en klient; returnerer nullptr hvis der ikke er plads. */
+  AsyncWebSocketClient* connect(uint32_t id) {
+    for (AsyncWebSocketClient& c : clients_) {
+      if (c.id_ == 0) {
+        c = AsyncWebSocketClient();
+        c.id_ = id;
+        return &c;
+      }
+    }
+    return nullptr;
+  }
+
+  AsyncWebSocketClient* client(uint32_t id) {
+    for (AsyncWebSocketClient& c : clients_) {
+      if (c.id_ == id && !c.closed) {
+        return &c;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  AsyncWebSocketClient clients_[kMaxClients];
+};
@@ -0,0 +1,34 @@
+/**
+ * @file fake_hw.h
+ * @brief Styrbart ur og indgange for de falske Arduino-funktioner.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Tilstand bag millis(), micros(), touchRead() og digitalRead().
+ *
+ * Uret står stille indtil advanceUs() kaldes. touchRead() returnerer
+ * touchValue, eller værdien fra touchFn hvis den er sat, så et pulstog kan
+ * genereres ud fra tiden.
+ */
+struct FakeHw {
+  uint64_t nowUs = 0;                              ///< Nuværende tid (µs)
+  uint8_t pins[64] = {};                           ///< digitalRead()/digitalWrite()
+  uint16_t touchValue = 100;                       ///< touchRead() uden touchFn
+  uint16_t (*touchFn)(uint8_t pin, uint64_t nowUs) = nullptr; ///< Genererer touchRead()-værdier
+  uint32_t touchReads = 0;                         ///< Antal kald til touchRead()
+
+  /** @brief Flytter uret frem. */
+  void advanceUs(uint64_t us) { nowUs += us; }
+
+  /** @brief touchRead() for pin på nuværende tidspunkt. */
+  uint16_t touch(uint8_t pin) {
+    touchReads++;
+    return touchFn ? touchFn(pin, nowUs) : touchValue;
+  }
+};
+
+extern FakeHw fakeHw; ///< Defineret i fakes.cpp
@@ -0,0 +1,8 @@
+/**
+ * @file fakes.cpp
+ * @brief Globale objekter for de falske Arduino-funktioner.
+ */
+
+#include "fake_hw.h"
+
+FakeHw fakeHw;
@@ -0,0 +1,428 @@
+/**
+ * @file microbench.cpp
+ * @brief Mikrobenchmarks af firmwarens varme stier på en Linux-host.
+ *
+ * Køres med PlatformIO-miljøet native:
+ *   pio run -e native && .pio/build/native/program [filter] > bench.jsonl
+ * eller bygges direkte:
+ *   g++ -std=gnu++17 -O2 -Iinclude -Ibench/fakes bench/microbench.cpp bench/fakes/fakes.cpp \
+ *       $(ls src/[!m]*.cpp) -o microbench
+ *
+ * Hver benchmark gentages med fordoblet antal iterationer indtil en måling
+ * varer mindst kMinRunNs. Derefter måles kRuns gange, og den hurtigste
+ * kørsel rapporteres, så støj fra andre processer fylder mindre. Der
+ * skrives én JSON-linje pr. benchmark:
+ *   {"bench":"pulse_sample","iterations":N,"ns_per_op":x,"ops_per_s":y}
+ * Sammenlign to kørsler med tools/bench_compare.py. Arduino-funktioner,
+ * lager og WebSocket er erstattet af fakes (bench/fakes, RamStorage).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "channel_bank.h"
+#include "config_record.h"
+#include "crc32.h"
+#include "energy.h"
+#include "history.h"
+#include "live_history.h"
+#include "live_protocol.h"
+#include "log_format.h"
+#include "log_writer.h"
+#include "metrics.h"
+#include "power_kernel.h"
+#include "push_exporter.h"
+#include "rollup.h"
+#include "rule_engine.h"
+#include "spsc_ring.h"
+#include "storage_ram.h"
+#include "ts_block.h"
+#include "ws_broadcaster.h"
+
+const uint64_t kMinRunNs = 20000000; ///< Mindste varighed af én målt kørsel (20 ms)
+const int kRuns = 5;                 ///< Målte kørsler; den hurtigste rapporteres
+
+volatile uint32_t benchSink; ///< Forhindrer at compileren fjerner resultater
+
+static const char* benchFilter = nullptr;
+
+static uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Kører en benchmark og skriver resultatet.
+ * @param name Navn i outputtet
+ * @param fn Kaldes med antal iterationer; én iteration = én operation
+ */
+template <typename Fn>
+static void bench(const char* name, Fn fn) {
+  if (benchFilter != nullptr && strstr(name, benchFilter) == nullptr) {
+    return;
+  }
+  uint64_t iterations = 1;
+  uint64_t elapsed = 0;
+  for (;;) {
+    uint64_t start = nowNs();
+    fn(iterations);
+    elapsed = nowNs() - start;
+    if (elapsed >= kMinRunNs || iterations >= (1ull << 40)) {
+      break;
+    }
+    iterations *= 2;
+  }
+  for (int run = 1; run < kRuns; run++) {
+    uint64_t start = nowNs();
+    fn(iterations);
+    uint64_t t = nowNs() - start;
+    if (t < elapsed) {
+      elapsed = t;
+    }
+  }
+  double nsPerOp = (double)elapsed / iterations;
+  printf("{\"bench\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"ops_per_s\":%.0f}\n", name,
+         (unsigned long long)iterations, nsPerOp, 1e9 / nsPerOp);
+  fflush(stdout);
+}
+
+/** @brief Pulstog på 1 Hz med 40 ms berøring, som en målers LED. */
+static uint16_t pulseTrain(uint8_t, uint64_t nowUs) {
+  return nowUs % 1000000 < 40000 ? 10 : 100;
+}
+
+/**
+ * @brief LogSink der appender til RamStorage og starter forfra når den er fuld.
+ */
+class RamLogSink : public LogSink {
+public:
+  explicit RamLogSink(RamStorage& storage) : storage_(storage) {}
+
+  bool commit(const uint8_t* data, size_t len) override {
+    if (storage_.append("/log.bin", data, len) == len) {
+      return true;
+    }
+    storage_.format();
+    return storage_.append("/log.bin", data, len) == len;
+  }
+
+private:
+  RamStorage& storage_;
+};
+
+static uint32_t fakeClockUs() {
+  return micros();
+}
+
+/**
+ * @brief Én samplegennemgang over count kanaler, som samplePulses() i main.cpp.
+ *
+ * Prisen pr. kanal er ns_per_op / count.
+ */
+static void benchChannels(const char* name, size_t count) {
+  bench(name, [count](uint64_t n) {
+    ChannelBank<kConfigMaxChannels> bank;
+    for (size_t ch = 0; ch < count; ch++) {
+      bank.setChannel(ch, ch, 1000, 20000, 2000);
+    }
+    bank.setCount(count);
+    fakeHw.touchFn = pulseTrain;
+    uint32_t pulses = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      fakeHw.advanceUs(2000);
+      pulses += __builtin_popcount(bank.sample(touchRead, esp_timer_get_time()));
+    }
+    benchSink = pulses;
+  });
+}
+
+/**
+ * @brief Sample-stien: touchRead, PulseDetectorBank og ring via ChannelBank::sampleInto(),
+ * samme kode som samplePulses() i main.cpp, og derefter energimåleren.
+ */
+static void benchPulse() {
+  bench("pulse_sample", [](uint64_t n) {
+    static ChannelBank<kConfigMaxChannels> bank;
+    static SpscRing<PulseEvent, 64> ring;
+    static EnergyMeter meter;
+    fakeHw.touchFn = pulseTrain;
+    for (uint64_t i = 0; i < n; i++) {
+      fakeHw.advanceUs(2000);
+      bank.sampleInto(touchRead, esp_timer_get_time(), ring);
+      PulseEvent event;
+      while (ring.pop(event)) {
+        meter.onPulse(event.us);
+      }
+    }
+    benchSink = meter.pulses();
+  });
+
+  benchChannels("sample_pass_1ch", 1);
+  benchChannels("sample_pass_2ch", 2);
+  benchChannels("sample_pass_4ch", 4);
+  benchChannels("sample_pass_8ch", 8);
+
+  bench("energy_power_mw", [](uint64_t n) {
+    EnergyMeter meter;
+    meter.onPulse(1000000);
+    meter.onPulse(2000000);
+    uint32_t sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      sum += meter.powerMw(2000000 + (i & 0xFFFFF));
+    }
+    benchSink = sum;
+  });
+
+  // Én prøve mod kConfigMaxRules regler på samme kanal, som evaluateRules() i main.cpp
+  bench("rule_update_8_rules", [](uint64_t n) {
+    static RuleEngine engine;
+    static bool configured = false;
+    if (!configured) {
+      configured = true;
+      RuleConfig rules[kConfigMaxRules];
+      size_t count = parseRules("power:0:3000:60:led;power:0:5000:5:event;idle:0:0:1800:event;"
+                                "energy:0:12000:0:push;power:0:2000:600:event;idle:0:0:60:led;"
+                                "energy:0:20000:0:event;power:0:100:1:push", rules, kConfigMaxRules);
+      engine.configure(rules, count);
+    }
+    RuleSample sample = {0, 19700, 0, 0, 0, 0};
+    uint32_t changes = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      sample.nowMs = (uint32_t)(i * 10);
+      sample.counter = (uint32_t)(i >> 6);
+      sample.energyWh = (uint32_t)(i >> 10);
+      sample.powerW = (int32_t)((i >> 8) & 0x1FFF);
+      changes += __builtin_popcount(engine.update(sample));
+    }
+    benchSink = changes;
+  });
+}
+
+/** @brief Logning: logskriver mod RamStorage, blokkodning og CSV. */
+static void benchLogging() {
+  bench("log_append", [](uint64_t n) {
+    static RamStorage storage(0x160000);
+    static RamLogSink sink(storage);
+    static LogWriter writer(sink, 32, 5000, fakeClockUs);
+    LogRecord record = {1700000000, 0, 0, LOG_EVENT_COUNTER, 0};
+    for (uint64_t i = 0; i < n; i++) {
+      record.value = (int32_t)i;
+      writer.append(&record, sizeof(record), millis());
+      writer.poll(millis());
+    }
+    benchSink = writer.stats().commits;
+  });
+
+  bench("ts_block_add", [](uint64_t n) {
+    static TsBlockEncoder encoder;
+    LogRecord record = {1700000000, 0, 0, LOG_EVENT_POWER, 800};
+    for (uint64_t i = 0; i < n; i++) {
+      record.time += 60;
+      record.value += (int32_t)(i % 41) - 20;
+      if (!encoder.add(record)) {
+        encoder.reset();
+        encoder.add(record);
+      }
+    }
+    benchSink = encoder.count();
+  });
+
+  bench("log_csv_format", [](uint64_t n) {
+    char line[64];
+    LogRecord record = {1700000000, 123, 0, LOG_EVENT_POWER, 1234};
+    size_t total = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      record.time++;
+      total += formatLogCsv(record, line, sizeof(line));
+    }
+    benchSink = total;
+  });
+
+  bench("crc32_1k", [](uint64_t n) {
+    static uint8_t data[1024];
+    uint32_t crc = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      data[0] = (uint8_t)i;
+      crc ^= crc32(data, sizeof(data));
+    }
+    benchSink = crc;
+  });
+}
+
+/** @brief Transport der altid er klar og glemmer alt; måler eksportørens eget arbejde. */
+class NullPushTransport : public PushTransport {
+public:
+  const char* name() const override { return "null"; }
+  bool ready(uint32_t) override { return true; }
+  bool send(const uint8_t* data, size_t len) override {
+    benchSink += data[len - 1];
+    return true;
+  }
+};
+
+/** @brief Beskedformatering: binære rammer, tekst og en broadcaster-tick. */
+static void benchMessages() {
+  static int32_t values[LIVE_FIELD_COUNT];
+  for (size_t i = 0; i < LIVE_FIELD_COUNT; i++) {
+    values[i] = (int32_t)(i * 1234567);
+  }
+  const uint32_t allFields = (1u << LIVE_CHANNEL_FIELDS) - 1; // kanal 0's felter
+
+  bench("live_frame_encode", [allFields](uint64_t n) {
+    uint8_t frame[kLiveFrameMaxSize];
+    size_t total = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      total += encodeLiveFrame(LIVE_FRAME_FIELDS, (uint32_t)i, (uint32_t)i, allFields, values, frame, sizeof(frame));
+    }
+    benchSink = total;
+  });
+
+  bench("live_text_format", [allFields](uint64_t n) {
+    char text[256];
+    size_t total = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      values[0] = (int32_t)i;
+      total += formatLiveText(allFields, values, text, sizeof(text));
+    }
+    benchSink = total;
+  });
+
+  bench("live_history_append", [](uint64_t n) {
+    static LiveHistory history;
+    const uint32_t mask = LiveFields::bit(LIVE_COUNTER) | LiveFields::bit(LIVE_POWER);
+    for (uint64_t i = 0; i < n; i++) {
+      values[LIVE_COUNTER] = (int32_t)i;
+      history.append((uint32_t)i + 1, (uint32_t)i * 200, mask, values);
+    }
+    benchSink = history.count();
+  });
+
+  // Snapshot til en ny klient: de sidste kSnapshotEntries fra en fuld ring
+  bench("live_history_snapshot", [](uint64_t n) {
+    static LiveHistory history;
+    static uint32_t seq = 0;
+    const uint32_t mask = LiveFields::bit(LIVE_COUNTER) | LiveFields::bit(LIVE_POWER);
+    while (seq < kLiveHistoryWords) {
+      seq++;
+      history.append(seq, seq * 200, mask, values);
+    }
+    LiveHistoryEntry entry;
+    uint32_t total = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      uint32_t cursor;
+      uint32_t after = history.seqBeforeLast(WsBroadcaster::kSnapshotEntries, &cursor);
+      while (history.next(after, entry, cursor)) {
+        after = entry.seq;
+        total += entry.values[LIVE_POWER];
+      }
+    }
+    benchSink = total;
+  });
+
+  // Ét punkt formateret og lagt i en batch; hver ~12. lukker batchen
+  bench("push_exporter_add", [](uint64_t n) {
+    static NullPushTransport transport;
+    static RamStorage storage(0x160000);
+    static PushExporter exporter(transport, storage, PushExporterConfig());
+    PushPoint point = {1700000000, 0, 0, 0, 230};
+    for (uint64_t i = 0; i < n; i++) {
+      point.time++;
+      point.counter = (uint32_t)i;
+      point.energyWh = (int32_t)(i / 1000);
+      exporter.add(point, millis());
+    }
+    benchSink += exporter.stats().batches;
+  });
+
+  bench("ws_tick_4_clients", [](uint64_t n) {
+    static AsyncWebSocket ws("/ws");
+    static WsBroadcaster broadcaster(ws, 100, 50);
+    static bool connected = false;
+    if (!connected) {
+      connected = true;
+      for (uint32_t id = 1; id <= 4; id++) {
+        ws.connect(id);
+        broadcaster.addClient(id);
+        broadcaster.setBinary(id, id % 2 == 0);
+      }
+    }
+    for (uint64_t i = 0; i < n; i++) {
+      fakeHw.advanceUs(100000);
+      broadcaster.set(LIVE_COUNTER, (int32_t)i);
+      broadcaster.set(LIVE_POWER, (int32_t)(i * 7));
+      broadcaster.tick(millis());
+    }
+    benchSink = broadcaster.messagesSent();
+  });
+}
+
+/** @brief Aggregering: rollup, historik-svar, histogram og effektkerne. */
+static void benchAggregation() {
+  bench("rollup_add", [](uint64_t n) {
+    static Rollup rollup;
+    static uint32_t t = 1700000000;
+    for (uint64_t i = 0; i < n; i++) {
+      rollup.add(t++, (int32_t)(i & 3));
+    }
+    benchSink = t;
+  });
+
+  bench("history_json_24h_1m", [](uint64_t n) {
+    static Rollup rollup;
+    static bool filled = false;
+    if (!filled) {
+      filled = true;
+      for (uint32_t t = 1700000000 - 86400; t < 1700000000; t++) {
+        rollup.add(t, (int32_t)(t % 3));
+      }
+    }
+    uint8_t buf[1024];
+    size_t total = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      HistoryCursor cursor(rollup, 1700000000 - 86400, 1700000000, 60, HISTORY_JSON);
+      while (!cursor.done()) {
+        total += cursor.fill(buf, sizeof(buf));
+      }
+    }
+    benchSink = total;
+  });
+
+  bench("histogram_observe", [](uint64_t n) {
+    static const uint32_t bounds[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000};
+    static Histogram hist(bounds, sizeof(bounds) / sizeof(bounds[0]));
+    for (uint64_t i = 0; i < n; i++) {
+      hist.observe((uint32_t)(i * 2654435761u) >> 14);
+    }
+    benchSink = hist.observations();
+  });
+
+  bench("power_accumulate_100", [](uint64_t n) {
+    static int16_t v[100];
+    static int16_t c[100];
+    for (int k = 0; k < 100; k++) {
+      v[k] = (int16_t)(k * 37 - 1800);
+      c[k] = (int16_t)(k * 11 - 500);
+    }
+    PowerSums sums = {};
+    for (uint64_t i = 0; i < n; i++) {
+      powerAccumulate(v, c, 100, sums);
+    }
+    benchSink = (uint32_t)sums.sumVI;
+  });
+}
+
+// Under pio test bygges bench/ med, men testene har deres egen main()
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char** argv) {
+  benchFilter = argc > 1 ? argv[1] : nullptr;
+  benchPulse();
+  benchLogging();
+  benchMessages();
+  benchAggregation();
+  return 0;
+}
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file boot_timeline.h
+ * @brief Tidsstempler for opstartens faser.
+ *
+ * Hver fase markeres første gang den nås, målt i µs siden boot. Markeringer
+ * kan komme fra forskellige tasks; hver fase skrives kun én gang, så der
+ * bruges en atomisk compare-exchange og ingen lås.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @brief Faser i opstarten.
+ */
+enum BootPhase : uint8_t {
+  BOOT_FS_MOUNTED = 0,    ///< SPIFFS er monteret
+  BOOT_STORAGE_READY,     ///< Log og rollup er indlæst
+  BOOT_SAMPLING_STARTED,  ///< Sample-tasken er startet
+  BOOT_FIRST_SAMPLE,      ///< Første sample er taget
+  BOOT_SERVER_STARTED,    ///< Webserveren lytter
+  BOOT_WIFI_CONNECTED,    ///< Første IP-adresse
+  BOOT_TIME_SYNCED,       ///< Uret er synkroniseret via NTP
+  BOOT_PHASE_COUNT
+};
+
+/**
+ * @brief Første tidspunkt for hver opstartsfase.
+ */
+class BootTimeline {
+public:
+  /**
+   * @brief Markerer en fase, hvis den ikke allerede er markeret.
+   * @param phase Fasen
+   * @param nowUs Tid siden boot (µs), 0 regnes som 1
+   */
+  void mark(BootPhase phase, uint64_t nowUs) {
+    uint64_t expected = 0;
+    phases_[phase].compare_exchange_strong(expected, nowUs ? nowUs : 1);
+  }
+
+  /** @brief Om fasen er nået. */
+  bool reached(BootPhase phase) const { return phases_[phase].load() != 0; }
+
+  /** @brief Tidspunkt for fasen (µs siden boot), 0 hvis ikke nået. */
+  uint64_t at(BootPhase phase) const { return phases_[phase].load(); }
+
+  /** @brief Navn på en fase til logs og metrics. */
+  static const char* name(BootPhase phase) {
+    static const char* const names[BOOT_PHASE_COUNT] = {
+      "fs_mounted", "storage_ready", "sampling_started", "first_sample",
+      "server_started", "wifi_connected", "time_synced",
+    };
+    return phase < BOOT_PHASE_COUNT ? names[phase] : "unknown";
+  }
+
+private:
+  std::atomic<uint64_t> phases_[BOOT_PHASE_COUNT] = {}; ///< µs siden boot, 0 = ikke nået
+};
@@ -0,0 +1,124 @@
+/**
+ * @file channel_bank.h
+ * @brief N pulsindgange der samples i én gennemgang.
+ *
+ * Hver kanal har sin egen sensorpin, målerkonstant og detektortilstand.
+ * Alt ligger som arrays med én plads pr. kanal (structure of arrays), med
+ * størrelsen N fastlagt ved oversættelse; hvor mange kanaler der er i brug,
+ * vælges ved kørsel. sample() læser alle pins først og kører derefter
+ * detektoren over alle kanaler, så råværdierne ligger samlet.
+ *
+ * Uden Arduino-afhængigheder: læsningen af en pin gives som funktion, så
+ * banken kan benchmarkes på en host (se bench/microbench.cpp).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pulse_detector.h"
+
+/**
+ * @brief En talt puls med kanal, som den sendes fra sample- til I/O-tasken.
+ */
+struct PulseEvent {
+  uint64_t us;     ///< Stigende flanke (µs siden boot)
+  uint8_t channel; ///< Kanal 0..N-1
+};
+
+/**
+ * @brief Pins, målerkonstanter og detektorer for op til N kanaler.
+ */
+template <size_t N>
+class ChannelBank {
+public:
+  static const size_t kMaxChannels = N; ///< Pladser i arrays
+
+  /**
+   * @brief Sætter en kanal op.
+   *
+   * Tidsgrænserne udledes af målerkonstanten med pulseTimingFor().
+   * @param ch Kanal
+   * @param pin Sensorens pin
+   * @param impPerKwh Målerkonstant (pulser pr. kWh)
+   * @param maxPowerW Største forventede effekt (W)
+   * @param sampleIntervalUs Sampleperiode (µs)
+   * @return Tidsgrænserne kanalen fik.
+   */
+  PulseTiming setChannel(size_t ch, uint8_t pin, uint32_t impPerKwh, uint32_t maxPowerW,
+                         uint32_t sampleIntervalUs) {
+    PulseTiming timing = pulseTimingFor(impPerKwh, maxPowerW, sampleIntervalUs);
+    PulseDetectorConfig config = detectors_.config(ch);
+    config.minWidthUs = timing.minWidthUs;
+    config.minIntervalUs = timing.minIntervalUs;
+    detectors_.configure(ch, config);
+    pin_[ch] = pin;
+    impPerKwh_[ch] = impPerKwh;
+    return timing;
+  }
+
+  /**
+   * @brief Vælger hvor mange kanaler der samples.
+   * @param count 1..N; kanal 0..count-1 skal være sat op
+   */
+  void setCount(size_t count) { count_ = count < 1 ? 1 : count > N ? N : count; }
+
+  /** @brief Kanaler i brug. */
+  size_t count() const { return count_; }
+
+  /** @brief Kanalens sensorpin. */
+  uint8_t pin(size_t ch) const { return pin_[ch]; }
+
+  /** @brief Kanalens målerkonstant. */
+  uint32_t impPerKwh(size_t ch) const { return impPerKwh_[ch]; }
+
+  /**
+   * @brief Sampler alle kanaler i brug én gang.
+   * @param read Funktion eller funktor uint16_t(uint8_t pin) der læser en sensor
+   * @param nowUs Tidspunkt for gennemgangen (µs)
+   * @return Bitmaske over kanaler med en ny puls; tidsstemplet er pulseStartUs().
+   */
+  template <class Read>
+  uint32_t sample(Read read, uint64_t nowUs) {
+    for (size_t ch = 0; ch < count_; ch++) {
+      raw_[ch] = read(pin_[ch]);
+    }
+    return detectors_.update(raw_, count_, nowUs);
+  }
+
+  /**
+   * @brief Sampler som sample() og lægger hver ny puls i en ring som PulseEvent.
+   *
+   * Sample-taskens arbejde pr. periode; deles med microbenchmarken og testene.
+   * @param read Se sample()
+   * @param nowUs Tidspunkt for gennemgangen (µs)
+   * @param ring Ring med push(const PulseEvent&), f.eks. SpscRing
+   * @return True hvis mindst én puls kom i ringen.
+   */
+  template <class Read, class Ring>
+  bool sampleInto(Read read, uint64_t nowUs, Ring& ring) {
+    uint32_t pulses = sample(read, nowUs);
+    bool pushed = false;
+    while (pulses != 0) {
+      uint8_t ch = __builtin_ctz(pulses);
+      pulses &= pulses - 1;
+      PulseEvent event = {detectors_.pulseStartUs(ch), ch};
+      pushed |= ring.push(event);
+    }
+    return pushed;
+  }
+
+  /** @brief Stigende flanke for kanalens senest talte puls (µs). */
+  uint64_t pulseStartUs(size_t ch) const { return detectors_.pulseStartUs(ch); }
+
+  /** @brief Signalkvalitet og tællere for en kanal. */
+  PulseDetectorStats stats(size_t ch) const { return detectors_.stats(ch); }
+
+private:
+  size_t count_ = 1;
+  uint8_t pin_[N] = {};
+  uint32_t impPerKwh_[N] = {};
+  uint16_t raw_[N] = {};          ///< Seneste råværdier, fyldes før detektoren kører
+  PulseDetectorBank<N> detectors_;
+};
@@ -0,0 +1,132 @@
+/**
+ * @file checkpoint_journal.h
+ * @brief Strømsvigtsikre checkpoints af tællere og energi i en roterende journal.
+ *
+ * Journalen er en FlashRegion delt i slots på kCheckpointSlotSize bytes.
+ * Checkpoints skrives i rækkefølge slot for slot og sektor for sektor i
+ * ring; når skrivningen når en ny sektor, slettes den først. Slid
+ * fordeles derfor jævnt over hele området, og hver sektor slettes én gang
+ * pr. gennemløb af ringen. Et slot:
+ * | Offset | Størrelse | Felt                                          |
+ * |--------|-----------|-----------------------------------------------|
+ * | 0      | 4         | Magic (kCheckpointMagic)                      |
+ * | 4      | 4         | Sekvensnummer, +1 pr. checkpoint              |
+ * | 8      | 4 × 8     | Pulstæller pr. kanal                          |
+ * | 40     | 8 × 8     | Energi pr. kanal (µWh)                        |
+ * | 104    | 4         | CRC-32 over byte 0-103                        |
+ * | 108    | 20        | Ubrugt (0xFF)                                 |
+ *
+ * Gendannelse læser første gyldige slot i hver sektor for at finde sektoren
+ * med det højeste sekvensnummer og derefter alle slots i den sektor. Normalt
+ * er det slot 0, så det tager sektorer + slots pr. sektor læsninger uanset
+ * hvor længe journalen har kørt; kun sektorer hvor slot 0 fejlede, eller
+ * som er tomme, læses længere. Et slot der blev afbrudt under skrivning,
+ * fejler CRC'en og springes over; så vinder det forrige. Skrivning
+ * fortsætter i første slettede slot efter det nyeste.
+ *
+ * Slid estimeres ud fra sekvensnummeret, der overlever genstarter:
+ * sletninger pr. sektor = sekvens / slots i alt. Uden Arduino-
+ * afhængigheder; se tools/checkpoint_sim.cpp for en test med strømsvigt.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "flash_region.h"
+
+const uint32_t kCheckpointMagic = 0x504B4345;   ///< "ECKP" little-endian
+const size_t kCheckpointChannels = 8;           ///< Kanaler pr. checkpoint
+const size_t kCheckpointSlotSize = 128;         ///< Bytes pr. slot
+const uint32_t kFlashEnduranceCycles = 100000;  ///< Garanterede sletninger pr. sektor (NOR)
+
+/**
+ * @brief Indholdet af ét checkpoint.
+ */
+struct Checkpoint {
+  uint32_t sequence = 0;                          ///< Sættes af CheckpointJournal::write()
+  uint32_t counters[kCheckpointChannels] = {};    ///< Pulser pr. kanal
+  uint64_t energyUwh[kCheckpointChannels] = {};   ///< Energi pr. kanal (µWh)
+};
+
+/**
+ * @brief Koder et checkpoint som et slot.
+ * @param checkpoint Checkpointet
+ * @param slot Modtager kCheckpointSlotSize bytes
+ */
+void checkpointEncode(const Checkpoint& checkpoint, uint8_t* slot);
+
+/**
+ * @brief Læser og validerer et slot.
+ * @param slot kCheckpointSlotSize bytes
+ * @param checkpoint Modtager checkpointet hvis slottet er gyldigt
+ * @return False hvis slottet er slettet, afbrudt eller ødelagt.
+ */
+bool checkpointDecode(const uint8_t* slot, Checkpoint& checkpoint);
+
+/**
+ * @brief Tællere for journalen siden opstart.
+ */
+struct CheckpointJournalStats {
+  uint32_t writes = 0;        ///< Skrevne checkpoints
+  uint32_t failures = 0;      ///< Skrivninger eller sletninger der fejlede
+  uint32_t erases = 0;        ///< Slettede sektorer
+  uint32_t skipped = 0;       ///< Slots sprunget over fordi de ikke var slettede
+  uint32_t recoveryReads = 0; ///< Slots læst ved gendannelse
+};
+
+/**
+ * @brief Skriver og gendanner checkpoints i en FlashRegion.
+ */
+class CheckpointJournal {
+public:
+  /** @param flash Området journalen ejer; mindst to sektorer */
+  explicit CheckpointJournal(FlashRegion& flash);
+
+  /**
+   * @brief Finder det nyeste gyldige checkpoint og hvor næste skal skrives.
+   *
+   * Skal kaldes før write().
+   * @param latest Modtager checkpointet
+   * @return False hvis journalen er tom.
+   */
+  bool recover(Checkpoint& latest);
+
+  /**
+   * @brief Skriver et nyt checkpoint efter det forrige.
+   *
+   * Sletter næste sektor når den nuværende er fuld. Mislykkes skrivningen,
+   * prøves næste slot én gang.
+   * @param checkpoint Checkpointet; sequence sættes
+   * @return True hvis checkpointet er skrevet og læst tilbage.
+   */
+  bool write(Checkpoint& checkpoint);
+
+  /** @brief Sekvensnummeret for seneste checkpoint. */
+  uint32_t sequence() const { return sequence_; }
+
+  /** @brief Slots i alt. */
+  uint32_t slots() const { return sectors_ * slotsPerSector_; }
+
+  /** @brief Estimerede sletninger pr. sektor over journalens levetid. */
+  uint32_t estimatedSectorErases() const { return slots() ? sequence_ / slots() : 0; }
+
+  /** @brief Brugt andel af flashens garanterede sletninger, 0..1+. */
+  float wear() const { return (float)estimatedSectorErases() / kFlashEnduranceCycles; }
+
+  /** @brief Tællere siden opstart. */
+  const CheckpointJournalStats& stats() const { return stats_; }
+
+private:
+  bool readSlot(uint32_t index, uint8_t* buf);
+  bool slotErased(uint32_t index);
+  bool writeAt(uint32_t index, Checkpoint& checkpoint);
+
+  FlashRegion& flash_;
+  uint32_t sectors_;
+  uint32_t slotsPerSector_;
+  uint32_t next_ = 0;      ///< Næste slot der skrives (0..slots()-1)
+  uint32_t sequence_ = 0;
+  CheckpointJournalStats stats_;
+};
@@ -0,0 +1,172 @@
+/**
+ * @file config_record.h
+ * @brief Versioneret, CRC-beskyttet konfigurationspost med to skiftevise slots.
+ *
+ * Posten består af en fast header efterfulgt af ConfigData:
+ * | Offset | Størrelse | Felt                                       |
+ * |--------|-----------|--------------------------------------------|
+ * | 0      | 4         | Magic (kConfigMagic)                       |
+ * | 4      | 2         | Version (kConfigVersion)                   |
+ * | 6      | 2         | Antal databytes der følger                 |
+ * | 8      | 4         | Sekvensnummer, +1 pr. gemning              |
+ * | 12     | 4         | CRC-32 over databytes                      |
+ * | 16     | size      | ConfigData                                 |
+ *
+ * Nye felter tilføjes altid sidst i ConfigData. En ældre, kortere post
+ * læses ved at kopiere de bytes den har og lade resten stå på
+ * standardværdierne; versionen øges kun hvis eksisterende felter ændrer
+ * betydning. Der gemmes skiftevis i to slots, så en strømafbrydelse under
+ * skrivning højst ødelægger den ældste post; ved indlæsning vinder den
+ * gyldige post med højest sekvensnummer.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "crc32.h"
+
+const uint32_t kConfigMagic = 0x47464345; ///< "ECFG" little-endian
+const uint16_t kConfigVersion = 1;        ///< Aktuel version af posten
+const size_t kConfigSlots = 2;            ///< Antal skiftevise slots
+const size_t kConfigMaxChannels = 8;      ///< Største antal pulskanaler
+const size_t kConfigMaxRules = 8;         ///< Største antal alarmregler
+const uint32_t kConfigMinSampleIntervalUs = 1000;   ///< Korteste sampleperiode; samplertasken skal nå alle kanaler
+const uint32_t kConfigMaxSampleIntervalUs = 100000; ///< Længste sampleperiode
+const uint32_t kConfigMaxPowerFloorW = 100;     ///< Mindste tilladte maxPowerW
+const uint32_t kConfigMaxPowerCeilW = 200000;   ///< Største tilladte maxPowerW; pulsintervallet skal kunne samples
+const uint32_t kConfigMinExportIntervalS = 1;    ///< Korteste interval mellem målepunkter til eksport
+const uint32_t kConfigMaxExportIntervalS = 3600; ///< Længste interval mellem målepunkter til eksport
+const uint32_t kConfigMaxImpPerKwh = 100000;     ///< Største målerkonstant; 0 og negative tal afvises
+const uint32_t kConfigMaxLogRetentionDays = 3650; ///< Længste opbevaring af loggen
+
+/**
+ * @brief Hvordan målinger skubbes til en opsamler (se push_exporter.h).
+ */
+enum ExportMode : uint8_t {
+  EXPORT_OFF = 0,  ///< Kun HTTP; opsamleren poller
+  EXPORT_UDP = 1,  ///< InfluxDB line protocol over UDP
+  EXPORT_MQTT = 2, ///< Line protocol som MQTT-beskeder med QoS 1
+};
+
+/**
+ * @brief Hvad en alarmregel holder øje med (se rule_engine.h).
+ */
+enum RuleKind : uint8_t {
+  RULE_OFF = 0,          ///< Reglen er ikke i brug
+  RULE_POWER_ABOVE = 1,  ///< Effekt over threshold W i mindst holdS sekunder
+  RULE_NO_PULSES = 2,    ///< Ingen pulser i holdS sekunder
+  RULE_DAILY_ENERGY = 3, ///< Energi siden midnat (UTC) over threshold Wh
+};
+
+/**
+ * @brief Hvad der sker når en regel slår til eller fra; kan kombineres.
+ */
+enum RuleAction : uint8_t {
+  RULE_ACTION_LED = 0x01,   ///< LED'en lyser mens reglen er aktiv
+  RULE_ACTION_EVENT = 0x02, ///< Live-feltet "alerts" og en post i loggen
+  RULE_ACTION_PUSH = 0x04,  ///< En alarmlinje sendes straks med eksporten
+};
+
+/**
+ * @brief Én alarmregel.
+ */
+struct RuleConfig {
+  uint8_t kind;       ///< RuleKind
+  uint8_t channel;    ///< Pulskanal reglen gælder
+  uint8_t actions;    ///< RuleAction-bits
+  uint8_t reserved;   ///< Altid 0
+  uint32_t threshold; ///< W for RULE_POWER_ABOVE, Wh for RULE_DAILY_ENERGY
+  uint32_t holdS;     ///< Sekunder betingelsen skal holde, før reglen slår til
+};
+
+/**
+ * @brief Header foran hver konfigurationspost.
+ */
+struct ConfigHeader {
+  uint32_t magic;    ///< kConfigMagic
+  uint16_t version;  ///< kConfigVersion
+  uint16_t size;     ///< Antal bytes ConfigData
+  uint32_t sequence; ///< Højest vinder ved indlæsning
+  uint32_t crc;      ///< CRC-32 over ConfigData
+};
+
+/**
+ * @brief Selve indstillingerne. Nye felter tilføjes sidst.
+ */
+struct ConfigData {
+  char ssid[33];             ///< Wi-Fi SSID, nul-termineret
+  char pass[65];             ///< Wi-Fi password, nul-termineret
+  char ip[16];               ///< Statisk IP-adresse, tom = DHCP
+  char gateway[16];          ///< Gateway-adresse
+  uint8_t samplingMode;      ///< SamplingMode
+  uint8_t reserved;          ///< Altid 0
+  uint32_t impPerKwh;        ///< Målerkonstant (pulser pr. kWh)
+  uint32_t sampleIntervalUs; ///< Sampleperiode for pulsindgangen (µs)
+  uint16_t logRetentionDays; ///< Dage loggen gemmes, 0 = indtil flash er fuld
+  uint32_t maxPowerW;        ///< Største forventede effekt (W); giver pulsdetektorens tidsgrænser
+  uint8_t channelCount;      ///< Pulskanaler i brug, 1..kConfigMaxChannels
+  uint8_t channelPins[kConfigMaxChannels];         ///< Sensorpin pr. kanal
+  uint32_t channelImpPerKwh[kConfigMaxChannels];   ///< Målerkonstant pr. kanal, 0 = impPerKwh
+  uint8_t exportMode;        ///< ExportMode
+  uint16_t exportPort;       ///< Modtagerens port, 0 = 8089 (UDP) eller 1883 (MQTT)
+  uint16_t exportIntervalS;  ///< Sekunder mellem målepunkter til eksport
+  char exportHost[64];       ///< Modtagerens værtsnavn eller IP-adresse, nul-termineret
+  char exportTopic[64];      ///< MQTT-emne, tom = "energi/<enhed>/lp"
+  RuleConfig rules[kConfigMaxRules]; ///< Alarmregler, RULE_OFF = ubrugt
+};
+
+const size_t kConfigRecordSize = sizeof(ConfigHeader) + sizeof(ConfigData); ///< Bytes pr. slot
+
+/**
+ * @brief Sætter alle felter til standardværdierne.
+ * @param data Indstillingerne der nulstilles
+ */
+void configDefaults(ConfigData& data);
+
+/**
+ * @brief Koder en post klar til at blive skrevet i et slot.
+ * @param data Indstillingerne
+ * @param sequence Sekvensnummer for posten
+ * @param buf Modtager kConfigRecordSize bytes
+ */
+void configEncode(const ConfigData& data, uint32_t sequence, uint8_t* buf);
+
+/**
+ * @brief Læser og validerer en post.
+ *
+ * Felter som posten ikke indeholder, får standardværdier.
+ * @param buf Postens bytes
+ * @param len Antal bytes læst fra slottet
+ * @param data Modtager indstillingerne hvis posten er gyldig
+ * @param sequence Modtager sekvensnummeret hvis posten er gyldig
+ * @return False hvis magic, version, længde eller CRC ikke passer.
+ */
+bool configDecode(const uint8_t* buf, size_t len, ConfigData& data, uint32_t& sequence);
+
+/**
+ * @brief Kopierer en streng ind i et felt med fast længde.
+ * @param dst Feltet
+ * @param size Feltets størrelse inkl. nul-terminering
+ * @param src Strengen, afkortes hvis den er for lang
+ */
+void configSetString(char* dst, size_t size, const char* src);
+
+/**
+ * @brief Begrænser et tal fra konfigurationsformularen til et interval.
+ * @param value Værdien; negative tal giver min
+ * @param min Mindste tilladte værdi
+ * @param max Største tilladte værdi
+ * @return value begrænset til [min, max].
+ */
+uint32_t configClamp(long value, uint32_t min, uint32_t max);
+
+/**
+ * @brief Om en GPIO kan bruges som pulskanal.
+ *
+ * Kun ESP32's touch-pins kan læses med touchRead(); GPIO 2 og 4 er
+ * desuden optaget af LED'en og reset-knappen.
+ * @param pin GPIO-nummeret
+ */
+bool configChannelPinValid(uint32_t pin);
@@ -0,0 +1,18 @@
+/**
+ * @file crc32.h
+ * @brief CRC-32 til integritetstjek af poster og blokke på flash.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief CRC-32 (IEEE 802.3, reflekteret).
+ * @param data Data
+ * @param len Antal bytes
+ * @param crc Tidligere CRC ved fortsættelse, ellers 0
+ * @return Ny CRC.
+ */
+uint32_t crc32(const void* data, size_t len, uint32_t crc = 0);
@@ -0,0 +1,170 @@
+/**
+ * @file energy.h
+ * @brief Omsætning af pulser fra elmåleren til energi (Wh) og effekt (W).
+ *
+ * Måleren giver impPerKwh pulser pr. kWh, så hver puls svarer til
+ * 10^9 / impPerKwh µWh. Energien akkumuleres i et 64-bit heltal i µWh med en
+ * rest i Bresenham-stil, så konstanter der ikke går op i 10^9 ikke giver
+ * drift. Effekten estimeres fra tiden mellem de to seneste pulser:
+ *
+ *   P [mW] = 3,6·10^15 / (impPerKwh · Δt [µs])
+ *
+ * Konstanten i tælleren beregnes én gang, så hver puls koster én 64-bit
+ * division og ingen flydende tal. Udebliver næste puls, kan effekten højst
+ * være det der svarer til den tid der er gået siden sidste puls, så estimatet
+ * falder mod nul og sættes til nul efter maxIntervalUs. Ved CT-måling
+ * fodres direkte målt effekt ind med onPower() i stedet. Uden Arduino-
+ * afhængigheder, så den kan køres på en host med syntetiske målere.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Energi- og effektberegning for én pulsindgang.
+ */
+class EnergyMeter {
+public:
+  static const uint32_t kDefaultImpPerKwh = 1000;              ///< Typisk konstant for elmålere
+  static const uint64_t kDefaultMaxIntervalUs = 3600000000ULL; ///< Efter 1 time uden puls er effekten 0
+
+  /**
+   * @param impPerKwh Målerkonstant (pulser pr. kWh), 0 giver standardværdien
+   * @param maxIntervalUs Tid uden pulser hvorefter effekten regnes som 0 (µs)
+   */
+  explicit EnergyMeter(uint32_t impPerKwh = kDefaultImpPerKwh,
+                       uint64_t maxIntervalUs = kDefaultMaxIntervalUs)
+      : maxIntervalUs_(maxIntervalUs) {
+    setImpPerKwh(impPerKwh);
+  }
+
+  /**
+   * @brief Skifter målerkonstant. Akkumuleret energi bevares.
+   * @param impPerKwh Pulser pr. kWh, 0 giver standardværdien
+   */
+  void setImpPerKwh(uint32_t impPerKwh) {
+    impPerKwh_ = impPerKwh ? impPerKwh : kDefaultImpPerKwh;
+    uwhPerPulse_ = kUwhPerKwh / impPerKwh_;
+    uwhRemainderStep_ = kUwhPerKwh % impPerKwh_;
+    uwhRemainder_ = 0;
+    powerNumerator_ = kMicroMwPerKwh / impPerKwh_;
+    powerMw_ = 0;
+  }
+
+  /** @brief Aktuel målerkonstant (pulser pr. kWh). */
+  uint32_t impPerKwh() const { return impPerKwh_; }
+
+  /**
+   * @brief Registrerer en puls. Konstant tid, ingen flydende tal.
+   * @param nowUs Pulsens tidsstempel (µs)
+   */
+  void onPulse(uint64_t nowUs) {
+    energyUwh_ += uwhPerPulse_;
+    uwhRemainder_ += uwhRemainderStep_;
+    if (uwhRemainder_ >= impPerKwh_) {
+      uwhRemainder_ -= impPerKwh_;
+      energyUwh_++;
+    }
+    if (pulses_ > 0 && nowUs > lastPulseUs_) {
+      uint64_t dt = nowUs - lastPulseUs_;
+      powerMw_ = dt <= maxIntervalUs_ ? clampMw(powerNumerator_ / dt) : 0;
+    }
+    lastPulseUs_ = nowUs;
+    pulses_++;
+    hasTime_ = true;
+  }
+
+  /**
+   * @brief Registrerer en direkte målt middeleffekt over et tidsrum (CT-måling).
+   *
+   * Energien integreres som mW·µs (nJ) med rest, så korte perioder ikke
+   * afrundes væk. Negativ effekt (eksport) tælles ikke med i energien.
+   * @param powerMw Middeleffekt i perioden (mW)
+   * @param durationUs Periodens længde (µs)
+   * @param nowUs Periodens slutning (µs)
+   */
+  void onPower(int32_t powerMw, uint32_t durationUs, uint64_t nowUs) {
+    if (powerMw > 0) {
+      njRemainder_ += (uint64_t)powerMw * durationUs;
+      energyUwh_ += njRemainder_ / kNjPerUwh;
+      njRemainder_ %= kNjPerUwh;
+      powerMw_ = (uint32_t)powerMw;
+    } else {
+      powerMw_ = 0;
+    }
+    lastPulseUs_ = nowUs;
+    hasTime_ = true;
+  }
+
+  /**
+   * @brief Effektestimat på et givet tidspunkt.
+   *
+   * Sidste målte effekt, dog højst hvad tiden siden sidste puls tillader,
+   * og 0 når der ikke er kommet en puls i maxIntervalUs.
+   * @param nowUs Nuværende tid (µs)
+   * @return Effekt i mW.
+   */
+  uint32_t powerMw(uint64_t nowUs) const {
+    if (!hasTime_ || nowUs <= lastPulseUs_) {
+      return powerMw_;
+    }
+    uint64_t elapsed = nowUs - lastPulseUs_;
+    if (elapsed > maxIntervalUs_) {
+      return 0;
+    }
+    uint32_t bound = clampMw(powerNumerator_ / elapsed);
+    return bound < powerMw_ ? bound : powerMw_;
+  }
+
+  /** @brief Akkumuleret energi (µWh). */
+  uint64_t energyUwh() const { return energyUwh_; }
+
+  /** @brief Akkumuleret energi (hele Wh). */
+  uint64_t energyWh() const { return energyUwh_ / 1000000; }
+
+  /** @brief Antal registrerede pulser. */
+  uint64_t pulses() const { return pulses_; }
+
+  /** @brief Tidspunkt for sidste puls (µs). */
+  uint64_t lastPulseUs() const { return lastPulseUs_; }
+
+  /**
+   * @brief Sætter den akkumulerede energi, f.eks. efter genstart.
+   *
+   * Effektestimatet nulstilles, da tiden til næste puls ikke kendes.
+   * @param energyUwh Energi (µWh)
+   */
+  void restore(uint64_t energyUwh) {
+    energyUwh_ = energyUwh;
+    uwhRemainder_ = 0;
+    njRemainder_ = 0;
+    pulses_ = 0;
+    powerMw_ = 0;
+    hasTime_ = false;
+  }
+
+  /** @brief Nulstiller energi og effekt. */
+  void clear() { restore(0); }
+
+private:
+  static const uint64_t kUwhPerKwh = 1000000000ULL;        ///< µWh pr. kWh
+  static const uint64_t kMicroMwPerKwh = 3600000000000000ULL; ///< mW·µs pr. kWh (3,6·10^15)
+  static const uint64_t kNjPerUwh = 3600000ULL;              ///< nJ (mW·µs) pr. µWh
+
+  /** @brief Begrænser en effekt til 32 bit (mW). */
+  static uint32_t clampMw(uint64_t mw) { return mw > UINT32_MAX ? UINT32_MAX : (uint32_t)mw; }
+
+  uint32_t impPerKwh_ = kDefaultImpPerKwh; ///< Pulser pr. kWh
+  uint64_t maxIntervalUs_;                 ///< Tid uden puls før effekten er 0 (µs)
+  uint64_t uwhPerPulse_ = 0;               ///< Hele µWh pr. puls
+  uint32_t uwhRemainderStep_ = 0;          ///< Rest pr. puls, i 1/impPerKwh µWh
+  uint32_t uwhRemainder_ = 0;              ///< Akkumuleret rest
+  uint64_t powerNumerator_ = 0;            ///< 3,6·10^15 / impPerKwh
+  uint64_t energyUwh_ = 0;                 ///< Akkumuleret energi (µWh)
+  uint64_t pulses_ = 0;                    ///< Pulser siden start/restore
+  uint64_t njRemainder_ = 0;               ///< Rest fra onPower() (nJ)
+  uint64_t lastPulseUs_ = 0;               ///< Tidspunkt for sidste puls eller effektmåling (µs)
+  uint32_t powerMw_ = 0;                   ///< Effekt fra de to seneste pulser eller CT (mW)
+  bool hasTime_ = false;                   ///< Om lastPulseUs_ er sat
+};
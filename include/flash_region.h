@@ -0,0 +1,139 @@
+/**
+ * @file flash_region.h
+ * @brief Rå NOR-flash med sektorvis sletning, under filsystemet.
+ *
+ * Til data der skrives så ofte at et filsystem ville slide på sine
+ * metadata (se checkpoint_journal.h). Semantikken er NOR-flash: sletning
+ * sætter en hel sektor til 0xFF, og skrivning kan kun ændre bits fra 1 til
+ * 0. På enheden er det en partition (PartitionFlashRegion i main.cpp);
+ * RamFlashRegion efterligner den på en host, inkl. afbrudte skrivninger.
+ * Uden Arduino-afhængigheder.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * @brief Et område af flash delt i sektorer.
+ */
+class FlashRegion {
+public:
+  virtual ~FlashRegion() {}
+
+  /** @brief Områdets størrelse i bytes; et multiplum af sectorSize(). */
+  virtual uint32_t size() const = 0;
+
+  /** @brief Mindste enhed der kan slettes (bytes). */
+  virtual uint32_t sectorSize() const = 0;
+
+  /**
+   * @brief Sletter én sektor til 0xFF.
+   * @param sector Sektor 0..size()/sectorSize()-1
+   */
+  virtual bool erase(uint32_t sector) = 0;
+
+  /**
+   * @brief Skriver bytes; bits kan kun gå fra 1 til 0.
+   * @param offset Position i området
+   * @param data Bytes der skrives
+   * @param len Antal bytes
+   */
+  virtual bool write(uint32_t offset, const uint8_t* data, size_t len) = 0;
+
+  /**
+   * @brief Læser bytes.
+   * @param offset Position i området
+   * @param buf Modtager bytes
+   * @param len Antal bytes
+   */
+  virtual bool read(uint32_t offset, uint8_t* buf, size_t len) = 0;
+};
+
+/**
+ * @brief FlashRegion i RAM til host-værktøjer.
+ *
+ * cutAfter() simulerer strømsvigt: efter det angivne antal bytes holder
+ * skrivning og sletning op med at virke, midt i en operation.
+ */
+class RamFlashRegion : public FlashRegion {
+public:
+  /**
+   * @param sectors Antal sektorer
+   * @param sectorSize Bytes pr. sektor
+   */
+  RamFlashRegion(uint32_t sectors, uint32_t sectorSize)
+    : sectorSize_(sectorSize), data_((size_t)sectors * sectorSize, 0xFF) {}
+
+  uint32_t size() const override { return data_.size(); }
+  uint32_t sectorSize() const override { return sectorSize_; }
+
+  bool erase(uint32_t sector) override {
+    if ((uint64_t)(sector + 1) * sectorSize_ > data_.size()) {
+      return false;
+    }
+    erases_++;
+    for (uint32_t i = 0; i < sectorSize_; i++) {
+      if (!tick()) {
+        return false;
+      }
+      data_[(size_t)sector * sectorSize_ + i] = 0xFF;
+    }
+    return true;
+  }
+
+  bool write(uint32_t offset, const uint8_t* data, size_t len) override {
+    if ((uint64_t)offset + len > data_.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (!tick()) {
+        return false;
+      }
+      data_[offset + i] &= data[i];
+    }
+    return true;
+  }
+
+  bool read(uint32_t offset, uint8_t* buf, size_t len) override {
+    if ((uint64_t)offset + len > data_.size()) {
+      return false;
+    }
+    memcpy(buf, &data_[offset], len);
+    reads_++;
+    return true;
+  }
+
+  /**
+   * @brief Lader de næste bytes lykkes og alle efterfølgende fejle.
+   * @param bytes Bytes der endnu skrives eller slettes; -1 slår svigtet fra
+   */
+  void cutAfter(int64_t bytes) { budget_ = bytes; }
+
+  /** @brief Sletninger i alt. */
+  uint32_t erases() const { return erases_; }
+
+  /** @brief Læsninger i alt. */
+  uint32_t reads() const { return reads_; }
+
+private:
+  bool tick() {
+    if (budget_ < 0) {
+      return true;
+    }
+    if (budget_ == 0) {
+      return false;
+    }
+    budget_--;
+    return true;
+  }
+
+  uint32_t sectorSize_;
+  std::vector<uint8_t> data_;
+  int64_t budget_ = -1;
+  uint32_t erases_ = 0;
+  uint32_t reads_ = 0;
+};
@@ -0,0 +1,60 @@
+/**
+ * @file heap_monitor.h
+ * @brief Vandmærker og fragmentering for heapen over lang oppetid.
+ *
+ * Fodres periodisk med fri heap, største frie blok og det laveste frie
+ * niveau nogensinde. Fragmentering angives i promille som
+ * 1000 - største blok / fri heap, så 0 betyder én sammenhængende blok.
+ * Ingen Arduino-afhængigheder.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Løbende heap-statistik.
+ */
+class HeapMonitor {
+public:
+  /**
+   * @brief Registrerer en måling.
+   * @param freeBytes Fri heap nu
+   * @param largestBlock Største frie blok nu
+   * @param minFreeEver Laveste frie heap siden boot
+   * @param nowS Oppetid (s)
+   */
+  void update(uint32_t freeBytes, uint32_t largestBlock, uint32_t minFreeEver, uint32_t nowS) {
+    freeBytes_ = freeBytes;
+    largestBlock_ = largestBlock;
+    minFreeEver_ = minFreeEver;
+    fragmentation_ = freeBytes > 0 ? 1000 - (uint32_t)((uint64_t)largestBlock * 1000 / freeBytes) : 0;
+    if (samples_ == 0 || largestBlock < minLargestBlock_) {
+      minLargestBlock_ = largestBlock;
+      minLargestBlockAt_ = nowS;
+    }
+    if (fragmentation_ > maxFragmentation_) {
+      maxFragmentation_ = fragmentation_;
+    }
+    samples_++;
+  }
+
+  uint32_t freeBytes() const { return freeBytes_; }               ///< Fri heap ved seneste måling
+  uint32_t largestBlock() const { return largestBlock_; }         ///< Største frie blok ved seneste måling
+  uint32_t minFreeEver() const { return minFreeEver_; }           ///< Laveste frie heap siden boot
+  uint32_t minLargestBlock() const { return minLargestBlock_; }   ///< Mindste største blok set
+  uint32_t minLargestBlockAt() const { return minLargestBlockAt_; } ///< Oppetid da minLargestBlock blev set (s)
+  uint32_t fragmentation() const { return fragmentation_; }       ///< Fragmentering nu (promille)
+  uint32_t maxFragmentation() const { return maxFragmentation_; } ///< Højeste fragmentering set (promille)
+  uint32_t samples() const { return samples_; }                   ///< Antal målinger
+
+private:
+  uint32_t freeBytes_ = 0;
+  uint32_t largestBlock_ = 0;
+  uint32_t minFreeEver_ = 0;
+  uint32_t minLargestBlock_ = 0;
+  uint32_t minLargestBlockAt_ = 0;
+  uint32_t fragmentation_ = 0;
+  uint32_t maxFragmentation_ = 0;
+  uint32_t samples_ = 0;
+};
@@ -0,0 +1,84 @@
+/**
+ * @file history.h
+ * @brief Streaming af historik fra rollup som JSON eller CSV.
+ *
+ * HistoryCursor gennemløber et tidsinterval i faste skridt og skriver én
+ * række pr. skridt i den buffer kalderen giver, så et svar kan sendes i
+ * bidder uden at hele resultatet ligger i RAM. Skridtet rundes op til et
+ * multiplum af det groveste rollup-niveau hvis opløsning er <= det ønskede
+ * skridt og begrænses til niveauets vindue; tomme skridt springes over.
+ *
+ * Intervallet beskæres til niveauets gemte buckets når cursoren oprettes, og
+ * hvert fill() går højst kHistoryMaxEmptySteps tomme skridt igennem, så et
+ * kald holder aldrig rollup-låsen længe uanset hvad klienten beder om.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rollup.h"
+
+const uint32_t kHistoryMaxEmptySteps = 256; ///< Tomme skridt pr. fill() før der returneres
+
+/**
+ * @brief Outputformat for historik.
+ */
+enum HistoryFormat {
+  HISTORY_JSON, ///< {"from":..,"to":..,"step":..,"points":[[t,sum,min,max,count],...]}
+  HISTORY_CSV,  ///< time,sum,min,max,count
+};
+
+/**
+ * @brief Tilstand for ét streamet historiksvar.
+ */
+class HistoryCursor {
+public:
+  /**
+   * @param rollup Kilde til data; kalderen sørger for låsning under fill()
+   * @param from Første tidspunkt (s, inklusiv)
+   * @param to Sidste tidspunkt (s, inklusiv)
+   * @param step Ønsket skridt (s)
+   * @param format JSON eller CSV
+   */
+  HistoryCursor(const Rollup& rollup, uint32_t from, uint32_t to, uint32_t step, HistoryFormat format);
+
+  /**
+   * @brief Skriver næste del af svaret.
+   * @param buf Destinationsbuffer
+   * @param len Bufferens størrelse
+   * @return Antal skrevne bytes. 0 betyder at svaret er færdigt hvis done()
+   *         er sand, ellers at kaldet kun gik tomme skridt igennem og skal
+   *         gentages.
+   */
+  size_t fill(uint8_t* buf, size_t len);
+
+  /** @brief Sand når hele svaret er skrevet. */
+  bool done() const { return phase_ == PHASE_DONE && pieceOff_ == pieceLen_; }
+
+  /** @brief Det faktisk anvendte skridt (s). */
+  uint32_t step() const { return step_; }
+
+private:
+  enum Phase { PHASE_HEADER, PHASE_ROWS, PHASE_FOOTER, PHASE_DONE };
+
+  bool bucketAt(uint32_t t, RollupBucket& out) const;
+  bool window(uint32_t& oldest, uint32_t& newest) const;
+  bool nextPiece(uint32_t& emptySteps);
+
+  const Rollup& rollup_;
+  HistoryFormat format_;
+  uint8_t tier_;       ///< 0 = sekunder, 1 = minutter, 2 = timer, 3 = dage
+  uint32_t resolution_;
+  uint32_t step_;
+  uint32_t from_;
+  uint32_t to_;
+  uint32_t cursor_;    ///< Start af næste skridt
+  uint32_t end_;       ///< Første tidspunkt efter de data der skal med (eksklusiv)
+  uint32_t rows_ = 0;  ///< Antal skrevne rækker
+  Phase phase_ = PHASE_HEADER;
+  char piece_[96];     ///< Formateret del der venter på at blive kopieret
+  size_t pieceLen_ = 0;
+  size_t pieceOff_ = 0;
+};
@@ -0,0 +1,74 @@
+/**
+ * @file http_range.h
+ * @brief Fortolkning af HTTP Range-headeren for ét byte-interval.
+ *
+ * Understøtter "bytes=a-b", "bytes=a-" og "bytes=-n" (de sidste n bytes).
+ * Flere intervaller i samme header understøttes ikke; de behandles som
+ * ingen Range, og hele filen sendes, hvilket RFC 9110 tillader. Uden
+ * Arduino-afhængigheder.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Resultat af parseByteRange().
+ */
+enum ByteRangeResult : uint8_t {
+  BYTE_RANGE_NONE = 0,          ///< Ingen (brugbar) Range, send hele filen med 200
+  BYTE_RANGE_OK = 1,            ///< Send [first, last] med 206
+  BYTE_RANGE_UNSATISFIABLE = 2, ///< Intervallet ligger uden for filen, send 416
+};
+
+/**
+ * @brief Fortolker en Range-header mod en fil af kendt størrelse.
+ * @param header Headerens værdi, f.eks. "bytes=100-"; nullptr = ingen header
+ * @param size Filens størrelse
+ * @param first Modtager første byte (inklusiv)
+ * @param last Modtager sidste byte (inklusiv), afkortet til filen
+ * @return Hvordan svaret skal sendes.
+ */
+inline ByteRangeResult parseByteRange(const char* header, uint32_t size, uint32_t& first, uint32_t& last) {
+  if (header == nullptr || strncmp(header, "bytes=", 6) != 0 || strchr(header, ',') != nullptr) {
+    return BYTE_RANGE_NONE;
+  }
+  const char* spec = header + 6;
+  const char* dash = strchr(spec, '-');
+  if (dash == nullptr) {
+    return BYTE_RANGE_NONE;
+  }
+  char* end;
+  if (dash == spec) {
+    // Suffiks: de sidste n bytes
+    unsigned long n = strtoul(dash + 1, &end, 10);
+    if (end == dash + 1 || *end != '\0') {
+      return BYTE_RANGE_NONE;
+    }
+    if (n == 0 || size == 0) {
+      return BYTE_RANGE_UNSATISFIABLE;
+    }
+    first = n >= size ? 0 : size - n;
+    last = size - 1;
+    return BYTE_RANGE_OK;
+  }
+  unsigned long a = strtoul(spec, &end, 10);
+  if (end != dash) {
+    return BYTE_RANGE_NONE;
+  }
+  unsigned long b = size ? size - 1 : 0;
+  if (dash[1] != '\0') {
+    b = strtoul(dash + 1, &end, 10);
+    if (*end != '\0' || b < a) {
+      return BYTE_RANGE_NONE;
+    }
+  }
+  if (a >= size) {
+    return BYTE_RANGE_UNSATISFIABLE;
+  }
+  first = a;
+  last = b >= size ? size - 1 : b;
+  return BYTE_RANGE_OK;
+}
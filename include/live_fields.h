@@ -0,0 +1,113 @@
+/**
+ * @file live_fields.h
+ * @brief Sæt af live-værdier med ændringsmaske til coalescing af opdateringer.
+ *
+ * Producenter kalder set() så ofte de vil; kun felter hvis værdi faktisk har
+ * ændret sig markeres. Broadcasteren henter masken én gang pr. tick med
+ * takeChanged(), så mange opdateringer mellem to ticks bliver til én besked.
+ * Tæller, energi og effekt findes for hver pulskanal; kanal 0 bruger de
+ * oprindelige felter, kanal 1..kLiveMaxChannels-1 felter fra
+ * LIVE_CHANNEL_FIELDS og frem (se liveChannelField()).
+ * Ingen låsning og ingen Arduino-afhængigheder; kalderen serialiserer.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Felter der sendes til dashboardet.
+ */
+enum LiveField : uint8_t {
+  LIVE_COUNTER = 0, ///< Pulstæller
+  LIVE_LED = 1,     ///< LED-tilstand (0/1)
+  LIVE_ENERGY = 2,  ///< Akkumuleret energi (Wh)
+  LIVE_POWER = 3,   ///< Effektestimat (W)
+  LIVE_VRMS = 4,    ///< Effektiv spænding (mV), kun CT-måling
+  LIVE_IRMS = 5,    ///< Effektiv strøm (mA), kun CT-måling
+  LIVE_PF = 6,      ///< Effektfaktor (‰), kun CT-måling
+  LIVE_ALERTS = 7,  ///< Aktive alarmregler, bit i = regel i (se rule_engine.h)
+  LIVE_CHANNEL_FIELDS = 8, ///< Første felt for kanal 1
+};
+
+const uint8_t kLiveMaxChannels = 8;        ///< Kanaler med egne felter
+const uint8_t kLiveFieldsPerChannel = 3;   ///< Tæller, energi og effekt
+const uint8_t LIVE_FIELD_COUNT = LIVE_CHANNEL_FIELDS + kLiveFieldsPerChannel * (kLiveMaxChannels - 1); ///< Felter i alt
+static_assert(LIVE_FIELD_COUNT <= 32, "live field masks are 32 bits");
+
+/**
+ * @brief Feltet for en kanals tæller, energi eller effekt.
+ * @param base LIVE_COUNTER, LIVE_ENERGY eller LIVE_POWER
+ * @param channel Kanal 0..kLiveMaxChannels-1
+ */
+inline LiveField liveChannelField(LiveField base, uint8_t channel) {
+  if (channel == 0) {
+    return base;
+  }
+  uint8_t slot = base == LIVE_COUNTER ? 0 : base == LIVE_ENERGY ? 1 : 2;
+  return (LiveField)(LIVE_CHANNEL_FIELDS + (channel - 1) * kLiveFieldsPerChannel + slot);
+}
+
+/** @brief Kanalen et felt hører til; 0 for felter uden kanal. */
+inline uint8_t liveFieldChannel(uint8_t field) {
+  return field < LIVE_CHANNEL_FIELDS ? 0 : 1 + (field - LIVE_CHANNEL_FIELDS) / kLiveFieldsPerChannel;
+}
+
+/** @brief Det oprindelige felt (kanal 0) som et kanalfelt svarer til. */
+inline LiveField liveFieldBase(uint8_t field) {
+  if (field < LIVE_CHANNEL_FIELDS) {
+    return (LiveField)field;
+  }
+  static const LiveField bases[kLiveFieldsPerChannel] = {LIVE_COUNTER, LIVE_ENERGY, LIVE_POWER};
+  return bases[(field - LIVE_CHANNEL_FIELDS) % kLiveFieldsPerChannel];
+}
+
+/**
+ * @brief Aktuelle værdier og hvilke der er ændret siden sidste tick.
+ */
+class LiveFields {
+public:
+  /**
+   * @brief Opdaterer et felt.
+   * @param field Feltet
+   * @param value Ny værdi
+   */
+  void set(LiveField field, int32_t value) {
+    if (values_[field] == value && (valid_ & bit(field))) {
+      return;
+    }
+    if (changed_ & bit(field)) {
+      coalesced_++;
+    }
+    values_[field] = value;
+    valid_ |= bit(field);
+    changed_ |= bit(field);
+  }
+
+  /** @brief Nuværende værdi af et felt. */
+  int32_t get(LiveField field) const { return values_[field]; }
+
+  /** @brief Maske over felter der har fået en værdi. */
+  uint32_t validMask() const { return valid_; }
+
+  /**
+   * @brief Henter og nulstiller masken over ændrede felter.
+   */
+  uint32_t takeChanged() {
+    uint32_t changed = changed_;
+    changed_ = 0;
+    return changed;
+  }
+
+  /** @brief Antal opdateringer der blev slået sammen med en ventende. */
+  uint32_t coalesced() const { return coalesced_; }
+
+  /** @brief Bit for et felt i masker. */
+  static uint32_t bit(LiveField field) { return 1u << field; }
+
+private:
+  int32_t values_[LIVE_FIELD_COUNT] = {};
+  uint32_t valid_ = 0;
+  uint32_t changed_ = 0;
+  uint32_t coalesced_ = 0;
+};
@@ -0,0 +1,123 @@
+/**
+ * @file live_history.h
+ * @brief Ringbuffer med de seneste live-udsendelser til snapshot og replay.
+ *
+ * Hver udsendelse gemmes med sekvensnummer, tidsstempel, masken over
+ * ændrede felter og kun de ændrede værdier, så en udsendelse med én
+ * ændret effekt fylder fire ord. Når bufferen er fuld, smides de ældste
+ * udsendelser ud. En klient der genforbinder, kan derfor få alt efter et
+ * givet sekvensnummer, så længe det stadig er i bufferen. Sekvensnumrene
+ * stiger med 1, så et lille indeks over udsendelsernes positioner giver
+ * seek() i O(1) uanset hvor mange udsendelser bufferen holder.
+ * Ingen låsning og ingen Arduino-afhængigheder; kalderen serialiserer.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "live_fields.h"
+
+const size_t kLiveHistoryWords = 2048; ///< Bufferens størrelse i 32-bit ord (8 KB)
+const size_t kLiveHistoryMaxEntries = kLiveHistoryWords / 3; ///< Udsendelser der højst er plads til (mindst tre ord hver)
+
+/**
+ * @brief Én udsendelse læst fra bufferen.
+ */
+struct LiveHistoryEntry {
+  uint32_t seq;                      ///< Sekvensnummer
+  uint32_t timeMs;                   ///< Tidsstempel, ms siden boot
+  uint32_t mask;                     ///< Ændrede felter (LiveFields::bit)
+  int32_t values[LIVE_FIELD_COUNT];  ///< Værdier, indekseret med LiveField; kun felter i mask er sat
+};
+
+/**
+ * @brief De seneste udsendelser i en ring af ord.
+ */
+class LiveHistory {
+public:
+  /**
+   * @brief Gemmer en udsendelse.
+   *
+   * Sekvensnummeret skal være ét højere end forrige udsendelses; ellers
+   * tømmes bufferen først.
+   * @param seq Sekvensnummer
+   * @param timeMs Tidsstempel (ms)
+   * @param mask Ændrede felter
+   * @param values Alle felters værdier, indekseret med LiveField
+   */
+  void append(uint32_t seq, uint32_t timeMs, uint32_t mask, const int32_t* values);
+
+  /**
+   * @brief Finder den ældste udsendelse efter et sekvensnummer.
+   *
+   * Søgningen starter ved cursor, hvis den stadig peger ind i bufferen, og
+   * ellers ved seek(afterSeq). Efter et fund peger cursor på den næste, så
+   * en klient der læser fremad kun koster O(1) pr. udsendelse.
+   * @param afterSeq Seneste sekvensnummer klienten har
+   * @param entry Modtager udsendelsen
+   * @param cursor Position fra begin() eller et tidligere kald
+   * @return False hvis der ikke er nogen nyere.
+   */
+  bool next(uint32_t afterSeq, LiveHistoryEntry& entry, uint32_t& cursor) const;
+
+  /** @brief Cursor til den ældste udsendelse, til next(). */
+  uint32_t begin() const { return tail_; }
+
+  /**
+   * @brief Cursor til den første udsendelse efter et sekvensnummer, i O(1).
+   *
+   * Er afterSeq ældre end bufferen, gives den ældste udsendelse; er den
+   * nyeste udsendelse ikke nyere, gives positionen efter den.
+   * @param afterSeq Seneste sekvensnummer klienten har
+   */
+  uint32_t seek(uint32_t afterSeq) const;
+
+  /**
+   * @brief Sekvensnummeret lige før de sidste n udsendelser.
+   *
+   * next() med dette nummer giver de sidste n udsendelser (eller alle, hvis
+   * der er færre).
+   * @param n Antal udsendelser
+   * @param cursor Modtager en cursor til next() ved den første af dem, hvis sat
+   */
+  uint32_t seqBeforeLast(size_t n, uint32_t* cursor = nullptr) const;
+
+  /**
+   * @brief Om alt efter afterSeq stadig er i bufferen.
+   *
+   * False betyder at klienten har mistet udsendelser der er smidt ud.
+   */
+  bool covers(uint32_t afterSeq) const { return count_ == 0 || afterSeq + 1 >= oldestSeq_; }
+
+  /** @brief Antal udsendelser i bufferen. */
+  size_t count() const { return count_; }
+
+  /** @brief Tidsspænd fra ældste til nyeste udsendelse (ms). */
+  uint32_t spanMs() const { return count_ ? newestTimeMs_ - oldestTimeMs_ : 0; }
+
+  /** @brief Tømmer bufferen. */
+  void clear();
+
+private:
+  static const size_t kHeaderWords = 3; ///< seq, timeMs, mask
+
+  uint32_t word(uint32_t pos) const { return words_[pos % kLiveHistoryWords]; }
+  void dropOldest();
+
+  /** @brief Position for en udsendelse der er i bufferen. */
+  uint32_t position(uint32_t seq) const {
+    return head_ - (uint16_t)((uint16_t)head_ - index_[seq % kLiveHistoryMaxEntries]);
+  }
+
+  uint32_t words_[kLiveHistoryWords];
+  uint16_t index_[kLiveHistoryMaxEntries]; ///< Laveste 16 bit af hver udsendelses position, indekseret med seq
+  uint32_t head_ = 0;          ///< Næste position der skrives (stigende, mod kLiveHistoryWords)
+  uint32_t tail_ = 0;          ///< Ældste udsendelses position
+  size_t count_ = 0;
+  uint32_t oldestSeq_ = 0;
+  uint32_t newestSeq_ = 0;
+  uint32_t oldestTimeMs_ = 0;
+  uint32_t newestTimeMs_ = 0;
+};
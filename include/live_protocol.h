@@ -0,0 +1,117 @@
+/**
+ * @file live_protocol.h
+ * @brief Versioneret binært rammeformat for live-data over WebSocket.
+ *
+ * Ramme (little-endian):
+ * | Offset | Størrelse | Felt                                  |
+ * |--------|-----------|---------------------------------------|
+ * | 0      | 1         | Version (kLiveProtocolVersion)        |
+ * | 1      | 1         | Rammetype (LiveFrameType)             |
+ * | 2      | 1         | Antal felter n                        |
+ * | 3      | 1         | Flag (LiveFrameFlag)                  |
+ * | 4      | 4         | Sekvensnummer, +1 pr. udsendelse      |
+ * | 8      | 4         | Tidsstempel, ms siden boot            |
+ * | 12     | 5 × n     | n × (felt-id uint8, værdi int32)      |
+ *
+ * Felt-id'et er (kanal << 4) | LiveField for kanalens felt i kanal 0, så
+ * kanal 0 har de samme id'er som før der kom flere kanaler. I tekstformatet
+ * får felter for kanal 1 og op kanalen som endelse, f.eks. "power.2:230".
+ *
+ * Klienter vælger format ved at sende "proto:bin1" eller "proto:text"; uden
+ * forhandling sendes tekstformatet "navn:værdi" med én linje pr. felt.
+ *
+ * En binær klient får ved tilslutning først en LIVE_FRAME_HELLO med
+ * enhedens opstarts-epoke (et tilfældigt tal pr. opstart) som uint32 efter
+ * headeren, derefter de seneste udsendelser som LIVE_FRAME_REPLAY-rammer med
+ * deres oprindelige sekvensnummer og tid og til sidst de aktuelle værdier
+ * som LIVE_FRAME_FIELDS. Efter en genforbindelse kan klienten sende
+ * "replay:<epoke>:<seq>" for at få alt efter sit seneste sekvensnummer, så
+ * længe det stadig er i enhedens buffer (se live_history.h). Er epoken en
+ * anden, er enheden genstartet, og klienten får et snapshot med
+ * LIVE_FLAG_RESYNC uanset sekvensnummeret. Replay findes kun i den binære
+ * protokol.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "live_fields.h"
+
+const uint8_t kLiveProtocolVersion = 1;  ///< Version i byte 0
+const size_t kLiveFrameHeaderSize = 12;  ///< Bytes før første felt
+const size_t kLiveFieldSize = 5;         ///< Bytes pr. felt
+const size_t kLiveTextMaxLine = 24;      ///< Længste "navn.kanal:værdi\n"
+const size_t kLiveHelloSize = kLiveFrameHeaderSize + 4; ///< Header og opstarts-epoke
+
+/**
+ * @brief Rammetyper.
+ */
+enum LiveFrameType : uint8_t {
+  LIVE_FRAME_FIELDS = 1, ///< Ændrede felter siden klientens forrige ramme
+  LIVE_FRAME_REPLAY = 2, ///< En tidligere udsendelse; kun felterne der ændrede sig i den
+  LIVE_FRAME_HELLO = 3,  ///< Første ramme til en binær klient; ingen felter, opstarts-epoken efter headeren
+};
+
+/**
+ * @brief Flag i byte 3.
+ */
+enum LiveFrameFlag : uint8_t {
+  LIVE_FLAG_RESYNC = 0x01, ///< Sekvensnumrene er startet forfra (genstart); glem det seneste
+};
+
+/**
+ * @brief Største mulige ramme for alle felter.
+ */
+const size_t kLiveFrameMaxSize = kLiveFrameHeaderSize + kLiveFieldSize * LIVE_FIELD_COUNT;
+
+/**
+ * @brief Største mulige tekstbesked for alle felter.
+ */
+const size_t kLiveTextMaxSize = kLiveTextMaxLine * LIVE_FIELD_COUNT;
+
+/**
+ * @brief Koder en binær ramme med felterne i mask.
+ * @param type Rammetype
+ * @param seq Sekvensnummer
+ * @param timeMs Tidsstempel (ms)
+ * @param mask Felter der skal med (LiveFields::bit)
+ * @param values Alle felters værdier, indekseret med LiveField
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @param flags Flag (LiveFrameFlag)
+ * @return Rammens længde, eller 0 hvis bufferen er for lille.
+ */
+size_t encodeLiveFrame(uint8_t type, uint32_t seq, uint32_t timeMs, uint32_t mask,
+                       const int32_t* values, uint8_t* buf, size_t len, uint8_t flags = 0);
+
+/**
+ * @brief Koder en LIVE_FRAME_HELLO.
+ * @param epoch Opstarts-epoke
+ * @param seq Seneste sekvensnummer
+ * @param timeMs Tidsstempel (ms)
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @return kLiveHelloSize, eller 0 hvis bufferen er for lille.
+ */
+size_t encodeLiveHello(uint32_t epoch, uint32_t seq, uint32_t timeMs, uint8_t* buf, size_t len);
+
+/**
+ * @brief Formaterer felterne i mask som tekst, én "navn:værdi" pr. linje.
+ * @return Antal skrevne tegn.
+ */
+size_t formatLiveText(uint32_t mask, const int32_t* values, char* buf, size_t len);
+
+/**
+ * @brief Navnet på et felt i tekstprotokollen, uden kanal.
+ *
+ * Kanalfelter giver navnet på det tilsvarende felt i kanal 0; brug
+ * liveFieldChannel() for kanalen.
+ */
+const char* liveFieldName(uint8_t field);
+
+/**
+ * @brief Felt-id'et der sendes i binære rammer.
+ */
+uint8_t liveFieldWireId(uint8_t field);
@@ -0,0 +1,155 @@
+/**
+ * @file log_export.h
+ * @brief Streaming af et tidsvindue fra loggen som CSV.
+ *
+ * LogCsvCursor læser poster i små portioner fra en LogRecordSource og
+ * skriver én CSV-linje pr. post i den buffer kalderen giver, så et svar kan
+ * sendes i bidder mens loggeren fortsætter med at tilføje poster. Kilden
+ * leverer poster i tidsorden; poster før vinduet springes over, og
+ * læsningen stopper ved første post efter vinduet.
+ *
+ * Historikken ligger dels som komprimerede blokke (ts_block.h), dels som
+ * rå poster der endnu ikke er komprimeret. LogBlockSource læser blokkene og
+ * springer blokke uden for vinduet over ud fra headerens min/max-tid uden
+ * at læse eller dekomprimere payloaden.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "log_format.h"
+#include "ts_block.h"
+
+/**
+ * @brief Giver sekventiel adgang til poster i tidsorden.
+ */
+class LogRecordSource {
+public:
+  virtual ~LogRecordSource() {}
+
+  /**
+   * @brief Læser de næste op til count poster.
+   * @param records Modtager posterne
+   * @param count Antal pladser i records
+   * @return Antal læste poster; 0 når kilden er tom eller ved fejl.
+   */
+  virtual size_t read(LogRecord* records, size_t count) = 0;
+};
+
+/**
+ * @brief Poster fra en fil med komprimerede blokke.
+ *
+ * Underklassen leverer filens bytes via readBytes(). Ved en ugyldig header,
+ * en CRC-fejl eller en blok der rækker ud over filen, søges der frem efter
+ * næste "TB"-magic fra byten efter seneste header, så en halvt skrevet blok
+ * midt i filen kun koster sine egne poster.
+ */
+class LogBlockSource : public LogRecordSource {
+public:
+  /**
+   * @param from Første tidspunkt (s, inklusiv); blokke der slutter før, springes over
+   * @param to Sidste tidspunkt (s, inklusiv); læsningen stopper ved en blok der starter efter
+   */
+  LogBlockSource(uint32_t from, uint32_t to) : from_(from), to_(to) {}
+
+  size_t read(LogRecord* records, size_t count) override;
+
+  /**
+   * @brief Springer de første poster over; kaldes før første read().
+   *
+   * Hele blokke springes over ud fra antallet i headeren uden at læse
+   * payloaden, så det koster én headerlæsning pr. blok. Følges en
+   * oversprungen blok ikke af en gyldig header, tælles den kun med hvis dens
+   * CRC passer, så en afbrudt blok ikke tælles.
+   * @param records Antal poster
+   */
+  void skip(uint32_t records) { skip_ = records; }
+
+  /** @brief Poster der er sprunget over med skip(). */
+  uint32_t recordsSkipped() const { return recordsSkipped_; }
+
+  /** @brief Blokke der er dekomprimeret. */
+  uint32_t blocksRead() const { return blocksRead_; }
+
+  /** @brief Blokke der er sprunget over uden at blive læst. */
+  uint32_t blocksSkipped() const { return blocksSkipped_; }
+
+  /** @brief Gange der er søgt frem til en ny blokheader efter en fejl. */
+  uint32_t resyncs() const { return resyncs_; }
+
+protected:
+  /**
+   * @brief Læser bytes fra blokfilen.
+   * @param offset Position i filen
+   * @param buf Modtager bytes
+   * @param len Antal bytes
+   * @return Antal læste bytes.
+   */
+  virtual size_t readBytes(uint32_t offset, uint8_t* buf, size_t len) = 0;
+
+private:
+  bool nextBlock();
+  bool resync();
+  bool confirmSkipped();
+
+  uint32_t from_;
+  uint32_t to_;
+  uint32_t offset_ = 0;         ///< Næste blokheader i filen
+  uint32_t scanFrom_ = 0;       ///< Hvor resync() søger fra; byten efter seneste header
+  bool verified_ = true;        ///< offset_ ligger lige efter en blok med gyldig CRC
+  bool done_ = false;
+  uint32_t blocksRead_ = 0;
+  uint32_t blocksSkipped_ = 0;
+  uint32_t resyncs_ = 0;
+  uint32_t skip_ = 0;           ///< Poster der endnu skal springes over
+  uint32_t recordsSkipped_ = 0;
+  TsBlockHeader skipped_ = {};  ///< Senest oversprungne blok, til den næste header er set
+  uint32_t skippedAt_ = 0;      ///< Dens payloads position i filen
+  TsBlockDecoder decoder_;      ///< Den aktuelle blok
+  uint8_t payload_[kTsBlockMaxPayload]; ///< Den aktuelle bloks payload
+};
+
+/**
+ * @brief Tilstand for ét streamet CSV-svar.
+ */
+class LogCsvCursor {
+public:
+  static const size_t kBatchRecords = 32; ///< Poster pr. læsning fra kilden
+
+  /**
+   * @param source Kilde til poster; kalderen sørger for låsning i read()
+   * @param from Første tidspunkt (s, inklusiv)
+   * @param to Sidste tidspunkt (s, inklusiv)
+   */
+  LogCsvCursor(LogRecordSource& source, uint32_t from, uint32_t to)
+    : source_(source), from_(from), to_(to) {}
+
+  /**
+   * @brief Skriver næste del af svaret, startende med kolonneoverskrifterne.
+   * @param buf Destinationsbuffer
+   * @param len Bufferens størrelse
+   * @return Antal skrevne bytes; 0 når svaret er færdigt.
+   */
+  size_t fill(uint8_t* buf, size_t len);
+
+  /** @brief Antal skrevne poster. */
+  uint32_t rows() const { return rows_; }
+
+private:
+  bool nextPiece();
+
+  LogRecordSource& source_;
+  uint32_t from_;
+  uint32_t to_;
+  uint32_t rows_ = 0;
+  bool header_ = false; ///< Om kolonneoverskrifterne er skrevet
+  bool done_ = false;
+  LogRecord batch_[kBatchRecords]; ///< Senest læste poster
+  size_t batchLen_ = 0;
+  size_t batchPos_ = 0;
+  char piece_[64];      ///< Formateret linje der venter på at blive kopieret
+  size_t pieceLen_ = 0;
+  size_t pieceOff_ = 0;
+};
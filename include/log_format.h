@@ -0,0 +1,124 @@
+/**
+ * @file log_format.h
+ * @brief Versioneret binært logformat med poster af fast størrelse.
+ *
+ * En logfil består af én LogHeader efterfulgt af LogRecord-poster. Alle felter
+ * er little-endian. Posternes tidsstempler er ikke-aftagende, så en fil kan
+ * gennemsøges med binær søgning på tid (se logLowerBound()).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+const uint32_t kLogMagic = 0x474C4D45;  ///< "EMLG" som little-endian uint32
+const uint16_t kLogVersion = 1;         ///< Nuværende formatversion
+const uint8_t kLogChannelUnsynced = 0x80; ///< Bit i LogRecord::channel: time er ikke Unix-tid (logget før NTP)
+
+/**
+ * @brief Hændelsestyper i loggen.
+ */
+enum LogEvent : uint8_t {
+  LOG_EVENT_BOOT = 1,     ///< Enheden er startet, value = 0
+  LOG_EVENT_LED_ON = 2,   ///< LED tændt via webinterface
+  LOG_EVENT_LED_OFF = 3,  ///< LED slukket via webinterface
+  LOG_EVENT_COUNTER = 4,  ///< Periodisk aflæsning af pulstælleren, value = tæller
+  LOG_EVENT_POWER = 5,    ///< Periodisk aflæsning af effekten, value = W
+  LOG_EVENT_RULE_ON = 6,  ///< En alarmregel er slået til, value = regelnummer
+  LOG_EVENT_RULE_OFF = 7, ///< En alarmregel er slået fra, value = regelnummer
+};
+
+/**
+ * @brief Filheader, skrives én gang i starten af logfilen.
+ */
+struct LogHeader {
+  uint32_t magic;      ///< kLogMagic
+  uint16_t version;    ///< kLogVersion
+  uint16_t recordSize; ///< sizeof(LogRecord) da filen blev oprettet
+  uint32_t createdAt;  ///< Tidspunkt for oprettelse (Unix-tid eller oppetid i s)
+  uint32_t reserved;   ///< Reserveret, skrives som 0
+};
+
+/**
+ * @brief Én logpost af fast størrelse.
+ */
+struct LogRecord {
+  uint32_t time;    ///< Sekunder (Unix-tid når uret er synkroniseret)
+  uint16_t millis;  ///< Millisekunder inden for sekundet
+  uint8_t channel;  ///< Målekanal; kLogChannelUnsynced betyder at tidspunktet er ukendt
+  uint8_t type;     ///< LogEvent
+  int32_t value;    ///< Hændelsens værdi
+};
+
+static_assert(sizeof(LogHeader) == 16, "LogHeader must be 16 bytes");
+static_assert(sizeof(LogRecord) == 12, "LogRecord must be 12 bytes");
+
+/**
+ * @brief Bygger en header til en ny logfil.
+ * @param createdAt Oprettelsestidspunkt
+ */
+LogHeader makeLogHeader(uint32_t createdAt);
+
+/**
+ * @brief Tjekker at en header har kendt magic, version og poststørrelse.
+ */
+bool logHeaderValid(const LogHeader& header);
+
+/**
+ * @brief Antal hele poster i en logfil af den givne størrelse.
+ */
+inline uint32_t logRecordCount(size_t fileSize) {
+  return fileSize < sizeof(LogHeader) ? 0 : (fileSize - sizeof(LogHeader)) / sizeof(LogRecord);
+}
+
+/**
+ * @brief Filoffset for post nummer index.
+ */
+inline size_t logRecordOffset(uint32_t index) {
+  return sizeof(LogHeader) + (size_t)index * sizeof(LogRecord);
+}
+
+/**
+ * @brief Navn på en hændelsestype, som det stod i den gamle tekstlog.
+ */
+const char* logEventName(uint8_t type);
+
+/** @brief CSV-kolonneoverskrifter matchende formatLogCsv(). */
+extern const char kLogCsvHeader[];
+
+/**
+ * @brief Formaterer en post som én CSV-linje inkl. linjeskift.
+ * @param record Posten
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @return Antal skrevne tegn, eller 0 hvis bufferen er for lille.
+ */
+size_t formatLogCsv(const LogRecord& record, char* buf, size_t len);
+
+/**
+ * @brief Binær søgning efter første post med time >= t.
+ * @tparam ReadAt Kaldbar `bool(uint32_t index, LogRecord& out)`
+ * @param readAt Læser post nummer index
+ * @param count Antal poster i filen
+ * @param t Søgt tidspunkt
+ * @return Indeks på første post med time >= t, eller count hvis ingen.
+ */
+template <typename ReadAt>
+uint32_t logLowerBound(ReadAt readAt, uint32_t count, uint32_t t) {
+  uint32_t lo = 0;
+  uint32_t hi = count;
+  LogRecord record;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (!readAt(mid, record)) {
+      return count;
+    }
+    if (record.time < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
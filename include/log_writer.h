@@ -0,0 +1,102 @@
+/**
+ * @file log_writer.h
+ * @brief Bufferet logskriver der samler poster og skriver dem i én flash-skrivning.
+ *
+ * Poster lægges i en fast RAM-buffer og committes samlet til en LogSink, når
+ * der står maxRecords poster i kø, når den ældste post er ældre end
+ * maxLatencyMs, eller når flush() kaldes eksplicit (f.eks. før genstart).
+ * Klassen er ikke trådsikker; kalderen skal serialisere adgangen.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Destination for committede logdata (f.eks. en fil på SPIFFS).
+ */
+class LogSink {
+public:
+  virtual ~LogSink() {}
+
+  /**
+   * @brief Skriver en samlet blok af poster.
+   * @param data Bufferens indhold
+   * @param len Antal bytes
+   * @return True hvis hele blokken blev skrevet.
+   */
+  virtual bool commit(const uint8_t* data, size_t len) = 0;
+};
+
+/**
+ * @brief Tællere for logskriveren.
+ */
+struct LogWriterStats {
+  uint32_t records = 0;        ///< Poster skrevet til sink
+  uint32_t bytes = 0;          ///< Bytes skrevet til sink
+  uint32_t commits = 0;        ///< Vellykkede commits
+  uint32_t failedCommits = 0;  ///< Commits hvor sink fejlede
+  uint32_t droppedRecords = 0; ///< Poster tabt (for store eller fejlet commit)
+  uint32_t lastCommitUs = 0;   ///< Varighed af seneste commit (µs)
+  uint32_t maxCommitUs = 0;    ///< Værste commit-varighed (µs)
+};
+
+/**
+ * @brief Group-commit logskriver med fast buffer.
+ */
+class LogWriter {
+public:
+  static const size_t kBufferSize = 1024; ///< Størrelse på RAM-bufferen (bytes)
+
+  typedef uint32_t (*Clock)(); ///< Mikrosekundur til måling af commit-tid
+
+  /**
+   * @param sink Destination for committede data
+   * @param maxRecords Commit når så mange poster står i kø
+   * @param maxLatencyMs Commit når den ældste post er så gammel (ms)
+   * @param clockUs Mikrosekundur til commit-statistik
+   */
+  LogWriter(LogSink& sink, uint16_t maxRecords, uint32_t maxLatencyMs, Clock clockUs);
+
+  /**
+   * @brief Lægger en post i bufferen og committer hvis grænsen er nået.
+   * @param data Postens bytes
+   * @param len Postens længde
+   * @param nowMs Nuværende tid (ms)
+   * @return False hvis posten blev tabt.
+   */
+  bool append(const void* data, size_t len, uint32_t nowMs);
+
+  /**
+   * @brief Committer bufferen hvis den ældste post har ventet for længe.
+   * @param nowMs Nuværende tid (ms)
+   */
+  void poll(uint32_t nowMs);
+
+  /**
+   * @brief Committer alt i bufferen med det samme.
+   * @return True hvis bufferen var tom eller blev skrevet.
+   */
+  bool flush();
+
+  /** @brief Smider bufferens indhold væk uden at skrive det. */
+  void discard();
+
+  /** @brief Antal poster der venter på commit. */
+  uint16_t pendingRecords() const { return pendingRecords_; }
+
+  /** @brief Tællere for skriveren. */
+  const LogWriterStats& stats() const { return stats_; }
+
+private:
+  LogSink& sink_;
+  uint16_t maxRecords_;
+  uint32_t maxLatencyMs_;
+  Clock clockUs_;
+  uint8_t buffer_[kBufferSize];
+  size_t used_ = 0;
+  uint16_t pendingRecords_ = 0;
+  uint32_t oldestMs_ = 0; ///< Tidspunkt for ældste post i bufferen (ms)
+  LogWriterStats stats_;
+};
@@ -0,0 +1,107 @@
+/**
+ * @file metrics.h
+ * @brief Låsefri histogrammer med faste spande til latensmålinger.
+ *
+ * observe() finder spanden ved lineær søgning i en lille, fast tabel og
+ * opdaterer atomare tællere uden read-modify-write, så hver måling koster
+ * få instruktioner. Hvert histogram må kun have én skrivende task ad gangen
+ * (eller skrivere serialiseret af en mutex); læsere må køre samtidig.
+ * Ingen Arduino-afhængigheder.
+ *
+ * Summen er 64 bit, men std::atomic<uint64_t> er ikke låsefri på Xtensa.
+ * Skriveren lægger den derfor skiftevis i to par af 32-bit-ord og
+ * publicerer parret med en sekvenstæller; en læser der ser tælleren skifte
+ * undervejs, læser igen. Skriveren rører aldrig det par læseren er henvist
+ * til, så læseren venter ikke på en afbrudt skriver.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @brief Histogram over værdier i mikrosekunder.
+ */
+class Histogram {
+public:
+  static const uint8_t kMaxBuckets = 16; ///< Højeste antal endelige spandgrænser
+
+  /**
+   * @param bounds Stigende øvre grænser (µs, inklusiv); skal leve hele programmets levetid
+   * @param count Antal grænser (højst kMaxBuckets)
+   */
+  Histogram(const uint32_t* bounds, uint8_t count)
+    : bounds_(bounds), count_(count > kMaxBuckets ? kMaxBuckets : count) {}
+
+  /**
+   * @brief Registrerer én måling.
+   * @param valueUs Målt værdi (µs)
+   */
+  void observe(uint32_t valueUs) {
+    uint8_t i = 0;
+    while (i < count_ && valueUs > bounds_[i]) {
+      i++;
+    }
+    bump(buckets_[i]);
+    bump(observations_);
+    publishSum(total_ + valueUs);
+  }
+
+  /** @brief Antal endelige spande. */
+  uint8_t bucketCount() const { return count_; }
+
+  /** @brief Øvre grænse for spand i (µs). */
+  uint32_t bound(uint8_t i) const { return bounds_[i]; }
+
+  /** @brief Antal målinger i spand i alene; i == bucketCount() er +Inf-spanden. */
+  uint32_t bucket(uint8_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+
+  /** @brief Antal målinger i alt. */
+  uint32_t observations() const { return observations_.load(std::memory_order_relaxed); }
+
+  /** @brief Summen af alle målinger (µs). */
+  uint64_t sum() const {
+    for (;;) {
+      uint32_t seq = sumSeq_.load(std::memory_order_acquire);
+      const SumWords& words = sumWords_[seq & 1];
+      uint64_t sum = (uint64_t)words.hi.load(std::memory_order_relaxed) << 32 |
+                     words.lo.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sumSeq_.load(std::memory_order_relaxed) == seq) {
+        return sum;
+      }
+    }
+  }
+
+private:
+  /** @brief Summen delt i to ord, der hver kan læses atomart. */
+  struct SumWords {
+    std::atomic<uint32_t> lo{0};
+    std::atomic<uint32_t> hi{0};
+  };
+
+  static void bump(std::atomic<uint32_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /** @brief Skriver sum i det par læserne ikke er henvist til og peger dem derhen. */
+  void publishSum(uint64_t sum) {
+    total_ = sum;
+    uint32_t seq = sumSeq_.load(std::memory_order_relaxed);
+    SumWords& words = sumWords_[(seq + 1) & 1];
+    std::atomic_thread_fence(std::memory_order_release);
+    words.lo.store((uint32_t)sum, std::memory_order_relaxed);
+    words.hi.store((uint32_t)(sum >> 32), std::memory_order_relaxed);
+    sumSeq_.store(seq + 1, std::memory_order_release);
+  }
+
+  const uint32_t* bounds_;
+  uint8_t count_;
+  std::atomic<uint32_t> buckets_[kMaxBuckets + 1] = {};
+  std::atomic<uint32_t> observations_{0};
+  uint64_t total_ = 0;              ///< Summen, kun til skriveren
+  SumWords sumWords_[2];            ///< Summen for lige og ulige sumSeq_
+  std::atomic<uint32_t> sumSeq_{0}; ///< Antal publicerede summer
+};
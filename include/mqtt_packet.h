@@ -0,0 +1,75 @@
+/**
+ * @file mqtt_packet.h
+ * @brief De få MQTT 3.1.1-pakker eksportøren bruger: CONNECT, PUBLISH med QoS 1 og svarene.
+ *
+ * Kun kodning og afkodning af bytes; forbindelsen ejes af kalderen, så den
+ * samme kode bruges over WiFiClient på enheden og over en socket på en
+ * host. PUBLISH kodes som header alene, så en batch kan sendes direkte fra
+ * sin buffer uden at blive kopieret. Sessionen er altid "clean" og uden
+ * will, brugernavn og password.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Pakketyper i den faste headers øverste nibble.
+ */
+enum MqttPacketType : uint8_t {
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14,
+};
+
+const size_t kMqttMaxHeaderSize = 5;          ///< Fast header: type + op til 4 bytes længde
+const size_t kMqttAckSize = 4;                ///< CONNACK og PUBACK
+const uint32_t kMqttMaxRemaining = 268435455; ///< Største "remaining length"
+
+/**
+ * @brief Koder en CONNECT-pakke.
+ * @param clientId Klient-id, højst 23 tegn for at passe alle brokere
+ * @param keepAliveS Keep-alive (s), 0 = broker lukker aldrig pga. stilhed
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @return Pakkens længde, eller 0 hvis bufferen er for lille.
+ */
+size_t mqttConnect(const char* clientId, uint16_t keepAliveS, uint8_t* buf, size_t len);
+
+/**
+ * @brief Koder headeren for en PUBLISH med QoS 1; payloaden sendes bagefter.
+ * @param topic Emne
+ * @param packetId Pakke-id, 1..65535, som PUBACK'en skal bære
+ * @param payloadLen Payloadens længde
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @return Headerens længde, eller 0 hvis bufferen er for lille.
+ */
+size_t mqttPublishHeader(const char* topic, uint16_t packetId, size_t payloadLen, uint8_t* buf, size_t len);
+
+/**
+ * @brief Koder en pakke uden indhold (PINGREQ eller DISCONNECT).
+ * @param type Pakketypen
+ * @param buf Modtager 2 bytes
+ * @return 2
+ */
+size_t mqttEmpty(MqttPacketType type, uint8_t* buf);
+
+/**
+ * @brief Læser et CONNACK.
+ * @param buf kMqttAckSize bytes
+ * @return True hvis brokeren accepterede forbindelsen.
+ */
+bool mqttConnackOk(const uint8_t* buf);
+
+/**
+ * @brief Læser et PUBACK.
+ * @param buf kMqttAckSize bytes
+ * @return Pakke-id'et, eller 0 hvis det ikke er et PUBACK.
+ */
+uint16_t mqttPubackId(const uint8_t* buf);
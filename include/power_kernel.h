@@ -0,0 +1,84 @@
+/**
+ * @file power_kernel.h
+ * @brief Beregning af Vrms, Irms, P, S og effektfaktor fra samples af spænding og strøm.
+ *
+ * Beregningen er delt i to trin:
+ * - powerAccumulate() lægger en blok samplepar til fem 64-bit summer
+ *   (Σv, Σi, Σv², Σi², Σv·i). Den er udrullet fire gange med uafhængige
+ *   akkumulatorer, bruger kun heltal og kan kaldes blokvis.
+ * - powerFinish() omsætter summerne for én netperiode til fysiske værdier.
+ *   DC-offset fjernes via middelværdierne, så rå ADC-værdier kan bruges
+ *   direkte, og kvadratroden tages med en heltals-sqrt.
+ *
+ * Kalibreringen angives i Q16 (1/65536), så en ADC-tælling svarer til
+ * mvPerCountQ16 / 65536 mV. Uden Arduino-afhængigheder, så kernen kan
+ * benchmarkes og testes på en host med genererede sinuskurver.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Løbende summer for en blok af samplepar.
+ */
+struct PowerSums {
+  int64_t sumV = 0;   ///< Σv
+  int64_t sumI = 0;   ///< Σi
+  int64_t sumVV = 0;  ///< Σv²
+  int64_t sumII = 0;  ///< Σi²
+  int64_t sumVI = 0;  ///< Σv·i
+  uint32_t count = 0; ///< Antal samplepar
+
+  /** @brief Nulstiller summerne. */
+  void clear() { *this = PowerSums(); }
+};
+
+/**
+ * @brief Omregning fra ADC-tællinger til mV og mA.
+ */
+struct PowerCalibration {
+  uint32_t mvPerCountQ16; ///< Spænding pr. tælling (mV, Q16)
+  uint32_t maPerCountQ16; ///< Strøm pr. tælling (mA, Q16)
+};
+
+/**
+ * @brief Resultat for én netperiode.
+ */
+struct PowerReading {
+  uint32_t vrmsMv;      ///< Effektiv spænding (mV)
+  uint32_t irmsMa;      ///< Effektiv strøm (mA)
+  int32_t realMw;       ///< Aktiv effekt (mW), negativ ved eksport
+  uint32_t apparentMva; ///< Tilsyneladende effekt (mVA)
+  int16_t pfPermille;   ///< Effektfaktor (‰), fortegn som realMw
+  uint32_t durationUs;  ///< Periodens varighed (µs)
+};
+
+/**
+ * @brief Lægger n samplepar til summerne.
+ *
+ * Konstant arbejde pr. sample, ingen forgreninger i den indre løkke. Med
+ * 12-bit samples kan summerne ikke løbe over før langt over 10^9 samples.
+ * @param v Spændingssamples
+ * @param i Strømsamples
+ * @param n Antal samplepar
+ * @param sums Summerne der opdateres
+ */
+void powerAccumulate(const int16_t* v, const int16_t* i, size_t n, PowerSums& sums);
+
+/**
+ * @brief Beregner værdierne for en afsluttet periode.
+ * @param sums Summerne for perioden (count > 0)
+ * @param cal Kalibrering
+ * @param durationUs Periodens varighed (µs), kopieres til resultatet
+ * @return Beregnede værdier; alle nul hvis sums er tom.
+ */
+PowerReading powerFinish(const PowerSums& sums, const PowerCalibration& cal, uint32_t durationUs);
+
+/**
+ * @brief Heltals-kvadratrod, afrundet nedad.
+ * @param x Værdien
+ * @return ⌊√x⌋
+ */
+uint32_t isqrt64(uint64_t x);
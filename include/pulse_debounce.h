@@ -0,0 +1,53 @@
+/**
+ * @file pulse_debounce.h
+ * @brief Flankedetektering og debounce af pulser fra berøringssensoren.
+ *
+ * Kaldes for hver sample med sensorens tilstand og et 64-bit tidsstempel i
+ * mikrosekunder. En puls tælles på overgangen fra inaktiv til aktiv, dog kun
+ * hvis der er gået mindst minIntervalUs siden forrige puls. Uden Arduino-
+ * afhængigheder, så den kan køres på en host med syntetiske pulstog.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Tilstandsmaskine der omsætter samples til pulser.
+ */
+class PulseDebouncer {
+public:
+  /**
+   * @param minIntervalUs Mindste tid mellem to pulser (µs)
+   */
+  explicit PulseDebouncer(uint32_t minIntervalUs) : minIntervalUs_(minIntervalUs) {}
+
+  /**
+   * @brief Fodrer en ny sample ind i detektoren.
+   * @param active True hvis sensoren er aktiv (berørt/belyst)
+   * @param nowUs Tidspunkt for samplen (µs)
+   * @return True hvis samplen starter en ny, gyldig puls.
+   */
+  bool update(bool active, uint64_t nowUs) {
+    bool rising = active && !active_;
+    active_ = active;
+    if (!rising) {
+      return false;
+    }
+    if (hasPulse_ && nowUs - lastPulseUs_ < minIntervalUs_) {
+      return false;
+    }
+    hasPulse_ = true;
+    lastPulseUs_ = nowUs;
+    return true;
+  }
+
+  /** @brief Tidspunkt for sidste accepterede puls (µs). */
+  uint64_t lastPulseUs() const { return lastPulseUs_; }
+
+private:
+  uint32_t minIntervalUs_;   ///< Debounce-tid (µs)
+  uint64_t lastPulseUs_ = 0; ///< Tidspunkt for sidste puls (µs)
+  bool hasPulse_ = false;    ///< Om der er set en puls endnu
+  bool active_ = false;      ///< Sensorens tilstand ved forrige sample
+};
@@ -0,0 +1,337 @@
+/**
+ * @file pulse_detector.h
+ * @brief Adaptiv pulsdetektor med sporet baseline og hysterese.
+ *
+ * Kaldes med fast samplerate med sensorens råværdi (touchRead() eller en
+ * fototransistor på ADC). Baseline følges med et IIR-filter (første ordens
+ * lavpas, alpha = 2^-baselineShift), og støjen som det tilsvarende filtrerede
+ * absolutte afvig. Begge opdateres kun mens sensoren er inaktiv, så pulserne
+ * ikke trækker baseline med sig. En puls starter når afviget fra baseline
+ * overstiger onThreshold = max(minDelta, onNoiseMultiple × støj) og slutter
+ * når det falder under det halve (hysterese).
+ *
+ * En puls tælles når den har været aktiv i minWidthUs, med tidsstempel ved
+ * den stigende flanke; kortere udsving tælles som afvist. Pulser der
+ * starter mindre end minIntervalUs efter forrige talte puls afvises også.
+ * Begge grænser udledes af målerkonstanten (pulseTimingFor()) i stedet for
+ * en fast debounce. Står detektoren aktiv i mere end maxWidthUs, antages
+ * et spring i baggrundslyset, og baseline sættes til den aktuelle værdi.
+ * De første kSettleSamples samples bruges kun til at finde hvileniveauet.
+ * PulseDetectorBank kører flere kanaler i én gennemgang; PulseDetector er
+ * den enkelte kanal.
+ *
+ * Al aritmetik er heltal (Q16), så update() er billig nok til sample-tasken;
+ * råværdier over kMaxRaw mættes, så de skiftede værdier kan ligge i int32.
+ * Uden Arduino-afhængigheder, så den kan køres på en host mod optagne eller
+ * syntetiske spor (se tools/detector_sim.cpp).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Tidsgrænser for en puls.
+ */
+struct PulseTiming {
+  uint32_t minWidthUs;    ///< Kortere udsving tælles ikke
+  uint32_t minIntervalUs; ///< Mindste tid mellem to stigende flanker
+};
+
+/**
+ * @brief Udleder tidsgrænserne af målerkonstanten og den største forventede effekt.
+ *
+ * Ved maxPowerW blinker måleren med perioden 3.6e12 / (impPerKwh × maxPowerW)
+ * µs. Mindste interval er halvdelen af den periode, så der er dobbelt
+ * margen op til maxPowerW. Mindste bredde er en ottendedel af perioden,
+ * højst 10 ms (målerens LED-puls er typisk 10-90 ms) og mindst to samples,
+ * så et enkelt støjsample aldrig bliver en puls.
+ * @param impPerKwh Målerkonstant (pulser pr. kWh), 0 giver 1000 som i EnergyMeter
+ * @param maxPowerW Største effekt der skal kunne måles (W)
+ * @param sampleIntervalUs Sampleperiode (µs)
+ */
+inline PulseTiming pulseTimingFor(uint32_t impPerKwh, uint32_t maxPowerW, uint32_t sampleIntervalUs) {
+  const uint32_t kMaxMinWidthUs = 10000;
+  uint64_t rate = (uint64_t)(impPerKwh ? impPerKwh : 1000) * (maxPowerW ? maxPowerW : 1);
+  uint64_t minPeriodUs = 3600000000000ull / rate;
+  PulseTiming timing;
+  timing.minIntervalUs = minPeriodUs / 2 > UINT32_MAX ? UINT32_MAX : (uint32_t)(minPeriodUs / 2);
+  uint64_t width = minPeriodUs / 8 < kMaxMinWidthUs ? minPeriodUs / 8 : kMaxMinWidthUs;
+  if (width < 2ull * sampleIntervalUs) {
+    width = 2ull * sampleIntervalUs;
+  }
+  timing.minWidthUs = (uint32_t)width;
+  return timing;
+}
+
+/**
+ * @brief Indstillinger for PulseDetector.
+ */
+struct PulseDetectorConfig {
+  bool activeLow = true;          ///< Aktiv når værdien falder (touchRead); false for fototransistor mod stel
+  uint8_t baselineShift = 12;     ///< Baseline-filter, tidskonstant 2^n samples (8 s ved 2 ms)
+  uint8_t noiseShift = 10;        ///< Støjfilter, tidskonstant 2^n samples
+  uint8_t onNoiseMultiple = 6;    ///< Starttærskel i antal gange støjen
+  uint16_t minDelta = 8;          ///< Mindste starttærskel i råværdier
+  uint32_t minWidthUs = 4000;     ///< Se PulseTiming
+  uint32_t minIntervalUs = 5000;  ///< Se PulseTiming
+  uint32_t maxWidthUs = 2000000;  ///< Aktiv længere end dette = nyt baggrundsniveau
+};
+
+/**
+ * @brief Signalkvalitet og tællere; skrives kun af detektoren.
+ *
+ * Felterne er enkelte 32-bit ord, så de kan læses fra en anden task uden
+ * lås; de er hver for sig konsistente, men ikke nødvendigvis indbyrdes.
+ */
+struct PulseDetectorStats {
+  uint32_t samples = 0;          ///< Behandlede samples
+  uint32_t pulses = 0;           ///< Talte pulser
+  uint32_t rejectedShort = 0;    ///< Udsving kortere end minWidthUs
+  uint32_t rejectedInterval = 0; ///< Pulser for tæt på forrige
+  uint32_t baselineResets = 0;   ///< Gange baseline er sat efter maxWidthUs
+  int32_t baselineQ16 = 0;        ///< Baseline (råværdi × 65536)
+  int32_t noiseQ16 = 0;           ///< Gennemsnitligt absolut afvig i hvile (× 65536)
+  int32_t lastAmplitudeQ16 = 0;   ///< Største afvig i seneste talte puls (× 65536)
+  int32_t minAmplitudeQ16 = 0;    ///< Mindste amplitude blandt talte pulser (× 65536), 0 = ingen endnu
+};
+
+/**
+ * @brief Tilstandsmaskinen for N kanaler med tilstanden lagt som arrays.
+ *
+ * Hvert felt ligger i sit eget array indekseret med kanal (structure of
+ * arrays), og flag er bitmasker, så en gennemgang af alle kanaler læser
+ * sammenhængende hukommelse. Alle kanaler samples samtidig og deler derfor
+ * indsvingningen. N er højst 32.
+ */
+template <size_t N>
+class PulseDetectorBank {
+  static_assert(N >= 1 && N <= 32, "PulseDetectorBank supports 1-32 channels");
+
+public:
+  static const uint32_t kSettleSamples = 64; ///< Samples der kun bruges til at finde hvileniveauet
+  static const uint16_t kMaxRaw = 0x7FFF;    ///< Største råværdi; højere mættes, så Q16 holder sig i int32
+
+  PulseDetectorBank() {
+    for (size_t ch = 0; ch < N; ch++) {
+      configure(ch, PulseDetectorConfig());
+    }
+  }
+
+  /**
+   * @brief Skifter indstillinger for én kanal; baseline og støj bevares.
+   * @param ch Kanal
+   * @param config Nye indstillinger
+   */
+  void configure(size_t ch, const PulseDetectorConfig& config) {
+    uint32_t bit = 1u << ch;
+    activeLow_ = config.activeLow ? activeLow_ | bit : activeLow_ & ~bit;
+    baselineShift_[ch] = config.baselineShift;
+    noiseShift_[ch] = config.noiseShift;
+    onNoiseMultiple_[ch] = config.onNoiseMultiple;
+    minDelta_[ch] = config.minDelta;
+    minWidthUs_[ch] = config.minWidthUs;
+    minIntervalUs_[ch] = config.minIntervalUs;
+    maxWidthUs_[ch] = config.maxWidthUs;
+  }
+
+  /** @brief Aktive indstillinger for én kanal. */
+  PulseDetectorConfig config(size_t ch) const {
+    PulseDetectorConfig config;
+    config.activeLow = (activeLow_ >> ch) & 1;
+    config.baselineShift = baselineShift_[ch];
+    config.noiseShift = noiseShift_[ch];
+    config.onNoiseMultiple = onNoiseMultiple_[ch];
+    config.minDelta = minDelta_[ch];
+    config.minWidthUs = minWidthUs_[ch];
+    config.minIntervalUs = minIntervalUs_[ch];
+    config.maxWidthUs = maxWidthUs_[ch];
+    return config;
+  }
+
+  /**
+   * @brief Fodrer én sample pr. kanal ind i detektoren.
+   * @param raw Råværdier for kanal 0..count-1
+   * @param count Antal kanaler i brug (højst N)
+   * @param nowUs Tidspunkt for samplerne (µs)
+   * @return Bitmaske over kanaler hvor en puls netop er talt; tidsstemplet er pulseStartUs().
+   */
+  uint32_t update(const uint16_t* raw, size_t count, uint64_t nowUs) {
+    if (count > N) {
+      count = N;
+    }
+    if (samples_++ < kSettleSamples) {
+      // Hvileniveauet er den mindst aktive værdi; et gennemsnit ville
+      // trække baseline mod pulserne hvis måleren blinker hurtigt
+      for (size_t ch = 0; ch < count; ch++) {
+        int32_t x = toQ16(raw[ch]);
+        bool quieter = (activeLow_ >> ch) & 1 ? x > baselineQ16_[ch] : x < baselineQ16_[ch];
+        if (samples_ == 1 || quieter) {
+          baselineQ16_[ch] = x;
+        }
+      }
+      return 0;
+    }
+    uint32_t pulses = 0;
+    for (size_t ch = 0; ch < count; ch++) {
+      if (step(ch, toQ16(raw[ch]), nowUs)) {
+        pulses |= 1u << ch;
+      }
+    }
+    return pulses;
+  }
+
+  /** @brief Stigende flanke for den senest talte puls på en kanal (µs). */
+  uint64_t pulseStartUs(size_t ch) const { return pulseStartUs_[ch]; }
+
+  /** @brief Om kanalens sensor er aktiv lige nu. */
+  bool active(size_t ch) const { return (active_ >> ch) & 1; }
+
+  /** @brief Signalkvalitet og tællere for én kanal. */
+  PulseDetectorStats stats(size_t ch) const {
+    PulseDetectorStats stats;
+    stats.samples = samples_;
+    stats.pulses = pulses_[ch];
+    stats.rejectedShort = rejectedShort_[ch];
+    stats.rejectedInterval = rejectedInterval_[ch];
+    stats.baselineResets = baselineResets_[ch];
+    stats.baselineQ16 = baselineQ16_[ch];
+    stats.noiseQ16 = noiseQ16_[ch];
+    stats.lastAmplitudeQ16 = lastAmplitudeQ16_[ch];
+    stats.minAmplitudeQ16 = minAmplitudeQ16_[ch];
+    return stats;
+  }
+
+private:
+  /** @brief Råværdi til Q16, mættet ved kMaxRaw. */
+  static int32_t toQ16(uint16_t raw) {
+    return (raw < kMaxRaw ? (int32_t)raw : (int32_t)kMaxRaw) << 16;
+  }
+
+  /** @brief Én sample for én kanal efter indsvingningen. */
+  bool step(size_t ch, int32_t x, uint64_t nowUs) {
+    const uint32_t bit = 1u << ch;
+    int32_t deviation = activeLow_ & bit ? baselineQ16_[ch] - x : x - baselineQ16_[ch];
+    int64_t on = (int64_t)noiseQ16_[ch] * onNoiseMultiple_[ch];
+    if (on < ((int64_t)minDelta_[ch] << 16)) {
+      on = (int64_t)minDelta_[ch] << 16;
+    }
+
+    if (!(active_ & bit)) {
+      if (deviation > on) {
+        active_ |= bit;
+        counted_ &= ~bit;
+        startUs_[ch] = nowUs;
+        peakQ16_[ch] = deviation;
+        return false;
+      }
+      baselineQ16_[ch] += (x - baselineQ16_[ch]) >> baselineShift_[ch];
+      int32_t magnitude = deviation < 0 ? -deviation : deviation;
+      if (magnitude > on) {
+        magnitude = (int32_t)on;
+      }
+      noiseQ16_[ch] += (magnitude - noiseQ16_[ch]) >> noiseShift_[ch];
+      return false;
+    }
+
+    if (deviation > peakQ16_[ch]) {
+      peakQ16_[ch] = deviation;
+    }
+    uint64_t width = nowUs - startUs_[ch];
+    if (deviation < on / 2) {
+      active_ &= ~bit;
+      if (!(counted_ & bit)) {
+        rejectedShort_[ch]++;
+      }
+      return false;
+    }
+    if (width > maxWidthUs_[ch]) {
+      active_ &= ~bit;
+      baselineQ16_[ch] = x;
+      baselineResets_[ch]++;
+      return false;
+    }
+    if ((counted_ & bit) || width < minWidthUs_[ch]) {
+      return false;
+    }
+    counted_ |= bit;
+    if ((hasPulse_ & bit) && startUs_[ch] - pulseStartUs_[ch] < minIntervalUs_[ch]) {
+      rejectedInterval_[ch]++;
+      return false;
+    }
+    hasPulse_ |= bit;
+    pulseStartUs_[ch] = startUs_[ch];
+    pulses_[ch]++;
+    lastAmplitudeQ16_[ch] = peakQ16_[ch];
+    if (minAmplitudeQ16_[ch] == 0 || peakQ16_[ch] < minAmplitudeQ16_[ch]) {
+      minAmplitudeQ16_[ch] = peakQ16_[ch];
+    }
+    return true;
+  }
+
+  // Indstillinger
+  uint32_t activeLow_ = 0;           ///< Bit pr. kanal, se PulseDetectorConfig::activeLow
+  uint8_t baselineShift_[N];
+  uint8_t noiseShift_[N];
+  uint8_t onNoiseMultiple_[N];
+  uint16_t minDelta_[N];
+  uint32_t minWidthUs_[N];
+  uint32_t minIntervalUs_[N];
+  uint32_t maxWidthUs_[N];
+
+  // Tilstand, skrives kun af update()
+  uint32_t samples_ = 0;             ///< Fælles for alle kanaler
+  uint32_t active_ = 0;              ///< Bit pr. kanal: afviget er over tærsklen
+  uint32_t counted_ = 0;             ///< Bit pr. kanal: den aktive puls er talt eller afvist på interval
+  uint32_t hasPulse_ = 0;            ///< Bit pr. kanal: der er talt en puls
+  int32_t baselineQ16_[N] = {};
+  int32_t noiseQ16_[N] = {};
+  int32_t peakQ16_[N] = {};          ///< Største afvig i den aktive puls
+  uint64_t startUs_[N] = {};         ///< Stigende flanke for den aktive puls
+  uint64_t pulseStartUs_[N] = {};    ///< Stigende flanke for seneste talte puls
+
+  // Statistik; enkelte 32-bit ord, se PulseDetectorStats
+  uint32_t pulses_[N] = {};
+  uint32_t rejectedShort_[N] = {};
+  uint32_t rejectedInterval_[N] = {};
+  uint32_t baselineResets_[N] = {};
+  int32_t lastAmplitudeQ16_[N] = {};
+  int32_t minAmplitudeQ16_[N] = {};
+};
+
+/**
+ * @brief Detektor for én kanal.
+ */
+class PulseDetector {
+public:
+  static const uint32_t kSettleSamples = PulseDetectorBank<1>::kSettleSamples; ///< Se PulseDetectorBank
+
+  explicit PulseDetector(const PulseDetectorConfig& config = PulseDetectorConfig()) { bank_.configure(0, config); }
+
+  /** @brief Skifter indstillinger; baseline og støj bevares. */
+  void configure(const PulseDetectorConfig& config) { bank_.configure(0, config); }
+
+  /** @brief Aktive indstillinger. */
+  PulseDetectorConfig config() const { return bank_.config(0); }
+
+  /**
+   * @brief Fodrer en ny sample ind i detektoren.
+   * @param raw Sensorens råværdi
+   * @param nowUs Tidspunkt for samplen (µs)
+   * @return True hvis en puls netop er talt; tidsstemplet er pulseStartUs().
+   */
+  bool update(uint16_t raw, uint64_t nowUs) { return bank_.update(&raw, 1, nowUs) != 0; }
+
+  /** @brief Stigende flanke for den senest talte puls (µs). */
+  uint64_t pulseStartUs() const { return bank_.pulseStartUs(0); }
+
+  /** @brief Om sensoren er aktiv lige nu. */
+  bool active() const { return bank_.active(0); }
+
+  /** @brief Signalkvalitet og tællere. */
+  PulseDetectorStats stats() const { return bank_.stats(0); }
+
+private:
+  PulseDetectorBank<1> bank_;
+};
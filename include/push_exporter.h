@@ -0,0 +1,212 @@
+/**
+ * @file push_exporter.h
+ * @brief Batchet eksport af målinger som InfluxDB line protocol med spool i lageret.
+ *
+ * Målepunkter formateres som line protocol og samles i en batch, der sendes
+ * når den når batchBytes eller er batchMs gammel. Transporten (UDP eller
+ * MQTT, se PushTransport) er udskiftelig. Kan en batch ikke sendes, gemmes
+ * den i en spool i lageret; når transporten er klar igen, sendes spoolen
+ * med højst én batch pr. drainIntervalMs, så et genforbundet net ikke
+ * oversvømmes. Nye batches sendes straks uden om spoolen; punkterne har
+ * tidsstempler, så rækkefølgen er ligegyldig for modtageren.
+ *
+ * Spoolen er segmentfiler "/spool<n>.lp" med poster [uint16 længde][batch].
+ * Der er højst spoolSegments segmenter på op til spoolSegmentBytes; når
+ * grænsen nås, slettes det ældste segment, så spoolen altid holder de
+ * nyeste data. En post der kun blev delvist skrevet, afslutter sit segment,
+ * så den aldrig efterfølges af hele poster. Læsepositionen holdes kun i
+ * RAM: efter en genstart sendes det ældste segment forfra. Et punkt med samme måling, tags og tidsstempel
+ * overskriver sig selv i InfluxDB, så gentagelser er harmløse.
+ * Alarmer (se rule_engine.h) lægges i samme batch, som så sendes straks.
+ * Uden Arduino-afhængigheder; se tools/push_host.cpp for en test mod en
+ * lokal modtager.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "storage.h"
+
+const size_t kPushBatchMaxBytes = 1024;  ///< Største batch; holder UDP under én Ethernet-MTU
+const size_t kPushLineMaxBytes = 160;    ///< Længste linje for ét punkt
+
+/**
+ * @brief Sender én batch ad gangen.
+ */
+class PushTransport {
+public:
+  virtual ~PushTransport() {}
+
+  /** @brief Transportens navn, f.eks. "udp". */
+  virtual const char* name() const = 0;
+
+  /**
+   * @brief Om der kan sendes nu; må forsøge at (gen)forbinde.
+   * @param nowMs Nuværende tid (ms)
+   */
+  virtual bool ready(uint32_t nowMs) = 0;
+
+  /**
+   * @brief Sender en batch.
+   * @param data Linjerne, hver afsluttet med '\n'
+   * @param len Antal bytes
+   * @return True når batchen er afleveret (UDP) eller kvitteret (MQTT QoS 1).
+   */
+  virtual bool send(const uint8_t* data, size_t len) = 0;
+};
+
+/**
+ * @brief Ét målepunkt for én kanal.
+ */
+struct PushPoint {
+  uint32_t time;      ///< Unix-tid (s)
+  uint8_t channel;    ///< Kanal
+  uint32_t counter;   ///< Pulstæller
+  int32_t energyWh;   ///< Energi (Wh)
+  int32_t powerW;     ///< Effekt (W)
+};
+
+/**
+ * @brief Formaterer et punkt som én linje line protocol.
+ *
+ * "energi,device=<id>,channel=<n> counter=<n>i,energy_wh=<n>i,power_w=<n>i <ns>\n"
+ * @param device Enhedens id; må ikke indeholde mellemrum, komma eller '='
+ * @param point Punktet
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @return Linjens længde, eller 0 hvis bufferen er for lille.
+ */
+size_t formatPushLine(const char* device, const PushPoint& point, char* buf, size_t len);
+
+/**
+ * @brief En alarmregel der er slået til eller fra.
+ */
+struct PushAlert {
+  uint32_t time;      ///< Unix-tid (s)
+  uint8_t channel;    ///< Kanal reglen gælder
+  uint8_t rule;       ///< Regelnummer
+  uint8_t kind;       ///< RuleKind
+  bool active;        ///< Slået til (true) eller fra
+  int32_t value;      ///< Værdien der udløste skiftet (se RuleEngine::value())
+};
+
+/**
+ * @brief Formaterer en alarm som én linje line protocol.
+ *
+ * "energi_alert,device=<id>,channel=<n>,rule=<n>,kind=<type> active=<0|1>i,value=<n>i <ns>\n"
+ * @param device Enhedens id
+ * @param alert Alarmen
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @return Linjens længde, eller 0 hvis bufferen er for lille.
+ */
+size_t formatAlertLine(const char* device, const PushAlert& alert, char* buf, size_t len);
+
+/**
+ * @brief Indstillinger for eksportøren.
+ */
+struct PushExporterConfig {
+  uint16_t batchBytes = 1024;          ///< Send når batchen har så mange bytes (højst kPushBatchMaxBytes)
+  uint32_t batchMs = 30000;            ///< Send senest så længe efter batchens første punkt (ms)
+  uint32_t retryMs = 10000;            ///< Vent så længe efter en fejlet afsendelse (ms)
+  uint32_t drainIntervalMs = 250;      ///< Mindste tid mellem to batches fra spoolen (ms)
+  uint32_t spoolSegmentBytes = 16384;  ///< Største segmentfil
+  uint8_t spoolSegments = 8;           ///< Største antal segmenter
+};
+
+/**
+ * @brief Tællere for eksportøren siden opstart.
+ */
+struct PushExporterStats {
+  uint32_t points = 0;          ///< Punkter lagt i en batch
+  uint32_t batches = 0;         ///< Batches lukket (sendt eller spoolet)
+  uint32_t sent = 0;            ///< Batches leveret direkte
+  uint32_t drained = 0;         ///< Batches leveret fra spoolen
+  uint32_t bytesSent = 0;       ///< Bytes leveret i alt
+  uint32_t sendFailures = 0;    ///< Afsendelser der fejlede
+  uint32_t spooled = 0;         ///< Batches skrevet i spoolen
+  uint32_t spoolFailures = 0;   ///< Batches tabt fordi spoolen ikke kunne skrives
+  uint32_t discardedBytes = 0;  ///< Spoolbytes slettet for at holde grænsen, eller ødelagte
+  uint32_t spoolBytes = 0;      ///< Bytes der venter i spoolen nu
+};
+
+/**
+ * @brief Samler, sender og spooler målepunkter.
+ *
+ * Ikke trådsikker; kaldes fra én task.
+ */
+class PushExporter {
+public:
+  /**
+   * @param transport Transporten batches sendes med
+   * @param storage Lageret spoolen ligger i
+   * @param config Indstillinger
+   */
+  PushExporter(PushTransport& transport, Storage& storage, const PushExporterConfig& config);
+
+  /**
+   * @brief Finder en spool fra før genstarten.
+   * @param device Enhedens id i linjerne (kopieres)
+   */
+  void begin(const char* device);
+
+  /**
+   * @brief Lægger et punkt i batchen; lukker batchen først hvis punktet ikke er plads.
+   * @param point Punktet
+   * @param nowMs Nuværende tid (ms)
+   */
+  void add(const PushPoint& point, uint32_t nowMs);
+
+  /**
+   * @brief Lægger en alarm i batchen og lukker den, så den sendes med det samme.
+   * @param alert Alarmen
+   * @param nowMs Nuværende tid (ms)
+   */
+  void addAlert(const PushAlert& alert, uint32_t nowMs);
+
+  /**
+   * @brief Lukker en forældet batch og sender fra spoolen; kaldes jævnligt.
+   * @param nowMs Nuværende tid (ms)
+   */
+  void poll(uint32_t nowMs);
+
+  /**
+   * @brief Lukker batchen uanset alder, f.eks. før nedlukning.
+   * @param nowMs Nuværende tid (ms)
+   */
+  void flush(uint32_t nowMs);
+
+  /** @brief Tællere siden opstart. */
+  const PushExporterStats& stats() const { return stats_; }
+
+private:
+  void append(const char* line, size_t len, uint32_t nowMs);
+  void closeBatch(uint32_t nowMs);
+  bool trySend(const uint8_t* data, size_t len, uint32_t nowMs);
+  void spool(const uint8_t* data, size_t len);
+  void drainOne(uint32_t nowMs);
+  void dropHeadSegment();
+  void nextSegment();
+  void segmentPath(uint32_t segment, char* buf, size_t len) const;
+
+  PushTransport& transport_;
+  Storage& storage_;
+  PushExporterConfig config_;
+  char device_[32] = "";
+  uint8_t batch_[kPushBatchMaxBytes];
+  size_t batchLen_ = 0;
+  uint32_t batchStartMs_ = 0;
+  uint8_t record_[2 + kPushBatchMaxBytes];  ///< Spoolpost under skrivning eller læsning
+  uint32_t headSegment_ = 0;   ///< Ældste segment
+  uint32_t tailSegment_ = 0;   ///< Segmentet der skrives i
+  uint32_t headOffset_ = 0;    ///< Læseposition i headSegment_
+  uint32_t tailSize_ = 0;      ///< Bytes i tailSegment_
+  bool tailClosed_ = false;    ///< Næste post skal i et nyt segment (efter en halv post)
+  bool spoolEmpty_ = true;
+  uint32_t retryAt_ = 0;       ///< Send ikke før dette tidspunkt efter en fejl (ms)
+  bool retryWait_ = false;
+  uint32_t lastDrain_ = 0;
+  PushExporterStats stats_;
+};
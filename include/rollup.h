@@ -0,0 +1,191 @@
+/**
+ * @file rollup.h
+ * @brief Inkrementelle aggregater (min/max/sum/antal) i flere tidsopløsninger.
+ *
+ * Hver RollupTier er en ringbuffer af spande med fast tidsopløsning. En sample
+ * lægges direkte i den spand der dækker dens tidspunkt i alle niveauer, så
+ * en opdatering koster O(1) pr. niveau. Spring frem i tid rydder højst N
+ * spande. Alt ligger i RAM; grove niveauer kan gemmes som rå bytes, da
+ * klasserne er trivielt kopierbare. Ingen Arduino-afhængigheder.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Aggregat for én tidsspand.
+ */
+struct RollupBucket {
+  int64_t sum;    ///< Summen af samples
+  int32_t min;    ///< Mindste sample (gyldig når count > 0)
+  int32_t max;    ///< Største sample (gyldig når count > 0)
+  uint32_t count; ///< Antal samples i spanden
+};
+
+/**
+ * @brief Ringbuffer af N spande med fast opløsning.
+ * @tparam N Antal spande
+ */
+template <size_t N>
+class RollupTier {
+public:
+  /**
+   * @param resolution Spandenes længde i sekunder
+   */
+  explicit RollupTier(uint32_t resolution) : resolution_(resolution) { clear(); }
+
+  /** @brief Tømmer alle spande. */
+  void clear() {
+    for (size_t i = 0; i < N; i++) {
+      buckets_[i] = RollupBucket{0, 0, 0, 0};
+    }
+    newestStart_ = 0;
+    newestIndex_ = 0;
+    empty_ = true;
+  }
+
+  /**
+   * @brief Lægger en sample i spanden der dækker tidspunktet t.
+   *
+   * Samples ældre end vinduet ignoreres.
+   * @param t Tidspunkt i sekunder
+   * @param value Samplens værdi
+   */
+  void add(uint32_t t, int32_t value) {
+    uint32_t start = t - t % resolution_;
+    if (empty_) {
+      newestStart_ = start;
+      newestIndex_ = 0;
+      empty_ = false;
+    } else if (start > newestStart_) {
+      advance(start);
+    }
+    int32_t index = indexOf(start);
+    if (index < 0) {
+      return;
+    }
+    RollupBucket* bucket = &buckets_[index];
+    if (bucket->count == 0) {
+      bucket->min = value;
+      bucket->max = value;
+    } else {
+      if (value < bucket->min) bucket->min = value;
+      if (value > bucket->max) bucket->max = value;
+    }
+    bucket->sum += value;
+    bucket->count++;
+  }
+
+  /**
+   * @brief Henter spanden der dækker tidspunktet t.
+   * @param t Tidspunkt i sekunder
+   * @param out Modtager spanden (count == 0 hvis ingen samples)
+   * @return False hvis t ligger uden for vinduet.
+   */
+  bool at(uint32_t t, RollupBucket& out) const {
+    uint32_t start = t - t % resolution_;
+    int32_t index = indexOf(start);
+    if (index < 0) {
+      return false;
+    }
+    out = buckets_[index];
+    return true;
+  }
+
+  /** @brief Om niveauet endnu ikke har modtaget samples. */
+  bool empty() const { return empty_; }
+
+  /** @brief Starttid for nyeste spand (s). */
+  uint32_t newestStart() const { return newestStart_; }
+
+  /** @brief Starttid for ældste spand i vinduet (s). */
+  uint32_t oldestStart() const {
+    uint32_t span = (uint32_t)(N - 1) * resolution_;
+    return newestStart_ > span ? newestStart_ - span : 0;
+  }
+
+  /** @brief Spandenes længde (s). */
+  uint32_t resolution() const { return resolution_; }
+
+  /** @brief Antal spande i vinduet. */
+  static constexpr size_t size() { return N; }
+
+private:
+  /**
+   * @brief Rykker vinduet frem til start og rydder de spande der genbruges.
+   */
+  void advance(uint32_t start) {
+    uint32_t steps = (start - newestStart_) / resolution_;
+    if (steps >= N) {
+      clear();
+      empty_ = false;
+    } else {
+      for (uint32_t i = 0; i < steps; i++) {
+        newestIndex_ = (newestIndex_ + 1) % N;
+        buckets_[newestIndex_] = RollupBucket{0, 0, 0, 0};
+      }
+    }
+    newestStart_ = start;
+  }
+
+  /**
+   * @brief Finder indekset for spanden der starter ved start, eller -1 uden for vinduet.
+   */
+  int32_t indexOf(uint32_t start) const {
+    if (empty_ || start > newestStart_) {
+      return -1;
+    }
+    uint32_t back = (newestStart_ - start) / resolution_;
+    if (back >= N) {
+      return -1;
+    }
+    return (newestIndex_ + N - back) % N;
+  }
+
+  RollupBucket buckets_[N];
+  uint32_t resolution_;
+  uint32_t newestStart_;
+  uint32_t newestIndex_;
+  bool empty_;
+};
+
+/**
+ * @brief Samler sekund-, minut-, time- og dagsniveauerne.
+ *
+ * Med 24-byte spande fylder det hele ca. 50 KB RAM. Minutniveauet dækker
+ * 24 timer, så den typiske dashboard-forespørgsel aldrig rører flash.
+ */
+class Rollup {
+public:
+  static const size_t kSecondBuckets = 120;  ///< 2 minutter i sekundopløsning
+  static const size_t kMinuteBuckets = 1440; ///< 24 timer i minutopløsning
+  static const size_t kHourBuckets = 168;    ///< 7 dage i timeopløsning
+  static const size_t kDayBuckets = 366;     ///< 1 år i dagsopløsning
+
+  /**
+   * @brief Lægger en sample i alle niveauer.
+   * @param t Tidspunkt i sekunder
+   * @param value Samplens værdi
+   */
+  void add(uint32_t t, int32_t value) {
+    seconds.add(t, value);
+    minutes.add(t, value);
+    hours.add(t, value);
+    days.add(t, value);
+  }
+
+  /** @brief Tømmer alle niveauer. */
+  void clear() {
+    seconds.clear();
+    minutes.clear();
+    hours.clear();
+    days.clear();
+  }
+
+  RollupTier<kSecondBuckets> seconds{1};   ///< Sekundniveau
+  RollupTier<kMinuteBuckets> minutes{60};  ///< Minutniveau
+  RollupTier<kHourBuckets> hours{3600};    ///< Timeniveau, gemmes på flash
+  RollupTier<kDayBuckets> days{86400};     ///< Dagsniveau, gemmes på flash
+};
@@ -0,0 +1,133 @@
+/**
+ * @file rule_engine.h
+ * @brief Alarmregler der evalueres løbende på målingerne.
+ *
+ * Reglerne (RuleConfig i config_record.h) evalueres inkrementelt: hver
+ * prøve for en kanal opdaterer de regler der gælder kanalen, med en fast
+ * tilstand pr. regel og uden heap. update() returnerer hvilke regler der
+ * er slået til eller fra, så kalderen kan udføre handlingerne.
+ *
+ * - RULE_POWER_ABOVE slår til når effekten har været over tærsklen i holdS
+ *   sekunder i træk, og fra så snart den ikke er det.
+ * - RULE_NO_PULSES slår til når tælleren ikke har ændret sig i holdS
+ *   sekunder, og fra ved næste puls. Giver kun mening ved pulsmåling.
+ * - RULE_DAILY_ENERGY slår til når energien siden døgnets start (UTC)
+ *   overstiger tærsklen, og fra ved næste døgn. Døgnets startværdi holdes
+ *   kun i RAM, så efter en genstart tælles fra opstarten. Reglen venter
+ *   til uret er synkroniseret.
+ *
+ * Ingen låsning og ingen Arduino-afhængigheder; kaldes fra én task.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "config_record.h"
+
+const size_t kRuleTextMaxBytes = 48;       ///< Længste regel som tekst fra formatRule()
+const uint32_t kRuleMaxHoldS = 30 * 86400; ///< Længste ventetid, så tidsforskelle i ms ikke løber rundt
+
+/**
+ * @brief Én prøve for én kanal.
+ */
+struct RuleSample {
+  uint32_t nowMs;    ///< Nuværende tid (ms)
+  uint32_t day;      ///< Døgnnummer (Unix-tid / 86400), 0 = uret er ikke sat
+  uint8_t channel;   ///< Kanal
+  uint32_t counter;  ///< Pulstæller
+  uint32_t energyWh; ///< Akkumuleret energi (Wh)
+  int32_t powerW;    ///< Effekt (W)
+};
+
+/**
+ * @brief Evaluerer op til kConfigMaxRules regler.
+ */
+class RuleEngine {
+public:
+  /**
+   * @brief Indlæser reglerne og nulstiller al tilstand.
+   * @param rules Reglerne; RULE_OFF og ukendte typer springes over
+   * @param count Antal regler, højst kConfigMaxRules
+   */
+  void configure(const RuleConfig* rules, size_t count);
+
+  /**
+   * @brief Evaluerer de regler der gælder prøvens kanal.
+   * @param sample Prøven
+   * @return Bit i for hver regel i der er slået til eller fra.
+   */
+  uint32_t update(const RuleSample& sample);
+
+  /** @brief Antal regler, inklusive RULE_OFF. */
+  size_t count() const { return count_; }
+
+  /** @brief Regel nummer i. */
+  const RuleConfig& rule(size_t i) const { return rules_[i]; }
+
+  /** @brief Bit i sat for hver aktiv regel i. */
+  uint32_t activeMask() const { return active_; }
+
+  /**
+   * @brief Regler med mindst én af handlingerne.
+   * @param actions RuleAction-bits
+   */
+  uint32_t actionMask(uint8_t actions) const;
+
+  /**
+   * @brief Værdien der fik regel i til at skifte sidst.
+   *
+   * Effekt (W), sekunder uden pulser eller døgnets energi (Wh).
+   */
+  int32_t value(size_t i) const { return state_[i].value; }
+
+private:
+  /**
+   * @brief Tilstand pr. regel.
+   */
+  struct RuleState {
+    uint32_t sinceMs = 0;   ///< Hvornår betingelsen begyndte at holde
+    uint32_t reference = 0; ///< Seneste tæller eller døgnets startenergi
+    uint32_t day = 0;       ///< Døgnet reference hører til
+    int32_t value = 0;      ///< Se value()
+    bool primed = false;    ///< reference er sat
+    bool pending = false;   ///< Betingelsen holder, men ikke længe nok endnu
+  };
+
+  bool evaluate(const RuleConfig& rule, RuleState& s, bool active, const RuleSample& sample);
+
+  RuleConfig rules_[kConfigMaxRules] = {};
+  RuleState state_[kConfigMaxRules];
+  size_t count_ = 0;
+  uint32_t active_ = 0;
+};
+
+/**
+ * @brief Læser regler fra konfigurationsformularen.
+ *
+ * Reglerne adskilles med ';' eller linjeskift og skrives
+ * "type:kanal:tærskel:sekunder:handlinger", hvor type er power, idle eller
+ * energy, og handlinger er led, event og push adskilt med '+', f.eks.
+ * "power:0:3000:60:led+event;idle:0:0:1800:event;energy:0:12000:0:push".
+ * @param text Teksten
+ * @param rules Modtager reglerne
+ * @param max Plads i rules
+ * @param end Modtager hvor læsningen stoppede: starten af første ugyldige
+ *            regel, første regel ud over max, eller tekstens slutning når
+ *            alle regler er læst. Må være nullptr.
+ * @return Antal læste regler; læsningen stopper ved første ugyldige regel.
+ */
+size_t parseRules(const char* text, RuleConfig* rules, size_t max, const char** end = nullptr);
+
+/**
+ * @brief Skriver en regel i samme format som parseRules() læser.
+ * @param rule Reglen
+ * @param buf Destinationsbuffer, mindst kRuleTextMaxBytes
+ * @param len Bufferens størrelse
+ * @return Tekstens længde, eller 0 hvis bufferen er for lille.
+ */
+size_t formatRule(const RuleConfig& rule, char* buf, size_t len);
+
+/** @brief Navnet på en regeltype i teksten, f.eks. "power". */
+const char* ruleKindName(uint8_t kind);
@@ -0,0 +1,76 @@
+/**
+ * @file spsc_ring.h
+ * @brief Låsefri single-producer/single-consumer ringbuffer.
+ *
+ * Bufferen deles mellem præcis én producent (f.eks. sample-timeren) og én
+ * forbruger (f.eks. loop()). Der bruges ingen låse og ingen heap; indeks er
+ * frit løbende 32-bit tællere, så kapaciteten skal være en potens af 2.
+ * Header-only og uden Arduino-afhængigheder, så den kan testes på en host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @brief Ringbuffer med fast kapacitet for én producent og én forbruger.
+ * @tparam T Elementtype (kopieres ind og ud)
+ * @tparam N Kapacitet, skal være en potens af 2
+ */
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+  /**
+   * @brief Lægger et element i bufferen (kun producenten må kalde).
+   * @param item Elementet der skal gemmes
+   * @return False hvis bufferen er fuld; elementet tabes og overflow tælles op.
+   */
+  bool push(const T& item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail >= N) {
+      overflows_.store(overflows_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    slots_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Henter det ældste element (kun forbrugeren må kalde).
+   * @param item Modtager elementet
+   * @return False hvis bufferen er tom.
+   */
+  bool pop(T& item) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t head = head_.load(std::memory_order_acquire);
+    if (head == tail) {
+      return false;
+    }
+    item = slots_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @brief Antal elementer der venter lige nu. */
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  /** @brief Kapaciteten af bufferen. */
+  static constexpr size_t capacity() { return N; }
+
+  /** @brief Antal elementer tabt fordi bufferen var fuld. */
+  uint32_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+
+private:
+  T slots_[N];
+  std::atomic<uint32_t> head_{0};      ///< Skrives kun af producenten
+  std::atomic<uint32_t> tail_{0};      ///< Skrives kun af forbrugeren
+  std::atomic<uint32_t> overflows_{0}; ///< Skrives kun af producenten
+};
@@ -0,0 +1,101 @@
+/**
+ * @file static_assets.h
+ * @brief Tabel over forkomprimerede filer med ETag og Content-Type.
+ *
+ * Byggetrinnet (tools/compress_data.py) gemmer hver fil fra data/ som
+ * <navn>.gz. Ved opstart læses de sidste 8 bytes af hver fil (gzip-trailer:
+ * CRC-32 og ukomprimeret længde), som giver en stærk ETag uden at hashe
+ * filen. Tabellen holdes i RAM, så et betinget GET kan besvares med 304
+ * uden at røre flash. Uden Arduino-afhængigheder.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Én forkomprimeret fil.
+ */
+struct StaticAsset {
+  char path[32]; ///< URL-sti uden ".gz", f.eks. "/index.html"
+  char etag[20]; ///< Stærk ETag inkl. anførselstegn
+};
+
+/**
+ * @brief Fast tabel over forkomprimerede filer.
+ */
+class StaticAssetTable {
+public:
+  static const size_t kMaxAssets = 12; ///< Plads til filer i data/
+  static const size_t kTrailerSize = 8; ///< CRC-32 + ISIZE i slutningen af en gzip-fil
+
+  /**
+   * @brief Tilføjer en fil ud fra dens gzip-trailer.
+   * @param gzPath Stien til .gz-filen
+   * @param trailer De sidste 8 bytes af filen
+   * @return False hvis tabellen er fuld, stien for lang eller ikke ender på ".gz".
+   */
+  bool add(const char* gzPath, const uint8_t trailer[kTrailerSize]) {
+    size_t len = strlen(gzPath);
+    if (count_ >= kMaxAssets || len < 4 || len - 3 >= sizeof(assets_[0].path) ||
+        strcmp(gzPath + len - 3, ".gz") != 0) {
+      return false;
+    }
+    StaticAsset& asset = assets_[count_++];
+    memcpy(asset.path, gzPath, len - 3);
+    asset.path[len - 3] = '\0';
+    uint32_t crc = readU32(trailer);
+    uint32_t size = readU32(trailer + 4);
+    snprintf(asset.etag, sizeof(asset.etag), "\"%08lx-%lx\"", (unsigned long)crc, (unsigned long)size);
+    return true;
+  }
+
+  /**
+   * @brief Finder en fil ud fra URL-stien.
+   * @param path URL-sti, f.eks. "/style.css"
+   * @return Filen, eller nullptr hvis den ikke findes komprimeret.
+   */
+  const StaticAsset* find(const char* path) const {
+    for (size_t i = 0; i < count_; i++) {
+      if (strcmp(assets_[i].path, path) == 0) {
+        return &assets_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  /** @brief Antal filer i tabellen. */
+  size_t size() const { return count_; }
+
+  /** @brief Tømmer tabellen. */
+  void clear() { count_ = 0; }
+
+  /**
+   * @brief Content-Type ud fra filendelsen.
+   * @param path Stien
+   */
+  static const char* contentType(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if (dot == nullptr) return "application/octet-stream";
+    if (strcmp(dot, ".html") == 0) return "text/html";
+    if (strcmp(dot, ".css") == 0) return "text/css";
+    if (strcmp(dot, ".js") == 0) return "application/javascript";
+    if (strcmp(dot, ".json") == 0) return "application/json";
+    if (strcmp(dot, ".png") == 0) return "image/png";
+    if (strcmp(dot, ".ico") == 0) return "image/x-icon";
+    if (strcmp(dot, ".svg") == 0) return "image/svg+xml";
+    return "application/octet-stream";
+  }
+
+private:
+  /** @brief Læser en little-endian uint32. */
+  static uint32_t readU32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  StaticAsset assets_[kMaxAssets]; ///< Fundne filer
+  size_t count_ = 0;               ///< Antal brugte pladser
+};
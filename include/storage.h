@@ -0,0 +1,118 @@
+/**
+ * @file storage.h
+ * @brief Udskifteligt lager for firmwarens filer.
+ *
+ * Storage dækker de få operationer firmwaren bruger: append, læsning fra en
+ * position, udskiftning af en hel fil, omdøbning og sletning. Filer holdes
+ * i én flad mappe med stier som "/log.bin". På enheden findes SPIFFS og
+ * LittleFS (FsStorage i main.cpp); RamStorage og StdioStorage kan også
+ * bruges på en host til benchmarks (se storage_bench.h).
+ *
+ * Læsning sker gennem en StorageReader, så et streamet svar kan holde
+ * filen åben mellem læsningerne i stedet for at åbne den pr. bid.
+ * Uden Arduino-afhængigheder.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+/**
+ * @brief Åbent læsehåndtag til én fil.
+ */
+class StorageReader {
+public:
+  virtual ~StorageReader() {}
+
+  /** @brief Filens størrelse da den blev åbnet, eller senere hvis backenden ser appends. */
+  virtual uint32_t size() = 0;
+
+  /**
+   * @brief Læser bytes fra en given position.
+   * @param offset Position i filen
+   * @param buf Modtager bytes
+   * @param len Antal bytes
+   * @return Antal læste bytes; 0 ved filens slutning eller fejl.
+   */
+  virtual size_t readAt(uint32_t offset, uint8_t* buf, size_t len) = 0;
+};
+
+/**
+ * @brief Kaldes én gang pr. fil af Storage::list().
+ * @param ctx Kalderens kontekst
+ * @param path Filens sti
+ * @param size Filens størrelse
+ */
+typedef void (*StorageListFn)(void* ctx, const char* path, uint32_t size);
+
+/**
+ * @brief Et filsystem firmwaren kan gemme på.
+ */
+class Storage {
+public:
+  virtual ~Storage() {}
+
+  /** @brief Backendens navn, f.eks. "spiffs". */
+  virtual const char* name() const = 0;
+
+  /**
+   * @brief Monterer lageret.
+   * @param formatOnFail Formatér hvis lageret ikke kan monteres
+   * @return True hvis lageret er klar.
+   */
+  virtual bool mount(bool formatOnFail) = 0;
+
+  /** @brief Sletter alle filer. */
+  virtual bool format() = 0;
+
+  /** @brief Lagerets kapacitet i bytes. */
+  virtual uint32_t totalBytes() = 0;
+
+  /** @brief Brugte bytes. */
+  virtual uint32_t usedBytes() = 0;
+
+  /** @brief Om filen findes. */
+  virtual bool exists(const char* path) = 0;
+
+  /** @brief Sletter en fil; false hvis den ikke fandtes eller ikke kunne slettes. */
+  virtual bool remove(const char* path) = 0;
+
+  /** @brief Omdøber en fil; en eksisterende fil med det nye navn erstattes. */
+  virtual bool rename(const char* from, const char* to) = 0;
+
+  /**
+   * @brief Tilføjer bytes sidst i en fil, som oprettes hvis den ikke findes.
+   * @return Antal skrevne bytes.
+   */
+  virtual size_t append(const char* path, const uint8_t* data, size_t len) = 0;
+
+  /**
+   * @brief Erstatter hele filens indhold.
+   * @return Antal skrevne bytes.
+   */
+  virtual size_t write(const char* path, const uint8_t* data, size_t len) = 0;
+
+  /**
+   * @brief Åbner en fil til læsning.
+   * @return Håndtaget, eller nullptr hvis filen ikke findes.
+   */
+  virtual std::unique_ptr<StorageReader> open(const char* path) = 0;
+
+  /**
+   * @brief Kalder fn for hver fil i lageret.
+   * @param fn Funktion der kaldes pr. fil
+   * @param ctx Sendes videre til fn
+   */
+  virtual void list(StorageListFn fn, void* ctx) = 0;
+
+  /**
+   * @brief Læser en hel lille fil eller dens første len bytes.
+   * @return Antal læste bytes; 0 hvis filen ikke findes.
+   */
+  size_t read(const char* path, uint8_t* buf, size_t len) {
+    std::unique_ptr<StorageReader> reader = open(path);
+    return reader ? reader->readAt(0, buf, len) : 0;
+  }
+};
@@ -0,0 +1,60 @@
+/**
+ * @file storage_bench.h
+ * @brief Måling af et lagers append-latens og læsehastighed ved forskellig fyldning.
+ *
+ * For hver fyldningsgrad fyldes lageret med en ballastfil til den ønskede
+ * procent, hvorefter der appendes kStorageBenchAppends bidder af samme
+ * størrelse som en commit fra logskriveren, og filen læses sekventielt.
+ * Ballast og testfil slettes bagefter. Fejlede appends tælles, så et lager
+ * der ikke kan skrive tæt på fuldt, kan ses i resultatet. Uden Arduino-
+ * afhængigheder, så samme måling kan køres på enheden og på en host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "storage.h"
+
+const size_t kStorageBenchAppends = 32;      ///< Appends pr. fyldningsgrad
+const size_t kStorageBenchAppendBytes = 384; ///< Bytes pr. append (32 logposter)
+const size_t kStorageBenchReadBytes = 1024;  ///< Bytes pr. læsning
+const char* const kStorageBenchDataPath = "/bench.dat";   ///< Testfil
+const char* const kStorageBenchFillPath = "/bench.fill";  ///< Ballastfil
+
+/**
+ * @brief Resultat for én fyldningsgrad.
+ */
+struct StorageBenchResult {
+  uint8_t fillPercent;   ///< Ønsket fyldning før målingen
+  uint8_t usedPercent;   ///< Faktisk fyldning før målingen
+  uint16_t failures;     ///< Appends der ikke blev skrevet helt
+  uint32_t appendP50Us;  ///< Median append-latens
+  uint32_t appendP90Us;  ///< 90%-fraktil
+  uint32_t appendP99Us;  ///< 99%-fraktil
+  uint32_t appendMaxUs;  ///< Største append-latens
+  uint32_t readKBps;     ///< Sekventiel læsning (KiB/s)
+};
+
+/**
+ * @brief Kører målingen for en række fyldningsgrader.
+ * @param storage Lageret; må ikke bruges af andre imens
+ * @param clockUs Mikrosekundur
+ * @param fills Fyldningsgrader i procent, f.eks. {0, 50, 90, 99}
+ * @param count Antal fyldningsgrader og pladser i results
+ * @param results Modtager ét resultat pr. fyldningsgrad
+ */
+void storageBench(Storage& storage, uint32_t (*clockUs)(), const uint8_t* fills, size_t count,
+                  StorageBenchResult* results);
+
+/**
+ * @brief Formaterer resultaterne som JSON.
+ * @param name Lagerets navn
+ * @param results Resultaterne
+ * @param count Antal resultater
+ * @param buf Destinationsbuffer
+ * @param len Bufferens størrelse
+ * @return Antal skrevne tegn (uden nul-terminering); afkortes ved for lille buffer.
+ */
+size_t storageBenchJson(const char* name, const StorageBenchResult* results, size_t count, char* buf, size_t len);
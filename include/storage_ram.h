@@ -0,0 +1,45 @@
+/**
+ * @file storage_ram.h
+ * @brief Lager i RAM med fast kapacitet, til host-benchmarks og tests.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "storage.h"
+
+/**
+ * @brief Storage der holder alle filer i RAM.
+ *
+ * Kapaciteten tælles i databytes, så fyldningsgraden opfører sig som på
+ * flash; append og write fejler når den er opbrugt. Læsehåndtag ser
+ * senere appends, som på SPIFFS og LittleFS.
+ */
+class RamStorage : public Storage {
+public:
+  /** @param capacity Kapacitet i bytes */
+  explicit RamStorage(uint32_t capacity) : capacity_(capacity) {}
+
+  const char* name() const override { return "ram"; }
+  bool mount(bool) override { return true; }
+  bool format() override;
+  uint32_t totalBytes() override { return capacity_; }
+  uint32_t usedBytes() override { return used_; }
+  bool exists(const char* path) override;
+  bool remove(const char* path) override;
+  bool rename(const char* from, const char* to) override;
+  size_t append(const char* path, const uint8_t* data, size_t len) override;
+  size_t write(const char* path, const uint8_t* data, size_t len) override;
+  std::unique_ptr<StorageReader> open(const char* path) override;
+  void list(StorageListFn fn, void* ctx) override;
+
+private:
+  typedef std::vector<uint8_t> Data;
+
+  uint32_t capacity_;
+  uint32_t used_ = 0;
+  std::map<std::string, std::shared_ptr<Data>> files_;
+};
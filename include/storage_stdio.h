@@ -0,0 +1,49 @@
+/**
+ * @file storage_stdio.h
+ * @brief Lager som almindelige filer i én mappe via stdio.
+ *
+ * Bruges på en host, hvor mappen ligger på PC'ens disk, men virker også på
+ * ESP32 over en VFS-monteret partition (f.eks. "/spiffs").
+ */
+
+#pragma once
+
+#include <string>
+
+#include "storage.h"
+
+/**
+ * @brief Storage der gemmer hver fil som root + sti.
+ *
+ * Kapaciteten er et loft kalderen vælger; brugte bytes er summen af
+ * filernes størrelse, talt op ved mount() og derefter holdt ajour.
+ */
+class StdioStorage : public Storage {
+public:
+  /**
+   * @param root Eksisterende mappe, uden afsluttende '/'
+   * @param capacity Kapacitet i bytes
+   */
+  StdioStorage(const char* root, uint32_t capacity) : root_(root), capacity_(capacity) {}
+
+  const char* name() const override { return "stdio"; }
+  bool mount(bool formatOnFail) override;
+  bool format() override;
+  uint32_t totalBytes() override { return capacity_; }
+  uint32_t usedBytes() override { return used_; }
+  bool exists(const char* path) override;
+  bool remove(const char* path) override;
+  bool rename(const char* from, const char* to) override;
+  size_t append(const char* path, const uint8_t* data, size_t len) override;
+  size_t write(const char* path, const uint8_t* data, size_t len) override;
+  std::unique_ptr<StorageReader> open(const char* path) override;
+  void list(StorageListFn fn, void* ctx) override;
+
+private:
+  std::string fullPath(const char* path) const { return root_ + path; }
+  size_t put(const char* path, const char* mode, const uint8_t* data, size_t len);
+
+  std::string root_;
+  uint32_t capacity_;
+  uint32_t used_ = 0;
+};
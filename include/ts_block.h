@@ -0,0 +1,143 @@
+/**
+ * @file ts_block.h
+ * @brief Komprimeret blokformat for logposter (delta-of-delta og zig-zag varint).
+ *
+ * En blok består af en header på 20 bytes efterfulgt af en komprimeret
+ * payload:
+ * | Offset | Størrelse | Felt                                          |
+ * |--------|-----------|-----------------------------------------------|
+ * | 0      | 2         | Magic (kTsBlockMagic)                         |
+ * | 2      | 1         | Version (kTsBlockVersion)                     |
+ * | 3      | 1         | Flag, reserveret (0)                          |
+ * | 4      | 2         | Antal poster                                  |
+ * | 6      | 2         | Payloadens længde i bytes                     |
+ * | 8      | 4         | Mindste tid i blokken (s)                     |
+ * | 12     | 4         | Største tid i blokken (s)                     |
+ * | 16     | 4         | CRC-32 over payload                           |
+ *
+ * Min/max-tid gør det muligt at springe en blok over uden at dekomprimere
+ * den. Hver post i payloaden kodes som:
+ * - tid i ms: første post som varint, resten som zig-zag delta-of-delta
+ *   (forrige delta er 0 ved blokstart; typisk 1 byte for periodiske poster)
+ * - (kanal << 8 | type) som varint
+ * - værdi som zig-zag delta mod forrige værdi af samme type
+ *
+ * Poster skal tilføjes i ikke-aftagende tidsorden. Uden Arduino-
+ * afhængigheder, så formatet kan benchmarkes på en host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "log_format.h"
+
+const uint16_t kTsBlockMagic = 0x4254;    ///< "TB" little-endian
+const uint8_t kTsBlockVersion = 1;        ///< Aktuel version
+const size_t kTsBlockHeaderSize = 20;     ///< Bytes før payloaden
+const size_t kTsBlockMaxPayload = 2048;   ///< Største payload pr. blok
+const uint16_t kTsBlockMaxRecords = 512;  ///< Største antal poster pr. blok
+const size_t kTsRecordMaxEncoded = 10 + 3 + 5; ///< Værste fald for én post: tid, kanal/type, værdi (bytes)
+
+/**
+ * @brief Afkodet blokheader.
+ */
+struct TsBlockHeader {
+  uint16_t count;        ///< Antal poster
+  uint16_t payloadBytes; ///< Payloadens længde
+  uint32_t minTime;      ///< Mindste tid (s)
+  uint32_t maxTime;      ///< Største tid (s)
+  uint32_t crc;          ///< CRC-32 over payload
+};
+
+/**
+ * @brief Læser en blokheader.
+ * @param buf kTsBlockHeaderSize bytes
+ * @param header Modtager headeren
+ * @return False hvis magic, version eller længder er ugyldige.
+ */
+bool tsBlockReadHeader(const uint8_t* buf, TsBlockHeader& header);
+
+/**
+ * @brief Bygger én blok op post for post.
+ */
+class TsBlockEncoder {
+public:
+  TsBlockEncoder() { reset(); }
+
+  /** @brief Starter en ny, tom blok. */
+  void reset();
+
+  /**
+   * @brief Tilføjer en post.
+   * @param record Posten; tiden må ikke være mindre end forrige posts
+   * @return False hvis blokken er fuld; posten er da ikke tilføjet.
+   */
+  bool add(const LogRecord& record);
+
+  /** @brief Antal poster i blokken. */
+  uint16_t count() const { return count_; }
+
+  /** @brief Bytes blokken fylder når den forsegles. */
+  size_t sealedSize() const { return kTsBlockHeaderSize + len_; }
+
+  /**
+   * @brief Skriver header og payload.
+   * @param buf Modtager sealedSize() bytes
+   * @return Antal skrevne bytes; 0 hvis blokken er tom.
+   */
+  size_t seal(uint8_t* buf) const;
+
+private:
+  uint8_t payload_[kTsBlockMaxPayload];
+  size_t len_;
+  uint16_t count_;
+  uint64_t lastMs_;
+  int64_t lastDelta_;
+  int32_t lastValue_[8]; ///< Forrige værdi pr. type (type & 7)
+  uint32_t minTime_;
+  uint32_t maxTime_;
+};
+
+/**
+ * @brief Afkoder posterne i én blok.
+ */
+class TsBlockDecoder {
+public:
+  /**
+   * @param header Blokkens header
+   * @param payload Blokkens payload (header.payloadBytes bytes)
+   */
+  TsBlockDecoder(const TsBlockHeader& header, const uint8_t* payload);
+
+  /** @brief Tom dekoder uden poster. */
+  TsBlockDecoder();
+
+  /**
+   * @brief Afkoder næste post.
+   * @param record Modtager posten
+   * @return False når blokken er slut eller payloaden er ødelagt.
+   */
+  bool next(LogRecord& record);
+
+  /** @brief Poster der endnu ikke er afkodet. */
+  uint16_t remaining() const { return remaining_; }
+
+private:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  uint16_t index_;
+  uint16_t remaining_;
+  uint64_t lastMs_;
+  int64_t lastDelta_;
+  int32_t lastValue_[8];
+};
+
+/**
+ * @brief Tjekker payloadens CRC.
+ * @param header Blokkens header
+ * @param payload Blokkens payload
+ * @return True hvis CRC'en passer.
+ */
+bool tsBlockVerify(const TsBlockHeader& header, const uint8_t* payload);
@@ -0,0 +1,167 @@
+/**
+ * @file wifi_connector.h
+ * @brief Ikke-blokerende tilstandsmaskine for Wi-Fi-forbindelsen.
+ *
+ * Maskinen fodres med hændelser (forbundet/afbrudt) og kaldes periodisk med
+ * poll(); den returnerer hvad kalderen skal gøre, men rører ikke selv Wi-Fi,
+ * så den kan køres på en host. Mislykkede forsøg giver eksponentiel backoff
+ * mellem minBackoffMs og maxBackoffMs. Access point til ny konfiguration
+ * startes straks når der ingen konfiguration er, og ellers kun hvis enheden
+ * aldrig har været forbundet og apAfterFailures forsøg i træk er slået fejl.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Forbindelsens tilstand.
+ */
+enum WifiState : uint8_t {
+  WIFI_STATE_UNCONFIGURED = 0, ///< Intet SSID gemt, kun access point
+  WIFI_STATE_CONNECTING = 1,   ///< Venter på IP efter et forsøg
+  WIFI_STATE_CONNECTED = 2,    ///< Har IP-adresse
+  WIFI_STATE_BACKOFF = 3,      ///< Venter før næste forsøg
+};
+
+/**
+ * @brief Handling kalderen skal udføre.
+ */
+enum WifiAction : uint8_t {
+  WIFI_ACTION_NONE = 0,     ///< Intet at gøre
+  WIFI_ACTION_CONNECT = 1,  ///< Start et nyt forbindelsesforsøg
+  WIFI_ACTION_START_AP = 2, ///< Start access point til konfiguration
+};
+
+/**
+ * @brief Tilstandsmaskine med backoff og forsinket access point.
+ */
+class WifiConnector {
+public:
+  /**
+   * @param connectTimeoutMs Tid et forsøg må tage før det regnes som fejlet (ms)
+   * @param minBackoffMs Ventetid efter første fejl (ms)
+   * @param maxBackoffMs Største ventetid mellem forsøg (ms)
+   * @param apAfterFailures Fejl i træk før access point startes, 0 = aldrig
+   */
+  WifiConnector(uint32_t connectTimeoutMs, uint32_t minBackoffMs, uint32_t maxBackoffMs,
+                uint8_t apAfterFailures)
+      : connectTimeoutMs_(connectTimeoutMs), minBackoffMs_(minBackoffMs),
+        maxBackoffMs_(maxBackoffMs), apAfterFailures_(apAfterFailures),
+        backoffMs_(minBackoffMs) {}
+
+  /**
+   * @brief Starter maskinen.
+   * @param configured True hvis der er et SSID at forbinde til
+   * @param nowMs Nuværende tid (ms)
+   * @return WIFI_ACTION_CONNECT, eller WIFI_ACTION_START_AP uden konfiguration.
+   */
+  WifiAction start(bool configured, uint32_t nowMs) {
+    if (!configured) {
+      state_ = WIFI_STATE_UNCONFIGURED;
+      apStarted_ = true;
+      return WIFI_ACTION_START_AP;
+    }
+    return beginAttempt(nowMs);
+  }
+
+  /**
+   * @brief Kaldes når stationen har fået en IP-adresse.
+   * @param nowMs Nuværende tid (ms)
+   */
+  void onConnected(uint32_t nowMs) {
+    if (state_ == WIFI_STATE_UNCONFIGURED) {
+      return;
+    }
+    state_ = WIFI_STATE_CONNECTED;
+    connectedAt_ = nowMs;
+    failures_ = 0;
+    backoffMs_ = minBackoffMs_;
+    everConnected_ = true;
+  }
+
+  /**
+   * @brief Kaldes når forbindelsen er tabt eller et forsøg er afvist.
+   *
+   * Gentagne hændelser under backoff ignoreres.
+   * @param nowMs Nuværende tid (ms)
+   */
+  void onDisconnected(uint32_t nowMs) {
+    if (state_ == WIFI_STATE_CONNECTING || state_ == WIFI_STATE_CONNECTED) {
+      enterBackoff(nowMs);
+    }
+  }
+
+  /**
+   * @brief Driver timeouts og backoff frem.
+   * @param nowMs Nuværende tid (ms)
+   * @return Handling kalderen skal udføre nu.
+   */
+  WifiAction poll(uint32_t nowMs) {
+    if (state_ == WIFI_STATE_CONNECTING && nowMs - attemptAt_ >= connectTimeoutMs_) {
+      enterBackoff(nowMs);
+    }
+    if (apPending_) {
+      apPending_ = false;
+      apStarted_ = true;
+      return WIFI_ACTION_START_AP;
+    }
+    if (state_ == WIFI_STATE_BACKOFF && nowMs - backoffAt_ >= backoffMs_) {
+      backoffMs_ = backoffMs_ >= maxBackoffMs_ / 2 ? maxBackoffMs_ : backoffMs_ * 2;
+      return beginAttempt(nowMs);
+    }
+    return WIFI_ACTION_NONE;
+  }
+
+  /** @brief Aktuel tilstand. */
+  WifiState state() const { return state_; }
+
+  /** @brief Mislykkede forsøg i træk. */
+  uint32_t failures() const { return failures_; }
+
+  /** @brief Antal forsøg siden start. */
+  uint32_t attempts() const { return attempts_; }
+
+  /** @brief Ventetid før næste forsøg (ms). */
+  uint32_t backoffMs() const { return backoffMs_; }
+
+  /** @brief Om access point er startet. */
+  bool apStarted() const { return apStarted_; }
+
+  /** @brief Tidspunkt for seneste forbindelse (ms). */
+  uint32_t connectedAt() const { return connectedAt_; }
+
+private:
+  /** @brief Starter et nyt forsøg. */
+  WifiAction beginAttempt(uint32_t nowMs) {
+    state_ = WIFI_STATE_CONNECTING;
+    attemptAt_ = nowMs;
+    attempts_++;
+    return WIFI_ACTION_CONNECT;
+  }
+
+  /** @brief Registrerer en fejl og venter backoffMs_ før næste forsøg. */
+  void enterBackoff(uint32_t nowMs) {
+    state_ = WIFI_STATE_BACKOFF;
+    backoffAt_ = nowMs;
+    failures_++;
+    if (!everConnected_ && !apStarted_ && apAfterFailures_ > 0 && failures_ >= apAfterFailures_) {
+      apPending_ = true;
+    }
+  }
+
+  uint32_t connectTimeoutMs_;   ///< Timeout for ét forsøg (ms)
+  uint32_t minBackoffMs_;       ///< Første ventetid (ms)
+  uint32_t maxBackoffMs_;       ///< Største ventetid (ms)
+  uint8_t apAfterFailures_;     ///< Fejl før access point
+  uint32_t backoffMs_;          ///< Næste ventetid (ms)
+  WifiState state_ = WIFI_STATE_UNCONFIGURED;
+  uint32_t attemptAt_ = 0;      ///< Start af aktuelt forsøg (ms)
+  uint32_t backoffAt_ = 0;      ///< Start af aktuel backoff (ms)
+  uint32_t connectedAt_ = 0;    ///< Seneste forbindelse (ms)
+  uint32_t failures_ = 0;       ///< Fejl i træk
+  uint32_t attempts_ = 0;       ///< Forsøg siden start
+  bool everConnected_ = false;  ///< Om der har været forbindelse siden boot
+  bool apStarted_ = false;      ///< Om access point er startet
+  bool apPending_ = false;      ///< Access point skal startes ved næste poll
+};
@@ -0,0 +1,179 @@
+/**
+ * @file ws_broadcaster.h
+ * @brief Coalescende WebSocket-broadcaster med backpressure pr. klient.
+ *
+ * Opdateringer samles i LiveFields og sendes højst én gang pr. tick, og kun
+ * de felter der har ændret sig siden klienten sidst fik en besked. En klient
+ * hvis sendekø er fuld springes over i det tick (ændringerne gemmes til
+ * næste), og en klient der har været fuld for længe lukkes, så én langsom
+ * browser ikke får AsyncTCP-køerne til at løbe over for alle. Hver klient
+ * får enten binære rammer eller tekst, efter hvad den har forhandlet (se
+ * live_protocol.h); beskeder sendes pr. klient frem for med binaryAll(), så
+ * backpressure kan håndteres individuelt.
+ *
+ * Hver udsendelse gemmes også i en LiveHistory. En ny binær klient får en
+ * hello-ramme med opstarts-epoken og de seneste kSnapshotEntries
+ * udsendelser som replay før de aktuelle værdier,
+ * så grafen ikke starter tom, og en klient der genforbinder kan bede om alt
+ * efter sit seneste sekvensnummer med requestReplay(). Replay sendes med
+ * højst kReplayFramesPerTick rammer pr. tick og samme backpressure som
+ * live-rammerne; live-rammer holdes tilbage til klienten har indhentet.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "live_fields.h"
+#include "live_history.h"
+
+/**
+ * @brief Statistik for én WebSocket-klient.
+ */
+struct WsClientStats {
+  uint32_t id = 0;               ///< AsyncWebSocketClient::id(), 0 = ledig plads
+  uint32_t pendingMask = 0;      ///< Felter klienten mangler at få
+  uint32_t sent = 0;             ///< Beskeder sendt til klienten
+  uint32_t coalesced = 0;        ///< Feltopdateringer slået sammen mens klienten ventede
+  uint32_t dropped = 0;          ///< Ticks sprunget over pga. fuld kø
+  uint16_t consecutiveDrops = 0; ///< Ticks i træk med fuld kø
+  bool binary = false;           ///< Klienten har valgt den binære protokol
+  bool hello = false;            ///< Klienten mangler LIVE_FRAME_HELLO
+  bool replaying = false;        ///< Klienten mangler udsendelser efter replayAfter
+  bool resync = false;           ///< Næste replay-ramme skal have LIVE_FLAG_RESYNC
+  uint32_t replayAfter = 0;      ///< Seneste udsendelse klienten har fået som replay
+  uint32_t replayCursor = 0;     ///< Position i LiveHistory for næste replay
+};
+
+/**
+ * @brief Sender LiveFields til alle tilsluttede klienter i et fast tick.
+ */
+class WsBroadcaster {
+public:
+  static const uint8_t kMaxClients = 8; ///< Samme grænse som AsyncWebSocket bruger
+  static const uint8_t kSnapshotEntries = 32;    ///< Udsendelser en ny klient får som replay
+  static const uint8_t kReplayFramesPerTick = 8; ///< Højst så mange replay-rammer pr. klient pr. tick
+
+  /**
+   * @param ws WebSocket-endepunktet
+   * @param tickMs Interval mellem udsendelser (ms)
+   * @param maxConsecutiveDrops Luk klienten efter så mange overspringninger i træk
+   */
+  WsBroadcaster(AsyncWebSocket& ws, uint32_t tickMs, uint16_t maxConsecutiveDrops);
+
+  /** @brief Opdaterer et felt; må kaldes fra alle tasks. */
+  void set(LiveField field, int32_t value);
+
+  /** @brief Seneste værdi af et felt; må kaldes fra alle tasks. */
+  int32_t get(LiveField field) const;
+
+  /**
+   * @brief Registrerer en ny klient.
+   *
+   * Den får alle felter ved næste tick og, hvis den vælger den binære
+   * protokol, først de seneste kSnapshotEntries udsendelser.
+   */
+  void addClient(uint32_t id);
+
+  /**
+   * @brief Sætter opstarts-epoken der sendes i hello-rammen.
+   *
+   * Kaldes én gang ved opstart, før klienter kan forbinde.
+   * @param epoch Tilfældigt tal pr. opstart; 0 er forbeholdt "ukendt" og bliver 1
+   */
+  void setEpoch(uint32_t epoch) { epoch_ = epoch != 0 ? epoch : 1; }
+
+  /**
+   * @brief Beder om replay af alt efter et sekvensnummer.
+   *
+   * Er seq ældre end bufferen, sendes det ældste der er. Er epoken en
+   * anden end enhedens, eller seq nyere end seneste udsendelse, er enheden
+   * genstartet, og der sendes et snapshot med LIVE_FLAG_RESYNC. Begge
+   * tæller som replay misses. Starten findes med LiveHistory::seek() i O(1).
+   * @param id Klientens id
+   * @param epoch Opstarts-epoken klientens seq hører til, 0 = ukendt
+   * @param seq Seneste sekvensnummer klienten har
+   */
+  void requestReplay(uint32_t id, uint32_t epoch, uint32_t seq);
+
+  /**
+   * @brief Vælger protokol for en klient.
+   * @param id Klientens id
+   * @param binary True for binære rammer, false for tekst
+   */
+  void setBinary(uint32_t id, bool binary);
+
+  /** @brief Fjerner en klient. */
+  void removeClient(uint32_t id);
+
+  /**
+   * @brief Sender ventende ændringer hvis tick-intervallet er gået.
+   * @param nowMs Nuværende tid (ms)
+   */
+  void tick(uint32_t nowMs);
+
+  /**
+   * @brief Kopierer id'erne på de registrerede klienter.
+   * @param ids Destination
+   * @param max Plads i ids
+   * @return Antal kopierede id'er.
+   */
+  uint8_t clientIds(uint32_t* ids, uint8_t max);
+
+  /** @brief Samlet antal sendte beskeder. */
+  uint32_t messagesSent() const { return messagesSent_; }
+
+  /** @brief Samlet antal beskeder sprunget over pga. fuld kø. */
+  uint32_t messagesDropped() const { return messagesDropped_; }
+
+  /** @brief Samlet antal replay-forespørgsler fra klienter. */
+  uint32_t replayRequests() const { return replayRequests_; }
+
+  /** @brief Samlet antal sendte replay-rammer, inkl. snapshots. */
+  uint32_t replayFrames() const { return replayFrames_; }
+
+  /** @brief Forespørgsler hvor en del af det ønskede ikke længere var i bufferen. */
+  uint32_t replayMisses() const { return replayMisses_; }
+
+  /** @brief Udsendelser i replay-bufferen. */
+  uint32_t historyEntries() const;
+
+  /** @brief Tidsspænd replay-bufferen dækker (ms). */
+  uint32_t historySpanMs() const;
+
+  /**
+   * @brief Skriver statistik som JSON.
+   * @param buf Destinationsbuffer
+   * @param len Bufferens størrelse
+   * @return Antal skrevne tegn.
+   */
+  size_t statsJson(char* buf, size_t len);
+
+private:
+  /**
+   * @brief Sender op til kReplayFramesPerTick replay-rammer til en klient.
+   * @return True hvis klienten stadig mangler replay efter kaldet.
+   */
+  bool sendReplay(uint8_t slot, uint32_t id, AsyncWebSocketClient* client);
+
+  /** @brief Sender LIVE_FRAME_HELLO til en klient. */
+  void sendHello(uint8_t slot, uint32_t id, AsyncWebSocketClient* client, uint32_t seq, uint32_t nowMs);
+
+  AsyncWebSocket& ws_;
+  uint32_t tickMs_;
+  uint16_t maxConsecutiveDrops_;
+  uint32_t lastTick_ = 0;
+  uint32_t seq_ = 0;          ///< Sekvensnummer for seneste udsendelse
+  uint32_t epoch_ = 1;        ///< Opstarts-epoke, se setEpoch()
+  LiveFields fields_;
+  LiveHistory history_;       ///< Seneste udsendelser til snapshot og replay
+  WsClientStats clients_[kMaxClients];
+  uint32_t messagesSent_ = 0;
+  uint32_t messagesDropped_ = 0;
+  uint32_t clientsClosed_ = 0;
+  uint32_t replayRequests_ = 0;
+  uint32_t replayFrames_ = 0;
+  uint32_t replayMisses_ = 0;
+  mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,165 @@
+/**
+ * @file checkpoint_journal.cpp
+ * @brief Kodning, skrivning og gendannelse af checkpoints.
+ */
+
+#include "checkpoint_journal.h"
+
+#include <string.h>
+
+#include "crc32.h"
+
+const size_t kCheckpointCrcOffset = 104; ///< CRC'en dækker bytes før denne
+
+static inline void putU32(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline uint32_t getU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void checkpointEncode(const Checkpoint& checkpoint, uint8_t* slot) {
+  memset(slot, 0xFF, kCheckpointSlotSize);
+  putU32(slot, kCheckpointMagic);
+  putU32(slot + 4, checkpoint.sequence);
+  for (size_t ch = 0; ch < kCheckpointChannels; ch++) {
+    putU32(slot + 8 + 4 * ch, checkpoint.counters[ch]);
+    putU32(slot + 40 + 8 * ch, (uint32_t)checkpoint.energyUwh[ch]);
+    putU32(slot + 44 + 8 * ch, (uint32_t)(checkpoint.energyUwh[ch] >> 32));
+  }
+  putU32(slot + kCheckpointCrcOffset, crc32(slot, kCheckpointCrcOffset));
+}
+
+bool checkpointDecode(const uint8_t* slot, Checkpoint& checkpoint) {
+  if (getU32(slot) != kCheckpointMagic ||
+      getU32(slot + kCheckpointCrcOffset) != crc32(slot, kCheckpointCrcOffset)) {
+    return false;
+  }
+  checkpoint.sequence = getU32(slot + 4);
+  for (size_t ch = 0; ch < kCheckpointChannels; ch++) {
+    checkpoint.counters[ch] = getU32(slot + 8 + 4 * ch);
+    checkpoint.energyUwh[ch] = getU32(slot + 40 + 8 * ch) | ((uint64_t)getU32(slot + 44 + 8 * ch) << 32);
+  }
+  return true;
+}
+
+CheckpointJournal::CheckpointJournal(FlashRegion& flash)
+  : flash_(flash), sectors_(flash.size() / flash.sectorSize()),
+    slotsPerSector_(flash.sectorSize() / kCheckpointSlotSize) {}
+
+bool CheckpointJournal::readSlot(uint32_t index, uint8_t* buf) {
+  uint32_t sector = index / slotsPerSector_;
+  uint32_t offset = sector * flash_.sectorSize() + (index % slotsPerSector_) * kCheckpointSlotSize;
+  return flash_.read(offset, buf, kCheckpointSlotSize);
+}
+
+bool CheckpointJournal::slotErased(uint32_t index) {
+  uint8_t buf[kCheckpointSlotSize];
+  if (!readSlot(index, buf)) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    if (buf[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CheckpointJournal::recover(Checkpoint& latest) {
+  next_ = 0;
+  sequence_ = 0;
+  if (slots() == 0) {
+    return false;
+  }
+  uint8_t buf[kCheckpointSlotSize];
+  Checkpoint checkpoint;
+
+  // Sektoren med det nyeste første gyldige slot indeholder det nyeste
+  // checkpoint, da slots skrives i rækkefølge. Fejlede skrivningen i slot 0,
+  // fortsatte write() i de næste slots, så led videre til første gyldige.
+  bool found = false;
+  uint32_t newestSector = 0;
+  for (uint32_t sector = 0; sector < sectors_; sector++) {
+    uint32_t first = sector * slotsPerSector_;
+    for (uint32_t index = first; index < first + slotsPerSector_; index++) {
+      stats_.recoveryReads++;
+      if (!readSlot(index, buf)) {
+        continue;
+      }
+      if (checkpointDecode(buf, checkpoint)) {
+        if (!found || checkpoint.sequence > sequence_) {
+          found = true;
+          newestSector = sector;
+          sequence_ = checkpoint.sequence;
+        }
+        break;
+      }
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  // Alle slots i sektoren, da et afbrudt slot kan være sprunget over
+  uint32_t first = newestSector * slotsPerSector_;
+  for (uint32_t index = first; index < first + slotsPerSector_; index++) {
+    stats_.recoveryReads++;
+    if (readSlot(index, buf) && checkpointDecode(buf, checkpoint) && checkpoint.sequence >= sequence_) {
+      latest = checkpoint;
+      sequence_ = checkpoint.sequence;
+      next_ = index + 1;
+    }
+  }
+  next_ %= slots();
+  return true;
+}
+
+bool CheckpointJournal::writeAt(uint32_t index, Checkpoint& checkpoint) {
+  checkpoint.sequence = sequence_ + 1;
+  uint8_t slot[kCheckpointSlotSize];
+  checkpointEncode(checkpoint, slot);
+  uint32_t sector = index / slotsPerSector_;
+  uint32_t offset = sector * flash_.sectorSize() + (index % slotsPerSector_) * kCheckpointSlotSize;
+  if (!flash_.write(offset, slot, sizeof(slot))) {
+    return false;
+  }
+  uint8_t check[kCheckpointSlotSize];
+  if (!flash_.read(offset, check, sizeof(check)) || memcmp(slot, check, sizeof(slot)) != 0) {
+    return false;
+  }
+  sequence_ = checkpoint.sequence;
+  return true;
+}
+
+bool CheckpointJournal::write(Checkpoint& checkpoint) {
+  if (slots() == 0) {
+    return false;
+  }
+  for (int attempt = 0; attempt < 2; attempt++) {
+    uint32_t index = next_;
+    // Et slot der ikke er slettet, er rester af en afbrudt skrivning
+    while (index % slotsPerSector_ != 0 && !slotErased(index)) {
+      stats_.skipped++;
+      index = (index + 1) % slots();
+    }
+    if (index % slotsPerSector_ == 0) {
+      if (!flash_.erase(index / slotsPerSector_)) {
+        stats_.failures++;
+        return false;
+      }
+      stats_.erases++;
+    }
+    next_ = (index + 1) % slots();
+    if (writeAt(index, checkpoint)) {
+      stats_.writes++;
+      return true;
+    }
+    stats_.failures++;
+  }
+  return false;
+}
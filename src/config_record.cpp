@@ -0,0 +1,82 @@
+/**
+ * @file config_record.cpp
+ * @brief Kodning og validering af konfigurationsposten.
+ */
+
+#include "config_record.h"
+
+#include <string.h>
+
+void configDefaults(ConfigData& data) {
+  memset(&data, 0, sizeof(data));
+  data.samplingMode = 0;
+  data.impPerKwh = 1000;
+  data.sampleIntervalUs = 2000;
+  data.logRetentionDays = 0;
+  data.maxPowerW = 20000;
+  // Kanal 0 er den oprindelige sensor; resten er de ledige touch-pins
+  // (GPIO 2 og 4 bruges til LED og reset-knap, GPIO 0 kun efter boot)
+  static const uint8_t pins[kConfigMaxChannels] = {15, 13, 12, 14, 27, 33, 32, 0};
+  data.channelCount = 1;
+  memcpy(data.channelPins, pins, sizeof(pins));
+  data.exportMode = EXPORT_OFF;
+  data.exportIntervalS = 10;
+}
+
+void configEncode(const ConfigData& data, uint32_t sequence, uint8_t* buf) {
+  ConfigHeader header;
+  header.magic = kConfigMagic;
+  header.version = kConfigVersion;
+  header.size = sizeof(ConfigData);
+  header.sequence = sequence;
+  header.crc = crc32(&data, sizeof(data));
+  memcpy(buf, &header, sizeof(header));
+  memcpy(buf + sizeof(header), &data, sizeof(data));
+}
+
+bool configDecode(const uint8_t* buf, size_t len, ConfigData& data, uint32_t& sequence) {
+  ConfigHeader header;
+  if (len < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, buf, sizeof(header));
+  if (header.magic != kConfigMagic || header.version != kConfigVersion ||
+      header.size == 0 || len - sizeof(header) < header.size) {
+    return false;
+  }
+  const uint8_t* payload = buf + sizeof(header);
+  if (crc32(payload, header.size) != header.crc) {
+    return false;
+  }
+  configDefaults(data);
+  memcpy(&data, payload, header.size < sizeof(data) ? header.size : sizeof(data));
+  data.ssid[sizeof(data.ssid) - 1] = '\0';
+  data.pass[sizeof(data.pass) - 1] = '\0';
+  data.ip[sizeof(data.ip) - 1] = '\0';
+  data.gateway[sizeof(data.gateway) - 1] = '\0';
+  data.exportHost[sizeof(data.exportHost) - 1] = '\0';
+  data.exportTopic[sizeof(data.exportTopic) - 1] = '\0';
+  sequence = header.sequence;
+  return true;
+}
+
+void configSetString(char* dst, size_t size, const char* src) {
+  strncpy(dst, src, size - 1);
+  dst[size - 1] = '\0';
+}
+
+bool configChannelPinValid(uint32_t pin) {
+  switch (pin) {
+    case 0: case 12: case 13: case 14: case 15: case 27: case 32: case 33:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint32_t configClamp(long value, uint32_t min, uint32_t max) {
+  if (value <= 0 || (unsigned long)value < min) {
+    return min;
+  }
+  return (unsigned long)value > max ? max : (uint32_t)value;
+}
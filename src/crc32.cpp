@@ -0,0 +1,18 @@
+/**
+ * @file crc32.cpp
+ * @brief Bitvis CRC-32 uden opslagstabel (sparer 1 KB flash/RAM).
+ */
+
+#include "crc32.h"
+
+uint32_t crc32(const void* data, size_t len, uint32_t crc) {
+  const uint8_t* p = (const uint8_t*)data;
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
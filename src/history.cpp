@@ -0,0 +1,191 @@
+/**
+ * @file history.cpp
+ * @brief Implementering af den streamede historik.
+ */
+
+#include "history.h"
+
+#include <stdio.h>
+#include <string.h>
+
+HistoryCursor::HistoryCursor(const Rollup& rollup, uint32_t from, uint32_t to, uint32_t step, HistoryFormat format)
+  : rollup_(rollup), format_(format), from_(from), to_(to) {
+  if (step < 1) {
+    step = 1;
+  }
+  if (step >= rollup.days.resolution()) {
+    tier_ = 3;
+  } else if (step >= rollup.hours.resolution()) {
+    tier_ = 2;
+  } else if (step >= rollup.minutes.resolution()) {
+    tier_ = 1;
+  } else {
+    tier_ = 0;
+  }
+  resolution_ = tier_ == 3 ? rollup.days.resolution()
+              : tier_ == 2 ? rollup.hours.resolution()
+              : tier_ == 1 ? rollup.minutes.resolution()
+              : rollup.seconds.resolution();
+  size_t buckets = tier_ == 3 ? rollup.days.size()
+                 : tier_ == 2 ? rollup.hours.size()
+                 : tier_ == 1 ? rollup.minutes.size()
+                 : rollup.seconds.size();
+  // Et skridt ud over niveauets vindue giver ikke mere med, og i 32 bit
+  // kunne oprundingen løbe over til 0
+  uint64_t span = (uint64_t)resolution_ * buckets;
+  uint64_t rounded = ((uint64_t)step + resolution_ - 1) / resolution_ * resolution_;
+  step_ = (uint32_t)(rounded < span ? rounded : span);
+
+  // Beskær til niveauets buckets, så et fjernt from/to ikke giver skridt
+  // der alle er tomme.
+  uint32_t oldest, newest;
+  if (!window(oldest, newest) || from > to) {
+    cursor_ = 0;
+    end_ = 0;
+    return;
+  }
+  if (from < oldest) {
+    from = oldest;
+  }
+  uint64_t end = (uint64_t)newest + resolution_;
+  if (end > (uint64_t)to + 1) {
+    end = (uint64_t)to + 1;
+  }
+  end_ = end > UINT32_MAX ? UINT32_MAX : (uint32_t)end;
+  cursor_ = from - from % step_;
+}
+
+bool HistoryCursor::bucketAt(uint32_t t, RollupBucket& out) const {
+  switch (tier_) {
+    case 0:  return rollup_.seconds.at(t, out);
+    case 1:  return rollup_.minutes.at(t, out);
+    case 2:  return rollup_.hours.at(t, out);
+    default: return rollup_.days.at(t, out);
+  }
+}
+
+/**
+ * @brief Start af ældste og nyeste bucket i niveauet.
+ * @return False hvis niveauet er tomt.
+ */
+bool HistoryCursor::window(uint32_t& oldest, uint32_t& newest) const {
+  switch (tier_) {
+    case 0:
+      oldest = rollup_.seconds.oldestStart();
+      newest = rollup_.seconds.newestStart();
+      return !rollup_.seconds.empty();
+    case 1:
+      oldest = rollup_.minutes.oldestStart();
+      newest = rollup_.minutes.newestStart();
+      return !rollup_.minutes.empty();
+    case 2:
+      oldest = rollup_.hours.oldestStart();
+      newest = rollup_.hours.newestStart();
+      return !rollup_.hours.empty();
+    default:
+      oldest = rollup_.days.oldestStart();
+      newest = rollup_.days.newestStart();
+      return !rollup_.days.empty();
+  }
+}
+
+/**
+ * @brief Formaterer næste del (header, række eller footer) i piece_.
+ * @param emptySteps Tomme skridt i dette fill(); stopper ved kHistoryMaxEmptySteps
+ * @return False når der ikke er mere at skrive lige nu.
+ */
+bool HistoryCursor::nextPiece(uint32_t& emptySteps) {
+  int n = 0;
+  while (n == 0) {
+    switch (phase_) {
+      case PHASE_HEADER:
+        if (format_ == HISTORY_JSON) {
+          n = snprintf(piece_, sizeof(piece_), "{\"from\":%lu,\"to\":%lu,\"step\":%lu,\"points\":[",
+                       (unsigned long)from_, (unsigned long)to_, (unsigned long)step_);
+        } else {
+          n = snprintf(piece_, sizeof(piece_), "time,sum,min,max,count\n");
+        }
+        phase_ = PHASE_ROWS;
+        break;
+
+      case PHASE_ROWS: {
+        if (cursor_ >= end_) {
+          phase_ = PHASE_FOOTER;
+          break;
+        }
+        if (emptySteps >= kHistoryMaxEmptySteps) {
+          return false;
+        }
+        // Niveauet kan være rykket frem mens svaret streames.
+        uint32_t oldest, newest;
+        window(oldest, newest);
+        if (cursor_ < oldest) {
+          cursor_ = oldest - oldest % step_;
+        }
+        uint64_t stepEnd = (uint64_t)cursor_ + step_;
+        uint32_t last = stepEnd < end_ ? (uint32_t)stepEnd : end_;
+        RollupBucket total = {0, 0, 0, 0};
+        RollupBucket bucket;
+        for (uint32_t t = cursor_; t < last; t += resolution_) {
+          if (!bucketAt(t, bucket) || bucket.count == 0) {
+            continue;
+          }
+          if (total.count == 0 || bucket.min < total.min) total.min = bucket.min;
+          if (total.count == 0 || bucket.max > total.max) total.max = bucket.max;
+          total.sum += bucket.sum;
+          total.count += bucket.count;
+        }
+        uint32_t t = cursor_;
+        cursor_ = stepEnd < end_ ? (uint32_t)stepEnd : end_;
+        if (total.count == 0) {
+          emptySteps++;
+          break;
+        }
+        if (format_ == HISTORY_JSON) {
+          n = snprintf(piece_, sizeof(piece_), "%s[%lu,%lld,%ld,%ld,%lu]",
+                       rows_ > 0 ? "," : "", (unsigned long)t, (long long)total.sum,
+                       (long)total.min, (long)total.max, (unsigned long)total.count);
+        } else {
+          n = snprintf(piece_, sizeof(piece_), "%lu,%lld,%ld,%ld,%lu\n",
+                       (unsigned long)t, (long long)total.sum,
+                       (long)total.min, (long)total.max, (unsigned long)total.count);
+        }
+        rows_++;
+        break;
+      }
+
+      case PHASE_FOOTER:
+        phase_ = PHASE_DONE;
+        if (format_ == HISTORY_JSON) {
+          n = snprintf(piece_, sizeof(piece_), "]}\n");
+        } else {
+          return false;
+        }
+        break;
+
+      case PHASE_DONE:
+        return false;
+    }
+  }
+  pieceLen_ = n;
+  pieceOff_ = 0;
+  return true;
+}
+
+size_t HistoryCursor::fill(uint8_t* buf, size_t len) {
+  size_t written = 0;
+  uint32_t emptySteps = 0;
+  while (written < len) {
+    if (pieceOff_ == pieceLen_ && !nextPiece(emptySteps)) {
+      break;
+    }
+    size_t chunk = pieceLen_ - pieceOff_;
+    if (chunk > len - written) {
+      chunk = len - written;
+    }
+    memcpy(buf + written, piece_ + pieceOff_, chunk);
+    pieceOff_ += chunk;
+    written += chunk;
+  }
+  return written;
+}
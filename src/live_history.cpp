@@ -0,0 +1,95 @@
+/**
+ * @file live_history.cpp
+ * @brief Implementering af ringbufferen med live-udsendelser.
+ */
+
+#include "live_history.h"
+
+void LiveHistory::clear() {
+  head_ = 0;
+  tail_ = 0;
+  count_ = 0;
+}
+
+void LiveHistory::dropOldest() {
+  tail_ += kHeaderWords + __builtin_popcount(word(tail_ + 2));
+  count_--;
+  if (count_ > 0) {
+    oldestSeq_ = word(tail_);
+    oldestTimeMs_ = word(tail_ + 1);
+  }
+}
+
+void LiveHistory::append(uint32_t seq, uint32_t timeMs, uint32_t mask, const int32_t* values) {
+  mask &= (1u << LIVE_FIELD_COUNT) - 1;
+  // Indekset forudsætter sammenhængende sekvensnumre
+  if (count_ > 0 && seq != newestSeq_ + 1) {
+    clear();
+  }
+  uint32_t need = kHeaderWords + __builtin_popcount(mask);
+  while (count_ > 0 && head_ - tail_ + need > kLiveHistoryWords) {
+    dropOldest();
+  }
+  uint32_t pos = head_;
+  index_[seq % kLiveHistoryMaxEntries] = (uint16_t)pos;
+  words_[pos++ % kLiveHistoryWords] = seq;
+  words_[pos++ % kLiveHistoryWords] = timeMs;
+  words_[pos++ % kLiveHistoryWords] = mask;
+  for (uint8_t f = 0; f < LIVE_FIELD_COUNT; f++) {
+    if (mask & LiveFields::bit((LiveField)f)) {
+      words_[pos++ % kLiveHistoryWords] = (uint32_t)values[f];
+    }
+  }
+  head_ = pos;
+  if (count_++ == 0) {
+    oldestSeq_ = seq;
+    oldestTimeMs_ = timeMs;
+  }
+  newestSeq_ = seq;
+  newestTimeMs_ = timeMs;
+}
+
+uint32_t LiveHistory::seek(uint32_t afterSeq) const {
+  if (count_ == 0 || afterSeq < oldestSeq_) {
+    return tail_;
+  }
+  if (afterSeq >= newestSeq_) {
+    return head_;
+  }
+  return position(afterSeq + 1);
+}
+
+bool LiveHistory::next(uint32_t afterSeq, LiveHistoryEntry& entry, uint32_t& cursor) const {
+  // En cursor bag tail_ er smidt ud; en cursor foran head_ er ugyldig
+  uint32_t pos = cursor - tail_ <= head_ - tail_ ? cursor : seek(afterSeq);
+  while (pos != head_) {
+    uint32_t mask = word(pos + 2);
+    if (word(pos) > afterSeq) {
+      entry.seq = word(pos);
+      entry.timeMs = word(pos + 1);
+      entry.mask = mask;
+      uint32_t v = pos + kHeaderWords;
+      for (uint8_t f = 0; f < LIVE_FIELD_COUNT; f++) {
+        entry.values[f] = mask & LiveFields::bit((LiveField)f) ? (int32_t)word(v++) : 0;
+      }
+      cursor = v;
+      return true;
+    }
+    pos += kHeaderWords + __builtin_popcount(mask);
+  }
+  return false;
+}
+
+uint32_t LiveHistory::seqBeforeLast(size_t n, uint32_t* cursor) const {
+  if (count_ == 0) {
+    if (cursor != nullptr) {
+      *cursor = tail_;
+    }
+    return 0;
+  }
+  uint32_t seq = count_ > n ? newestSeq_ - n : oldestSeq_ - 1;
+  if (cursor != nullptr) {
+    *cursor = seek(seq);
+  }
+  return seq;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file live_protocol.cpp
+ * @brief Kodning af live-data i binært format og tekstformat.
+ */
+
+#include "live_protocol.h"
+
+#include <stdio.h>
+
+/**
+ * @brief Navne på felterne i tekstprotokollen, indekseret med LiveField.
+ */
+static const char* const fieldNames[LIVE_CHANNEL_FIELDS] = {
+  "counter",
+  "led",
+  "energy",
+  "power",
+  "vrms",
+  "irms",
+  "pf",
+  "alerts",
+};
+
+/**
+ * @brief Skriver en uint32 som little-endian.
+ */
+static void putU32(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+size_t encodeLiveHello(uint32_t epoch, uint32_t seq, uint32_t timeMs, uint8_t* buf, size_t len) {
+  if (len < kLiveHelloSize || encodeLiveFrame(LIVE_FRAME_HELLO, seq, timeMs, 0, nullptr, buf, len) == 0) {
+    return 0;
+  }
+  putU32(buf + kLiveFrameHeaderSize, epoch);
+  return kLiveHelloSize;
+}
+
+const char* liveFieldName(uint8_t field) {
+  return field < LIVE_FIELD_COUNT ? fieldNames[liveFieldBase(field)] : "unknown";
+}
+
+uint8_t liveFieldWireId(uint8_t field) {
+  return (uint8_t)(liveFieldChannel(field) << 4) | liveFieldBase(field);
+}
+
+size_t encodeLiveFrame(uint8_t type, uint32_t seq, uint32_t timeMs, uint32_t mask,
+                       const int32_t* values, uint8_t* buf, size_t len, uint8_t flags) {
+  if (len < kLiveFrameHeaderSize) {
+    return 0;
+  }
+  size_t used = kLiveFrameHeaderSize;
+  uint8_t count = 0;
+  for (uint8_t f = 0; f < LIVE_FIELD_COUNT; f++) {
+    if (!(mask & LiveFields::bit((LiveField)f))) {
+      continue;
+    }
+    if (used + kLiveFieldSize > len) {
+      return 0;
+    }
+    buf[used] = liveFieldWireId(f);
+    putU32(buf + used + 1, (uint32_t)values[f]);
+    used += kLiveFieldSize;
+    count++;
+  }
+  buf[0] = kLiveProtocolVersion;
+  buf[1] = type;
+  buf[2] = count;
+  buf[3] = flags;
+  putU32(buf + 4, seq);
+  putU32(buf + 8, timeMs);
+  return used;
+}
+
+size_t formatLiveText(uint32_t mask, const int32_t* values, char* buf, size_t len) {
+  size_t used = 0;
+  for (uint8_t f = 0; f < LIVE_FIELD_COUNT; f++) {
+    if (!(mask & LiveFields::bit((LiveField)f))) {
+      continue;
+    }
+    uint8_t channel = liveFieldChannel(f);
+    int n = channel == 0
+      ? snprintf(buf + used, len - used, "%s%s:%ld",
+                 used > 0 ? "\n" : "", fieldNames[f], (long)values[f])
+      : snprintf(buf + used, len - used, "%s%s.%u:%ld",
+                 used > 0 ? "\n" : "", liveFieldName(f), channel, (long)values[f]);
+    if (n < 0 || (size_t)n >= len - used) {
+      break;
+    }
+    used += n;
+  }
+  return used;
+}
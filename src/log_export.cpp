@@ -0,0 +1,178 @@
+/**
+ * @file log_export.cpp
+ * @brief CSV-streaming af loggen og læsning af komprimerede blokke.
+ */
+
+#include "log_export.h"
+
+#include <string.h>
+
+/**
+ * @brief Søger frem fra scanFrom_ efter næste blokheaders magic og version.
+ *
+ * Bruger payload_ som buffer. Sætter offset_ til fundet og scanFrom_ til
+ * byten efter, så gentagne fejl altid kommer videre.
+ * @return False hvis filen ikke indeholder flere.
+ */
+bool LogBlockSource::resync() {
+  uint32_t pos = scanFrom_;
+  for (;;) {
+    size_t n = readBytes(pos, payload_, sizeof(payload_));
+    if (n < 3) {
+      return false;
+    }
+    for (size_t i = 0; i + 3 <= n; i++) {
+      if ((payload_[i] | (payload_[i + 1] << 8)) == kTsBlockMagic && payload_[i + 2] == kTsBlockVersion) {
+        offset_ = pos + i;
+        scanFrom_ = offset_ + 1;
+        resyncs_++;
+        return true;
+      }
+    }
+    pos += n - 2;
+  }
+}
+
+/**
+ * @brief Tjekker CRC'en for den senest oversprungne blok.
+ *
+ * Kaldes når blokken ikke følges af en gyldig header. Er den afbrudt,
+ * trækkes dens poster fra recordsSkipped_ igen og skal springes over senere.
+ * @return True hvis blokken er hel.
+ */
+bool LogBlockSource::confirmSkipped() {
+  uint16_t count = skipped_.count;
+  skipped_.count = 0;
+  if (readBytes(skippedAt_, payload_, skipped_.payloadBytes) == skipped_.payloadBytes &&
+      tsBlockVerify(skipped_, payload_)) {
+    return true;
+  }
+  skip_ += count;
+  recordsSkipped_ -= count;
+  return false;
+}
+
+bool LogBlockSource::nextBlock() {
+  uint8_t raw[kTsBlockHeaderSize];
+  while (!done_) {
+    TsBlockHeader header;
+    size_t got = readBytes(offset_, raw, sizeof(raw));
+    bool valid = got == sizeof(raw) && tsBlockReadHeader(raw, header);
+    if (!valid && skipped_.count > 0) {
+      verified_ = confirmSkipped();
+    }
+    skipped_.count = 0;
+    if (got == 0 && verified_) {
+      break;
+    }
+    // Rester af en afbrudt blok, eller en oversprunget blok hvis længde ikke
+    // passede; søg videre efter seneste header
+    if (!valid) {
+      if (!resync()) {
+        break;
+      }
+      continue;
+    }
+    if (header.minTime > to_) {
+      break;
+    }
+    uint32_t payloadAt = offset_ + kTsBlockHeaderSize;
+    scanFrom_ = offset_ + 1;
+    offset_ = payloadAt + header.payloadBytes;
+    verified_ = false;
+    if (skip_ >= header.count) {
+      skip_ -= header.count;
+      recordsSkipped_ += header.count;
+      blocksSkipped_++;
+      skipped_ = header;
+      skippedAt_ = payloadAt;
+      continue;
+    }
+    if (header.maxTime < from_) {
+      blocksSkipped_++;
+      continue;
+    }
+    if (readBytes(payloadAt, payload_, header.payloadBytes) != header.payloadBytes ||
+        !tsBlockVerify(header, payload_)) {
+      if (!resync()) {
+        break;
+      }
+      continue;
+    }
+    verified_ = true;
+    blocksRead_++;
+    decoder_ = TsBlockDecoder(header, payload_);
+    LogRecord discard;
+    while (skip_ > 0 && decoder_.next(discard)) {
+      skip_--;
+      recordsSkipped_++;
+    }
+    return true;
+  }
+  done_ = true;
+  return false;
+}
+
+size_t LogBlockSource::read(LogRecord* records, size_t count) {
+  size_t n = 0;
+  while (n < count) {
+    if (decoder_.next(records[n])) {
+      n++;
+    } else if (!nextBlock()) {
+      break;
+    }
+  }
+  return n;
+}
+
+bool LogCsvCursor::nextPiece() {
+  pieceOff_ = 0;
+  pieceLen_ = 0;
+  if (!header_) {
+    header_ = true;
+    pieceLen_ = strlen(kLogCsvHeader);
+    memcpy(piece_, kLogCsvHeader, pieceLen_);
+    return true;
+  }
+  while (!done_) {
+    if (batchPos_ == batchLen_) {
+      batchLen_ = source_.read(batch_, kBatchRecords);
+      batchPos_ = 0;
+      if (batchLen_ == 0) {
+        done_ = true;
+        break;
+      }
+    }
+    const LogRecord& record = batch_[batchPos_++];
+    if (record.time < from_) {
+      continue;
+    }
+    if (record.time > to_) {
+      done_ = true;
+      break;
+    }
+    pieceLen_ = formatLogCsv(record, piece_, sizeof(piece_));
+    if (pieceLen_ > 0) {
+      rows_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t LogCsvCursor::fill(uint8_t* buf, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    if (pieceOff_ == pieceLen_ && !nextPiece()) {
+      break;
+    }
+    size_t chunk = pieceLen_ - pieceOff_;
+    if (chunk > len - written) {
+      chunk = len - written;
+    }
+    memcpy(buf + written, piece_ + pieceOff_, chunk);
+    pieceOff_ += chunk;
+    written += chunk;
+  }
+  return written;
+}
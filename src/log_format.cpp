@@ -0,0 +1,54 @@
+/**
+ * @file log_format.cpp
+ * @brief Hjælpefunktioner til det binære logformat.
+ */
+
+#include "log_format.h"
+
+#include <stdio.h>
+
+const char kLogCsvHeader[] = "time,millis,channel,event,value\n";
+
+LogHeader makeLogHeader(uint32_t createdAt) {
+  LogHeader header;
+  header.magic = kLogMagic;
+  header.version = kLogVersion;
+  header.recordSize = sizeof(LogRecord);
+  header.createdAt = createdAt;
+  header.reserved = 0;
+  return header;
+}
+
+bool logHeaderValid(const LogHeader& header) {
+  return header.magic == kLogMagic &&
+         header.version == kLogVersion &&
+         header.recordSize == sizeof(LogRecord);
+}
+
+const char* logEventName(uint8_t type) {
+  switch (type) {
+    case LOG_EVENT_BOOT:     return "BOOT";
+    case LOG_EVENT_LED_ON:   return "LED ON";
+    case LOG_EVENT_LED_OFF:  return "LED OFF";
+    case LOG_EVENT_COUNTER:  return "COUNTER";
+    case LOG_EVENT_POWER:    return "POWER";
+    case LOG_EVENT_RULE_ON:  return "RULE ON";
+    case LOG_EVENT_RULE_OFF: return "RULE OFF";
+    default:                 return "UNKNOWN";
+  }
+}
+
+size_t formatLogCsv(const LogRecord& record, char* buf, size_t len) {
+  uint8_t channel = record.channel & ~kLogChannelUnsynced;
+  // En post uden kendt tid får tomme tidskolonner frem for et forkert tidspunkt
+  int n = record.channel & kLogChannelUnsynced
+    ? snprintf(buf, len, ",,%u,%s,%ld\n", (unsigned)channel, logEventName(record.type), (long)record.value)
+    : snprintf(buf, len, "%lu,%u,%u,%s,%ld\n",
+               (unsigned long)record.time, (unsigned)record.millis,
+               (unsigned)channel, logEventName(record.type),
+               (long)record.value);
+  if (n < 0 || (size_t)n >= len) {
+    return 0;
+  }
+  return n;
+}
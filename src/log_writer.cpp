@@ -0,0 +1,67 @@
+/**
+ * @file log_writer.cpp
+ * @brief Implementering af den bufferede logskriver.
+ */
+
+#include "log_writer.h"
+
+#include <string.h>
+
+LogWriter::LogWriter(LogSink& sink, uint16_t maxRecords, uint32_t maxLatencyMs, Clock clockUs)
+  : sink_(sink), maxRecords_(maxRecords), maxLatencyMs_(maxLatencyMs), clockUs_(clockUs) {}
+
+bool LogWriter::append(const void* data, size_t len, uint32_t nowMs) {
+  if (len > kBufferSize) {
+    stats_.droppedRecords++;
+    return false;
+  }
+  if (used_ + len > kBufferSize) {
+    flush();
+  }
+  if (used_ == 0) {
+    oldestMs_ = nowMs;
+  }
+  memcpy(buffer_ + used_, data, len);
+  used_ += len;
+  pendingRecords_++;
+  if (pendingRecords_ >= maxRecords_) {
+    return flush();
+  }
+  return true;
+}
+
+void LogWriter::poll(uint32_t nowMs) {
+  if (used_ > 0 && nowMs - oldestMs_ >= maxLatencyMs_) {
+    flush();
+  }
+}
+
+bool LogWriter::flush() {
+  if (used_ == 0) {
+    return true;
+  }
+  uint32_t start = clockUs_();
+  bool ok = sink_.commit(buffer_, used_);
+  uint32_t elapsed = clockUs_() - start;
+
+  stats_.lastCommitUs = elapsed;
+  if (elapsed > stats_.maxCommitUs) {
+    stats_.maxCommitUs = elapsed;
+  }
+  if (ok) {
+    stats_.commits++;
+    stats_.records += pendingRecords_;
+    stats_.bytes += used_;
+  } else {
+    stats_.failedCommits++;
+    stats_.droppedRecords += pendingRecords_;
+  }
+  used_ = 0;
+  pendingRecords_ = 0;
+  return ok;
+}
+
+void LogWriter::discard() {
+  used_ = 0;
+  pendingRecords_ = 0;
+}
@@ -1,11 +1,11 @@
 /**
  * @file main.cpp
- * @brief ESP32 Webserver med WebSocket, SPIFFS og touchsensor-integration.
+ * @brief ESP32 Webserver med WebSocket, flash-lager og touchsensor-integration.
  *
  * Dette program implementerer en ESP32-baseret webserver med:
  * - WebSocket-kommunikation
- * - Berøringssensor til tælling af events
- * - SPIFFS til filhåndtering af Wi-Fi-konfiguration og logning
+ * - Timerstyret sampling af berøringssensor til tælling af pulser
+ * - SPIFFS eller LittleFS (se storage.h) til konfiguration og logning
  * - Dynamisk konfiguration via et Access Point
  * - LED-kontrol og reset-knap med forsinkelse
  */
@@ -15,12 +15,52 @@
 #include <ESPAsyncWebServer.h>
 #include <AsyncTCP.h>
 #include <SPIFFS.h>
+#include <LittleFS.h>
 #include <Update.h>
 #include <DNSServer.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <esp_heap_caps.h>
+#include <esp_partition.h>
+#include <driver/adc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <sys/time.h>
+#include <atomic>
+#include <memory>
+
+#include "spsc_ring.h"
+#include "channel_bank.h"
+#include "checkpoint_journal.h"
+#include "log_writer.h"
+#include "log_format.h"
+#include "rollup.h"
+#include "history.h"
+#include "ws_broadcaster.h"
+#include "live_protocol.h"
+#include "heap_monitor.h"
+#include "metrics.h"
+#include "energy.h"
+#include "power_kernel.h"
+#include "wifi_connector.h"
+#include "boot_timeline.h"
+#include "config_record.h"
+#include "static_assets.h"
+#include "http_range.h"
+#include "log_export.h"
+#include "storage.h"
+#include "storage_bench.h"
+#include "push_exporter.h"
+#include "mqtt_packet.h"
+#include "rule_engine.h"
 
 // Webserver og WebSocket
 AsyncWebServer server(80);        ///< Webserver-objekt på port 80
 AsyncWebSocket ws("/ws");         ///< WebSocket endepunkt på "/ws"
+const uint32_t wsTickMs = 200;            ///< Broadcast-interval for live-data (5 Hz)
+const uint16_t wsMaxConsecutiveDrops = 50; ///< Luk en klient efter 10 s med fuld sendekø
+WsBroadcaster broadcaster(ws, wsTickMs, wsMaxConsecutiveDrops); ///< Coalescende live-broadcast
 
 // GPIO-konfiguration
 const int resetPin = 4;           ///< Pin til reset-knap
@@ -32,180 +72,2696 @@ const char* PARAM_INPUT_1 = "ssid";       ///< Wi-Fi SSID
 const char* PARAM_INPUT_2 = "pass";       ///< Wi-Fi password
 const char* PARAM_INPUT_3 = "ip";         ///< Statisk IP-adresse
 const char* PARAM_INPUT_4 = "gateway";    ///< Gateway-adresse
+const char* PARAM_INPUT_5 = "imp_per_kwh";        ///< Målerkonstant
+const char* PARAM_INPUT_6 = "sample_interval_us"; ///< Sampleperiode for pulsindgangen
+const char* PARAM_INPUT_7 = "log_retention_days"; ///< Dage loggen gemmes
+const char* PARAM_INPUT_8 = "sampling_mode";      ///< 0 = pulser, 1 = CT
+const char* PARAM_INPUT_9 = "max_power_w";        ///< Største forventede effekt
+const char* PARAM_INPUT_10 = "channel_count";      ///< Pulskanaler i brug
+const char* PARAM_INPUT_11 = "channel_pins";       ///< Sensorpins, kommasepareret pr. kanal
+const char* PARAM_INPUT_12 = "channel_imp_per_kwh"; ///< Målerkonstanter, kommasepareret pr. kanal
+const char* PARAM_INPUT_13 = "export_mode";        ///< 0 = fra, 1 = UDP, 2 = MQTT
+const char* PARAM_INPUT_14 = "export_host";        ///< Opsamlerens vært
+const char* PARAM_INPUT_15 = "export_port";        ///< Opsamlerens port, 0 = standard
+const char* PARAM_INPUT_16 = "export_topic";       ///< MQTT-emne, tomt = standard
+const char* PARAM_INPUT_17 = "export_interval_s";  ///< Sekunder mellem målepunkter
+const char* PARAM_INPUT_18 = "rules";              ///< Alarmregler, se parseRules()
+
+StaticAssetTable staticAssets;   ///< Forkomprimerede filer fra data/ (se tools/compress_data.py)
+const char* htmlCacheControl = "no-cache";                 ///< HTML genvalideres altid, 304 er billigt
+const char* assetCacheControl = "public, max-age=604800";  ///< Øvrige filer caches en uge
+
+ConfigData config;               ///< Aktuel konfiguration, indlæses i setup() og ændres ikke derefter
+uint32_t configSequence = 0;     ///< Sekvensnummer for den indlæste post
+const char* configSlotPaths[kConfigSlots] = {"/config0.bin", "/config1.bin"}; ///< Skiftevise slots (se config_record.h)
+
+// Gamle konfigurationsfiler, læses kun ved migrering
+const char* ssidPath = "/ssid.txt";       ///< Filsti til SSID
+const char* passPath = "/pass.txt";       ///< Filsti til password
+const char* ipPath = "/ip.txt";           ///< Filsti til IP-adresse
+const char* gatewayPath = "/gateway.txt"; ///< Filsti til gateway-adresse
+
+// Wi-Fi forbindes i baggrunden, se pollWiFi()
+const uint32_t wifiConnectTimeoutMs = 10000; ///< Timeout for ét forbindelsesforsøg (ms)
+const uint32_t wifiMinBackoffMs = 1000;      ///< Ventetid efter første fejlede forsøg (ms)
+const uint32_t wifiMaxBackoffMs = 60000;     ///< Største ventetid mellem forsøg (ms)
+const uint8_t wifiApAfterFailures = 6;       ///< Fejl i træk uden nogensinde at have været forbundet før AP startes
+const char* apSsid = "ESP-WIFI-MANAGER-Darab"; ///< SSID for konfigurations-AP
+WifiConnector wifiConnector(wifiConnectTimeoutMs, wifiMinBackoffMs, wifiMaxBackoffMs, wifiApAfterFailures); ///< Ejes af I/O-tasken
+std::atomic<bool> wifiGotIp{false};          ///< Sat af Wi-Fi-hændelse, læses af I/O-tasken
+std::atomic<bool> wifiLost{false};           ///< Sat af Wi-Fi-hændelse, læses af I/O-tasken
+std::atomic<bool> wifiProvisioning{false};   ///< Konfigurations-AP kører
+BootTimeline bootTimeline;                   ///< Tidspunkter for opstartens faser
+
+const int ledPin = 2;                     ///< GPIO til LED
+
+// Pulskanaler; kanal 0 er hovedmåleren og den eneste ved CT-måling
+static_assert(kConfigMaxChannels <= kLiveMaxChannels, "every channel needs live fields");
+uint32_t counters[kConfigMaxChannels] = {};      ///< Pulser talt pr. kanal; gendannes fra checkpoint ved opstart
+EnergyMeter energyMeters[kConfigMaxChannels];    ///< Energi og effekt pr. kanal, ejes af I/O-tasken
+std::atomic<bool> energyClearRequested{false};   ///< Beder I/O-tasken nulstille energyMeters
+bool storageFormatted = false;                   ///< Filsystemet er formateret før genstart; intet må skrives tilbage
+std::atomic<bool> storageStopRequested{false};   ///< loop() beder I/O- og eksport-tasken holde pause før formatering
+uint64_t lastPulseUs[kConfigMaxChannels] = {};   ///< Tidsstempel for sidste puls pr. kanal (µs siden boot)
+
+SpscRing<PulseEvent, 64> pulseRing;               ///< Pulser med kanal fra sample-task til I/O-task
+ChannelBank<kConfigMaxChannels> channels;         ///< Pins, målerkonstanter og detektorer; tilstanden ejes af sample-tasken
+esp_timer_handle_t sampleTimer = nullptr;         ///< Periodisk timer der vækker sample-tasken
+uint32_t reportedOverflows = 0;                   ///< Senest rapporterede antal tabte pulser
+
+/**
+ * @brief Hvordan energien måles.
+ */
+enum SamplingMode : uint8_t {
+  SAMPLING_PULSE = 0, ///< Pulser fra målernes LED via pulskanalerne
+  SAMPLING_CT = 1,    ///< Spænding og strøm via ADC og CT-tang
+};
+SamplingMode samplingMode = SAMPLING_PULSE; ///< Aktiv målemetode, sættes fra config
+
+// CT-måling: ADC1 kører kontinuerligt med DMA og skifter mellem de to kanaler
+const adc1_channel_t ctVoltageChannel = ADC1_CHANNEL_6; ///< GPIO34, spændingsdeler fra AC-adapter
+const adc1_channel_t ctCurrentChannel = ADC1_CHANNEL_7; ///< GPIO35, byrde over CT-tangen
+const uint32_t ctConversionRateHz = 10000;              ///< ADC-konverteringer pr. sekund (begge kanaler)
+const uint32_t mainsHz = 50;                            ///< Nominel netfrekvens
+const size_t ctPairsPerCycle = ctConversionRateHz / 2 / mainsHz; ///< Samplepar pr. netperiode
+const size_t ctFrameBytes = 256;                        ///< Bytes pr. DMA-læsning
+const PowerCalibration ctCalibration = {
+  330u << 16, ///< mV pr. tælling (Q16)
+  30u << 16,  ///< mA pr. tælling (Q16)
+};
+int16_t ctVoltage[2][ctPairsPerCycle];    ///< Dobbeltbuffer med spændingssamples
+int16_t ctCurrent[2][ctPairsPerCycle];    ///< Dobbeltbuffer med strømsamples
+SpscRing<PowerReading, 16> powerRing;     ///< Periodeværdier fra CT-tasken til I/O-tasken
+uint32_t reportedPowerOverflows = 0;      ///< Senest rapporterede antal tabte periodeværdier
+
+// FreeRTOS-tasks. Til sammenligning kører Wi-Fi med prioritet 23 og esp_timer
+// med 22 på core 0, async_tcp med 3 og Arduinos loop() med 1 på core 1.
+const UBaseType_t samplerPriority = 10;   ///< Sampling: over async_tcp og loop(), under Wi-Fi og esp_timer
+const BaseType_t samplerCore = 1;         ///< Sampling kører alene på APP-core
+const uint32_t samplerStackSize = 2048;   ///< Stak til sample-tasken (bytes)
+const UBaseType_t ioPriority = 2;         ///< Lager/netværk: under async_tcp, så HTTP ikke venter på flash
+const BaseType_t ioCore = 0;              ///< Lager/netværk deler PRO-core med Wi-Fi
+const uint32_t ioStackSize = 6144;        ///< Stak til I/O-tasken (bytes)
+const TickType_t ioPeriod = pdMS_TO_TICKS(10); ///< Længste ventetid mellem I/O-iterationer
+const UBaseType_t exportPriority = 1;     ///< Eksport: under I/O-tasken, da den kan vente sekunder på netværket
+const uint32_t exportStackSize = 4096;    ///< Stak til eksport-tasken (bytes)
+const TickType_t exportPeriod = pdMS_TO_TICKS(100); ///< Ventetid mellem eksport-iterationer
+const UBaseType_t logQueueLength = 32;    ///< Logposter der kan vente på I/O-tasken
+const uint32_t storageStopTimeoutMs = 10000;   ///< Længste ventetid på at I/O- og eksport-tasken holder pause (ms)
+const TickType_t storagePausePeriod = pdMS_TO_TICKS(50); ///< Hvor ofte en task i pause ser om den må fortsætte
+TaskHandle_t samplerTaskHandle = nullptr; ///< Sample-tasken
+TaskHandle_t ioTaskHandle = nullptr;      ///< Lager/netværk-tasken
+TaskHandle_t exportTaskHandle = nullptr;  ///< Eksport-tasken, kun når eksport er slået til
+TaskHandle_t loopTaskHandle = nullptr;    ///< Arduinos loop()-task
+QueueHandle_t logQueue = nullptr;         ///< Logposter fra alle tasks til I/O-tasken
+std::atomic<uint32_t> logQueueDrops{0};   ///< Logposter tabt fordi køen var fuld
+
+// Metrikker til /metrics; grænser i µs
+const uint32_t loopBoundsUs[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000};
+const uint32_t sampleBoundsUs[] = {25, 50, 100, 200, 300, 500, 750, 1000, 2000, 5000};
+const uint32_t flashBoundsUs[] = {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+Histogram loopHist(loopBoundsUs, sizeof(loopBoundsUs) / sizeof(loopBoundsUs[0]));        ///< Varighed af én I/O-iteration
+Histogram sampleHist(sampleBoundsUs, sizeof(sampleBoundsUs) / sizeof(sampleBoundsUs[0])); ///< Én samplegennemgang over alle kanaler
+Histogram logCommitHist(flashBoundsUs, sizeof(flashBoundsUs) / sizeof(flashBoundsUs[0])); ///< Commit af logbufferen
+Histogram rollupSaveHist(flashBoundsUs, sizeof(flashBoundsUs) / sizeof(flashBoundsUs[0])); ///< Gemning af rollup
+Histogram checkpointHist(flashBoundsUs, sizeof(flashBoundsUs) / sizeof(flashBoundsUs[0])); ///< Checkpoint i journalen
+std::atomic<uint32_t> wifiConnects{0};    ///< Antal gange Wi-Fi har fået IP
+std::atomic<uint32_t> wifiDisconnects{0}; ///< Antal mistede Wi-Fi-forbindelser
+
+// Heap-overvågning
+const unsigned long heapSampleInterval = 10000;   ///< Interval mellem heap-målinger (ms)
+const unsigned long heapReportInterval = 3600000; ///< Interval mellem heap-rapporter på Serial (ms)
+HeapMonitor heapMonitor;                  ///< Vandmærker og fragmentering for heapen
+unsigned long lastHeapSample = 0;         ///< Tidspunkt for seneste heap-måling
+unsigned long lastHeapReport = 0;         ///< Tidspunkt for seneste heap-rapport
+
+/**
+ * @brief Læsehåndtag over en Arduino File.
+ */
+class FsReader : public StorageReader {
+public:
+  explicit FsReader(File file) : file_(file) {}
+  ~FsReader() { file_.close(); }
+
+  uint32_t size() override { return file_.size(); }
+
+  size_t readAt(uint32_t offset, uint8_t *buf, size_t len) override {
+    return file_.seek(offset) ? file_.read(buf, len) : 0;
+  }
+
+private:
+  File file_;
+};
+
+/**
+ * @brief Storage over et Arduino-filsystem (SPIFFS eller LittleFS).
+ *
+ * Begge bruger partitionen "spiffs", så skift af backend kræver kun at
+ * filsystemet formateres (og at data uploades med board_build.filesystem).
+ */
+template <class FileSystem>
+class FsStorage : public Storage {
+public:
+  FsStorage(FileSystem &fs, const char *name) : fs_(fs), name_(name) {}
+
+  const char *name() const override { return name_; }
+  bool mount(bool formatOnFail) override { return fs_.begin(formatOnFail); }
+  bool format() override { return fs_.format(); }
+  uint32_t totalBytes() override { return fs_.totalBytes(); }
+  uint32_t usedBytes() override { return fs_.usedBytes(); }
+  bool exists(const char *path) override { return fs_.exists(path); }
+  bool remove(const char *path) override { return fs_.exists(path) && fs_.remove(path); }
+
+  bool rename(const char *from, const char *to) override {
+    remove(to);
+    return fs_.rename(from, to);
+  }
+
+  size_t append(const char *path, const uint8_t *data, size_t len) override {
+    return put(path, FILE_APPEND, data, len);
+  }
+
+  size_t write(const char *path, const uint8_t *data, size_t len) override {
+    return put(path, FILE_WRITE, data, len);
+  }
+
+  std::unique_ptr<StorageReader> open(const char *path) override {
+    File file = fs_.exists(path) ? fs_.open(path) : File();
+    if (!file || file.isDirectory()) {
+      return nullptr;
+    }
+    return std::unique_ptr<StorageReader>(new FsReader(file));
+  }
+
+  void list(StorageListFn fn, void *ctx) override {
+    File root = fs_.open("/");
+    for (File file = root.openNextFile(); file; file = root.openNextFile()) {
+      fn(ctx, file.path(), file.size());
+    }
+  }
+
+private:
+  size_t put(const char *path, const char *mode, const uint8_t *data, size_t len) {
+    File file = fs_.open(path, mode);
+    if (!file) {
+      return 0;
+    }
+    size_t written = file.write(data, len);
+    file.close();
+    return written;
+  }
+
+  FileSystem &fs_;
+  const char *name_;
+};
+
+// Lager. Vælg LittleFS med -D ENERGI_STORAGE_LITTLEFS og board_build.filesystem = littlefs
+#ifdef ENERGI_STORAGE_LITTLEFS
+FsStorage<decltype(LittleFS)> storage(LittleFS, "littlefs"); ///< Lager for alle filer
+#else
+FsStorage<decltype(SPIFFS)> storage(SPIFFS, "spiffs");       ///< Lager for alle filer
+#endif
+
+/**
+ * @brief Læsehåndtag der tager en mutex om hver læsning.
+ */
+class LockedReader : public StorageReader {
+public:
+  LockedReader(std::unique_ptr<StorageReader> inner, SemaphoreHandle_t &mutex)
+    : inner_(std::move(inner)), mutex_(mutex) {}
+  ~LockedReader() {
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    inner_.reset();
+    xSemaphoreGive(mutex_);
+  }
+
+  uint32_t size() override {
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    uint32_t size = inner_->size();
+    xSemaphoreGive(mutex_);
+    return size;
+  }
+
+  size_t readAt(uint32_t offset, uint8_t *buf, size_t len) override {
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    size_t n = inner_->readAt(offset, buf, len);
+    xSemaphoreGive(mutex_);
+    return n;
+  }
+
+private:
+  std::unique_ptr<StorageReader> inner_;
+  SemaphoreHandle_t &mutex_;
+};
+
+/**
+ * @brief Storage der tager en mutex om hver operation.
+ *
+ * Eksport-tasken bruger den med logMutex til spoolen, så dens filoperationer
+ * ikke falder midt i en commit, komprimering eller formatering fra andre
+ * tasks, uden at mutexen holdes mens der sendes. HTTP-handlerne bruger den
+ * til filer uden for loggen af samme grund.
+ */
+class LockedStorage : public Storage {
+public:
+  LockedStorage(Storage &inner, SemaphoreHandle_t &mutex) : inner_(inner), mutex_(mutex) {}
+
+  const char *name() const override { return inner_.name(); }
+  bool mount(bool formatOnFail) override { return locked([&] { return inner_.mount(formatOnFail); }); }
+  bool format() override { return locked([&] { return inner_.format(); }); }
+  uint32_t totalBytes() override { return locked([&] { return inner_.totalBytes(); }); }
+  uint32_t usedBytes() override { return locked([&] { return inner_.usedBytes(); }); }
+  bool exists(const char *path) override { return locked([&] { return inner_.exists(path); }); }
+  bool remove(const char *path) override { return locked([&] { return inner_.remove(path); }); }
+
+  bool rename(const char *from, const char *to) override {
+    return locked([&] { return inner_.rename(from, to); });
+  }
+
+  size_t append(const char *path, const uint8_t *data, size_t len) override {
+    return locked([&] { return inner_.append(path, data, len); });
+  }
+
+  size_t write(const char *path, const uint8_t *data, size_t len) override {
+    return locked([&] { return inner_.write(path, data, len); });
+  }
+
+  std::unique_ptr<StorageReader> open(const char *path) override {
+    std::unique_ptr<StorageReader> file = locked([&] { return inner_.open(path); });
+    if (!file) {
+      return nullptr;
+    }
+    return std::unique_ptr<StorageReader>(new LockedReader(std::move(file), mutex_));
+  }
+
+  void list(StorageListFn fn, void *ctx) override {
+    locked([&] {
+      inner_.list(fn, ctx);
+      return true;
+    });
+  }
+
+private:
+  template <class Fn>
+  auto locked(Fn fn) -> decltype(fn()) {
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    auto result = fn();
+    xSemaphoreGive(mutex_);
+    return result;
+  }
+
+  Storage &inner_;
+  SemaphoreHandle_t &mutex_;
+};
+
+// Lager-benchmark på enheden. Fylder lageret og standser logningen mens det
+// kører, så det kun bygges med -D ENERGI_STORAGE_BENCH (se tools/storage_bench.cpp)
+#ifdef ENERGI_STORAGE_BENCH
+std::atomic<bool> storageBenchRequested{false}; ///< Sat af WebSocket-beskeden "storage_bench"
+char storageBenchResult[768] = "{}";            ///< Seneste benchmark som JSON, skrives under logMutex
+#endif
+
+// Datalog fil
+const char* logFilePath = "/log.bin";     ///< Filsti til binær logfil (se log_format.h)
+const char* legacyLogPath = "/log.txt";   ///< Gammel tekstlog, slettes sammen med måleværdier
+const char* historyPath = "/history.blk"; ///< Komprimerede logblokke (se ts_block.h)
+const char* historyTmpPath = "/history.tmp"; ///< Efterladt af ældre firmware, der kopierede historikken; slettes ved opstart
+const char* logBasePath = "/log.base";    ///< Poster i historyPath da logfilen blev startet (se logBaseRecords)
+const uint32_t logCompactRecords = 512;   ///< Komprimer logfilen når den har så mange poster
+const unsigned long logCompactCheckInterval = 60000; ///< Interval mellem tjek af logfilens størrelse (ms)
+unsigned long lastLogCompactCheck = 0;    ///< Tidspunkt for seneste tjek
+const uint16_t logMaxRecords = 32;        ///< Commit logbufferen ved så mange poster
+const uint32_t logMaxLatencyMs = 5000;    ///< Commit logbufferen senest efter så mange ms
+const unsigned long counterLogInterval = 60000; ///< Interval for logning af tælleren (ms)
+unsigned long lastCounterLog = 0;         ///< Tidspunkt for seneste logning af tælleren
+uint32_t lastLogTime = 0;                 ///< Seneste tidsstempel i loggen, holder den sorteret
+const size_t unsyncedLogCapacity = 64;    ///< Poster fra før NTP der kan vente på rigtig tid
+LogRecord unsyncedLog[unsyncedLogCapacity]; ///< Poster med oppetid som tidsstempel, beskyttes af logMutex
+size_t unsyncedLogCount = 0;              ///< Poster i unsyncedLog
+
+/**
+ * @brief LogSink der appender committede poster til logfilen i lageret.
+ *
+ * Findes filen ikke, skrives en LogHeader først.
+ */
+class StorageLogSink : public LogSink {
+public:
+  bool commit(const uint8_t* data, size_t len) override {
+    if (!storage.exists(logFilePath)) {
+      LogHeader header = makeLogHeader(lastLogTime);
+      if (storage.append(logFilePath, (const uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+        Serial.println("Failed to create log file");
+        return false;
+      }
+    }
+    return storage.append(logFilePath, data, len) == len;
+  }
+};
+
+/**
+ * @brief Måler hver commit til logfilen i logCommitHist.
+ */
+class TimedLogSink : public LogSink {
+public:
+  explicit TimedLogSink(LogSink& inner) : inner_(inner) {}
+
+  bool commit(const uint8_t* data, size_t len) override {
+    uint32_t start = micros();
+    bool ok = inner_.commit(data, len);
+    logCommitHist.observe(micros() - start);
+    return ok;
+  }
+
+private:
+  LogSink& inner_;
+};
+
+/**
+ * @brief Mikrosekundur til logskriverens commit-statistik.
+ */
+uint32_t logClockUs() {
+  return micros();
+}
+
+// Historik i flere opløsninger
+const char* rollupPath = "/rollup.bin";          ///< Gemte time- og dagsniveauer
+const char* rollupTmpPath = "/rollup.tmp";       ///< Midlertidig fil, omdøbes når skrivningen er færdig
+const uint32_t rollupMagic = 0x4C524D45;         ///< "EMRL" som little-endian uint32
+const uint16_t rollupVersion = 1;                ///< Version af rollup-filen
+const unsigned long rollupSaveInterval = 600000; ///< Interval for at gemme rollup på flash (ms)
+const time_t validTimeAfter = 1600000000;        ///< Tidspunkter før dette betyder at uret ikke er synkroniseret
+
+/**
+ * @brief Header for rollup-filen i lageret.
+ */
+struct RollupFileHeader {
+  uint32_t magic;     ///< rollupMagic
+  uint16_t version;   ///< rollupVersion
+  uint16_t reserved;  ///< Reserveret, 0
+  uint32_t hoursSize; ///< sizeof(rollup.hours)
+  uint32_t daysSize;  ///< sizeof(rollup.days)
+};
+
+Rollup rollup;                        ///< Pulser pr. sekund aggregeret i fire opløsninger
+uint32_t rollupSecond = 0;            ///< Sekundet der samles pulser for
+int32_t pulsesThisSecond = 0;         ///< Pulser talt i rollupSecond indtil videre
+unsigned long lastRollupSave = 0;     ///< Tidspunkt for seneste gemning af rollup (ms)
+SemaphoreHandle_t rollupMutex = nullptr; ///< Beskytter rollup mellem loop() og HTTP-handlere
+
+// Checkpoints af tællere og energi (se checkpoint_journal.h)
+static_assert(kConfigMaxChannels <= kCheckpointChannels, "every channel needs a checkpoint slot");
+const char* checkpointPartition = "checkpoint";   ///< Partitionens navn i partitions.csv
+const unsigned long checkpointInterval = 5000;    ///< Mindste tid mellem checkpoints i flash (ms)
+RTC_NOINIT_ATTR uint8_t rtcCheckpoint[kCheckpointSlotSize]; ///< Seneste tilstand; overlever bløde genstarter
+std::unique_ptr<FlashRegion> checkpointFlash;     ///< Partitionen, nullptr hvis den mangler
+std::unique_ptr<CheckpointJournal> checkpointJournal; ///< Journalen i checkpointFlash
+SemaphoreHandle_t checkpointMutex = nullptr;      ///< Serialiserer journalen mellem I/O-tasken og nedlukning
+bool checkpointDirty = false;                     ///< Tællere ændret siden seneste checkpoint i flash
+bool rtcCheckpointDirty = false;                  ///< Tællere ændret siden rtcCheckpoint blev skrevet
+unsigned long lastCheckpoint = 0;                 ///< Tidspunkt for seneste checkpoint i flash (ms)
+
+// Eksport til en opsamler (se push_exporter.h)
+const uint32_t exportAckTimeoutMs = 3000;         ///< Længste ventetid på forbindelse, CONNACK og PUBACK (ms)
+const uint16_t exportUdpPort = 8089;              ///< InfluxDB's standardport for UDP
+const uint16_t exportMqttPort = 1883;             ///< MQTT's standardport
+char exportDevice[16] = "";                       ///< Enhedens id i linjerne, "energi-xxxxxx"
+char exportTopic[80] = "";                        ///< MQTT-emnet i brug
+std::unique_ptr<PushTransport> exportTransport;   ///< UDP eller MQTT; nullptr når eksport er slået fra
+std::unique_ptr<PushExporter> exporter;           ///< Ejes af eksport-tasken
+SemaphoreHandle_t exportMutex = nullptr;          ///< Beskytter exportStats
+PushExporterStats exportStats;                    ///< Kopi af exporter's tællere til /metrics
+unsigned long lastExportPoint = 0;                ///< Tidspunkt for seneste målepunkt (ms)
+
+// Alarmregler (se rule_engine.h)
+RuleEngine ruleEngine;                            ///< Reglerne fra config, ejes af I/O-tasken
+std::atomic<uint32_t> ruleActive{0};              ///< Kopi af ruleEngine.activeMask() til /metrics
+std::atomic<uint32_t> ruleFired[kConfigMaxRules]; ///< Gange hver regel er slået til siden opstart
+SpscRing<PushAlert, 16> alertRing;                ///< Alarmer fra I/O-tasken til eksport-tasken
+
+const uint8_t maxHistoryStreams = 2;  ///< Højst så mange samtidige /api/history-svar
+std::atomic<uint8_t> historyStreams{0}; ///< Aktive /api/history-svar
+const uint8_t maxLogStreams = 2;        ///< Højst så mange samtidige /api/log-svar
+std::atomic<uint8_t> logStreams{0};     ///< Aktive /api/log- og /api/log.csv-svar
+
+/**
+ * @brief Et igangværende /api/history-svar; frigiver sin plads når det nedlægges.
+ */
+struct HistoryStream {
+  HistoryCursor cursor; ///< Position i historikken
+
+  HistoryStream(uint32_t from, uint32_t to, uint32_t step, HistoryFormat format)
+    : cursor(rollup, from, to, step, format) {}
+  ~HistoryStream() { historyStreams--; }
+};
+
+StorageLogSink storageLogSink;                                           ///< Logfil i lageret
+TimedLogSink logSink(storageLogSink);                                    ///< Logfil med latensmåling
+LogWriter logWriter(logSink, logMaxRecords, logMaxLatencyMs, logClockUs); ///< Bufferet logskriver
+SemaphoreHandle_t logMutex = nullptr;                                    ///< Serialiserer adgang til logWriter
+LockedStorage lockedStorage(storage, logMutex);                          ///< Lageret under logMutex for eksportens spool og HTTP-handlerne
+TsBlockEncoder compactEncoder;                         ///< Blok under opbygning ved komprimering
+uint8_t compactBlock[kTsBlockHeaderSize + kTsBlockMaxPayload]; ///< Forseglet blok klar til flash
+uint32_t logCompactions = 0;                           ///< Gennemførte komprimeringer
+uint32_t logCompactFailures = 0;                       ///< Komprimeringer opgivet pga. skrivefejl
+uint32_t historyRecords = 0;                           ///< Poster i historyPath, beskyttes af logMutex
+uint32_t logBaseRecords = 0;                           ///< historyRecords da logfilen blev startet, beskyttes af logMutex
+
+/**
+ * @brief Monterer lageret; formaterer hvis det ikke kan monteres.
+ */
+void initStorage() {
+  if (!storage.mount(true)) {
+    Serial.printf("An error has occurred while mounting %s\r\n", storage.name());
+    return;
+  }
+  // Rester af et lager-benchmark der blev afbrudt af en genstart
+  storage.remove(kStorageBenchFillPath);
+  storage.remove(kStorageBenchDataPath);
+  Serial.printf("%s mounted successfully, %u of %u bytes used\r\n", storage.name(),
+                storage.usedBytes(), storage.totalBytes());
+}
+
+/**
+ * @brief Læser første linje af en lille tekstfil fra lageret.
+ * @param path Stien til filen
+ * @return Linjen uden linjeskift; tom hvis filen ikke findes.
+ */
+String readFile(const char *path) {
+  Serial.printf("Reading file: %s\r\n", path);
+  char line[96];
+  size_t len = storage.read(path, (uint8_t *)line, sizeof(line) - 1);
+  line[len] = '\0';
+  line[strcspn(line, "\r\n")] = '\0';
+  return String(line);
+}
+
+/**
+ * @brief Indlæser den nyeste gyldige konfigurationspost.
+ *
+ * Hvert slot læses med én læsning; posten med højest sekvensnummer vinder.
+ * @return True hvis en gyldig post blev fundet.
+ */
+bool loadConfig() {
+  bool found = false;
+  for (size_t slot = 0; slot < kConfigSlots; slot++) {
+    uint8_t buf[kConfigRecordSize];
+    size_t len = storage.read(configSlotPaths[slot], buf, sizeof(buf));
+    if (len == 0) {
+      continue;
+    }
+    ConfigData data;
+    uint32_t sequence;
+    if (configDecode(buf, len, data, sequence)) {
+      if (!found || sequence > configSequence) {
+        config = data;
+        configSequence = sequence;
+        found = true;
+      }
+    } else {
+      Serial.printf("Ignoring invalid config slot %s\r\n", configSlotPaths[slot]);
+    }
+  }
+  return found;
+}
+
+/**
+ * @brief Gemmer konfigurationen i det slot der ikke holder den nyeste post.
+ *
+ * Den forrige post står urørt, indtil den nye er skrevet helt. Skrives
+ * under logMutex, da den kaldes fra async_tcp. config ændres ikke, da tasks
+ * læser den uden lås; en ny konfiguration træder i kraft ved næste opstart.
+ * @param data Indstillingerne
+ * @return True hvis hele posten blev skrevet.
+ */
+bool saveConfig(const ConfigData& data) {
+  uint32_t sequence = configSequence + 1;
+  uint8_t buf[kConfigRecordSize];
+  configEncode(data, sequence, buf);
+  bool ok = lockedStorage.write(configSlotPaths[sequence % kConfigSlots], buf, sizeof(buf)) == sizeof(buf);
+  if (!ok) {
+    Serial.println("Failed to write config slot");
+  } else {
+    configSequence = sequence;
+  }
+  return ok;
+}
+
+/**
+ * @brief Flytter de gamle tekstfiler over i konfigurationsposten.
+ *
+ * De gamle filer slettes først når posten er gemt.
+ * @return True hvis der var noget at migrere.
+ */
+bool migrateLegacyConfig() {
+  if (!storage.exists(ssidPath)) {
+    return false;
+  }
+  ConfigData data;
+  configDefaults(data);
+  configSetString(data.ssid, sizeof(data.ssid), readFile(ssidPath).c_str());
+  configSetString(data.pass, sizeof(data.pass), readFile(passPath).c_str());
+  configSetString(data.ip, sizeof(data.ip), readFile(ipPath).c_str());
+  configSetString(data.gateway, sizeof(data.gateway), readFile(gatewayPath).c_str());
+  config = data;
+  if (saveConfig(data)) {
+    storage.remove(ssidPath);
+    storage.remove(passPath);
+    storage.remove(ipPath);
+    storage.remove(gatewayPath);
+    Serial.println("Migrated legacy config files");
+  }
+  return true;
+}
+
+/**
+ * @brief Sætter pulskanalerne op fra konfigurationen.
+ *
+ * Tidsgrænserne udledes af hver kanals målerkonstant. Kaldes før
+ * sample-tasken startes.
+ */
+void configureChannels() {
+  size_t count = config.channelCount;
+  count = count < 1 ? 1 : count > kConfigMaxChannels ? kConfigMaxChannels : count;
+  for (size_t ch = 0; ch < count; ch++) {
+    uint32_t impPerKwh = config.channelImpPerKwh[ch] ? config.channelImpPerKwh[ch] : config.impPerKwh;
+    PulseTiming timing = channels.setChannel(ch, config.channelPins[ch], impPerKwh,
+                                             config.maxPowerW, config.sampleIntervalUs);
+    energyMeters[ch].setImpPerKwh(impPerKwh);
+    Serial.printf("Channel %u: pin %u, %u imp/kWh, min width %u us, min interval %u us\n",
+                  (unsigned)ch, config.channelPins[ch], impPerKwh, timing.minWidthUs, timing.minIntervalUs);
+    if (timing.minIntervalUs < 2 * config.sampleIntervalUs) {
+      Serial.printf("Warning: sample interval too long for channel %u at max_power_w\n", (unsigned)ch);
+    }
+  }
+  channels.setCount(count);
+}
+
+/**
+ * @brief Kanaler der måles på; CT-måling har kun kanal 0.
+ */
+size_t activeChannels() {
+  return samplingMode == SAMPLING_CT ? 1 : channels.count();
+}
+
+/**
+ * @brief Indlæser konfigurationen ved opstart.
+ *
+ * Uden gyldig post prøves migrering fra de gamle tekstfiler, ellers bruges
+ * standardværdierne.
+ */
+void initConfig() {
+  configDefaults(config);
+  if (!loadConfig() && !migrateLegacyConfig()) {
+    Serial.println("No config found, using defaults");
+  }
+  // En for kort periode fra en ældre post ville lade sampletimeren æde CPU'en
+  if (config.sampleIntervalUs == 0) {
+    config.sampleIntervalUs = 2000;
+  }
+  config.sampleIntervalUs = configClamp(config.sampleIntervalUs, kConfigMinSampleIntervalUs,
+                                        kConfigMaxSampleIntervalUs);
+  if (config.maxPowerW == 0) {
+    config.maxPowerW = 20000;
+  }
+  config.maxPowerW = configClamp(config.maxPowerW, kConfigMaxPowerFloorW, kConfigMaxPowerCeilW);
+  config.exportIntervalS = configClamp(config.exportIntervalS, kConfigMinExportIntervalS,
+                                       kConfigMaxExportIntervalS);
+  if (config.logRetentionDays > kConfigMaxLogRetentionDays) {
+    config.logRetentionDays = kConfigMaxLogRetentionDays;
+  }
+  // En post fra før formularen kontrollerede målerkonstanter og pins kan
+  // have 0, et negativt tal læst som uint32 eller en pin uden touch
+  ConfigData defaults;
+  configDefaults(defaults);
+  if (config.impPerKwh == 0 || config.impPerKwh > kConfigMaxImpPerKwh) {
+    config.impPerKwh = defaults.impPerKwh;
+  }
+  for (size_t ch = 0; ch < kConfigMaxChannels; ch++) {
+    if (config.channelImpPerKwh[ch] > kConfigMaxImpPerKwh) {
+      config.channelImpPerKwh[ch] = 0;
+    }
+  }
+  for (size_t ch = 0; ch < kConfigMaxChannels; ch++) {
+    if (!configChannelPinValid(config.channelPins[ch])) {
+      Serial.printf("Channel %u: pin %u is not a free touch pin, using %u\n", (unsigned)ch,
+                    config.channelPins[ch], defaults.channelPins[ch]);
+      config.channelPins[ch] = defaults.channelPins[ch];
+    }
+  }
+  samplingMode = config.samplingMode == SAMPLING_CT ? SAMPLING_CT : SAMPLING_PULSE;
+  configureChannels();
+}
+
+/**
+ * @brief Kontrollerer logfilen ved opstart og finder seneste tidsstempel.
+ *
+ * En fil med ukendt header eller version slettes, så nye poster ikke blandes
+ * med et andet format.
+ */
+void initLog() {
+  std::unique_ptr<StorageReader> file = storage.open(logFilePath);
+  if (!file) {
+    return;
+  }
+  LogHeader header;
+  bool valid = file->readAt(0, (uint8_t*)&header, sizeof(header)) == sizeof(header) && logHeaderValid(header);
+  uint32_t count = logRecordCount(file->size());
+  if (valid && count > 0) {
+    LogRecord last;
+    if (file->readAt(logRecordOffset(count - 1), (uint8_t*)&last, sizeof(last)) == sizeof(last)) {
+      lastLogTime = last.time;
+    }
+  }
+  file.reset();
+  if (!valid) {
+    Serial.println("Unknown log format, removing log file");
+    storage.remove(logFilePath);
+  }
+}
+
+/**
+ * @brief Sender en hændelse til logkøen.
+ *
+ * Må kaldes fra alle tasks og blokerer aldrig; er køen fuld, tælles posten
+ * som tabt. Tidsstemplet er Unix-tid når uret er synkroniseret via NTP,
+ * ellers oppetid med kLogChannelUnsynced sat (se drainLogQueue()).
+ * @param type Hændelsestype (LogEvent)
+ * @param value Hændelsens værdi
+ * @param channel Pulskanal hændelsen gælder
+ */
+void logEvent(uint8_t type, int32_t value, uint8_t channel = 0) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+
+  LogRecord record;
+  record.time = tv.tv_sec;
+  record.millis = tv.tv_usec / 1000;
+  record.channel = channel;
+  if (tv.tv_sec < validTimeAfter) {
+    uint64_t uptimeMs = esp_timer_get_time() / 1000;
+    record.time = uptimeMs / 1000;
+    record.millis = uptimeMs % 1000;
+    record.channel |= kLogChannelUnsynced;
+  }
+  record.type = type;
+  record.value = value;
+  if (xQueueSend(logQueue, &record, 0) != pdTRUE) {
+    logQueueDrops++;
+  }
+}
+
+/**
+ * @brief Lægger en post i logbufferen; kalderen holder logMutex.
+ *
+ * Tidsstempler holdes ikke-aftagende i forhold til seneste post, så filen
+ * forbliver sorteret.
+ */
+void appendLogRecord(LogRecord& record) {
+  if (record.time < lastLogTime) {
+    record.time = lastLogTime;
+    record.millis = 0;
+  }
+  lastLogTime = record.time;
+  logWriter.append(&record, sizeof(record), millis());
+}
+
+/**
+ * @brief Skriver posterne i unsyncedLog; kalderen holder logMutex.
+ *
+ * Er uret synkroniseret, omregnes oppetiden til Unix-tid og markeringen
+ * fjernes. Ellers skrives de kun med force, og så med markeringen, så
+ * tidspunktet vises som ukendt i stedet for at ligne seneste posts.
+ * @param force Skriv også selvom uret ikke er synkroniseret (nedlukning)
+ */
+void writeUnsyncedLog(bool force) {
+  if (unsyncedLogCount == 0) {
+    return;
+  }
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  bool synced = tv.tv_sec >= validTimeAfter;
+  if (!synced && !force) {
+    return;
+  }
+  int64_t bootMs = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - esp_timer_get_time() / 1000;
+  for (size_t i = 0; i < unsyncedLogCount; i++) {
+    LogRecord record = unsyncedLog[i];
+    if (synced) {
+      int64_t ms = bootMs + (int64_t)record.time * 1000 + record.millis;
+      record.time = ms / 1000;
+      record.millis = ms % 1000;
+      record.channel &= ~kLogChannelUnsynced;
+    }
+    appendLogRecord(record);
+  }
+  unsyncedLogCount = 0;
+}
+
+/**
+ * @brief Flytter ventende poster fra logkøen til logbufferen.
+ *
+ * Poster fra før NTP venter i unsyncedLog og får rigtig tid når uret er
+ * synkroniseret; de skrives før de første poster med Unix-tid, så filen
+ * forbliver sorteret. Bliver unsyncedLog fuld, skrives den ældste med
+ * markeringen. Kaldes fra I/O-tasken og ved nedlukning.
+ */
+void drainLogQueue() {
+  LogRecord record;
+  while (xQueueReceive(logQueue, &record, 0) == pdTRUE) {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    if (record.channel & kLogChannelUnsynced) {
+      if (unsyncedLogCount == unsyncedLogCapacity) {
+        appendLogRecord(unsyncedLog[0]);
+        memmove(unsyncedLog, unsyncedLog + 1, (unsyncedLogCapacity - 1) * sizeof(LogRecord));
+        unsyncedLogCount--;
+      }
+      unsyncedLog[unsyncedLogCount++] = record;
+    } else {
+      writeUnsyncedLog(false);
+      appendLogRecord(record);
+    }
+    xSemaphoreGive(logMutex);
+  }
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  writeUnsyncedLog(false);
+  xSemaphoreGive(logMutex);
+}
+
+/**
+ * @brief Logger hver kanals tæller og effekt med faste mellemrum.
+ */
+void logCounterIfDue() {
+  unsigned long now = millis();
+  if (now - lastCounterLog >= counterLogInterval) {
+    lastCounterLog = now;
+    uint64_t nowUs = esp_timer_get_time();
+    for (size_t ch = 0; ch < activeChannels(); ch++) {
+      logEvent(LOG_EVENT_COUNTER, counters[ch], ch);
+      logEvent(LOG_EVENT_POWER, energyMeters[ch].powerMw(nowUs) / 1000, ch);
+    }
+  }
+}
+
+/**
+ * @brief Committer logbufferen hvis den ældste post har ventet længe nok.
+ */
+void pollLog() {
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  logWriter.poll(millis());
+  xSemaphoreGive(logMutex);
+}
+
+/**
+ * @brief Skriver alt i logbufferen til flash. Kaldes før genstart.
+ */
+void flushLog() {
+  if (logMutex == nullptr) {
+    return;
+  }
+  drainLogQueue();
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  writeUnsyncedLog(true);
+  logWriter.flush();
+  xSemaphoreGive(logMutex);
+}
+
+/**
+ * @brief Antal poster i starten af logfilen der allerede ligger i historyPath.
+ *
+ * Kun efter en komprimering der blev afbrudt før logfilen blev slettet.
+ * Kaldes med logMutex taget.
+ * @param count Poster i logfilen
+ */
+uint32_t logCompactedRecords(uint32_t count) {
+  uint32_t compacted = historyRecords - logBaseRecords;
+  return compacted < count ? compacted : count;
+}
+
+/**
+ * @brief Gemmer logBaseRecords for en ny logfil. Kaldes med logMutex taget.
+ * @param base Poster i historyPath
+ */
+void saveLogBase(uint32_t base) {
+  logBaseRecords = base;
+  if (storage.write(logBasePath, (const uint8_t *)&base, sizeof(base)) != sizeof(base)) {
+    Serial.println("Failed to write log base");
+  }
+}
+
+/**
+ * @brief Forsegler blokken under opbygning og appender den til historikfilen.
+ * @return False hvis blokken ikke blev skrevet helt.
+ */
+bool appendCompactBlock() {
+  size_t len = compactEncoder.seal(compactBlock);
+  uint16_t records = compactEncoder.count();
+  compactEncoder.reset();
+  if (storage.append(historyPath, compactBlock, len) != len) {
+    return false;
+  }
+  historyRecords += records;
+  return true;
+}
+
+/**
+ * @brief Komprimerer logfilen til blokke i historyPath når den er stor nok.
+ *
+ * De rå poster kodes til blokke, der appendes direkte til historikfilen,
+ * hvorefter logfilen slettes og startes forfra ved næste commit. Det koster
+ * kun de nye blokke og ingen ekstra plads. Hvor langt en afbrudt
+ * komprimering nåede, udledes af historikken selv: logfilens første
+ * historyRecords - logBaseRecords poster ligger allerede i blokkene og
+ * springes over, både her og af log-svarene (se LogStream). En halvt
+ * skrevet blok tælles ikke med (se LogBlockSource::skip()), så dens poster
+ * komprimeres igen. Går strømmen efter logfilen er slettet men før
+ * logBasePath er skrevet, retter initHistoryRecords() det, da logfilen så
+ * er tom. Springes over mens et log-svar læser filerne. Posterne beholder
+ * deres rækkefølge, så byte-offsets i /api/log er uændrede (se
+ * LogDownloadStream).
+ */
+void compactLogIfDue() {
+  if (millis() - lastLogCompactCheck < logCompactCheckInterval) {
+    return;
+  }
+  lastLogCompactCheck = millis();
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  uint32_t start = micros();
+  logWriter.flush();
+  std::unique_ptr<StorageReader> log = storage.open(logFilePath);
+  uint32_t count = log ? logRecordCount(log->size()) : 0;
+  uint32_t first = logCompactedRecords(count);
+  if (count - first < logCompactRecords || logStreams.load() > 0) {
+    xSemaphoreGive(logMutex);
+    return;
+  }
+  bool ok = true;
+  compactEncoder.reset();
+  LogRecord batch[32];
+  for (uint32_t index = first; ok && index < count;) {
+    size_t want = count - index < 32 ? count - index : 32;
+    size_t n = log->readAt(logRecordOffset(index), (uint8_t *)batch, want * sizeof(LogRecord)) / sizeof(LogRecord);
+    if (n == 0) {
+      ok = false;
+      break;
+    }
+    for (size_t i = 0; ok && i < n; i++) {
+      if (!compactEncoder.add(batch[i])) {
+        ok = appendCompactBlock() && compactEncoder.add(batch[i]);
+      }
+    }
+    index += n;
+  }
+  if (ok && compactEncoder.count() > 0) {
+    ok = appendCompactBlock();
+  }
+  log.reset();
+  if (ok) {
+    storage.remove(logFilePath);
+    saveLogBase(historyRecords);
+    logCompactions++;
+  } else {
+    logCompactFailures++;
+  }
+  std::unique_ptr<StorageReader> history = storage.open(historyPath);
+  size_t historyBytes = history ? history->size() : 0;
+  history.reset();
+  xSemaphoreGive(logMutex);
+  Serial.printf("Log compaction %s: %u records, history %u bytes, %u us\r\n", ok ? "done" : "failed",
+                count - first, (unsigned)historyBytes, micros() - start);
+}
+
+#ifdef ENERGI_STORAGE_BENCH
+/**
+ * @brief Kører lager-benchmarket hvis det er bestilt via WebSocket.
+ *
+ * Kører i I/O-tasken med logMutex taget, så ingen commit eller
+ * komprimering skriver imens; live-data og logning står derfor stille i de
+ * sekunder det tager. Lageret fyldes kortvarigt til 99 %, og ballasten
+ * slettes igen bagefter. Resultatet kan hentes på /api/storage/bench.
+ */
+void runStorageBenchIfRequested() {
+  if (!storageBenchRequested.exchange(false)) {
+    return;
+  }
+  static const uint8_t fills[] = {0, 50, 90, 99};
+  StorageBenchResult results[sizeof(fills)];
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  logWriter.flush();
+  storageBench(storage, logClockUs, fills, sizeof(fills), results);
+  storageBenchJson(storage.name(), results, sizeof(fills), storageBenchResult, sizeof(storageBenchResult));
+  xSemaphoreGive(logMutex);
+  Serial.println(storageBenchResult);
+}
+#endif
+
+/**
+ * @brief Sender logskriverens tællere som JSON.
+ * @param request HTTP-forespørgslen
+ */
+void handleLogStats(AsyncWebServerRequest *request) {
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  LogWriterStats stats = logWriter.stats();
+  uint16_t pending = logWriter.pendingRecords();
+  xSemaphoreGive(logMutex);
+
+  char json[192];
+  snprintf(json, sizeof(json),
+           "{\"records\":%u,\"bytes\":%u,\"commits\":%u,\"failed_commits\":%u,"
+           "\"dropped\":%u,\"pending\":%u,\"last_commit_us\":%u,\"max_commit_us\":%u}",
+           stats.records, stats.bytes, stats.commits, stats.failedCommits,
+           stats.droppedRecords, pending, stats.lastCommitUs, stats.maxCommitUs);
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Sampler alle pulskanaler én gang.
+ *
+ * Nye pulser tidsstemples med 64-bit mikrosekundtid ved den stigende flanke
+ * og lægges i pulseRing med deres kanal; er bufferen fuld, tælles pulsen som
+ * overflow i stedet. Hele gennemgangen måles i sampleHist.
+ * @return True hvis der blev registreret en ny puls.
+ */
+bool samplePulses() {
+  uint64_t now = (uint64_t)esp_timer_get_time();
+  bool pushed = channels.sampleInto(touchRead, now, pulseRing);
+  sampleHist.observe((uint32_t)(esp_timer_get_time() - now));
+  return pushed;
+}
+
+/**
+ * @brief Sample-tasken: venter på timeren og sampler, intet andet.
+ *
+ * Den har sin egen core og rører hverken flash eller netværk, så en langsom
+ * commit eller klient ikke forsinker en sample. Nye pulser vækker I/O-tasken.
+ */
+void samplerTask(void*) {
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  bootTimeline.mark(BOOT_FIRST_SAMPLE, esp_timer_get_time());
+  for (;;) {
+    if (samplePulses() && ioTaskHandle != nullptr) {
+      xTaskNotifyGive(ioTaskHandle);
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+/**
+ * @brief esp_timer-callback der vækker sample-tasken hver sampleperiode.
+ */
+void onSampleTimer(void*) {
+  xTaskNotifyGive(samplerTaskHandle);
+}
+
+/**
+ * @brief Starter sample-tasken og den periodiske timer der driver den.
+ */
+void initPulseCapture() {
+  xTaskCreatePinnedToCore(samplerTask, "sampler", samplerStackSize, nullptr,
+                          samplerPriority, &samplerTaskHandle, samplerCore);
+  const esp_timer_create_args_t args = {
+    .callback = &onSampleTimer,
+    .arg = nullptr,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "pulse",
+    .skip_unhandled_events = true,
+  };
+  if (esp_timer_create(&args, &sampleTimer) != ESP_OK ||
+      esp_timer_start_periodic(sampleTimer, config.sampleIntervalUs) != ESP_OK) {
+    Serial.println("Failed to start pulse sampling timer");
+  }
+}
+
+/**
+ * @brief Udfylder en dobbeltbuffer fra ADC'ens DMA og beregner hver netperiode.
+ *
+ * DMA'en fylder driverens ringbuffer uafhængigt af tasken; samples fordeles
+ * efter kanal i den aktive buffer, og når en periode er fuld, skiftes
+ * bufferen og kernen kører på den netop afsluttede.
+ */
+void ctSamplerTask(void*) {
+  uint8_t frame[ctFrameBytes];
+  uint8_t active = 0;
+  size_t voltageCount = 0;
+  size_t currentCount = 0;
+  uint64_t cycleStart = esp_timer_get_time();
+  for (;;) {
+    uint32_t length = 0;
+    if (adc_digi_read_bytes(frame, sizeof(frame), &length, ADC_MAX_DELAY) != ESP_OK) {
+      continue;
+    }
+    bootTimeline.mark(BOOT_FIRST_SAMPLE, esp_timer_get_time());
+    for (uint32_t k = 0; k + sizeof(adc_digi_output_data_t) <= length; k += sizeof(adc_digi_output_data_t)) {
+      const adc_digi_output_data_t *out = (const adc_digi_output_data_t *)&frame[k];
+      int16_t value = out->type1.data;
+      if (out->type1.channel == ctVoltageChannel && voltageCount < ctPairsPerCycle) {
+        ctVoltage[active][voltageCount++] = value;
+      } else if (out->type1.channel == ctCurrentChannel && currentCount < ctPairsPerCycle) {
+        ctCurrent[active][currentCount++] = value;
+      }
+      if (voltageCount == ctPairsPerCycle && currentCount == ctPairsPerCycle) {
+        uint8_t done = active;
+        active ^= 1;
+        voltageCount = 0;
+        currentCount = 0;
+        uint64_t now = esp_timer_get_time();
+        PowerSums sums;
+        powerAccumulate(ctVoltage[done], ctCurrent[done], ctPairsPerCycle, sums);
+        PowerReading reading = powerFinish(sums, ctCalibration, (uint32_t)(now - cycleStart));
+        cycleStart = now;
+        if (powerRing.push(reading) && ioTaskHandle != nullptr) {
+          xTaskNotifyGive(ioTaskHandle);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Starter kontinuerlig ADC-sampling med DMA og CT-tasken.
+ */
+void initCtCapture() {
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = 4 * ctFrameBytes;
+  init.conv_num_each_intr = ctFrameBytes;
+  init.adc1_chan_mask = BIT(ctVoltageChannel) | BIT(ctCurrentChannel);
+  init.adc2_chan_mask = 0;
+
+  adc_digi_pattern_config_t pattern[2] = {};
+  pattern[0].atten = ADC_ATTEN_DB_11;
+  pattern[0].channel = ctVoltageChannel;
+  pattern[0].unit = 0;
+  pattern[0].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  pattern[1] = pattern[0];
+  pattern[1].channel = ctCurrentChannel;
+
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = true;
+  config.conv_limit_num = 250;
+  config.pattern_num = 2;
+  config.adc_pattern = pattern;
+  config.sample_freq_hz = ctConversionRateHz;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+  if (adc_digi_initialize(&init) != ESP_OK ||
+      adc_digi_controller_configure(&config) != ESP_OK ||
+      adc_digi_start() != ESP_OK) {
+    Serial.println("Failed to start CT sampling");
+    return;
+  }
+  xTaskCreatePinnedToCore(ctSamplerTask, "sampler", samplerStackSize, nullptr,
+                          samplerPriority, &samplerTaskHandle, samplerCore);
+}
+
+/**
+ * @brief Tømmer powerRing og fodrer energi, effekt og live-felter.
+ */
+void drainPowerReadings() {
+  PowerReading reading;
+  bool gotReading = false;
+  while (powerRing.pop(reading)) {
+    energyMeters[0].onPower(reading.realMw, reading.durationUs, esp_timer_get_time());
+    gotReading = true;
+  }
+  if (gotReading) {
+    checkpointDirty = true;
+    rtcCheckpointDirty = true;
+    broadcaster.set(LIVE_ENERGY, (int32_t)energyMeters[0].energyWh());
+    broadcaster.set(LIVE_VRMS, (int32_t)reading.vrmsMv);
+    broadcaster.set(LIVE_IRMS, (int32_t)reading.irmsMa);
+    broadcaster.set(LIVE_PF, reading.pfPermille);
+  }
+  uint32_t overflows = powerRing.overflows();
+  if (overflows != reportedPowerOverflows) {
+    Serial.printf("Power ring overflow: %u cycles dropped\r\n", overflows);
+    reportedPowerOverflows = overflows;
+  }
+}
+
+/**
+ * @brief Tømmer pulseRing, opdaterer tællere og energi pr. kanal og rapporterer tabte pulser.
+ *
+ * Historikken (rollup) følger kanal 0.
+ */
+void drainPulses() {
+  PulseEvent event;
+  uint32_t changed = 0;
+  if (energyClearRequested.exchange(false)) {
+    for (size_t ch = 0; ch < kConfigMaxChannels; ch++) {
+      energyMeters[ch].clear();
+    }
+    changed = (1u << kConfigMaxChannels) - 1;
+  }
+
+  while (pulseRing.pop(event)) {
+    uint8_t ch = event.channel;
+    counters[ch]++;
+    energyMeters[ch].onPulse(event.us);
+    lastPulseUs[ch] = event.us;
+    if (ch == 0) {
+      pulsesThisSecond++;
+    }
+    changed |= 1u << ch;
+  }
+  if (changed != 0) {
+    checkpointDirty = true;
+    rtcCheckpointDirty = true;
+  }
+  uint64_t nowUs = esp_timer_get_time();
+  for (size_t ch = 0; ch < channels.count(); ch++) {
+    if (changed & (1u << ch)) {
+      broadcaster.set(liveChannelField(LIVE_COUNTER, ch), counters[ch]);
+      broadcaster.set(liveChannelField(LIVE_ENERGY, ch), (int32_t)energyMeters[ch].energyWh());
+    }
+    broadcaster.set(liveChannelField(LIVE_POWER, ch), (int32_t)(energyMeters[ch].powerMw(nowUs) / 1000));
+  }
+  uint32_t overflows = pulseRing.overflows();
+  if (overflows != reportedOverflows) {
+    Serial.printf("Pulse ring overflow: %u pulses dropped\r\n", overflows);
+    reportedOverflows = overflows;
+  }
+}
+
+/**
+ * @brief Udfører handlingerne for regler der er slået til eller fra.
+ * @param changed Bit i for hver regel i der har skiftet
+ * @param t Unix-tid, til alarmer der skal med eksporten
+ */
+void applyRuleChanges(uint32_t changed, time_t t) {
+  uint32_t active = ruleEngine.activeMask();
+  for (size_t i = 0; i < ruleEngine.count(); i++) {
+    uint32_t bit = 1u << i;
+    if (!(changed & bit)) {
+      continue;
+    }
+    const RuleConfig& rule = ruleEngine.rule(i);
+    bool on = (active & bit) != 0;
+    if (on) {
+      ruleFired[i]++;
+    }
+    Serial.printf("Rule %u %s: %s on channel %u, value %ld\r\n", (unsigned)i, on ? "on" : "off",
+                  ruleKindName(rule.kind), (unsigned)rule.channel, (long)ruleEngine.value(i));
+    if (rule.actions & RULE_ACTION_EVENT) {
+      logEvent(on ? LOG_EVENT_RULE_ON : LOG_EVENT_RULE_OFF, i, rule.channel);
+    }
+    // Eksporten laver kun punkter med synkroniseret ur; det samme gælder alarmer
+    if ((rule.actions & RULE_ACTION_PUSH) && exportTaskHandle != nullptr && t >= validTimeAfter) {
+      PushAlert alert;
+      alert.time = (uint32_t)t;
+      alert.channel = rule.channel;
+      alert.rule = i;
+      alert.kind = rule.kind;
+      alert.active = on;
+      alert.value = ruleEngine.value(i);
+      alertRing.push(alert);
+    }
+  }
+  ruleActive = active;
+  uint32_t ledRules = ruleEngine.actionMask(RULE_ACTION_LED);
+  if (changed & ledRules) {
+    bool led = (active & ledRules) != 0;
+    digitalWrite(ledPin, led ? HIGH : LOW);
+    broadcaster.set(LIVE_LED, led ? 1 : 0);
+  }
+  broadcaster.set(LIVE_ALERTS, (int32_t)(active & ruleEngine.actionMask(RULE_ACTION_EVENT)));
+}
+
+/**
+ * @brief Evaluerer alarmreglerne på hver kanals aktuelle værdier.
+ *
+ * Kaldes fra I/O-tasken lige efter pulser og CT-målinger er talt med, dvs.
+ * ved hver ny puls og ellers mindst hver ioPeriod. Bruger ingen heap.
+ */
+void evaluateRules() {
+  if (ruleEngine.count() == 0) {
+    return;
+  }
+  uint32_t nowMs = millis();
+  time_t t = time(nullptr);
+  uint64_t nowUs = esp_timer_get_time();
+  uint32_t changed = 0;
+  for (size_t ch = 0; ch < activeChannels(); ch++) {
+    RuleSample sample;
+    sample.nowMs = nowMs;
+    sample.day = t >= validTimeAfter ? (uint32_t)(t / 86400) : 0;
+    sample.channel = ch;
+    sample.counter = counters[ch];
+    sample.energyWh = (uint32_t)energyMeters[ch].energyWh();
+    sample.powerW = (int32_t)(energyMeters[ch].powerMw(nowUs) / 1000);
+    changed |= ruleEngine.update(sample);
+  }
+  if (changed != 0) {
+    applyRuleChanges(changed, t);
+  }
+}
+
+/**
+ * @brief Indlæser alarmreglerne fra config før I/O-tasken starter.
+ */
+void initRules() {
+  size_t count = 0;
+  while (count < kConfigMaxRules && config.rules[count].kind != RULE_OFF) {
+    count++;
+  }
+  ruleEngine.configure(config.rules, count);
+  char text[kRuleTextMaxBytes];
+  for (size_t i = 0; i < count; i++) {
+    if (formatRule(config.rules[i], text, sizeof(text)) > 0) {
+      Serial.printf("Rule %u: %s\r\n", (unsigned)i, text);
+    }
+    if (config.rules[i].channel >= activeChannels()) {
+      Serial.printf("Warning: rule %u uses inactive channel %u\r\n", (unsigned)i, (unsigned)config.rules[i].channel);
+    }
+  }
+}
+
+/**
+ * @brief FlashRegion i en partition fra partitionstabellen.
+ */
+class PartitionFlashRegion : public FlashRegion {
+public:
+  explicit PartitionFlashRegion(const esp_partition_t *partition) : partition_(partition) {}
+
+  uint32_t size() const override { return partition_->size / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE; }
+  uint32_t sectorSize() const override { return SPI_FLASH_SEC_SIZE; }
+
+  bool erase(uint32_t sector) override {
+    return esp_partition_erase_range(partition_, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE) == ESP_OK;
+  }
+
+  bool write(uint32_t offset, const uint8_t *data, size_t len) override {
+    return esp_partition_write(partition_, offset, data, len) == ESP_OK;
+  }
+
+  bool read(uint32_t offset, uint8_t *buf, size_t len) override {
+    return esp_partition_read(partition_, offset, buf, len) == ESP_OK;
+  }
+
+private:
+  const esp_partition_t *partition_;
+};
+
+/**
+ * @brief Samler tællere og energi pr. kanal i et checkpoint.
+ */
+void captureCheckpoint(Checkpoint &checkpoint) {
+  for (size_t ch = 0; ch < kConfigMaxChannels; ch++) {
+    checkpoint.counters[ch] = counters[ch];
+    checkpoint.energyUwh[ch] = energyMeters[ch].energyUwh();
+  }
+}
+
+/**
+ * @brief Gendanner tællere og energi ved opstart.
+ *
+ * RTC-hukommelsen overlever bløde genstarter (watchdog, ESP.restart(),
+ * panik) og er altid mindst lige så ny som journalen; efter strømsvigt er
+ * den ugyldig, og det nyeste checkpoint i flash bruges. Skal kaldes før
+ * I/O-tasken startes.
+ */
+void initCheckpoint() {
+  checkpointMutex = xSemaphoreCreateMutex();
+  Checkpoint fromFlash;
+  bool flashValid = false;
+  const esp_partition_t *partition =
+    esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, checkpointPartition);
+  if (partition != nullptr) {
+    checkpointFlash.reset(new PartitionFlashRegion(partition));
+    checkpointJournal.reset(new CheckpointJournal(*checkpointFlash));
+    flashValid = checkpointJournal->recover(fromFlash);
+  } else {
+    Serial.println("No checkpoint partition, counters survive soft restarts only");
+  }
+
+  Checkpoint fromRtc;
+  bool rtcValid = checkpointDecode(rtcCheckpoint, fromRtc) && (!flashValid || fromRtc.sequence >= fromFlash.sequence);
+  const Checkpoint *restored = rtcValid ? &fromRtc : flashValid ? &fromFlash : nullptr;
+  if (restored == nullptr) {
+    return;
+  }
+  for (size_t ch = 0; ch < kConfigMaxChannels; ch++) {
+    counters[ch] = restored->counters[ch];
+    energyMeters[ch].restore(restored->energyUwh[ch]);
+  }
+  Serial.printf("Counters restored from %s checkpoint %u\n", rtcValid ? "RTC" : "flash", restored->sequence);
+}
+
+/**
+ * @brief Gemmer tællerne i RTC-hukommelsen og, hvis toFlash, i journalen.
+ *
+ * RTC-kopien får sekvensnummeret for seneste checkpoint i journalen, så
+ * initCheckpoint() kan se at den er mindst lige så ny.
+ * @param toFlash Skriv også et checkpoint i journalen
+ */
+void saveCheckpoint(bool toFlash) {
+  Checkpoint checkpoint;
+  captureCheckpoint(checkpoint);
+  xSemaphoreTake(checkpointMutex, portMAX_DELAY);
+  if (toFlash && checkpointJournal) {
+    uint32_t start = micros();
+    checkpointJournal->write(checkpoint);
+    checkpointHist.observe(micros() - start);
+  }
+  checkpoint.sequence = checkpointJournal ? checkpointJournal->sequence() : 0;
+  checkpointEncode(checkpoint, rtcCheckpoint);
+  xSemaphoreGive(checkpointMutex);
+}
+
+/**
+ * @brief Holder RTC-kopien opdateret og skriver checkpoints med faste mellemrum.
+ *
+ * RTC-kopien koster en CRC over ~100 bytes og skrives hver gang tællerne
+ * har ændret sig; journalen kun når der er gået checkpointInterval, så
+ * flashen slides mindst muligt.
+ */
+void checkpointIfDue() {
+  bool toFlash = checkpointDirty && millis() - lastCheckpoint >= checkpointInterval;
+  if (!toFlash && !rtcCheckpointDirty) {
+    return;
+  }
+  if (toFlash) {
+    lastCheckpoint = millis();
+    checkpointDirty = false;
+  }
+  rtcCheckpointDirty = false;
+  saveCheckpoint(toFlash);
+}
+
+/**
+ * @brief Sender batches som UDP-pakker til InfluxDB's UDP-service.
+ *
+ * UDP har ingen kvittering, så en batch regnes som leveret når den er sendt.
+ */
+class UdpPushTransport : public PushTransport {
+public:
+  UdpPushTransport(const char *host, uint16_t port) : host_(host), port_(port) {}
+
+  const char *name() const override { return "udp"; }
+
+  bool ready(uint32_t) override { return WiFi.isConnected(); }
+
+  bool send(const uint8_t *data, size_t len) override {
+    return udp_.beginPacket(host_, port_) == 1 && udp_.write(data, len) == len && udp_.endPacket() == 1;
+  }
+
+private:
+  WiFiUDP udp_;
+  const char *host_;
+  uint16_t port_;
+};
+
+/**
+ * @brief Sender batches som MQTT-beskeder med QoS 1 over én TCP-forbindelse.
+ *
+ * Forbinder ved behov og regner først en batch som leveret når PUBACK'en er
+ * kommet. Uden svar inden exportAckTimeoutMs lukkes forbindelsen, og
+ * eksportøren spooler batchen. Keep-alive er 0, så brokeren ikke lukker
+ * forbindelsen mellem batches; en død forbindelse opdages ved næste send.
+ */
+class MqttPushTransport : public PushTransport {
+public:
+  MqttPushTransport(const char *host, uint16_t port, const char *clientId, const char *topic)
+    : host_(host), port_(port), clientId_(clientId), topic_(topic) {}
+
+  const char *name() const override { return "mqtt"; }
+
+  bool ready(uint32_t) override {
+    if (!WiFi.isConnected()) {
+      client_.stop();
+      return false;
+    }
+    if (client_.connected()) {
+      return true;
+    }
+    uint8_t packet[64];
+    size_t len = mqttConnect(clientId_, 0, packet, sizeof(packet));
+    uint8_t ack[kMqttAckSize];
+    if (!client_.connect(host_, port_, exportAckTimeoutMs)) {
+      return false;
+    }
+    // Header og payload skrives hver for sig
+    client_.setNoDelay(true);
+    if (client_.write(packet, len) != len || !readAck(ack) || !mqttConnackOk(ack)) {
+      client_.stop();
+      return false;
+    }
+    return true;
+  }
+
+  bool send(const uint8_t *data, size_t len) override {
+    uint8_t header[kMqttMaxHeaderSize + 2 + sizeof(exportTopic) + 2];
+    packetId_ = packetId_ == 0xFFFF ? 1 : packetId_ + 1;
+    size_t headerLen = mqttPublishHeader(topic_, packetId_, len, header, sizeof(header));
+    uint8_t ack[kMqttAckSize];
+    if (headerLen == 0 || client_.write(header, headerLen) != headerLen || client_.write(data, len) != len ||
+        !readAck(ack) || mqttPubackId(ack) != packetId_) {
+      client_.stop();
+      return false;
+    }
+    return true;
+  }
+
+private:
+  bool readAck(uint8_t *ack) {
+    unsigned long start = millis();
+    while (client_.available() < (int)kMqttAckSize) {
+      if (!client_.connected() || millis() - start > exportAckTimeoutMs) {
+        return false;
+      }
+      vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return client_.read(ack, kMqttAckSize) == (int)kMqttAckSize;
+  }
+
+  WiFiClient client_;
+  const char *host_;
+  uint16_t port_;
+  const char *clientId_;
+  const char *topic_;
+  uint16_t packetId_ = 0;
+};
+
+/**
+ * @brief Holder pause i den kaldende task, så længe loop() beder om det.
+ *
+ * Kaldes af I/O- og eksport-tasken i starten af hver iteration, hvor de
+ * ikke holder nogen lås. Pausen kvitteres til loop() (se stopStorageTasks()).
+ */
+void pauseIfStorageStopRequested() {
+  if (!storageStopRequested) {
+    return;
+  }
+  xTaskNotifyGive(loopTaskHandle);
+  while (storageStopRequested) {
+    vTaskDelay(storagePausePeriod);
+  }
+}
+
+/**
+ * @brief Eksport-tasken: målepunkter hvert exportIntervalS, batches og spool.
+ *
+ * Kører for sig selv, da en MQTT-forbindelse kan vente sekunder på
+ * netværket. Værdierne læses fra broadcaster, som må læses fra alle tasks.
+ * Punkter laves først når uret er synkroniseret, da de ellers får forkerte
+ * tidsstempler. Alarmer fra alertRing sendes uden at vente på batchen.
+ */
+void exportTask(void*) {
+  const unsigned long interval = (config.exportIntervalS > 0 ? config.exportIntervalS : 1) * 1000UL;
+  for (;;) {
+    pauseIfStorageStopRequested();
+    unsigned long now = millis();
+    time_t t = time(nullptr);
+    if (now - lastExportPoint >= interval && t >= validTimeAfter) {
+      lastExportPoint = now;
+      for (size_t ch = 0; ch < activeChannels(); ch++) {
+        PushPoint point;
+        point.time = (uint32_t)t;
+        point.channel = ch;
+        point.counter = (uint32_t)broadcaster.get(liveChannelField(LIVE_COUNTER, ch));
+        point.energyWh = broadcaster.get(liveChannelField(LIVE_ENERGY, ch));
+        point.powerW = broadcaster.get(liveChannelField(LIVE_POWER, ch));
+        exporter->add(point, now);
+      }
+    }
+    PushAlert alert;
+    while (alertRing.pop(alert)) {
+      exporter->addAlert(alert, now);
+    }
+    exporter->poll(now);
+    xSemaphoreTake(exportMutex, portMAX_DELAY);
+    exportStats = exporter->stats();
+    xSemaphoreGive(exportMutex);
+    vTaskDelay(exportPeriod);
+  }
+}
+
+/**
+ * @brief Starter eksporten hvis den er konfigureret.
+ *
+ * Finder en spool fra før genstarten, så den sendes når nettet er oppe.
+ */
+void initExport() {
+  if (config.exportMode == EXPORT_OFF || config.exportHost[0] == '\0') {
+    return;
+  }
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(exportDevice, sizeof(exportDevice), "energi-%06lx", (unsigned long)((mac >> 24) & 0xFFFFFF));
+  if (config.exportTopic[0] != '\0') {
+    configSetString(exportTopic, sizeof(exportTopic), config.exportTopic);
+  } else {
+    snprintf(exportTopic, sizeof(exportTopic), "energi/%s/lp", exportDevice);
+  }
+  uint16_t port = config.exportPort;
+  if (config.exportMode == EXPORT_MQTT) {
+    port = port != 0 ? port : exportMqttPort;
+    exportTransport.reset(new MqttPushTransport(config.exportHost, port, exportDevice, exportTopic));
+  } else {
+    port = port != 0 ? port : exportUdpPort;
+    exportTransport.reset(new UdpPushTransport(config.exportHost, port));
+  }
+  exportMutex = xSemaphoreCreateMutex();
+  exporter.reset(new PushExporter(*exportTransport, lockedStorage, PushExporterConfig()));
+  exporter->begin(exportDevice);
+  exportStats = exporter->stats();
+  Serial.printf("Export: %s to %s:%u as %s, %u bytes spooled\r\n", exportTransport->name(),
+                config.exportHost, port, exportDevice, exportStats.spoolBytes);
+  xTaskCreatePinnedToCore(exportTask, "export", exportStackSize, nullptr, exportPriority, &exportTaskHandle, ioCore);
+}
+
+/**
+ * @brief Indlæser time- og dagsniveauerne fra flash ved opstart.
+ */
+void loadRollup() {
+  std::unique_ptr<StorageReader> file = storage.open(rollupPath);
+  if (!file) {
+    return;
+  }
+  RollupFileHeader header;
+  const uint32_t hoursAt = sizeof(header);
+  const uint32_t daysAt = hoursAt + sizeof(rollup.hours);
+  bool ok = file->readAt(0, (uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == rollupMagic && header.version == rollupVersion &&
+            header.hoursSize == sizeof(rollup.hours) && header.daysSize == sizeof(rollup.days) &&
+            file->readAt(hoursAt, (uint8_t*)&rollup.hours, sizeof(rollup.hours)) == sizeof(rollup.hours) &&
+            file->readAt(daysAt, (uint8_t*)&rollup.days, sizeof(rollup.days)) == sizeof(rollup.days);
+  file.reset();
+  if (!ok) {
+    Serial.println("Invalid rollup file, starting empty");
+    rollup.hours.clear();
+    rollup.days.clear();
+  }
+}
+
+/**
+ * @brief Gemmer time- og dagsniveauerne på flash.
+ *
+ * Skrives til en midlertidig fil der derefter omdøbes, så et strømsvigt
+ * midt i skrivningen efterlader den forrige udgave intakt.
+ */
+void saveRollup() {
+  if (rollup.hours.empty()) {
+    return;
+  }
+  uint32_t start = micros();
+  RollupFileHeader header = {rollupMagic, rollupVersion, 0, sizeof(rollup.hours), sizeof(rollup.days)};
+  bool ok = storage.write(rollupTmpPath, (const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            storage.append(rollupTmpPath, (const uint8_t*)&rollup.hours, sizeof(rollup.hours)) == sizeof(rollup.hours) &&
+            storage.append(rollupTmpPath, (const uint8_t*)&rollup.days, sizeof(rollup.days)) == sizeof(rollup.days);
+  if (ok) {
+    storage.rename(rollupTmpPath, rollupPath);
+    rollupSaveHist.observe(micros() - start);
+  } else {
+    Serial.println("Failed to write rollup file");
+    storage.remove(rollupTmpPath);
+  }
+}
+
+/**
+ * @brief Afslutter sekundet når uret går videre og gemmer rollup periodisk.
+ *
+ * Antallet af pulser i hvert sekund lægges i rollup, også når det er 0.
+ * Før uret er synkroniseret via NTP samles der ikke historik.
+ */
+void updateRollup() {
+  time_t now = time(nullptr);
+  if (now < validTimeAfter) {
+    pulsesThisSecond = 0;
+    return;
+  }
+  if ((uint32_t)now != rollupSecond) {
+    if (rollupSecond != 0) {
+      xSemaphoreTake(rollupMutex, portMAX_DELAY);
+      rollup.add(rollupSecond, pulsesThisSecond);
+      xSemaphoreGive(rollupMutex);
+    }
+    rollupSecond = now;
+    pulsesThisSecond = 0;
+  }
+  if (millis() - lastRollupSave >= rollupSaveInterval) {
+    lastRollupSave = millis();
+    xSemaphoreTake(rollupMutex, portMAX_DELAY);
+    saveRollup();
+    xSemaphoreGive(rollupMutex);
+  }
+}
+
+/**
+ * @brief Håndterer /api/history?from=&to=&step=&format=json|csv.
+ *
+ * Svaret streames i chunks direkte fra rollup, så heap-forbruget er begrænset
+ * til én HistoryCursor pr. svar uanset tidsintervallets længde. Standard er
+ * de seneste 24 timer i minutopløsning som JSON.
+ * @param request HTTP-forespørgslen
+ */
+void handleHistory(AsyncWebServerRequest *request) {
+  uint32_t to = time(nullptr);
+  uint32_t from = to > 86400 ? to - 86400 : 0;
+  uint32_t step = 60;
+  HistoryFormat format = HISTORY_JSON;
+  if (request->hasParam("from")) {
+    from = strtoul(request->getParam("from")->value().c_str(), nullptr, 10);
+  }
+  if (request->hasParam("to")) {
+    to = strtoul(request->getParam("to")->value().c_str(), nullptr, 10);
+  }
+  if (request->hasParam("step")) {
+    step = strtoul(request->getParam("step")->value().c_str(), nullptr, 10);
+  }
+  if (request->hasParam("format") && request->getParam("format")->value() == "csv") {
+    format = HISTORY_CSV;
+  }
+
+  if (historyStreams.fetch_add(1) >= maxHistoryStreams) {
+    historyStreams--;
+    request->send(503, "text/plain", "Too many history requests");
+    return;
+  }
+  std::shared_ptr<HistoryStream> stream = std::make_shared<HistoryStream>(from, to, step, format);
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+    format == HISTORY_CSV ? "text/csv" : "application/json",
+    [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      xSemaphoreTake(rollupMutex, portMAX_DELAY);
+      size_t len = stream->cursor.fill(buffer, maxLen);
+      xSemaphoreGive(rollupMutex);
+      if (len == 0 && !stream->cursor.done()) {
+        return RESPONSE_TRY_AGAIN; // Kun tomme skridt; fortsæt ved næste kald
+      }
+      return len;
+    });
+  request->send(response);
+}
+
+/**
+ * @brief Åbner en fil til læsning under logMutex.
+ *
+ * Så åbningen ikke falder midt i en komprimering, der sletter logfilen.
+ */
+std::unique_ptr<StorageReader> openLogFile(const char *path) {
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  std::unique_ptr<StorageReader> file = storage.open(path);
+  xSemaphoreGive(logMutex);
+  return file;
+}
+
+/**
+ * @brief Læser logfilen for ét streamet svar.
+ *
+ * Har sit eget filhåndtag; hver læsning sker under logMutex, så den ikke
+ * blandes med en commit fra I/O-tasken. Poster der allerede ligger i
+ * historyPath efter en afbrudt komprimering er skjult, så filen ser ud til
+ * kun at have de rå poster. Destruktoren frigiver pladsen i logStreams.
+ */
+struct LogStream {
+  std::unique_ptr<StorageReader> file; ///< Læsehåndtag til logFilePath
+  uint32_t compacted = 0;              ///< Skjulte poster i starten af filen
+
+  LogStream() {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    file = storage.open(logFilePath);
+    compacted = file ? logCompactedRecords(logRecordCount(file->size())) : 0;
+    xSemaphoreGive(logMutex);
+  }
+  ~LogStream() {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    file.reset();
+    xSemaphoreGive(logMutex);
+    logStreams--;
+  }
+
+  /** @brief Filens størrelse uden de skjulte poster, dvs. alle committede bytes. */
+  uint32_t size() { return file ? file->size() - compacted * sizeof(LogRecord) : 0; }
+
+  /**
+   * @brief Læser bytes fra en given position, enten i headeren eller i posterne.
+   * @return Antal læste bytes.
+   */
+  size_t readBytes(uint32_t offset, uint8_t *buf, size_t len) {
+    if (offset >= sizeof(LogHeader)) {
+      offset += compacted * sizeof(LogRecord);
+    }
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    size_t n = file ? file->readAt(offset, buf, len) : 0;
+    xSemaphoreGive(logMutex);
+    return n;
+  }
+
+  /**
+   * @brief Læser poster fra et givet indeks.
+   * @return Antal læste poster.
+   */
+  size_t readRecords(uint32_t index, LogRecord *records, size_t count) {
+    return readBytes(logRecordOffset(index), (uint8_t *)records, count * sizeof(LogRecord)) / sizeof(LogRecord);
+  }
+};
+
+/**
+ * @brief De komprimerede blokke i historyPath for ét CSV-svar.
+ */
+class HistoryBlockStream : public LogBlockSource {
+public:
+  HistoryBlockStream(uint32_t from, uint32_t to) : LogBlockSource(from, to), file_(openLogFile(historyPath)) {}
+  ~HistoryBlockStream() {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    file_.reset();
+    xSemaphoreGive(logMutex);
+  }
+
+protected:
+  size_t readBytes(uint32_t offset, uint8_t *buf, size_t len) override {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    size_t n = file_ ? file_->readAt(offset, buf, len) : 0;
+    xSemaphoreGive(logMutex);
+    return n;
+  }
+
+private:
+  std::unique_ptr<StorageReader> file_; ///< Læsehåndtag til historyPath
+};
+
+/**
+ * @brief Tæller posterne i historyPath ved opstart og finder logBaseRecords.
+ *
+ * Læser kun blokheaderne. Er logfilen tom, starter den forfra ved
+ * historyRecords; mangler logBasePath ved en logfil med poster, er ingen af
+ * dem komprimeret. logBasePath rettes i begge tilfælde. Sletter en
+ * efterladt historyTmpPath.
+ */
+void initHistoryRecords() {
+  HistoryBlockStream blocks(0, UINT32_MAX);
+  blocks.skip(UINT32_MAX);
+  LogRecord record;
+  blocks.read(&record, 1);
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  storage.remove(historyTmpPath);
+  historyRecords = blocks.recordsSkipped();
+  std::unique_ptr<StorageReader> log = storage.open(logFilePath);
+  uint32_t count = log ? logRecordCount(log->size()) : 0;
+  log.reset();
+  uint32_t stored = UINT32_MAX;
+  if (storage.read(logBasePath, (uint8_t *)&stored, sizeof(stored)) != sizeof(stored)) {
+    stored = UINT32_MAX;
+  }
+  uint32_t base = count > 0 && stored <= historyRecords ? stored : historyRecords;
+  if (base != stored) {
+    saveLogBase(base);
+  }
+  logBaseRecords = base;
+  xSemaphoreGive(logMutex);
+}
+
+/**
+ * @brief Et tidsvindue fra loggen som CSV.
+ *
+ * Læser først de komprimerede blokke, hvor blokke uden for vinduet
+ * springes over, og derefter de rå poster i logfilen fra første post med
+ * time >= from. Antallet af rå poster fastlægges når svaret starter; poster
+ * der tilføjes undervejs kommer med i næste forespørgsel. Komprimering
+ * venter til svaret er færdigt (se compactLogIfDue()).
+ */
+struct LogCsvStream : public LogRecordSource {
+  HistoryBlockStream blocks; ///< Komprimeret historik
+  LogStream head;            ///< Rå poster der endnu ikke er komprimeret
+  uint32_t next;             ///< Næste rå post
+  uint32_t count;            ///< Rå poster i filen ved start
+  LogCsvCursor cursor;       ///< Position i svaret
+
+  LogCsvStream(uint32_t from, uint32_t to)
+    : blocks(from, to), count(logRecordCount(head.size())), cursor(*this, from, to) {
+    next = logLowerBound([this](uint32_t index, LogRecord &record) {
+      return head.readRecords(index, &record, 1) == 1;
+    }, count, from);
+  }
+
+  size_t read(LogRecord *records, size_t want) override {
+    size_t n = blocks.read(records, want);
+    if (n > 0 || next >= count) {
+      return n;
+    }
+    n = head.readRecords(next, records, count - next < want ? count - next : want);
+    next += n;
+    return n;
+  }
+};
 
-String ssid;           ///< Gemt Wi-Fi SSID
-String pass;           ///< Gemt Wi-Fi password
-String ip;             ///< Gemt IP-adresse
-String gateway;        ///< Gemt gateway-adresse
+/**
+ * @brief Reserverer en plads til et log-svar.
+ * @return False (og 503 er sendt) hvis der allerede er maxLogStreams svar.
+ */
+bool reserveLogStream(AsyncWebServerRequest *request) {
+  if (logStreams.fetch_add(1) >= maxLogStreams) {
+    logStreams--;
+    request->send(503, "text/plain", "Too many log downloads");
+    return false;
+  }
+  return true;
+}
 
-// Filstier til SPIFFS
-const char* ssidPath = "/ssid.txt";       ///< Filsti til SSID
-const char* passPath = "/pass.txt";       ///< Filsti til password
-const char* ipPath = "/ip.txt";           ///< Filsti til IP-adresse
-const char* gatewayPath = "/gateway.txt"; ///< Filsti til gateway-adresse
+/**
+ * @brief Hele loggen som én binær logfil for /api/log.
+ *
+ * Logfilens header, posterne i de komprimerede blokke og de rå poster i
+ * logfilen, i den rækkefølge. Komprimering flytter poster fra logfilen til
+ * blokkene uden at ændre rækkefølgen, så en posts byte-offset er den samme
+ * før og efter. Blokposterne afkodes fra starten af den blok offsettet
+ * falder i; læsninger forventes i stigende rækkefølge.
+ */
+struct LogDownloadStream {
+  LogStream head;                             ///< Rå poster; frigiver pladsen i logStreams
+  std::unique_ptr<HistoryBlockStream> blocks; ///< Blokposter fra blockNext
+  uint32_t blockRecords;                      ///< Poster i blokkene ved start
+  uint32_t blockNext = 0;                     ///< Indeks på næste post fra blocks
+  LogRecord last;                             ///< Senest afkodede blokpost
+  uint32_t lastIndex = UINT32_MAX;            ///< Indeks på last
+  LogHeader header;                           ///< Filheaderen der sendes først
+
+  LogDownloadStream() {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    blockRecords = historyRecords;
+    xSemaphoreGive(logMutex);
+    if (head.readBytes(0, (uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+      header = makeLogHeader(lastLogTime);
+    }
+  }
 
-unsigned long previousMillis = 0;         ///< Timer til Wi-Fi timeout
-const long interval = 10000;              ///< Timeout-interval for Wi-Fi (ms)
+  /** @brief Størrelsen af den samlede fil. */
+  uint32_t size() {
+    return logRecordOffset(blockRecords + logRecordCount(head.size()));
+  }
 
-const int ledPin = 2;                     ///< GPIO til LED
-String ledState;                          ///< Status for LED
+  /**
+   * @brief Blokpost nummer index.
+   * @return False hvis den ikke kunne læses.
+   */
+  bool blockRecord(uint32_t index, LogRecord &record) {
+    if (index == lastIndex) {
+      record = last;
+      return true;
+    }
+    if (!blocks || index != blockNext) {
+      blocks.reset(new HistoryBlockStream(0, UINT32_MAX));
+      blocks->skip(index);
+      blockNext = index;
+    }
+    if (blocks->read(&last, 1) != 1) {
+      return false;
+    }
+    lastIndex = blockNext++;
+    record = last;
+    return true;
+  }
 
-// Touch sensor
-const int touchPin = 15;                  ///< GPIO til berøringssensor
-int counter = 0;                          ///< Tæller for touch events
-unsigned long lastTouchTime = 0;          ///< Tidspunkt for sidste touch event
-const unsigned long debounceTime = 500;   ///< Debounce-tid (ms)
+  /**
+   * @brief Læser bytes fra en given position i den samlede fil.
+   * @return Antal læste bytes.
+   */
+  size_t readBytes(uint32_t offset, uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+      uint32_t at = offset + n;
+      if (at < sizeof(LogHeader)) {
+        size_t chunk = sizeof(LogHeader) - at < len - n ? sizeof(LogHeader) - at : len - n;
+        memcpy(buf + n, (const uint8_t *)&header + at, chunk);
+        n += chunk;
+        continue;
+      }
+      uint32_t index = (at - sizeof(LogHeader)) / sizeof(LogRecord);
+      uint32_t within = (at - sizeof(LogHeader)) % sizeof(LogRecord);
+      if (index >= blockRecords) {
+        return n + head.readBytes(logRecordOffset(index - blockRecords) + within, buf + n, len - n);
+      }
+      LogRecord record;
+      if (!blockRecord(index, record)) {
+        break;
+      }
+      size_t chunk = sizeof(LogRecord) - within < len - n ? sizeof(LogRecord) - within : len - n;
+      memcpy(buf + n, (const uint8_t *)&record + within, chunk);
+      n += chunk;
+    }
+    return n;
+  }
+};
 
-// Datalog fil
-const char* logFilePath = "/log.txt";     ///< Filsti til logfil
+/**
+ * @brief Sender hele loggen som binær logfil, helt eller som et byte-interval.
+ *
+ * Understøtter "Range: bytes=a-b", "bytes=a-" og "bytes=-n". Filen består
+ * af de komprimerede blokke afkodet til poster efterfulgt af de rå poster
+ * (se LogDownloadStream) og vokser kun, så en collector kan hente nye bytes
+ * med "bytes=<forrige størrelse>-". Den bliver kun mindre når måleværdierne
+ * slettes; så startes forfra. Svaret streames i bidder direkte fra flash.
+ */
+void handleLogDownload(AsyncWebServerRequest *request) {
+  if (!reserveLogStream(request)) {
+    return;
+  }
+  std::shared_ptr<LogDownloadStream> stream = std::make_shared<LogDownloadStream>();
+  uint32_t size = stream->size();
+  uint32_t first = 0;
+  uint32_t last = size ? size - 1 : 0;
+  ByteRangeResult range = parseByteRange(
+    request->hasHeader("Range") ? request->getHeader("Range")->value().c_str() : nullptr, size, first, last);
+
+  char contentRange[48];
+  if (range == BYTE_RANGE_UNSATISFIABLE) {
+    snprintf(contentRange, sizeof(contentRange), "bytes */%lu", (unsigned long)size);
+    AsyncWebServerResponse *response = request->beginResponse(416);
+    response->addHeader("Content-Range", contentRange);
+    request->send(response);
+    return;
+  }
+  size_t length = size ? last - first + 1 : 0;
+  AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", length,
+    [stream, first, length](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      if (index >= length) {
+        return 0;
+      }
+      return stream->readBytes(first + index, buffer, maxLen < length - index ? maxLen : length - index);
+    });
+  response->addHeader("Accept-Ranges", "bytes");
+  response->addHeader("Content-Disposition", "attachment; filename=\"log.bin\"");
+  if (range == BYTE_RANGE_OK) {
+    snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu",
+             (unsigned long)first, (unsigned long)last, (unsigned long)size);
+    response->setCode(206);
+    response->addHeader("Content-Range", contentRange);
+  }
+  request->send(response);
+}
 
 /**
- * @brief Initialiserer SPIFFS.
+ * @brief Eksporterer et tidsvindue fra loggen som CSV.
+ *
+ * Parametre: from og to (Unix-tid i s, inklusiv). Standard er hele loggen.
  */
-void initSPIFFS() {
-  if (!SPIFFS.begin(true)) {
-    Serial.println("An error has occurred while mounting SPIFFS");
+void handleLogCsv(AsyncWebServerRequest *request) {
+  uint32_t from = 0;
+  uint32_t to = UINT32_MAX;
+  if (request->hasParam("from")) {
+    from = strtoul(request->getParam("from")->value().c_str(), nullptr, 10);
   }
-  Serial.println("SPIFFS mounted successfully");
+  if (request->hasParam("to")) {
+    to = strtoul(request->getParam("to")->value().c_str(), nullptr, 10);
+  }
+  if (!reserveLogStream(request)) {
+    return;
+  }
+  std::shared_ptr<LogCsvStream> stream = std::make_shared<LogCsvStream>(from, to);
+  AsyncWebServerResponse *response = request->beginChunkedResponse("text/csv",
+    [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return stream->cursor.fill(buffer, maxLen);
+    });
+  request->send(response);
 }
 
 /**
- * @brief Læser indholdet af en fil fra SPIFFS.
- * @param fs Filesystem objektet (SPIFFS)
- * @param path Stien til filen
- * @return Indholdet af filen som en streng
+ * @brief Sender WebSocket-broadcasterens statistik som JSON.
+ * @param request HTTP-forespørgslen
  */
-String readFile(fs::FS &fs, const char * path){
-  Serial.printf("Reading file: %s\r\n", path);
-  File file = fs.open(path);
-  if(!file || file.isDirectory()){
-    Serial.println("- failed to open file for reading");
-    return String();
+void handleWsStats(AsyncWebServerRequest *request) {
+  char json[1024];
+  broadcaster.statsJson(json, sizeof(json));
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Skriver et histogram i Prometheus' tekstformat, omregnet til sekunder.
+ * @param out Svarstrømmen
+ * @param name Metrikkens navn
+ * @param help Beskrivelse; nullptr udelader HELP/TYPE (flere serier med labels)
+ * @param labels Ekstra labels, f.eks. "file=\"log\"", eller ""
+ * @param hist Histogrammet
+ */
+void writeHistogram(AsyncResponseStream *out, const char *name, const char *help, const char *labels, const Histogram &hist) {
+  if (help != nullptr) {
+    out->printf("# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
   }
-  String fileContent;
-  while(file.available()){
-    fileContent = file.readStringUntil('\n');
-    break;     
+  const char *sep = labels[0] ? "," : "";
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < hist.bucketCount(); i++) {
+    cumulative += hist.bucket(i);
+    out->printf("%s_bucket{%s%sle=\"%.6f\"} %u\n", name, labels, sep, hist.bound(i) / 1e6, cumulative);
   }
-  return fileContent;
+  cumulative += hist.bucket(hist.bucketCount());
+  out->printf("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, sep, cumulative);
+  out->printf("%s_sum{%s} %.6f\n", name, labels, hist.sum() / 1e6);
+  out->printf("%s_count{%s} %u\n", name, labels, cumulative);
 }
 
 /**
- * @brief Skriver data til en fil på SPIFFS.
- * @param fs Filesystem objektet
- * @param path Stien til filen
- * @param message Data, der skal skrives
+ * @brief Skriver en enkelt gauge eller counter i Prometheus' tekstformat.
+ */
+void writeMetric(AsyncResponseStream *out, const char *name, const char *type, const char *help, double value) {
+  out->printf("# HELP %s %s\n# TYPE %s %s\n%s %.0f\n", name, help, name, type, name, value);
+}
+
+/**
+ * @brief Skriver laveste resterende stak (high-water mark) for hver task.
+ * @param out Svarstrømmen
+ */
+void writeStackMetrics(AsyncResponseStream *out) {
+  out->print("# HELP energi_task_stack_free_bytes Lowest free stack ever seen per task\n"
+             "# TYPE energi_task_stack_free_bytes gauge\n");
+  const struct { const char *name; TaskHandle_t handle; } tasks[] = {
+    {"sampler", samplerTaskHandle},
+    {"io", ioTaskHandle},
+    {"export", exportTaskHandle},
+    {"loop", loopTaskHandle},
+  };
+  for (const auto &task : tasks) {
+    if (task.handle != nullptr) {
+      out->printf("energi_task_stack_free_bytes{task=\"%s\"} %u\n",
+                  task.name, (unsigned)uxTaskGetStackHighWaterMark(task.handle));
+    }
+  }
+}
+
+/**
+ * @brief Markerer en opstartsfase og skriver tidspunktet på Serial.
+ *
+ * Må ikke kaldes fra sample-tasken; den markerer direkte i bootTimeline.
+ * @param phase Fasen
  */
-void writeFile(fs::FS &fs, const char * path, const char * message){
-  Serial.printf("Writing file: %s\r\n", path);
-  File file = fs.open(path, FILE_WRITE);
-  if(!file){
-    Serial.println("- failed to open file for writing");
+void markBoot(BootPhase phase) {
+  if (bootTimeline.reached(phase)) {
     return;
   }
-  if(file.print(message)){
-    Serial.println("- file written");
-  } else {
-    Serial.println("- write failed");
+  bootTimeline.mark(phase, esp_timer_get_time());
+  Serial.printf("Boot: %s after %u ms\r\n", BootTimeline::name(phase),
+                (unsigned)(bootTimeline.at(phase) / 1000));
+}
+
+/**
+ * @brief Udfører en handling fra wifiConnector.
+ * @param action Handlingen
+ */
+void applyWiFiAction(WifiAction action) {
+  if (action == WIFI_ACTION_CONNECT) {
+    Serial.printf("Connecting to WiFi (attempt %u)...\r\n", wifiConnector.attempts());
+    WiFi.disconnect();
+    WiFi.begin(config.ssid, config.pass);
+  } else if (action == WIFI_ACTION_START_AP) {
+    Serial.println("Starting configuration access point");
+    WiFi.mode(config.ssid[0] == '\0' ? WIFI_AP : WIFI_AP_STA);
+    WiFi.softAP(apSsid, NULL);
+    wifiProvisioning = true;
   }
 }
 
 /**
- * @brief Logger data til en fil og sender over WebSocket.
- * @param data Den data, der skal logges
+ * @brief Starter Wi-Fi uden at vente på forbindelse.
+ *
+ * Uden gemt SSID startes konfigurations-AP'et straks; ellers forbindes der
+ * i baggrunden, og pollWiFi() håndterer timeout og genforbindelse.
  */
-void logData(String data) {
-  File file = SPIFFS.open(logFilePath, FILE_APPEND);
-  if (file) {
-    file.println(data);
-    file.close();
-    Serial.println("Data logged: " + data);
-  } else {
-    Serial.println("Failed to open log file");
+void initWiFi() {
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);
+  WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+    wifiConnects++;
+    wifiGotIp = true;
+    if (ioTaskHandle != nullptr) {
+      xTaskNotifyGive(ioTaskHandle);
+    }
+  }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+    wifiDisconnects++;
+    wifiLost = true;
+  }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  bool configured = config.ssid[0] != '\0';
+  if (!configured) {
+    Serial.println("Undefined SSID.");
   }
-  ws.textAll(data);
+  applyWiFiAction(wifiConnector.start(configured, millis()));
 }
 
 /**
- * @brief Sender tællerværdien over WebSocket.
+ * @brief Fodrer Wi-Fi-hændelser til wifiConnector og udfører dens handlinger.
+ *
+ * Kaldes fra I/O-tasken; blokerer aldrig.
  */
-void sendCounter() {
-  String message = "counter:" + String(counter);
-  ws.textAll(message);
+void pollWiFi() {
+  uint32_t now = millis();
+  if (wifiLost.exchange(false)) {
+    wifiConnector.onDisconnected(now);
+    if (wifiConnector.state() == WIFI_STATE_BACKOFF) {
+      Serial.printf("WiFi lost, retrying in %u ms\r\n", wifiConnector.backoffMs());
+    }
+  }
+  if (wifiGotIp.exchange(false)) {
+    wifiConnector.onConnected(now);
+    Serial.print("Connected to Wi-Fi, IP Address: ");
+    Serial.println(WiFi.localIP());
+    markBoot(BOOT_WIFI_CONNECTED);
+  }
+  applyWiFiAction(wifiConnector.poll(now));
+  if (!bootTimeline.reached(BOOT_TIME_SYNCED) && time(nullptr) >= validTimeAfter) {
+    markBoot(BOOT_TIME_SYNCED);
+  }
 }
 
 /**
- * @brief Håndterer berøringsinput med debouncing.
+ * @brief Skriver tidspunktet for hver nået opstartsfase.
+ * @param out Svarstrømmen
  */
-void handleTouch() {
-  unsigned long now = millis();
-  if (touchRead(touchPin) < 40 && (now - lastTouchTime > debounceTime)) {
-    counter++;
-    sendCounter();
-    lastTouchTime = now;
+void writeBootMetrics(AsyncResponseStream *out) {
+  out->print("# HELP energi_boot_phase_seconds Time from boot until each startup phase was reached\n"
+             "# TYPE energi_boot_phase_seconds gauge\n");
+  for (uint8_t p = 0; p < BOOT_PHASE_COUNT; p++) {
+    if (bootTimeline.reached((BootPhase)p)) {
+      out->printf("energi_boot_phase_seconds{phase=\"%s\"} %.3f\n",
+                  BootTimeline::name((BootPhase)p), bootTimeline.at((BootPhase)p) / 1e6);
+    }
   }
 }
 
 /**
- * @brief Initialiserer Wi-Fi-forbindelsen.
- * @return True hvis forbindelse lykkes, ellers false.
+ * @brief Skriver HELP og TYPE for en metrik med én serie pr. kanal.
  */
-bool initWiFi() {
-  if(ssid=="" || ip==""){
-    Serial.println("Undefined SSID or IP address.");
-    return false;
+void writeChannelHeader(AsyncResponseStream *out, const char *name, const char *type, const char *help) {
+  out->printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Skriver tællere, energi, effekt og detektorens signalkvalitet pr. kanal.
+ *
+ * Samplegennemgangens pris pr. kanal er middelvarigheden delt med antallet
+ * af kanaler, så den kan følges når der tilføjes kanaler.
+ * Energi og effekt læses fra broadcaster, da energyMeters ejes af I/O-tasken.
+ * @param out Svarstrømmen
+ */
+void writeChannelMetrics(AsyncResponseStream *out) {
+  size_t count = activeChannels();
+  PulseDetectorStats stats[kConfigMaxChannels];
+  for (size_t ch = 0; ch < count; ch++) {
+    stats[ch] = channels.stats(ch);
+  }
+
+  writeChannelHeader(out, "energi_pulses_total", "counter", "Pulses counted, kept across restarts by checkpoints");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_pulses_total{channel=\"%u\"} %u\n", (unsigned)ch, counters[ch]);
+  }
+  writeChannelHeader(out, "energi_energy_wh_total", "counter", "Energy measured since last clear (Wh)");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_energy_wh_total{channel=\"%u\"} %ld\n", (unsigned)ch,
+                (long)broadcaster.get(liveChannelField(LIVE_ENERGY, ch)));
+  }
+  writeChannelHeader(out, "energi_power_watts", "gauge", "Power estimated from the pulse interval");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_power_watts{channel=\"%u\"} %ld\n", (unsigned)ch,
+                (long)broadcaster.get(liveChannelField(LIVE_POWER, ch)));
+  }
+  if (samplingMode == SAMPLING_CT) {
+    return;
   }
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid.c_str(), pass.c_str());
-  Serial.println("Connecting to WiFi...");
 
-  unsigned long currentMillis = millis();
-  previousMillis = currentMillis;
+  writeMetric(out, "energi_sample_channels", "gauge", "Pulse channels sampled per pass", count);
+  uint32_t passes = sampleHist.observations();
+  out->printf("# HELP energi_sample_cost_per_channel_seconds Mean sampling pass duration divided by channels\n"
+              "# TYPE energi_sample_cost_per_channel_seconds gauge\n"
+              "energi_sample_cost_per_channel_seconds %.9f\n",
+              passes ? sampleHist.sum() / 1e6 / passes / count : 0.0);
 
-  while(WiFi.status() != WL_CONNECTED) {
-    currentMillis = millis();
-    if (currentMillis - previousMillis >= interval) {
-      Serial.println("Failed to connect.");
-      return false;
+  writeChannelHeader(out, "energi_detector_baseline", "gauge", "Tracked sensor idle level");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_detector_baseline{channel=\"%u\"} %.2f\n", (unsigned)ch, stats[ch].baselineQ16 / 65536.0f);
+  }
+  writeChannelHeader(out, "energi_detector_noise", "gauge", "Mean absolute sensor deviation at rest");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_detector_noise{channel=\"%u\"} %.2f\n", (unsigned)ch, stats[ch].noiseQ16 / 65536.0f);
+  }
+  writeChannelHeader(out, "energi_detector_min_amplitude", "gauge", "Smallest amplitude among counted pulses");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_detector_min_amplitude{channel=\"%u\"} %.2f\n", (unsigned)ch, stats[ch].minAmplitudeQ16 / 65536.0f);
+  }
+  writeChannelHeader(out, "energi_detector_snr", "gauge", "Smallest pulse amplitude divided by noise");
+  for (size_t ch = 0; ch < count; ch++) {
+    float noise = stats[ch].noiseQ16 / 65536.0f;
+    out->printf("energi_detector_snr{channel=\"%u\"} %.1f\n", (unsigned)ch,
+                noise > 0 ? stats[ch].minAmplitudeQ16 / 65536.0f / noise : 0.0f);
+  }
+  writeChannelHeader(out, "energi_detector_rejected_total", "counter", "Sensor excursions not counted as pulses");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_detector_rejected_total{channel=\"%u\",reason=\"short\"} %u\n"
+                "energi_detector_rejected_total{channel=\"%u\",reason=\"interval\"} %u\n",
+                (unsigned)ch, stats[ch].rejectedShort, (unsigned)ch, stats[ch].rejectedInterval);
+  }
+  writeChannelHeader(out, "energi_detector_baseline_resets_total", "counter", "Baseline resets after the sensor stayed active too long");
+  for (size_t ch = 0; ch < count; ch++) {
+    out->printf("energi_detector_baseline_resets_total{channel=\"%u\"} %u\n", (unsigned)ch, stats[ch].baselineResets);
+  }
+}
+
+/**
+ * @brief Skriver checkpoint-journalens tællere og estimerede slid.
+ * @param out Svarstrømmen
+ */
+void writeCheckpointMetrics(AsyncResponseStream *out) {
+  if (!checkpointJournal) {
+    return;
+  }
+  xSemaphoreTake(checkpointMutex, portMAX_DELAY);
+  CheckpointJournalStats stats = checkpointJournal->stats();
+  uint32_t sequence = checkpointJournal->sequence();
+  uint32_t sectorErases = checkpointJournal->estimatedSectorErases();
+  float wear = checkpointJournal->wear();
+  xSemaphoreGive(checkpointMutex);
+  writeMetric(out, "energi_checkpoint_writes_total", "counter", "Counter checkpoints written to flash since boot", stats.writes);
+  writeMetric(out, "energi_checkpoint_failures_total", "counter", "Checkpoint writes or erases that failed", stats.failures);
+  writeMetric(out, "energi_checkpoint_sequence", "gauge", "Sequence number of the newest checkpoint", sequence);
+  writeMetric(out, "energi_checkpoint_recovery_reads", "gauge", "Slots read to find the newest checkpoint at boot", stats.recoveryReads);
+  writeMetric(out, "energi_checkpoint_sector_erases", "gauge", "Estimated erase cycles per journal sector over its lifetime", sectorErases);
+  out->printf("# HELP energi_checkpoint_flash_wear_ratio Estimated share of rated erase cycles used by the journal\n"
+              "# TYPE energi_checkpoint_flash_wear_ratio gauge\n"
+              "energi_checkpoint_flash_wear_ratio %.6f\n", wear);
+}
+
+/**
+ * @brief Skriver eksportørens leveringstællere.
+ * @param out Svaret der skrives til
+ */
+void writeExportMetrics(AsyncResponseStream *out) {
+  if (!exporter) {
+    return;
+  }
+  xSemaphoreTake(exportMutex, portMAX_DELAY);
+  PushExporterStats stats = exportStats;
+  xSemaphoreGive(exportMutex);
+  writeMetric(out, "energi_export_points_total", "counter", "Points added to export batches", stats.points);
+  writeMetric(out, "energi_export_batches_total", "counter", "Export batches closed by size or age", stats.batches);
+  writeMetric(out, "energi_export_batches_sent_total", "counter", "Batches delivered directly", stats.sent);
+  writeMetric(out, "energi_export_batches_drained_total", "counter", "Batches delivered from the flash spool", stats.drained);
+  writeMetric(out, "energi_export_bytes_sent_total", "counter", "Line protocol bytes delivered", stats.bytesSent);
+  writeMetric(out, "energi_export_send_failures_total", "counter", "Batch sends that failed or were not acknowledged", stats.sendFailures);
+  writeMetric(out, "energi_export_batches_spooled_total", "counter", "Batches written to the flash spool", stats.spooled);
+  writeMetric(out, "energi_export_spool_failures_total", "counter", "Batches lost because the spool could not be written", stats.spoolFailures);
+  writeMetric(out, "energi_export_spool_discarded_bytes_total", "counter", "Spool bytes dropped to stay within the bound or because they were unreadable", stats.discardedBytes);
+  writeMetric(out, "energi_export_spool_bytes", "gauge", "Bytes waiting in the flash spool", stats.spoolBytes);
+}
+
+/**
+ * @brief Skriver alarmreglernes tilstand.
+ * @param out Svaret der skrives til
+ */
+void writeRuleMetrics(AsyncResponseStream *out) {
+  if (ruleEngine.count() == 0) {
+    return;
+  }
+  uint32_t active = ruleActive;
+  out->print("# HELP energi_rule_active Whether an alert rule is active\n"
+             "# TYPE energi_rule_active gauge\n");
+  for (size_t i = 0; i < ruleEngine.count(); i++) {
+    const RuleConfig& rule = ruleEngine.rule(i);
+    out->printf("energi_rule_active{rule=\"%u\",kind=\"%s\",channel=\"%u\"} %u\n", (unsigned)i,
+                ruleKindName(rule.kind), (unsigned)rule.channel, (unsigned)((active >> i) & 1));
+  }
+  out->print("# HELP energi_rule_fired_total Times an alert rule became active since boot\n"
+             "# TYPE energi_rule_fired_total counter\n");
+  for (size_t i = 0; i < ruleEngine.count(); i++) {
+    out->printf("energi_rule_fired_total{rule=\"%u\"} %u\n", (unsigned)i, ruleFired[i].load());
+  }
+  writeMetric(out, "energi_rule_alerts_dropped_total", "counter", "Alerts not exported because the alert queue was full", alertRing.overflows());
+}
+
+/**
+ * @brief Håndterer /metrics i Prometheus' tekstformat.
+ * @param request HTTP-forespørgslen
+ */
+void handleMetrics(AsyncWebServerRequest *request) {
+  AsyncResponseStream *out = request->beginResponseStream("text/plain; version=0.0.4");
+
+  writeHistogram(out, "energi_loop_duration_seconds", "Duration of one I/O task iteration", "", loopHist);
+  writeHistogram(out, "energi_sample_pass_seconds", "Duration of one sampling pass over all pulse channels", "", sampleHist);
+  writeHistogram(out, "energi_flash_write_seconds", "Duration of flash commits", "file=\"log\"", logCommitHist);
+  writeHistogram(out, "energi_flash_write_seconds", nullptr, "file=\"rollup\"", rollupSaveHist);
+  writeHistogram(out, "energi_flash_write_seconds", nullptr, "file=\"checkpoint\"", checkpointHist);
+
+  writeMetric(out, "energi_uptime_seconds", "gauge", "Seconds since boot", esp_timer_get_time() / 1e6);
+  writeMetric(out, "energi_pulse_overflows_total", "counter", "Pulses dropped because the ring was full", pulseRing.overflows());
+  writeChannelMetrics(out);
+
+  writeMetric(out, "energi_heap_free_bytes", "gauge", "Free heap", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+  writeMetric(out, "energi_heap_largest_free_block_bytes", "gauge", "Largest free heap block", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  writeMetric(out, "energi_heap_min_free_bytes", "gauge", "Minimum free heap since boot", heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+
+  writeMetric(out, "energi_wifi_rssi_dbm", "gauge", "Wi-Fi signal strength", WiFi.RSSI());
+  writeMetric(out, "energi_wifi_connects_total", "counter", "Times Wi-Fi got an IP address", wifiConnects.load());
+  writeMetric(out, "energi_wifi_disconnects_total", "counter", "Times the Wi-Fi connection was lost", wifiDisconnects.load());
+  writeMetric(out, "energi_wifi_state", "gauge", "Wi-Fi state (0 unconfigured, 1 connecting, 2 connected, 3 backoff)", wifiConnector.state());
+  writeMetric(out, "energi_wifi_attempts_total", "counter", "Wi-Fi connection attempts", wifiConnector.attempts());
+  writeBootMetrics(out);
+
+  writeMetric(out, "energi_ws_clients", "gauge", "Connected WebSocket clients", ws.count());
+  writeMetric(out, "energi_ws_messages_sent_total", "counter", "Live messages sent", broadcaster.messagesSent());
+  writeMetric(out, "energi_ws_messages_dropped_total", "counter", "Live messages skipped on full client queues", broadcaster.messagesDropped());
+  writeMetric(out, "energi_ws_replay_requests_total", "counter", "Replay requests from reconnecting clients", broadcaster.replayRequests());
+  writeMetric(out, "energi_ws_replay_frames_total", "counter", "Replay frames sent, including connect snapshots", broadcaster.replayFrames());
+  writeMetric(out, "energi_ws_replay_misses_total", "counter", "Replay requests older than the history ring or from before a restart", broadcaster.replayMisses());
+  writeMetric(out, "energi_ws_history_entries", "gauge", "Broadcasts held in the replay ring", broadcaster.historyEntries());
+  writeMetric(out, "energi_ws_history_span_seconds", "gauge", "Time span covered by the replay ring", broadcaster.historySpanMs() / 1000.0f);
+  out->print("# HELP energi_ws_client_queue_depth Messages queued per WebSocket client\n"
+             "# TYPE energi_ws_client_queue_depth gauge\n");
+  uint32_t ids[WsBroadcaster::kMaxClients];
+  uint8_t clients = broadcaster.clientIds(ids, WsBroadcaster::kMaxClients);
+  for (uint8_t i = 0; i < clients; i++) {
+    AsyncWebSocketClient *client = ws.client(ids[i]);
+    if (client != nullptr) {
+      out->printf("energi_ws_client_queue_depth{client=\"%u\"} %u\n", ids[i], client->queueLen());
     }
   }
 
-  Serial.println("Connected to Wi-Fi");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  LogWriterStats logStats = logWriter.stats();
+  xSemaphoreGive(logMutex);
+  writeMetric(out, "energi_log_records_total", "counter", "Log records committed to flash", logStats.records);
+  writeMetric(out, "energi_log_commits_total", "counter", "Log buffer commits", logStats.commits);
+  writeMetric(out, "energi_log_dropped_total", "counter", "Log records dropped", logStats.droppedRecords);
+  writeMetric(out, "energi_log_queue_drops_total", "counter", "Log records dropped because the queue was full", logQueueDrops.load());
+  writeMetric(out, "energi_log_compactions_total", "counter", "Log files compacted into history blocks", logCompactions);
+  writeMetric(out, "energi_log_compaction_failures_total", "counter", "Log compactions abandoned after a write error", logCompactFailures);
+  writeMetric(out, "energi_storage_used_bytes", "gauge", "Bytes used in the file storage", storage.usedBytes());
+  writeMetric(out, "energi_storage_total_bytes", "gauge", "Capacity of the file storage", storage.totalBytes());
+  writeCheckpointMetrics(out);
+  writeExportMetrics(out);
+  writeRuleMetrics(out);
+  writeStackMetrics(out);
+
+  request->send(out);
+}
+
+/**
+ * @brief Gemmer log, rollup og et checkpoint før genstart.
+ *
+ * Efter en formatering gemmes kun checkpointet; journalen ligger i sin egen
+ * partition, og I/O-tasken holder pause uden for saveCheckpoint().
+ */
+void onShutdown() {
+  saveCheckpoint(true);
+  if (storageFormatted) {
+    return;
+  }
+  flushLog();
+  xSemaphoreTake(rollupMutex, portMAX_DELAY);
+  saveRollup();
+  xSemaphoreGive(rollupMutex);
+}
+
+/**
+ * @brief Registrerer de forkomprimerede filer og deres ETags.
+ *
+ * Læser kun gzip-traileren (8 bytes) fra hver .gz-fil i roden.
+ */
+void initStaticAssets() {
+  storage.list([](void *, const char *path, uint32_t size) {
+    uint8_t trailer[StaticAssetTable::kTrailerSize];
+    std::unique_ptr<StorageReader> file;
+    if (size > sizeof(trailer) && strstr(path, ".gz") != nullptr && (file = storage.open(path)) &&
+        file->readAt(size - sizeof(trailer), trailer, sizeof(trailer)) == sizeof(trailer)) {
+      staticAssets.add(path, trailer);
+    }
+  }, nullptr);
+  Serial.printf("Static assets: %u compressed files\r\n", (unsigned)staticAssets.size());
+}
+
+/**
+ * @brief Sender en forkomprimeret fil med ETag og Cache-Control.
+ *
+ * Matcher If-None-Match, svares 304 uden at læse filen.
+ * @param request Forespørgslen
+ * @param path URL-sti, f.eks. "/index.html"
+ * @return False hvis filen ikke findes i staticAssets.
+ */
+bool serveAsset(AsyncWebServerRequest *request, const char *path) {
+  const StaticAsset *asset = staticAssets.find(path);
+  if (asset == nullptr) {
+    return false;
+  }
+  const char *type = StaticAssetTable::contentType(path);
+  AsyncWebServerResponse *response;
+  if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == asset->etag) {
+    response = request->beginResponse(304);
+  } else {
+    char gzPath[sizeof(asset->path) + 3];
+    snprintf(gzPath, sizeof(gzPath), "%s.gz", path);
+    std::shared_ptr<StorageReader> file = lockedStorage.open(gzPath);
+    if (!file) {
+      return false;
+    }
+    response = request->beginResponse(type, file->size(),
+      [file](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return file->readAt(index, buffer, maxLen);
+      });
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("ETag", asset->etag);
+  response->addHeader("Cache-Control", strcmp(type, "text/html") == 0 ? htmlCacheControl : assetCacheControl);
+  request->send(response);
   return true;
 }
 
 /**
- * @brief Returnerer dynamisk variabel til HTML-siderne.
- * @param var Navnet på variablen
- * @return Værdien af variablen som en streng
+ * @brief Sender de aktuelle live-værdier som JSON.
+ *
+ * Samme værdier som WebSocket-klienter får ved forbindelse; til klienter
+ * der kun poller.
+ */
+void handleState(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->addHeader("Cache-Control", "no-store");
+  response->print('{');
+  for (uint8_t f = 0; f < LIVE_FIELD_COUNT; f++) {
+    uint8_t channel = liveFieldChannel(f);
+    if (channel >= activeChannels()) {
+      break;
+    }
+    if (channel == 0) {
+      response->printf("%s\"%s\":%ld", f ? "," : "", liveFieldName(f), (long)broadcaster.get((LiveField)f));
+    } else {
+      response->printf(",\"%s.%u\":%ld", liveFieldName(f), channel, (long)broadcaster.get((LiveField)f));
+    }
+  }
+  response->print('}');
+  request->send(response);
+}
+
+/**
+ * @brief Sammenligner en modtaget besked med en kommando uden at kopiere den.
+ * @param data Beskedens bytes (ikke nul-termineret)
+ * @param len Beskedens længde
+ * @param command Kommandoen
+ * @return True hvis beskeden er præcis kommandoen.
+ */
+bool messageIs(const uint8_t *data, size_t len, const char *command) {
+  return len == strlen(command) && memcmp(data, command, len) == 0;
+}
+
+/**
+ * @brief Læser argumenterne til en kommando på formen "kommando:tal[:tal...]".
+ * @param data Beskedens bytes (ikke nul-termineret)
+ * @param len Beskedens længde
+ * @param prefix Kommandoen inkl. kolon
+ * @param values Modtager tallene
+ * @param max Plads i values
+ * @return Antal tal, eller 0 hvis beskeden ikke er kommandoen efterfulgt af
+ *         1 til max decimaltal adskilt af kolon.
  */
-String processor(const String& var) {
-  if(var == "STATE") {
-    ledState = digitalRead(ledPin) ? "ON" : "OFF";
-    return ledState;
+size_t messageArgs(const uint8_t *data, size_t len, const char *prefix, uint32_t *values, size_t max) {
+  size_t n = strlen(prefix);
+  if (len <= n || memcmp(data, prefix, n) != 0) {
+    return 0;
   }
-  return String();
+  size_t count = 0;
+  size_t i = n;
+  while (count < max) {
+    size_t start = i;
+    uint64_t v = 0;
+    while (i < len && data[i] >= '0' && data[i] <= '9' && i - start < 10) {
+      v = v * 10 + (data[i++] - '0');
+    }
+    if (i == start || v > UINT32_MAX) {
+      return 0;
+    }
+    values[count++] = (uint32_t)v;
+    if (i == len) {
+      return count;
+    }
+    if (data[i++] != ':') {
+      return 0;
+    }
+  }
+  return 0;
 }
 
 /**
  * @brief Håndterer modtagne WebSocket-beskeder.
  * @param client WebSocket klient
- * @param message Beskeden fra klienten
+ * @param data Beskedens bytes (ikke nul-termineret)
+ * @param len Beskedens længde
  */
-void onWebSocketMessage(AsyncWebSocketClient *client, String message) {
-  Serial.println("WebSocket Message: " + message);
-  if (message == "clear_measurements") {
-    if (SPIFFS.remove(logFilePath)) {
+void onWebSocketMessage(AsyncWebSocketClient *client, const uint8_t *data, size_t len) {
+  Serial.printf("WebSocket Message: %.*s\r\n", (int)len, (const char*)data);
+  uint32_t args[2];
+  size_t argCount;
+  if (messageIs(data, len, "clear_measurements")) {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    logWriter.discard();
+    xSemaphoreGive(logMutex);
+    xSemaphoreTake(rollupMutex, portMAX_DELAY);
+    rollup.clear();
+    storage.remove(rollupPath);
+    energyClearRequested = true;
+    xSemaphoreGive(rollupMutex);
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    storage.remove(legacyLogPath);
+    storage.remove(historyPath);
+    storage.remove(logBasePath);
+    historyRecords = 0;
+    logBaseRecords = 0;
+    bool removed = storage.remove(logFilePath);
+    xSemaphoreGive(logMutex);
+    if (removed) {
       client->text("Måleværdier slettet.");
     } else {
       client->text("Kunne ikke slette måleværdier.");
     }
-  } else if (message == "clear_configuration") {
-    bool success = SPIFFS.remove(ssidPath) && SPIFFS.remove(passPath) && SPIFFS.remove(ipPath) && SPIFFS.remove(gatewayPath);
+  } else if (messageIs(data, len, "clear_configuration")) {
+    bool success = true;
+    for (size_t slot = 0; slot < kConfigSlots; slot++) {
+      if (lockedStorage.exists(configSlotPaths[slot]) && !lockedStorage.remove(configSlotPaths[slot])) {
+        success = false;
+      }
+    }
     client->text(success ? "Konfiguration slettet." : "Kunne ikke slette konfiguration.");
+#ifdef ENERGI_STORAGE_BENCH
+  } else if (messageIs(data, len, "storage_bench")) {
+    storageBenchRequested = true;
+    client->text("Storage benchmark started, see /api/storage/bench.");
+#endif
+  } else if (messageIs(data, len, "proto:bin1")) {
+    broadcaster.setBinary(client->id(), true);
+  } else if (messageIs(data, len, "proto:text")) {
+    broadcaster.setBinary(client->id(), false);
+  } else if ((argCount = messageArgs(data, len, "replay:", args, 2)) > 0) {
+    // "replay:<epoke>:<seq>"; uden epoke kan en genstart ikke udelukkes
+    broadcaster.requestReplay(client->id(), argCount == 2 ? args[0] : 0, args[argCount - 1]);
+  }
+}
+
+/**
+ * @brief Måler heapen periodisk og skriver en rapport på Serial en gang i timen.
+ */
+void sampleHeap() {
+  unsigned long now = millis();
+  if (now - lastHeapSample < heapSampleInterval) {
+    return;
+  }
+  lastHeapSample = now;
+  heapMonitor.update(heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                     heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+                     heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+                     now / 1000);
+  if (now - lastHeapReport >= heapReportInterval) {
+    lastHeapReport = now;
+    Serial.printf("Heap: free %u, largest %u (min %u at %us), min free %u, fragmentation %u/1000 (max %u)\r\n",
+                  heapMonitor.freeBytes(), heapMonitor.largestBlock(),
+                  heapMonitor.minLargestBlock(), heapMonitor.minLargestBlockAt(),
+                  heapMonitor.minFreeEver(), heapMonitor.fragmentation(), heapMonitor.maxFragmentation());
+    Serial.printf("Stack free: sampler %u, io %u, loop %u\r\n",
+                  (unsigned)uxTaskGetStackHighWaterMark(samplerTaskHandle),
+                  (unsigned)uxTaskGetStackHighWaterMark(ioTaskHandle),
+                  (unsigned)uxTaskGetStackHighWaterMark(loopTaskHandle));
+  }
+}
+
+/**
+ * @brief Sender de gemte alarmregler i samme format som formularen tager imod.
+ * @param request HTTP-forespørgslen
+ */
+void handleRules(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response = request->beginResponseStream("text/plain");
+  response->addHeader("Cache-Control", "no-store");
+  char text[kRuleTextMaxBytes];
+  for (size_t i = 0; i < kConfigMaxRules && config.rules[i].kind != RULE_OFF; i++) {
+    if (formatRule(config.rules[i], text, sizeof(text)) > 0) {
+      response->printf("%s%s", i > 0 ? ";" : "", text);
+    }
+  }
+  request->send(response);
+}
+
+/**
+ * @brief Sender heap-vandmærker og fragmentering som JSON.
+ * @param request HTTP-forespørgslen
+ */
+void handleHeap(AsyncWebServerRequest *request) {
+  char json[256];
+  snprintf(json, sizeof(json),
+           "{\"uptime\":%lu,\"free\":%u,\"largest_block\":%u,\"min_free\":%u,"
+           "\"min_largest_block\":%u,\"min_largest_block_at\":%u,"
+           "\"fragmentation_permille\":%u,\"max_fragmentation_permille\":%u,\"samples\":%u}",
+           millis() / 1000, heapMonitor.freeBytes(), heapMonitor.largestBlock(), heapMonitor.minFreeEver(),
+           heapMonitor.minLargestBlock(), heapMonitor.minLargestBlockAt(),
+           heapMonitor.fragmentation(), heapMonitor.maxFragmentation(), heapMonitor.samples());
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Lager/netværk-tasken: alt arbejde der kan blokere på flash eller TCP.
+ *
+ * Tømmer puls- og logkøerne, evaluerer alarmregler, opdaterer rollup,
+ * committer logbufferen og sender live-data. Vækkes af sample-tasken ved nye pulser, ellers mindst
+ * hver ioPeriod.
+ */
+void ioTask(void*) {
+  for (;;) {
+    pauseIfStorageStopRequested();
+    uint32_t start = micros();
+    pollWiFi();
+    drainPulses();
+    drainPowerReadings();
+    evaluateRules();
+    checkpointIfDue();
+    logCounterIfDue();
+    drainLogQueue();
+    updateRollup();
+    pollLog();
+    compactLogIfDue();
+#ifdef ENERGI_STORAGE_BENCH
+    runStorageBenchIfRequested();
+#endif
+    broadcaster.tick(millis());
+    sampleHeap();
+    ws.cleanupClients();
+    loopHist.observe(micros() - start);
+    ulTaskNotifyTake(pdTRUE, ioPeriod);
+  }
+}
+
+/**
+ * @brief Starter lager/netværk-tasken.
+ */
+void initIoTask() {
+  xTaskCreatePinnedToCore(ioTask, "io", ioStackSize, nullptr, ioPriority, &ioTaskHandle, ioCore);
+}
+
+/**
+ * @brief Læser en kommasepareret liste af heltal fra konfigurationsformularen.
+ * @param text F.eks. "15,13,12"
+ * @param values Modtager tallene
+ * @param max Plads i values
+ * @return Antal læste tal; læsningen stopper ved første ugyldige element.
+ */
+size_t parseUintList(const char *text, uint32_t *values, size_t max) {
+  size_t n = 0;
+  while (n < max && *text != '\0') {
+    char *end;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text) {
+      break;
+    }
+    values[n++] = value;
+    text = *end == ',' ? end + 1 : end;
   }
+  return n;
 }
 
 /**
@@ -213,85 +2769,273 @@ void onWebSocketMessage(AsyncWebSocketClient *client, String message) {
  */
 void setup() {
   Serial.begin(115200);
-  initSPIFFS();
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  logMutex = xSemaphoreCreateMutex();
+  rollupMutex = xSemaphoreCreateMutex();
+  logQueue = xQueueCreate(logQueueLength, sizeof(LogRecord));
+
+  // Konfigurationen bestemmer samplingen, derefter startes den straks;
+  // pulser venter i pulseRing til log og I/O-tasken er klar
+  initStorage();
+  markBoot(BOOT_FS_MOUNTED);
+  initConfig();
+  initCheckpoint();
+  initStaticAssets();
 
   pinMode(ledPin, OUTPUT);
   digitalWrite(ledPin, LOW);
-
   pinMode(resetPin, INPUT_PULLUP);
-  pinMode(touchPin, INPUT);
+  for (size_t ch = 0; ch < channels.count(); ch++) {
+    pinMode(channels.pin(ch), INPUT);
+  }
+  if (samplingMode == SAMPLING_CT) {
+    initCtCapture();
+  } else {
+    initPulseCapture();
+  }
+  markBoot(BOOT_SAMPLING_STARTED);
+
+  esp_register_shutdown_handler(onShutdown);
+  initLog();
+  initHistoryRecords();
+  loadRollup();
+  logEvent(LOG_EVENT_BOOT, 0);
+  markBoot(BOOT_STORAGE_READY);
+
+  broadcaster.setEpoch(esp_random());
+  broadcaster.set(LIVE_LED, 0);
+  broadcaster.set(LIVE_ALERTS, 0);
+  for (size_t ch = 0; ch < activeChannels(); ch++) {
+    broadcaster.set(liveChannelField(LIVE_COUNTER, ch), counters[ch]);
+    broadcaster.set(liveChannelField(LIVE_ENERGY, ch), 0);
+    broadcaster.set(liveChannelField(LIVE_POWER, ch), 0);
+  }
+  initRules();
+
+  // I/O-tasken poller wifiConnector og startes derfor først når den er startet
+  initWiFi();
+  initIoTask();
+  configTime(0, 0, "pool.ntp.org");
+  initExport();
+
+  // Uden forbindelse viser forsiden konfigurationen, når AP'et kører
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+    bool provisioning = wifiProvisioning && wifiConnector.state() != WIFI_STATE_CONNECTED;
+    if (!serveAsset(request, provisioning ? "/wifimanager.html" : "/index.html")) {
+      request->send(404, "text/plain", "Not found");
+    }
+  });
+  server.onNotFound([](AsyncWebServerRequest *request) {
+    if (request->method() != HTTP_GET || !serveAsset(request, request->url().c_str())) {
+      request->send(404, "text/plain", "Not found");
+    }
+  });
+
+  server.on("/api/state", HTTP_GET, handleState);
+
+  server.on("/api/log/stats", HTTP_GET, handleLogStats);
+  server.on("/api/log.csv", HTTP_GET, handleLogCsv);
+#ifdef ENERGI_STORAGE_BENCH
+  server.on("/api/storage/bench", HTTP_GET, [](AsyncWebServerRequest *request) {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    String json = storageBenchResult;
+    xSemaphoreGive(logMutex);
+    request->send(200, "application/json", json);
+  });
+#endif
+  server.on("/api/log", HTTP_GET, handleLogDownload);
+  server.on("/api/history", HTTP_GET, handleHistory);
+  server.on("/api/ws/stats", HTTP_GET, handleWsStats);
+  server.on("/api/heap", HTTP_GET, handleHeap);
+  server.on("/api/rules", HTTP_GET, handleRules);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+
+  server.on("/on", HTTP_GET, [](AsyncWebServerRequest *request) {
+    digitalWrite(ledPin, HIGH);
+    logEvent(LOG_EVENT_LED_ON, 1);
+    broadcaster.set(LIVE_LED, 1);
+    request->redirect("/");
+  });
+
+  server.on("/off", HTTP_GET, [](AsyncWebServerRequest *request) {
+    digitalWrite(ledPin, LOW);
+    logEvent(LOG_EVENT_LED_OFF, 0);
+    broadcaster.set(LIVE_LED, 0);
+    request->redirect("/");
+  });
   
-  ssid = readFile(SPIFFS, ssidPath);
-  pass = readFile(SPIFFS, passPath);
-  ip = readFile(SPIFFS, ipPath);
-  gateway = readFile(SPIFFS, gatewayPath);
-
-  if(initWiFi()) {
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-      request->send(SPIFFS, "/index.html", "text/html", false, processor);
-    });
-    server.serveStatic("/", SPIFFS, "/");
-
-    server.on("/on", HTTP_GET, [](AsyncWebServerRequest *request) {
-      digitalWrite(ledPin, HIGH);
-      logData("LED ON");
-      request->send(SPIFFS, "/index.html", "text/html", false, processor);
-    });
-
-    server.on("/off", HTTP_GET, [](AsyncWebServerRequest *request) {
-      digitalWrite(ledPin, LOW);
-      logData("LED OFF");
-      request->send(SPIFFS, "/index.html", "text/html", false, processor);
-    });
-    
-    ws.onEvent([](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
-      if(type == WS_EVT_DATA) {
-        onWebSocketMessage(client, String((char*)data).substring(0, len));
+  ws.onEvent([](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+    if(type == WS_EVT_CONNECT) {
+      broadcaster.addClient(client->id());
+    } else if(type == WS_EVT_DISCONNECT) {
+      broadcaster.removeClient(client->id());
+    } else if(type == WS_EVT_DATA) {
+      // Kun hele tekstbeskeder i én ramme; data er ikke nul-termineret.
+      AwsFrameInfo *info = (AwsFrameInfo*)arg;
+      if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
+        onWebSocketMessage(client, data, len);
       }
-    });
-    server.addHandler(&ws);
-    
-    server.begin();
-  } else {
-    WiFi.softAP("ESP-WIFI-MANAGER-Darab", NULL);
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-      request->send(SPIFFS, "/wifimanager.html", "text/html");
-    });
-    server.serveStatic("/", SPIFFS, "/");
-    
-    server.on("/", HTTP_POST, [](AsyncWebServerRequest *request) {
-      int params = request->params();
-      for(int i = 0; i < params; i++){
-        const AsyncWebParameter* p = request->getParam(i);
-        if(p->isPost()){
-          if (p->name() == PARAM_INPUT_1) {
-            ssid = p->value().c_str();
-            writeFile(SPIFFS, ssidPath, ssid.c_str());
+    }
+  });
+  server.addHandler(&ws);
+
+  server.on("/", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!wifiProvisioning) {
+      request->send(403, "text/plain", "Configuration access point is not active.");
+      return;
+    }
+    // Alle felter gemmes samlet i én post; manglende felter beholder deres værdi
+    ConfigData updated = config;
+    int params = request->params();
+    for(int i = 0; i < params; i++){
+      const AsyncWebParameter* p = request->getParam(i);
+      if(p->isPost()){
+        if (p->name() == PARAM_INPUT_1) {
+          configSetString(updated.ssid, sizeof(updated.ssid), p->value().c_str());
+        }
+        if (p->name() == PARAM_INPUT_2) {
+          configSetString(updated.pass, sizeof(updated.pass), p->value().c_str());
+        }
+        if (p->name() == PARAM_INPUT_3) {
+          configSetString(updated.ip, sizeof(updated.ip), p->value().c_str());
+        }
+        if (p->name() == PARAM_INPUT_4) {
+          configSetString(updated.gateway, sizeof(updated.gateway), p->value().c_str());
+        }
+        if (p->name() == PARAM_INPUT_5 && p->value().length() > 0) {
+          long imp = p->value().toInt();
+          if (imp <= 0 || (unsigned long)imp > kConfigMaxImpPerKwh) {
+            request->send(400, "text/plain", "Meter constant must be 1-100000 imp/kWh, nothing saved.");
+            return;
+          }
+          updated.impPerKwh = imp;
+        }
+        if (p->name() == PARAM_INPUT_6) {
+          updated.sampleIntervalUs = configClamp(p->value().toInt(), kConfigMinSampleIntervalUs,
+                                                 kConfigMaxSampleIntervalUs);
+        }
+        if (p->name() == PARAM_INPUT_7) {
+          // 0 betyder indtil flash er fuld, så negative tal giver også 0
+          long days = p->value().toInt();
+          updated.logRetentionDays = days <= 0 ? 0 : configClamp(days, 1, kConfigMaxLogRetentionDays);
+        }
+        if (p->name() == PARAM_INPUT_8) {
+          updated.samplingMode = p->value().toInt() == SAMPLING_CT ? SAMPLING_CT : SAMPLING_PULSE;
+        }
+        if (p->name() == PARAM_INPUT_9) {
+          updated.maxPowerW = configClamp(p->value().toInt(), kConfigMaxPowerFloorW, kConfigMaxPowerCeilW);
+        }
+        if (p->name() == PARAM_INPUT_10) {
+          updated.channelCount = p->value().toInt();
+        }
+        if (p->name() == PARAM_INPUT_11) {
+          uint32_t pins[kConfigMaxChannels];
+          size_t n = parseUintList(p->value().c_str(), pins, kConfigMaxChannels);
+          for (size_t ch = 0; ch < n; ch++) {
+            if (!configChannelPinValid(pins[ch])) {
+              request->send(400, "text/plain", "Channel pins must be touch GPIOs 0, 12, 13, 14, 15, 27, 32 or 33.");
+              return;
+            }
+            updated.channelPins[ch] = pins[ch];
+          }
+        }
+        if (p->name() == PARAM_INPUT_12) {
+          // 0 betyder kanalen bruger impPerKwh; strtoul læser "-1" som et kæmpe tal
+          uint32_t imps[kConfigMaxChannels];
+          size_t n = parseUintList(p->value().c_str(), imps, kConfigMaxChannels);
+          bool valid = strchr(p->value().c_str(), '-') == nullptr;
+          for (size_t ch = 0; ch < n; ch++) {
+            valid = valid && imps[ch] <= kConfigMaxImpPerKwh;
           }
-          if (p->name() == PARAM_INPUT_2) {
-            pass = p->value().c_str();
-            writeFile(SPIFFS, passPath, pass.c_str());
+          if (!valid) {
+            request->send(400, "text/plain", "Channel meter constants must be 0-100000 imp/kWh, nothing saved.");
+            return;
           }
-          if (p->name() == PARAM_INPUT_3) {
-            ip = p->value().c_str();
-            writeFile(SPIFFS, ipPath, ip.c_str());
+          memcpy(updated.channelImpPerKwh, imps, n * sizeof(imps[0]));
+        }
+        if (p->name() == PARAM_INPUT_13) {
+          long mode = p->value().toInt();
+          updated.exportMode = mode == EXPORT_UDP || mode == EXPORT_MQTT ? (uint8_t)mode : (uint8_t)EXPORT_OFF;
+        }
+        if (p->name() == PARAM_INPUT_14) {
+          configSetString(updated.exportHost, sizeof(updated.exportHost), p->value().c_str());
+        }
+        if (p->name() == PARAM_INPUT_15) {
+          long port = p->value().toInt();
+          if (port < 0 || port > 65535) {
+            request->send(400, "text/plain", "Export port must be 0-65535.");
+            return;
           }
-          if (p->name() == PARAM_INPUT_4) {
-            gateway = p->value().c_str();
-            writeFile(SPIFFS, gatewayPath, gateway.c_str());
+          updated.exportPort = port;
+        }
+        if (p->name() == PARAM_INPUT_16) {
+          configSetString(updated.exportTopic, sizeof(updated.exportTopic), p->value().c_str());
+        }
+        if (p->name() == PARAM_INPUT_17) {
+          updated.exportIntervalS = configClamp(p->value().toInt(), kConfigMinExportIntervalS,
+                                                kConfigMaxExportIntervalS);
+        }
+        if (p->name() == PARAM_INPUT_18) {
+          // Et tomt felt beholder reglerne, "none" sletter dem; ellers erstattes
+          // de kun hvis hele teksten kan læses
+          RuleConfig rules[kConfigMaxRules] = {};
+          const char *end;
+          size_t n = parseRules(p->value().c_str(), rules, kConfigMaxRules, &end);
+          if (p->value() == "none") {
+            memset(updated.rules, 0, sizeof(updated.rules));
+          } else if (*end != '\0') {
+            request->send(400, "text/plain", String("Invalid or too many alert rules, nothing saved: ") + end);
+            return;
+          } else if (n > 0) {
+            memcpy(updated.rules, rules, sizeof(rules));
           }
         }
       }
-      request->send(200, "text/plain", "Done. ESP will restart.");
-      delay(3000);
-      ESP.restart();
-    });
-    server.begin();
+    }
+    if (!saveConfig(updated)) {
+      request->send(500, "text/plain", "Could not save configuration.");
+      return;
+    }
+    request->send(200, "text/plain", "Done. ESP will restart.");
+    delay(3000);
+    ESP.restart();
+  });
+
+  server.begin();
+  markBoot(BOOT_SERVER_STARTED);
+}
+
+/**
+ * @brief Beder I/O- og eksport-tasken holde pause og venter på deres kvittering.
+ *
+ * Svarer en af dem ikke inden storageStopTimeoutMs, fx fordi eksporten
+ * venter på netværket, fortsætter begge igen.
+ * @return True hvis alle kørende tasks holder pause.
+ */
+bool stopStorageTasks() {
+  ulTaskNotifyTake(pdTRUE, 0); // Sene kvitteringer fra et opgivet forsøg
+  uint32_t waiting = (ioTaskHandle != nullptr ? 1 : 0) + (exportTaskHandle != nullptr ? 1 : 0);
+  storageStopRequested = true;
+  if (ioTaskHandle != nullptr) {
+    xTaskNotifyGive(ioTaskHandle);
+  }
+  uint32_t start = millis();
+  while (waiting > 0) {
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= storageStopTimeoutMs ||
+        ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(storageStopTimeoutMs - elapsed)) == 0) {
+      storageStopRequested = false;
+      return false;
+    }
+    waiting--;
   }
+  return true;
 }
 
 /**
- * @brief Hoved-løkken som kontrollerer touch, reset og WebSocket-klienter.
+ * @brief Hoved-løkken som kun kontrollerer reset-knappen.
+ *
+ * Sampling og lager/netværk kører i egne tasks (se samplerTask og ioTask).
  */
 void loop() {
   if (digitalRead(resetPin) == LOW) {
@@ -299,14 +3043,28 @@ void loop() {
       buttonPressTime = millis();
     }
     if (millis() - buttonPressTime > resetDelay) {
-      SPIFFS.format();
-      ESP.restart();
+      // I/O- og eksport-tasken holder pause mellem to iterationer, så ingen
+      // af dem er midt i en fil- eller journalskrivning eller holder en lås.
+      // HTTP-handlerne på async_tcp rører kun lageret under logMutex
+      // (lockedStorage, LogStream, HistoryBlockStream) eller rollupMutex;
+      // låsene holdes til genstarten, så intet rører det formaterede lager
+      if (!stopStorageTasks()) {
+        Serial.println("Reset aborted: io or export task did not pause");
+        buttonPressTime = 0;
+      } else {
+        xSemaphoreTake(logMutex, portMAX_DELAY);
+        xSemaphoreTake(rollupMutex, portMAX_DELAY);
+        logWriter.discard();
+        rollup.clear();
+        storage.format();
+        storageFormatted = true;
+        ESP.restart();
+      }
     }
   } else {
     buttonPressTime = 0;
   }
-  handleTouch();
-  ws.cleanupClients();
+  vTaskDelay(pdMS_TO_TICKS(20));
 }
 
 // #include <Arduino.h>
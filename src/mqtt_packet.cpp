@@ -0,0 +1,93 @@
+/**
+ * @file mqtt_packet.cpp
+ * @brief Kodning af MQTT 3.1.1-pakker.
+ */
+
+#include "mqtt_packet.h"
+
+#include <string.h>
+
+/**
+ * @brief Skriver den faste header med variabel længde.
+ * @return Antal bytes, eller 0 hvis der ikke er plads.
+ */
+static size_t putFixedHeader(uint8_t first, uint32_t remaining, uint8_t* buf, size_t len) {
+  if (remaining > kMqttMaxRemaining || len < 2) {
+    return 0;
+  }
+  size_t n = 0;
+  buf[n++] = first;
+  do {
+    if (n >= len) {
+      return 0;
+    }
+    uint8_t digit = remaining & 0x7F;
+    remaining >>= 7;
+    buf[n++] = remaining > 0 ? digit | 0x80 : digit;
+  } while (remaining > 0);
+  return n;
+}
+
+/**
+ * @brief Skriver en streng med 2 bytes længde foran.
+ */
+static size_t putString(const char* s, size_t sLen, uint8_t* buf) {
+  buf[0] = sLen >> 8;
+  buf[1] = sLen;
+  memcpy(buf + 2, s, sLen);
+  return 2 + sLen;
+}
+
+size_t mqttConnect(const char* clientId, uint16_t keepAliveS, uint8_t* buf, size_t len) {
+  static const uint8_t variable[] = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x02}; // 3.1.1, clean session
+  size_t idLen = strlen(clientId);
+  if (idLen > 0xFFFF) {
+    return 0;
+  }
+  uint32_t remaining = sizeof(variable) + 2 + 2 + idLen;
+  size_t n = putFixedHeader(MQTT_CONNECT << 4, remaining, buf, len);
+  if (n == 0 || len - n < remaining) {
+    return 0;
+  }
+  memcpy(buf + n, variable, sizeof(variable));
+  n += sizeof(variable);
+  buf[n++] = keepAliveS >> 8;
+  buf[n++] = keepAliveS;
+  return n + putString(clientId, idLen, buf + n);
+}
+
+size_t mqttPublishHeader(const char* topic, uint16_t packetId, size_t payloadLen, uint8_t* buf, size_t len) {
+  size_t topicLen = strlen(topic);
+  if (topicLen > 0xFFFF || packetId == 0 || payloadLen > kMqttMaxRemaining) {
+    return 0;
+  }
+  uint64_t remaining = 2 + topicLen + 2 + (uint64_t)payloadLen;
+  if (remaining > kMqttMaxRemaining) {
+    return 0;
+  }
+  size_t n = putFixedHeader((MQTT_PUBLISH << 4) | 0x02, (uint32_t)remaining, buf, len); // QoS 1
+  if (n == 0 || len - n < 2 + topicLen + 2) {
+    return 0;
+  }
+  n += putString(topic, topicLen, buf + n);
+  buf[n++] = packetId >> 8;
+  buf[n++] = packetId;
+  return n;
+}
+
+size_t mqttEmpty(MqttPacketType type, uint8_t* buf) {
+  buf[0] = type << 4;
+  buf[1] = 0;
+  return 2;
+}
+
+bool mqttConnackOk(const uint8_t* buf) {
+  return buf[0] == (MQTT_CONNACK << 4) && buf[1] == 2 && buf[3] == 0;
+}
+
+uint16_t mqttPubackId(const uint8_t* buf) {
+  if (buf[0] != (MQTT_PUBACK << 4) || buf[1] != 2) {
+    return 0;
+  }
+  return (uint16_t)(buf[2] << 8) | buf[3];
+}
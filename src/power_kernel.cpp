@@ -0,0 +1,101 @@
+/**
+ * @file power_kernel.cpp
+ * @brief Heltalskerne til effektberegning for CT-måling.
+ */
+
+#include "power_kernel.h"
+
+void powerAccumulate(const int16_t* v, const int16_t* i, size_t n, PowerSums& sums) {
+  // Fire uafhængige sæt akkumulatorer, så multiplikationerne kan overlappe
+  int32_t sv0 = 0, sv1 = 0, sv2 = 0, sv3 = 0;
+  int32_t si0 = 0, si1 = 0, si2 = 0, si3 = 0;
+  int64_t vv0 = 0, vv1 = 0, vv2 = 0, vv3 = 0;
+  int64_t ii0 = 0, ii1 = 0, ii2 = 0, ii3 = 0;
+  int64_t vi0 = 0, vi1 = 0, vi2 = 0, vi3 = 0;
+
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    int32_t a0 = v[k], a1 = v[k + 1], a2 = v[k + 2], a3 = v[k + 3];
+    int32_t b0 = i[k], b1 = i[k + 1], b2 = i[k + 2], b3 = i[k + 3];
+    sv0 += a0; sv1 += a1; sv2 += a2; sv3 += a3;
+    si0 += b0; si1 += b1; si2 += b2; si3 += b3;
+    vv0 += a0 * a0; vv1 += a1 * a1; vv2 += a2 * a2; vv3 += a3 * a3;
+    ii0 += b0 * b0; ii1 += b1 * b1; ii2 += b2 * b2; ii3 += b3 * b3;
+    vi0 += a0 * b0; vi1 += a1 * b1; vi2 += a2 * b2; vi3 += a3 * b3;
+  }
+  for (; k < n; k++) {
+    int32_t a = v[k], b = i[k];
+    sv0 += a;
+    si0 += b;
+    vv0 += a * a;
+    ii0 += b * b;
+    vi0 += a * b;
+  }
+
+  sums.sumV += (int64_t)sv0 + sv1 + sv2 + sv3;
+  sums.sumI += (int64_t)si0 + si1 + si2 + si3;
+  sums.sumVV += vv0 + vv1 + vv2 + vv3;
+  sums.sumII += ii0 + ii1 + ii2 + ii3;
+  sums.sumVI += vi0 + vi1 + vi2 + vi3;
+  sums.count += n;
+}
+
+uint32_t isqrt64(uint64_t x) {
+  uint64_t result = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (x >= result + bit) {
+      x -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)result;
+}
+
+/**
+ * @brief Effektiv værdi i fysiske enheder fra summerne for én kanal.
+ * @param sum Σx
+ * @param sumSq Σx²
+ * @param n Antal samples
+ * @param scaleQ16 Enheder pr. tælling (Q16)
+ */
+static uint32_t rmsScaled(int64_t sum, int64_t sumSq, int64_t n, uint32_t scaleQ16) {
+  // n²·varians = n·Σx² − (Σx)², så √ giver n·rms uden at miste decimaler
+  int64_t varN = n * sumSq - sum * sum;
+  if (varN <= 0) {
+    return 0;
+  }
+  uint64_t rmsTimesN = isqrt64((uint64_t)varN);
+  return (uint32_t)(((rmsTimesN * scaleQ16) / (uint64_t)n) >> 16);
+}
+
+PowerReading powerFinish(const PowerSums& sums, const PowerCalibration& cal, uint32_t durationUs) {
+  PowerReading reading = {};
+  reading.durationUs = durationUs;
+  if (sums.count == 0) {
+    return reading;
+  }
+  int64_t n = sums.count;
+
+  reading.vrmsMv = rmsScaled(sums.sumV, sums.sumVV, n, cal.mvPerCountQ16);
+  reading.irmsMa = rmsScaled(sums.sumI, sums.sumII, n, cal.maPerCountQ16);
+
+  // Middelværdi af v·i uden DC i tællinger² (Q8), derefter mV·mA = µW
+  int64_t covN = n * sums.sumVI - sums.sumV * sums.sumI;
+  int64_t powerQ8 = covN * 256 / (n * n);
+  int64_t uw = ((powerQ8 * (int64_t)cal.mvPerCountQ16) >> 24) * (int64_t)cal.maPerCountQ16 >> 16;
+  reading.realMw = (int32_t)(uw / 1000);
+
+  reading.apparentMva = (uint32_t)((uint64_t)reading.vrmsMv * reading.irmsMa / 1000);
+  if (reading.apparentMva > 0) {
+    int64_t pf = (int64_t)reading.realMw * 1000 / reading.apparentMva;
+    reading.pfPermille = (int16_t)(pf > 1000 ? 1000 : (pf < -1000 ? -1000 : pf));
+  }
+  return reading;
+}
@@ -0,0 +1,266 @@
+/**
+ * @file push_exporter.cpp
+ * @brief Batching, afsendelse og spool for eksportøren.
+ */
+
+#include "push_exporter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rule_engine.h"
+
+size_t formatPushLine(const char* device, const PushPoint& point, char* buf, size_t len) {
+  // Tidsstemplet i ns er sekunderne med ni nuller, så der ikke skal 64-bit printf til
+  int n = snprintf(buf, len, "energi,device=%s,channel=%u counter=%lui,energy_wh=%ldi,power_w=%ldi %lu000000000\n",
+                   device, point.channel, (unsigned long)point.counter, (long)point.energyWh,
+                   (long)point.powerW, (unsigned long)point.time);
+  return n > 0 && (size_t)n < len ? n : 0;
+}
+
+size_t formatAlertLine(const char* device, const PushAlert& alert, char* buf, size_t len) {
+  int n = snprintf(buf, len, "energi_alert,device=%s,channel=%u,rule=%u,kind=%s active=%ui,value=%ldi %lu000000000\n",
+                   device, alert.channel, alert.rule, ruleKindName(alert.kind), alert.active ? 1 : 0,
+                   (long)alert.value, (unsigned long)alert.time);
+  return n > 0 && (size_t)n < len ? n : 0;
+}
+
+PushExporter::PushExporter(PushTransport& transport, Storage& storage, const PushExporterConfig& config)
+  : transport_(transport), storage_(storage), config_(config) {
+  if (config_.batchBytes == 0 || config_.batchBytes > kPushBatchMaxBytes) {
+    config_.batchBytes = kPushBatchMaxBytes;
+  }
+  if (config_.spoolSegments == 0) {
+    config_.spoolSegments = 1;
+  }
+}
+
+/**
+ * @brief Samler segmentfilerne fundet af Storage::list().
+ */
+struct SpoolScan {
+  bool found = false;
+  uint32_t first = 0;
+  uint32_t last = 0;
+  uint32_t lastSize = 0;
+  uint32_t bytes = 0;
+};
+
+void PushExporter::begin(const char* device) {
+  strncpy(device_, device, sizeof(device_) - 1);
+  device_[sizeof(device_) - 1] = '\0';
+  SpoolScan scan;
+  storage_.list([](void* ctx, const char* path, uint32_t size) {
+    SpoolScan& s = *(SpoolScan*)ctx;
+    const char* name = path[0] == '/' ? path + 1 : path;
+    char* end;
+    if (strncmp(name, "spool", 5) != 0) {
+      return;
+    }
+    unsigned long segment = strtoul(name + 5, &end, 10);
+    if (end == name + 5 || strcmp(end, ".lp") != 0) {
+      return;
+    }
+    if (!s.found || segment < s.first) {
+      s.first = segment;
+    }
+    if (!s.found || segment >= s.last) {
+      s.last = segment;
+      s.lastSize = size;
+    }
+    s.found = true;
+    s.bytes += size;
+  }, &scan);
+  if (scan.found) {
+    headSegment_ = scan.first;
+    tailSegment_ = scan.last;
+    tailSize_ = scan.lastSize;
+    headOffset_ = 0;
+    spoolEmpty_ = false;
+    // Sidste post kan være afbrudt af strømsvigtet; skriv videre i et nyt segment
+    tailClosed_ = true;
+    stats_.spoolBytes = scan.bytes;
+  }
+}
+
+void PushExporter::segmentPath(uint32_t segment, char* buf, size_t len) const {
+  snprintf(buf, len, "/spool%lu.lp", (unsigned long)segment);
+}
+
+void PushExporter::add(const PushPoint& point, uint32_t nowMs) {
+  char line[kPushLineMaxBytes];
+  size_t n = formatPushLine(device_, point, line, sizeof(line));
+  if (n > 0) {
+    append(line, n, nowMs);
+  }
+}
+
+void PushExporter::addAlert(const PushAlert& alert, uint32_t nowMs) {
+  char line[kPushLineMaxBytes];
+  size_t n = formatAlertLine(device_, alert, line, sizeof(line));
+  if (n > 0) {
+    append(line, n, nowMs);
+    closeBatch(nowMs);
+  }
+}
+
+void PushExporter::append(const char* line, size_t n, uint32_t nowMs) {
+  if (batchLen_ + n > config_.batchBytes) {
+    closeBatch(nowMs);
+  }
+  if (batchLen_ == 0) {
+    batchStartMs_ = nowMs;
+  }
+  memcpy(batch_ + batchLen_, line, n);
+  batchLen_ += n;
+  stats_.points++;
+}
+
+void PushExporter::poll(uint32_t nowMs) {
+  if (batchLen_ > 0 && nowMs - batchStartMs_ >= config_.batchMs) {
+    closeBatch(nowMs);
+  }
+  if (!spoolEmpty_ && nowMs - lastDrain_ >= config_.drainIntervalMs) {
+    lastDrain_ = nowMs;
+    drainOne(nowMs);
+  }
+}
+
+void PushExporter::flush(uint32_t nowMs) {
+  closeBatch(nowMs);
+}
+
+void PushExporter::closeBatch(uint32_t nowMs) {
+  if (batchLen_ == 0) {
+    return;
+  }
+  stats_.batches++;
+  if (trySend(batch_, batchLen_, nowMs)) {
+    stats_.sent++;
+  } else {
+    spool(batch_, batchLen_);
+  }
+  batchLen_ = 0;
+}
+
+bool PushExporter::trySend(const uint8_t* data, size_t len, uint32_t nowMs) {
+  if (retryWait_ && (int32_t)(nowMs - retryAt_) < 0) {
+    return false;
+  }
+  if (!transport_.ready(nowMs)) {
+    retryWait_ = true;
+    retryAt_ = nowMs + config_.retryMs;
+    return false;
+  }
+  if (!transport_.send(data, len)) {
+    stats_.sendFailures++;
+    retryWait_ = true;
+    retryAt_ = nowMs + config_.retryMs;
+    return false;
+  }
+  retryWait_ = false;
+  stats_.bytesSent += len;
+  return true;
+}
+
+void PushExporter::spool(const uint8_t* data, size_t len) {
+  size_t recordLen = 2 + len;
+  if (spoolEmpty_) {
+    tailSegment_++;
+    headSegment_ = tailSegment_;
+    headOffset_ = 0;
+    tailSize_ = 0;
+  } else if (tailClosed_ || tailSize_ + recordLen > config_.spoolSegmentBytes) {
+    tailSegment_++;
+    tailSize_ = 0;
+    tailClosed_ = false;
+    // Grænsen holdes ved at opgive de ældste data
+    while (tailSegment_ - headSegment_ >= config_.spoolSegments) {
+      dropHeadSegment();
+    }
+  }
+  record_[0] = len;
+  record_[1] = len >> 8;
+  memcpy(record_ + 2, data, len);
+  char path[24];
+  segmentPath(tailSegment_, path, sizeof(path));
+  size_t written = storage_.append(path, record_, recordLen);
+  if (written != recordLen) {
+    // En halv post fanges som ødelagt når segmentet læses, og resten af
+    // segmentet opgives med den; næste post skrives derfor i et nyt segment
+    stats_.spoolFailures++;
+    tailSize_ += written;
+    stats_.spoolBytes += written;
+    spoolEmpty_ = false;
+    tailClosed_ = true;
+    return;
+  }
+  tailSize_ += recordLen;
+  stats_.spoolBytes += recordLen;
+  stats_.spooled++;
+  spoolEmpty_ = false;
+}
+
+void PushExporter::dropHeadSegment() {
+  char path[24];
+  segmentPath(headSegment_, path, sizeof(path));
+  std::unique_ptr<StorageReader> reader = storage_.open(path);
+  uint32_t left = reader && reader->size() > headOffset_ ? reader->size() - headOffset_ : 0;
+  reader.reset();
+  stats_.discardedBytes += left;
+  stats_.spoolBytes -= left < stats_.spoolBytes ? left : stats_.spoolBytes;
+  nextSegment();
+}
+
+void PushExporter::nextSegment() {
+  char path[24];
+  segmentPath(headSegment_, path, sizeof(path));
+  storage_.remove(path);
+  headOffset_ = 0;
+  if (headSegment_ == tailSegment_) {
+    spoolEmpty_ = true;
+    tailSize_ = 0;
+    stats_.spoolBytes = 0;
+  } else {
+    headSegment_++;
+  }
+}
+
+void PushExporter::drainOne(uint32_t nowMs) {
+  char path[24];
+  // Højst ét forsøg på at sende; tomme og ødelagte segmenter ryddes undervejs
+  while (!spoolEmpty_) {
+    segmentPath(headSegment_, path, sizeof(path));
+    std::unique_ptr<StorageReader> reader = storage_.open(path);
+    uint32_t size = reader ? reader->size() : 0;
+    if (headOffset_ >= size) {
+      reader.reset();
+      nextSegment();
+      continue;
+    }
+    size_t len = 0;
+    if (reader->readAt(headOffset_, record_, 2) == 2) {
+      len = record_[0] | (record_[1] << 8);
+    }
+    if (len == 0 || len > kPushBatchMaxBytes || headOffset_ + 2 + len > size ||
+        reader->readAt(headOffset_ + 2, record_ + 2, len) != len) {
+      // Resten af segmentet kan ikke læses sikkert
+      uint32_t left = size - headOffset_;
+      stats_.discardedBytes += left;
+      stats_.spoolBytes -= left < stats_.spoolBytes ? left : stats_.spoolBytes;
+      headOffset_ = size;
+      continue;
+    }
+    reader.reset();
+    if (trySend(record_ + 2, len, nowMs)) {
+      headOffset_ += 2 + len;
+      stats_.spoolBytes -= 2 + len < stats_.spoolBytes ? 2 + len : stats_.spoolBytes;
+      stats_.drained++;
+      if (headOffset_ >= size) {
+        nextSegment();
+      }
+    }
+    return;
+  }
+}
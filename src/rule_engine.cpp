@@ -0,0 +1,248 @@
+/**
+ * @file rule_engine.cpp
+ * @brief Evaluering, læsning og formatering af alarmregler.
+ */
+
+#include "rule_engine.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Navne på handlingerne i teksten.
+ */
+static const struct {
+  const char* name;
+  uint8_t action;
+} actionNames[] = {
+  {"led", RULE_ACTION_LED},
+  {"event", RULE_ACTION_EVENT},
+  {"push", RULE_ACTION_PUSH},
+};
+
+const char* ruleKindName(uint8_t kind) {
+  switch (kind) {
+    case RULE_OFF:          return "off";
+    case RULE_POWER_ABOVE:  return "power";
+    case RULE_NO_PULSES:    return "idle";
+    case RULE_DAILY_ENERGY: return "energy";
+    default:                return "unknown";
+  }
+}
+
+void RuleEngine::configure(const RuleConfig* rules, size_t count) {
+  count_ = count < kConfigMaxRules ? count : kConfigMaxRules;
+  for (size_t i = 0; i < kConfigMaxRules; i++) {
+    rules_[i] = i < count_ ? rules[i] : RuleConfig();
+    state_[i] = RuleState();
+  }
+  active_ = 0;
+}
+
+uint32_t RuleEngine::actionMask(uint8_t actions) const {
+  uint32_t mask = 0;
+  for (size_t i = 0; i < count_; i++) {
+    if (rules_[i].kind != RULE_OFF && (rules_[i].actions & actions)) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+}
+
+uint32_t RuleEngine::update(const RuleSample& sample) {
+  uint32_t changed = 0;
+  for (size_t i = 0; i < count_; i++) {
+    const RuleConfig& rule = rules_[i];
+    if (rule.kind == RULE_OFF || rule.channel != sample.channel) {
+      continue;
+    }
+    uint32_t bit = 1u << i;
+    bool active = (active_ & bit) != 0;
+    if (evaluate(rule, state_[i], active, sample) != active) {
+      active_ ^= bit;
+      changed |= bit;
+    }
+  }
+  return changed;
+}
+
+bool RuleEngine::evaluate(const RuleConfig& rule, RuleState& s, bool active, const RuleSample& sample) {
+  uint64_t holdMs = (uint64_t)rule.holdS * 1000;
+  switch (rule.kind) {
+    case RULE_POWER_ABOVE:
+      if (sample.powerW <= (int64_t)rule.threshold) {
+        s.pending = false;
+        if (active) {
+          s.value = sample.powerW;
+        }
+        return false;
+      }
+      if (!s.pending) {
+        s.pending = true;
+        s.sinceMs = sample.nowMs;
+      }
+      if (!active && sample.nowMs - s.sinceMs >= holdMs) {
+        s.value = sample.powerW;
+        return true;
+      }
+      return active;
+
+    case RULE_NO_PULSES:
+      if (!s.primed || sample.counter != s.reference) {
+        if (active) {
+          s.value = (sample.nowMs - s.sinceMs) / 1000;
+        }
+        s.primed = true;
+        s.reference = sample.counter;
+        s.sinceMs = sample.nowMs;
+        return false;
+      }
+      if (!active && sample.nowMs - s.sinceMs >= holdMs) {
+        s.value = (sample.nowMs - s.sinceMs) / 1000;
+        return true;
+      }
+      return active;
+
+    case RULE_DAILY_ENERGY:
+      if (sample.day == 0) {
+        return active;
+      }
+      // Nyt døgn, første prøve med ur eller nulstillet energi: ny startværdi
+      if (!s.primed || sample.day != s.day || sample.energyWh < s.reference) {
+        if (active) {
+          s.value = sample.energyWh - s.reference;
+        }
+        s.primed = true;
+        s.reference = sample.energyWh;
+        s.day = sample.day;
+        return false;
+      }
+      if (!active && sample.energyWh - s.reference > rule.threshold) {
+        s.value = sample.energyWh - s.reference;
+        return true;
+      }
+      return active;
+
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Springer over et ord hvis teksten starter med det.
+ */
+static bool matchWord(const char*& p, const char* word) {
+  size_t n = strlen(word);
+  if (strncmp(p, word, n) != 0 || isalpha((unsigned char)p[n])) {
+    return false;
+  }
+  p += n;
+  return true;
+}
+
+/**
+ * @brief Læser et tal uden fortegn, højst max.
+ */
+static bool parseNumber(const char*& p, uint32_t max, uint32_t& value) {
+  if (!isdigit((unsigned char)*p)) {
+    return false;
+  }
+  char* end;
+  unsigned long long v = strtoull(p, &end, 10);
+  if (v > max) {
+    return false;
+  }
+  value = (uint32_t)v;
+  p = end;
+  return true;
+}
+
+/**
+ * @brief Springer over ét bestemt tegn.
+ */
+static bool expect(const char*& p, char c) {
+  if (*p != c) {
+    return false;
+  }
+  p++;
+  return true;
+}
+
+size_t parseRules(const char* text, RuleConfig* rules, size_t max, const char** end) {
+  size_t n = 0;
+  const char* p = text;
+  for (;;) {
+    while (*p == ';' || *p == '\n' || *p == '\r' || *p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '\0' || n == max) {
+      break;
+    }
+    const char* start = p;
+    RuleConfig rule = {};
+    for (uint8_t kind = RULE_POWER_ABOVE; kind <= RULE_DAILY_ENERGY; kind++) {
+      if (matchWord(p, ruleKindName(kind))) {
+        rule.kind = kind;
+        break;
+      }
+    }
+    uint32_t channel;
+    if (rule.kind == RULE_OFF || !expect(p, ':') ||
+        !parseNumber(p, kConfigMaxChannels - 1, channel) || !expect(p, ':') ||
+        !parseNumber(p, UINT32_MAX, rule.threshold) || !expect(p, ':') ||
+        !parseNumber(p, kRuleMaxHoldS, rule.holdS) || !expect(p, ':')) {
+      p = start;
+      break;
+    }
+    rule.channel = channel;
+    bool matched;
+    do {
+      matched = false;
+      for (size_t a = 0; a < sizeof(actionNames) / sizeof(actionNames[0]); a++) {
+        if (matchWord(p, actionNames[a].name)) {
+          rule.actions |= actionNames[a].action;
+          matched = true;
+          break;
+        }
+      }
+    } while (matched && expect(p, '+'));
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+      p++;
+    }
+    // Uden ventetid ville en idle-regel slå til mellem hver to pulser
+    if (!matched || (*p != ';' && *p != '\n' && *p != '\0') ||
+        (rule.kind == RULE_NO_PULSES && rule.holdS == 0)) {
+      p = start;
+      break;
+    }
+    rules[n++] = rule;
+  }
+  if (end != nullptr) {
+    *end = p;
+  }
+  return n;
+}
+
+size_t formatRule(const RuleConfig& rule, char* buf, size_t len) {
+  int n = snprintf(buf, len, "%s:%u:%lu:%lu:", ruleKindName(rule.kind), (unsigned)rule.channel,
+                   (unsigned long)rule.threshold, (unsigned long)rule.holdS);
+  if (n < 0 || (size_t)n >= len) {
+    return 0;
+  }
+  size_t used = n;
+  bool first = true;
+  for (size_t a = 0; a < sizeof(actionNames) / sizeof(actionNames[0]); a++) {
+    if (!(rule.actions & actionNames[a].action)) {
+      continue;
+    }
+    n = snprintf(buf + used, len - used, "%s%s", first ? "" : "+", actionNames[a].name);
+    if (n < 0 || (size_t)n >= len - used) {
+      return 0;
+    }
+    used += n;
+    first = false;
+  }
+  return used;
+}
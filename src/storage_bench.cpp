@@ -0,0 +1,122 @@
+/**
+ * @file storage_bench.cpp
+ * @brief Benchmark af Storage-backends.
+ */
+
+#include "storage_bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Sorterer en lille tabel stigende (indsættelsessortering). */
+static void sortLatencies(uint32_t* values, size_t count) {
+  for (size_t i = 1; i < count; i++) {
+    uint32_t v = values[i];
+    size_t j = i;
+    for (; j > 0 && values[j - 1] > v; j--) {
+      values[j] = values[j - 1];
+    }
+    values[j] = v;
+  }
+}
+
+/** @brief Fraktil fra en sorteret tabel (nærmeste rang). */
+static uint32_t percentile(const uint32_t* sorted, size_t count, uint8_t p) {
+  size_t rank = (count * p + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * @brief Fylder lageret med ballast til fillPercent.
+ *
+ * Pladsen til selve målingen trækkes fra først, så testfilen også kan
+ * skrives ved høj fyldning.
+ */
+static void fillTo(Storage& storage, uint8_t fillPercent) {
+  static uint8_t block[1024];
+  uint64_t target = (uint64_t)storage.totalBytes() * fillPercent / 100;
+  uint32_t reserve = kStorageBenchAppends * kStorageBenchAppendBytes;
+  if (target + reserve > storage.totalBytes()) {
+    target = storage.totalBytes() > reserve ? storage.totalBytes() - reserve : 0;
+  }
+  while (storage.usedBytes() < target) {
+    uint64_t missing = target - storage.usedBytes();
+    size_t len = missing < sizeof(block) ? missing : sizeof(block);
+    if (storage.append(kStorageBenchFillPath, block, len) != len) {
+      break;
+    }
+  }
+}
+
+void storageBench(Storage& storage, uint32_t (*clockUs)(), const uint8_t* fills, size_t count,
+                  StorageBenchResult* results) {
+  static uint8_t data[kStorageBenchAppendBytes > kStorageBenchReadBytes ? kStorageBenchAppendBytes : kStorageBenchReadBytes];
+  uint32_t latencies[kStorageBenchAppends];
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t)(i * 31);
+  }
+
+  for (size_t f = 0; f < count; f++) {
+    StorageBenchResult& r = results[f];
+    memset(&r, 0, sizeof(r));
+    r.fillPercent = fills[f];
+    storage.remove(kStorageBenchDataPath);
+    fillTo(storage, fills[f]);
+    r.usedPercent = storage.totalBytes() ? (uint64_t)storage.usedBytes() * 100 / storage.totalBytes() : 0;
+
+    for (size_t i = 0; i < kStorageBenchAppends; i++) {
+      uint32_t start = clockUs();
+      if (storage.append(kStorageBenchDataPath, data, kStorageBenchAppendBytes) != kStorageBenchAppendBytes) {
+        r.failures++;
+      }
+      latencies[i] = clockUs() - start;
+    }
+    sortLatencies(latencies, kStorageBenchAppends);
+    r.appendP50Us = percentile(latencies, kStorageBenchAppends, 50);
+    r.appendP90Us = percentile(latencies, kStorageBenchAppends, 90);
+    r.appendP99Us = percentile(latencies, kStorageBenchAppends, 99);
+    r.appendMaxUs = latencies[kStorageBenchAppends - 1];
+
+    std::unique_ptr<StorageReader> reader = storage.open(kStorageBenchDataPath);
+    if (reader) {
+      uint32_t bytes = 0;
+      uint32_t start = clockUs();
+      size_t n;
+      while ((n = reader->readAt(bytes, data, kStorageBenchReadBytes)) > 0) {
+        bytes += n;
+      }
+      uint32_t elapsed = clockUs() - start;
+      r.readKBps = (uint64_t)bytes * 1000000 / 1024 / (elapsed ? elapsed : 1);
+    }
+    reader.reset();
+    storage.remove(kStorageBenchDataPath);
+  }
+  storage.remove(kStorageBenchFillPath);
+}
+
+size_t storageBenchJson(const char* name, const StorageBenchResult* results, size_t count, char* buf, size_t len) {
+  if (len == 0) {
+    return 0;
+  }
+  size_t pos = 0;
+  auto put = [&](int n) {
+    if (n > 0) {
+      pos += (size_t)n < len - pos ? (size_t)n : len - pos - 1;
+    }
+  };
+  put(snprintf(buf, len, "{\"backend\":\"%s\",\"append_bytes\":%u,\"results\":[", name,
+               (unsigned)kStorageBenchAppendBytes));
+  for (size_t i = 0; i < count && pos + 1 < len; i++) {
+    const StorageBenchResult& r = results[i];
+    put(snprintf(buf + pos, len - pos,
+                 "%s{\"fill\":%u,\"used\":%u,\"failures\":%u,\"append_p50_us\":%u,\"append_p90_us\":%u,"
+                 "\"append_p99_us\":%u,\"append_max_us\":%u,\"read_kbps\":%u}",
+                 i ? "," : "", r.fillPercent, r.usedPercent, r.failures, (unsigned)r.appendP50Us,
+                 (unsigned)r.appendP90Us, (unsigned)r.appendP99Us, (unsigned)r.appendMaxUs,
+                 (unsigned)r.readKBps));
+  }
+  if (pos + 1 < len) {
+    put(snprintf(buf + pos, len - pos, "]}"));
+  }
+  return pos;
+}
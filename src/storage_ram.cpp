@@ -0,0 +1,104 @@
+/**
+ * @file storage_ram.cpp
+ * @brief RamStorage.
+ */
+
+#include "storage_ram.h"
+
+#include <string.h>
+
+namespace {
+
+/**
+ * @brief Læsehåndtag der deler data med filen, så senere appends ses.
+ */
+class RamReader : public StorageReader {
+public:
+  explicit RamReader(std::shared_ptr<std::vector<uint8_t>> data) : data_(data) {}
+
+  uint32_t size() override { return data_->size(); }
+
+  size_t readAt(uint32_t offset, uint8_t* buf, size_t len) override {
+    if (offset >= data_->size()) {
+      return 0;
+    }
+    size_t n = data_->size() - offset < len ? data_->size() - offset : len;
+    memcpy(buf, data_->data() + offset, n);
+    return n;
+  }
+
+private:
+  std::shared_ptr<std::vector<uint8_t>> data_;
+};
+
+}  // namespace
+
+bool RamStorage::format() {
+  files_.clear();
+  used_ = 0;
+  return true;
+}
+
+bool RamStorage::exists(const char* path) {
+  return files_.count(path) > 0;
+}
+
+bool RamStorage::remove(const char* path) {
+  auto it = files_.find(path);
+  if (it == files_.end()) {
+    return false;
+  }
+  used_ -= it->second->size();
+  files_.erase(it);
+  return true;
+}
+
+bool RamStorage::rename(const char* from, const char* to) {
+  auto it = files_.find(from);
+  if (it == files_.end()) {
+    return false;
+  }
+  std::shared_ptr<Data> data = it->second;
+  files_.erase(it);
+  remove(to);
+  files_[to] = data;
+  return true;
+}
+
+size_t RamStorage::append(const char* path, const uint8_t* data, size_t len) {
+  if (len > capacity_ - used_) {
+    return 0;
+  }
+  std::shared_ptr<Data>& file = files_[path];
+  if (!file) {
+    file = std::make_shared<Data>();
+  }
+  file->insert(file->end(), data, data + len);
+  used_ += len;
+  return len;
+}
+
+size_t RamStorage::write(const char* path, const uint8_t* data, size_t len) {
+  auto it = files_.find(path);
+  uint32_t old = it == files_.end() ? 0 : it->second->size();
+  if (len > capacity_ - used_ + old) {
+    return 0;
+  }
+  files_[path] = std::make_shared<Data>(data, data + len);
+  used_ = used_ - old + len;
+  return len;
+}
+
+std::unique_ptr<StorageReader> RamStorage::open(const char* path) {
+  auto it = files_.find(path);
+  if (it == files_.end()) {
+    return nullptr;
+  }
+  return std::unique_ptr<StorageReader>(new RamReader(it->second));
+}
+
+void RamStorage::list(StorageListFn fn, void* ctx) {
+  for (auto& file : files_) {
+    fn(ctx, file.first.c_str(), file.second->size());
+  }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file storage_stdio.cpp
+ * @brief StdioStorage.
+ */
+
+#include "storage_stdio.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+namespace {
+
+/**
+ * @brief Læsehåndtag over en åben FILE.
+ */
+class StdioReader : public StorageReader {
+public:
+  explicit StdioReader(FILE* file) : file_(file) {}
+  ~StdioReader() { fclose(file_); }
+
+  uint32_t size() override {
+    return fseek(file_, 0, SEEK_END) == 0 ? ftell(file_) : 0;
+  }
+
+  size_t readAt(uint32_t offset, uint8_t* buf, size_t len) override {
+    return fseek(file_, offset, SEEK_SET) == 0 ? fread(buf, 1, len, file_) : 0;
+  }
+
+private:
+  FILE* file_;
+};
+
+/** @brief Filens størrelse, 0 hvis den ikke findes. */
+uint32_t fileSize(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+}  // namespace
+
+bool StdioStorage::mount(bool) {
+  DIR* dir = opendir(root_.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  closedir(dir);
+  used_ = 0;
+  list([](void* ctx, const char*, uint32_t size) { *(uint32_t*)ctx += size; }, &used_);
+  return true;
+}
+
+bool StdioStorage::format() {
+  bool ok = true;
+  DIR* dir = opendir(root_.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.' && ::remove((root_ + "/" + entry->d_name).c_str()) != 0) {
+      ok = false;
+    }
+  }
+  closedir(dir);
+  used_ = 0;
+  return ok;
+}
+
+bool StdioStorage::exists(const char* path) {
+  struct stat st;
+  return stat(fullPath(path).c_str(), &st) == 0;
+}
+
+bool StdioStorage::remove(const char* path) {
+  uint32_t size = fileSize(fullPath(path));
+  if (::remove(fullPath(path).c_str()) != 0) {
+    return false;
+  }
+  used_ -= size;
+  return true;
+}
+
+bool StdioStorage::rename(const char* from, const char* to) {
+  if (!exists(from)) {
+    return false;
+  }
+  remove(to);
+  return ::rename(fullPath(from).c_str(), fullPath(to).c_str()) == 0;
+}
+
+size_t StdioStorage::put(const char* path, const char* mode, const uint8_t* data, size_t len) {
+  FILE* file = fopen(fullPath(path).c_str(), mode);
+  if (file == nullptr) {
+    return 0;
+  }
+  size_t written = fwrite(data, 1, len, file);
+  if (fclose(file) != 0) {
+    written = 0;
+  }
+  return written;
+}
+
+size_t StdioStorage::append(const char* path, const uint8_t* data, size_t len) {
+  if (len > capacity_ - used_) {
+    return 0;
+  }
+  size_t written = put(path, "ab", data, len);
+  used_ += written;
+  return written;
+}
+
+size_t StdioStorage::write(const char* path, const uint8_t* data, size_t len) {
+  uint32_t old = fileSize(fullPath(path));
+  if (len > capacity_ - used_ + old) {
+    return 0;
+  }
+  size_t written = put(path, "wb", data, len);
+  used_ = used_ - old + fileSize(fullPath(path));
+  return written;
+}
+
+std::unique_ptr<StorageReader> StdioStorage::open(const char* path) {
+  FILE* file = fopen(fullPath(path).c_str(), "rb");
+  if (file == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<StorageReader>(new StdioReader(file));
+}
+
+void StdioStorage::list(StorageListFn fn, void* ctx) {
+  DIR* dir = opendir(root_.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    std::string path = std::string("/") + entry->d_name;
+    fn(ctx, path.c_str(), fileSize(fullPath(path.c_str())));
+  }
+  closedir(dir);
+}
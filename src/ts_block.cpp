@@ -0,0 +1,181 @@
+/**
+ * @file ts_block.cpp
+ * @brief Kodning og afkodning af komprimerede logblokke.
+ */
+
+#include "ts_block.h"
+
+#include <string.h>
+
+#include "crc32.h"
+
+/** @brief Zig-zag: små negative og positive tal bliver små ikke-negative. */
+static inline uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+/** @brief Omvendt zig-zag. */
+static inline int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/** @brief Skriver en varint (7 bit pr. byte, LSB først) og returnerer antal bytes. */
+static inline size_t putVarint(uint8_t* p, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+/** @brief Læser en varint; returnerer false ved afkortet eller for lang varint. */
+static inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (uint8_t shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline void putU16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void putU32(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline uint16_t getU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t getU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool tsBlockReadHeader(const uint8_t* buf, TsBlockHeader& header) {
+  if (getU16(buf) != kTsBlockMagic || buf[2] != kTsBlockVersion) {
+    return false;
+  }
+  header.count = getU16(buf + 4);
+  header.payloadBytes = getU16(buf + 6);
+  header.minTime = getU32(buf + 8);
+  header.maxTime = getU32(buf + 12);
+  header.crc = getU32(buf + 16);
+  return header.count > 0 && header.count <= kTsBlockMaxRecords &&
+         header.payloadBytes <= kTsBlockMaxPayload && header.minTime <= header.maxTime;
+}
+
+bool tsBlockVerify(const TsBlockHeader& header, const uint8_t* payload) {
+  return crc32(payload, header.payloadBytes) == header.crc;
+}
+
+void TsBlockEncoder::reset() {
+  len_ = 0;
+  count_ = 0;
+  lastMs_ = 0;
+  lastDelta_ = 0;
+  memset(lastValue_, 0, sizeof(lastValue_));
+  minTime_ = 0;
+  maxTime_ = 0;
+}
+
+bool TsBlockEncoder::add(const LogRecord& record) {
+  if (count_ >= kTsBlockMaxRecords || len_ + kTsRecordMaxEncoded > sizeof(payload_)) {
+    return false;
+  }
+  uint64_t ms = (uint64_t)record.time * 1000 + record.millis;
+  uint8_t* p = payload_ + len_;
+  if (count_ == 0) {
+    p += putVarint(p, ms);
+    minTime_ = record.time;
+  } else {
+    int64_t delta = (int64_t)(ms - lastMs_);
+    p += putVarint(p, zigzag(delta - lastDelta_));
+    lastDelta_ = delta;
+  }
+  lastMs_ = ms;
+  maxTime_ = record.time;
+
+  p += putVarint(p, ((uint32_t)record.channel << 8) | record.type);
+  int32_t& last = lastValue_[record.type & 7];
+  p += putVarint(p, zigzag((int64_t)record.value - last));
+  last = record.value;
+
+  len_ = p - payload_;
+  count_++;
+  return true;
+}
+
+size_t TsBlockEncoder::seal(uint8_t* buf) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  putU16(buf, kTsBlockMagic);
+  buf[2] = kTsBlockVersion;
+  buf[3] = 0;
+  putU16(buf + 4, count_);
+  putU16(buf + 6, (uint16_t)len_);
+  putU32(buf + 8, minTime_);
+  putU32(buf + 12, maxTime_);
+  putU32(buf + 16, crc32(payload_, len_));
+  memcpy(buf + kTsBlockHeaderSize, payload_, len_);
+  return kTsBlockHeaderSize + len_;
+}
+
+TsBlockDecoder::TsBlockDecoder(const TsBlockHeader& header, const uint8_t* payload)
+  : pos_(payload), end_(payload + header.payloadBytes), index_(0), remaining_(header.count),
+    lastMs_(0), lastDelta_(0) {
+  memset(lastValue_, 0, sizeof(lastValue_));
+}
+
+TsBlockDecoder::TsBlockDecoder()
+  : pos_(nullptr), end_(nullptr), index_(0), remaining_(0), lastMs_(0), lastDelta_(0) {
+  memset(lastValue_, 0, sizeof(lastValue_));
+}
+
+bool TsBlockDecoder::next(LogRecord& record) {
+  if (remaining_ == 0) {
+    return false;
+  }
+  uint64_t v;
+  if (!getVarint(pos_, end_, v)) {
+    remaining_ = 0;
+    return false;
+  }
+  if (index_ == 0) {
+    lastMs_ = v;
+  } else {
+    int64_t delta = lastDelta_ + unzigzag(v);
+    lastMs_ += delta;
+    lastDelta_ = delta;
+  }
+
+  uint64_t tag;
+  uint64_t diff;
+  if (!getVarint(pos_, end_, tag) || !getVarint(pos_, end_, diff)) {
+    remaining_ = 0;
+    return false;
+  }
+  record.time = (uint32_t)(lastMs_ / 1000);
+  record.millis = (uint16_t)(lastMs_ % 1000);
+  record.channel = (uint8_t)(tag >> 8);
+  record.type = (uint8_t)tag;
+  int32_t& last = lastValue_[record.type & 7];
+  last = (int32_t)((int64_t)last + unzigzag(diff));
+  record.value = last;
+
+  index_++;
+  remaining_--;
+  return true;
+}
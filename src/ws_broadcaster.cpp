@@ -0,0 +1,309 @@
+/**
+ * @file ws_broadcaster.cpp
+ * @brief Implementering af den coalescende WebSocket-broadcaster.
+ */
+
+#include "ws_broadcaster.h"
+#include "live_protocol.h"
+
+#include <stdio.h>
+
+WsBroadcaster::WsBroadcaster(AsyncWebSocket& ws, uint32_t tickMs, uint16_t maxConsecutiveDrops)
+  : ws_(ws), tickMs_(tickMs), maxConsecutiveDrops_(maxConsecutiveDrops) {}
+
+void WsBroadcaster::set(LiveField field, int32_t value) {
+  portENTER_CRITICAL(&lock_);
+  fields_.set(field, value);
+  portEXIT_CRITICAL(&lock_);
+}
+
+int32_t WsBroadcaster::get(LiveField field) const {
+  portENTER_CRITICAL(&lock_);
+  int32_t value = fields_.get(field);
+  portEXIT_CRITICAL(&lock_);
+  return value;
+}
+
+void WsBroadcaster::addClient(uint32_t id) {
+  bool added = false;
+  portENTER_CRITICAL(&lock_);
+  for (uint8_t i = 0; i < kMaxClients; i++) {
+    if (clients_[i].id == 0) {
+      clients_[i] = WsClientStats();
+      clients_[i].id = id;
+      clients_[i].pendingMask = fields_.validMask();
+      clients_[i].replaying = true;
+      clients_[i].replayAfter = history_.seqBeforeLast(kSnapshotEntries, &clients_[i].replayCursor);
+      added = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&lock_);
+  if (!added) {
+    AsyncWebSocketClient* client = ws_.client(id);
+    if (client != nullptr) {
+      client->close();
+    }
+  }
+}
+
+void WsBroadcaster::removeClient(uint32_t id) {
+  portENTER_CRITICAL(&lock_);
+  for (uint8_t i = 0; i < kMaxClients; i++) {
+    if (clients_[i].id == id) {
+      clients_[i].id = 0;
+    }
+  }
+  portEXIT_CRITICAL(&lock_);
+}
+
+void WsBroadcaster::setBinary(uint32_t id, bool binary) {
+  portENTER_CRITICAL(&lock_);
+  for (uint8_t i = 0; i < kMaxClients; i++) {
+    if (clients_[i].id == id) {
+      clients_[i].binary = binary;
+      clients_[i].hello = binary;
+      clients_[i].pendingMask = fields_.validMask();
+      if (!binary) {
+        clients_[i].replaying = false;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&lock_);
+}
+
+void WsBroadcaster::requestReplay(uint32_t id, uint32_t epoch, uint32_t seq) {
+  portENTER_CRITICAL(&lock_);
+  replayRequests_++;
+  for (uint8_t i = 0; i < kMaxClients; i++) {
+    WsClientStats& c = clients_[i];
+    if (c.id != id) {
+      continue;
+    }
+    if (epoch != epoch_ || seq > seq_) {
+      // Klienten kender sekvensnumre fra før en genstart
+      c.replayAfter = history_.seqBeforeLast(kSnapshotEntries, &c.replayCursor);
+      c.resync = true;
+      replayMisses_++;
+    } else {
+      c.replayAfter = seq;
+      c.replayCursor = history_.seek(seq);
+      c.resync = false;
+      if (!history_.covers(seq)) {
+        replayMisses_++;
+      }
+    }
+    c.replaying = true;
+  }
+  portEXIT_CRITICAL(&lock_);
+}
+
+uint32_t WsBroadcaster::historyEntries() const {
+  portENTER_CRITICAL(&lock_);
+  uint32_t n = history_.count();
+  portEXIT_CRITICAL(&lock_);
+  return n;
+}
+
+uint32_t WsBroadcaster::historySpanMs() const {
+  portENTER_CRITICAL(&lock_);
+  uint32_t span = history_.spanMs();
+  portEXIT_CRITICAL(&lock_);
+  return span;
+}
+
+bool WsBroadcaster::sendReplay(uint8_t slot, uint32_t id, AsyncWebSocketClient* client) {
+  uint8_t frame[kLiveFrameMaxSize];
+  LiveHistoryEntry entry;
+  for (uint8_t n = 0; n < kReplayFramesPerTick; n++) {
+    if (n > 0 && (client->queueIsFull() || !client->canSend())) {
+      return true;
+    }
+    portENTER_CRITICAL(&lock_);
+    WsClientStats& c = clients_[slot];
+    bool found = c.id == id && c.replaying && history_.next(c.replayAfter, entry, c.replayCursor);
+    uint8_t flags = found && c.resync ? LIVE_FLAG_RESYNC : 0;
+    if (found) {
+      c.replayAfter = entry.seq;
+      c.resync = false;
+      c.sent++;
+      replayFrames_++;
+    } else if (c.id == id) {
+      c.replaying = false;
+    }
+    portEXIT_CRITICAL(&lock_);
+    if (!found) {
+      return false;
+    }
+    size_t len = encodeLiveFrame(LIVE_FRAME_REPLAY, entry.seq, entry.timeMs, entry.mask, entry.values,
+                                 frame, sizeof(frame), flags);
+    client->binary(frame, len);
+  }
+  return true;
+}
+
+void WsBroadcaster::sendHello(uint8_t slot, uint32_t id, AsyncWebSocketClient* client, uint32_t seq,
+                              uint32_t nowMs) {
+  uint8_t frame[kLiveHelloSize];
+  size_t len = encodeLiveHello(epoch_, seq, nowMs, frame, sizeof(frame));
+  client->binary(frame, len);
+  portENTER_CRITICAL(&lock_);
+  WsClientStats& c = clients_[slot];
+  if (c.id == id) {
+    c.hello = false;
+    c.sent++;
+  }
+  portEXIT_CRITICAL(&lock_);
+}
+
+void WsBroadcaster::tick(uint32_t nowMs) {
+  if (nowMs - lastTick_ < tickMs_) {
+    return;
+  }
+  lastTick_ = nowMs;
+
+  // Tag et konsistent øjebliksbillede under låsen og send uden for den.
+  int32_t values[LIVE_FIELD_COUNT];
+  uint32_t ids[kMaxClients];
+  uint32_t masks[kMaxClients];
+  bool binary[kMaxClients];
+  bool replay[kMaxClients];
+  bool hello[kMaxClients];
+  portENTER_CRITICAL(&lock_);
+  uint32_t changed = fields_.takeChanged();
+  for (uint8_t f = 0; f < LIVE_FIELD_COUNT; f++) {
+    values[f] = fields_.get((LiveField)f);
+  }
+  if (changed != 0) {
+    seq_++;
+    history_.append(seq_, nowMs, changed, values);
+  }
+  uint32_t seq = seq_;
+  for (uint8_t i = 0; i < kMaxClients; i++) {
+    WsClientStats& c = clients_[i];
+    if (c.id != 0) {
+      c.coalesced += __builtin_popcount(c.pendingMask & changed);
+      c.pendingMask |= changed;
+    }
+    ids[i] = c.id;
+    masks[i] = c.pendingMask;
+    binary[i] = c.binary;
+    replay[i] = c.binary && c.replaying;
+    hello[i] = c.binary && c.hello;
+  }
+  portEXIT_CRITICAL(&lock_);
+
+  char message[kLiveTextMaxSize];
+  uint8_t frame[kLiveFrameMaxSize];
+  for (uint8_t i = 0; i < kMaxClients; i++) {
+    if (ids[i] == 0 || (masks[i] == 0 && !replay[i] && !hello[i])) {
+      continue;
+    }
+    AsyncWebSocketClient* client = ws_.client(ids[i]);
+    if (client == nullptr) {
+      removeClient(ids[i]);
+      continue;
+    }
+    bool blocked = client->queueIsFull() || !client->canSend();
+    // Hello før alt andet, så klienten kender epoken når replay starter
+    if (!blocked && hello[i]) {
+      sendHello(i, ids[i], client, seq, nowMs);
+    }
+    // Live-rammen venter til klienten har fået alt før den
+    bool replaying = !blocked && replay[i] && sendReplay(i, ids[i], client);
+    bool live = !blocked && !replaying && masks[i] != 0;
+    bool close = false;
+    if (live && binary[i]) {
+      size_t len = encodeLiveFrame(LIVE_FRAME_FIELDS, seq, nowMs, masks[i], values, frame, sizeof(frame));
+      client->binary(frame, len);
+    } else if (live) {
+      size_t len = formatLiveText(masks[i], values, message, sizeof(message));
+      client->text(message, len);
+    }
+
+    portENTER_CRITICAL(&lock_);
+    WsClientStats& c = clients_[i];
+    if (c.id == ids[i]) {
+      if (blocked) {
+        c.dropped++;
+        messagesDropped_++;
+        close = ++c.consecutiveDrops >= maxConsecutiveDrops_;
+        if (close) {
+          clientsClosed_++;
+        }
+      } else {
+        c.consecutiveDrops = 0;
+      }
+      if (live) {
+        c.sent++;
+        c.pendingMask &= ~masks[i];
+        messagesSent_++;
+      }
+    }
+    portEXIT_CRITICAL(&lock_);
+
+    if (close) {
+      client->close();
+    }
+  }
+}
+
+uint8_t WsBroadcaster::clientIds(uint32_t* ids, uint8_t max) {
+  uint8_t n = 0;
+  portENTER_CRITICAL(&lock_);
+  for (uint8_t i = 0; i < kMaxClients && n < max; i++) {
+    if (clients_[i].id != 0) {
+      ids[n++] = clients_[i].id;
+    }
+  }
+  portEXIT_CRITICAL(&lock_);
+  return n;
+}
+
+size_t WsBroadcaster::statsJson(char* buf, size_t len) {
+  WsClientStats clients[kMaxClients];
+  portENTER_CRITICAL(&lock_);
+  uint32_t coalesced = fields_.coalesced();
+  uint32_t sent = messagesSent_;
+  uint32_t dropped = messagesDropped_;
+  uint32_t closed = clientsClosed_;
+  uint32_t replayRequests = replayRequests_;
+  uint32_t replayFrames = replayFrames_;
+  uint32_t replayMisses = replayMisses_;
+  uint32_t historyEntries = history_.count();
+  uint32_t historySpanMs = history_.spanMs();
+  for (uint8_t i = 0; i < kMaxClients; i++) {
+    clients[i] = clients_[i];
+  }
+  portEXIT_CRITICAL(&lock_);
+
+  int n = snprintf(buf, len,
+                   "{\"sent\":%lu,\"coalesced\":%lu,\"dropped\":%lu,\"closed\":%lu,"
+                   "\"replay\":{\"requests\":%lu,\"frames\":%lu,\"misses\":%lu,"
+                   "\"entries\":%lu,\"span_ms\":%lu},\"clients\":[",
+                   (unsigned long)sent, (unsigned long)coalesced, (unsigned long)dropped,
+                   (unsigned long)closed, (unsigned long)replayRequests, (unsigned long)replayFrames,
+                   (unsigned long)replayMisses, (unsigned long)historyEntries,
+                   (unsigned long)historySpanMs);
+  size_t used = n > 0 && (size_t)n < len ? n : 0;
+  bool first = true;
+  for (uint8_t i = 0; i < kMaxClients && used < len; i++) {
+    if (clients[i].id == 0) {
+      continue;
+    }
+    n = snprintf(buf + used, len - used,
+                 "%s{\"id\":%lu,\"sent\":%lu,\"coalesced\":%lu,\"dropped\":%lu}",
+                 first ? "" : ",", (unsigned long)clients[i].id, (unsigned long)clients[i].sent,
+                 (unsigned long)clients[i].coalesced, (unsigned long)clients[i].dropped);
+    if (n < 0 || (size_t)n >= len - used) {
+      break;
+    }
+    used += n;
+    first = false;
+  }
+  n = snprintf(buf + used, len - used, "]}");
+  if (n > 0 && (size_t)n < len - used) {
+    used += n;
+  }
+  return used;
+}
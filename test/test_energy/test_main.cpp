@@ -0,0 +1,128 @@
+/**
+ * @file test_main.cpp
+ * @brief EnergyMeter på host: syntetiske målere med kendte konstanter og intervaller.
+ *
+ * Energien sammenlignes med den eksakte værdi i µWh, så rest og afrunding
+ * ikke kan gemme sig bag en tolerance. Køres med pio test -e native.
+ */
+
+#include <unity.h>
+
+#include "energy.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/** @brief Resten løber over på de rigtige pulser, også når 10^9 / konstanten ikke går op. */
+void test_remainder_rolls_over_without_drift(void) {
+  const uint32_t constants[] = {375, 800, 1000, 1600, 7, 999999};
+  for (uint32_t imp : constants) {
+    EnergyMeter meter(imp);
+    for (uint64_t k = 1; k <= 3ull * imp && k <= 3000000; k++) {
+      meter.onPulse(k * 1000);
+      // Efter k pulser er energien k / imp kWh, rundet ned til hele µWh
+      if (meter.energyUwh() != k * 1000000000ull / imp) {
+        TEST_ASSERT_EQUAL_UINT64(k * 1000000000ull / imp, meter.energyUwh());
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT64(3000000000ull, meter.energyUwh());
+  }
+}
+
+/** @brief Energien akkumuleres i 64 bit og går forbi 2^32 µWh uden at løbe rundt. */
+void test_energy_accumulates_past_32_bits(void) {
+  EnergyMeter meter(1000);
+  for (uint32_t k = 0; k < 10000; k++) {
+    meter.onPulse((uint64_t)k * 3600000);
+  }
+  TEST_ASSERT_EQUAL_UINT64(10000000000ull, meter.energyUwh());
+  TEST_ASSERT_EQUAL_UINT64(10000, meter.energyWh());
+  TEST_ASSERT_EQUAL_UINT64(10000, meter.pulses());
+}
+
+/** @brief Effekten er 3,6·10^15 / (imp · Δt): 1000 imp/kWh og 3,6 s giver 1 kW. */
+void test_power_from_pulse_interval(void) {
+  EnergyMeter meter(1000);
+  meter.onPulse(1000000);
+  TEST_ASSERT_EQUAL_UINT32(0, meter.powerMw(1000000)); // Én puls giver intet interval
+  meter.onPulse(4600000);
+  TEST_ASSERT_EQUAL_UINT32(1000000, meter.powerMw(4600000));
+
+  // 10000 imp/kWh med 20 ms mellem pulserne: 18 kW
+  EnergyMeter fast(10000);
+  for (uint32_t k = 0; k < 50; k++) {
+    fast.onPulse(1000000 + (uint64_t)k * 20000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(18000000, fast.powerMw(1000000 + 49 * 20000));
+}
+
+/** @brief Uden nye pulser begrænses effekten af tiden siden sidste puls og bliver 0. */
+void test_power_decays_when_pulses_stop(void) {
+  EnergyMeter meter(1000, 60000000);
+  meter.onPulse(0);
+  meter.onPulse(1000000); // 3,6 kW
+  TEST_ASSERT_EQUAL_UINT32(3600000, meter.powerMw(1500000));
+  TEST_ASSERT_EQUAL_UINT32(1800000, meter.powerMw(3000000));
+  TEST_ASSERT_EQUAL_UINT32(360000, meter.powerMw(11000000));
+  TEST_ASSERT_EQUAL_UINT32(60000, meter.powerMw(61000000));
+  TEST_ASSERT_EQUAL_UINT32(0, meter.powerMw(61000001));
+
+  // Næste puls efter maxIntervalUs giver heller ingen effekt
+  meter.onPulse(70000000);
+  TEST_ASSERT_EQUAL_UINT32(0, meter.powerMw(70000000));
+}
+
+/** @brief Et tidsstempel der går baglæns, tæller energien men ændrer ikke effekten. */
+void test_backwards_timestamp_keeps_power(void) {
+  EnergyMeter meter(1000);
+  meter.onPulse(10000000);
+  meter.onPulse(13600000);
+  meter.onPulse(12000000);
+  TEST_ASSERT_EQUAL_UINT32(1000000, meter.powerMw(12000000));
+  TEST_ASSERT_EQUAL_UINT64(3000000, meter.energyUwh());
+}
+
+/** @brief CT-effekt integreres med rest: 250 mW i 20 ms ad gangen giver præcis 1 mWh pr. 720. */
+void test_on_power_integrates_with_remainder(void) {
+  EnergyMeter meter;
+  for (uint32_t k = 1; k <= 7200; k++) {
+    meter.onPower(250, 20000, (uint64_t)k * 20000);
+  }
+  TEST_ASSERT_EQUAL_UINT64(10000, meter.energyUwh());
+  TEST_ASSERT_EQUAL_UINT32(250, meter.powerMw(7200 * 20000));
+
+  // Eksport tæller ikke og giver effekt 0
+  meter.onPower(-500000, 1000000, 7200 * 20000 + 1000000);
+  TEST_ASSERT_EQUAL_UINT64(10000, meter.energyUwh());
+  TEST_ASSERT_EQUAL_UINT32(0, meter.powerMw(7200 * 20000 + 1000000));
+}
+
+/** @brief restore() sætter energien og nulstiller effekten; ny konstant bevarer energien. */
+void test_restore_and_constant_change(void) {
+  EnergyMeter meter(1000);
+  meter.onPulse(0);
+  meter.onPulse(3600000);
+  meter.restore(5000000000ull);
+  TEST_ASSERT_EQUAL_UINT64(5000, meter.energyWh());
+  TEST_ASSERT_EQUAL_UINT32(0, meter.powerMw(4000000));
+  TEST_ASSERT_EQUAL_UINT64(0, meter.pulses());
+
+  meter.setImpPerKwh(500);
+  meter.onPulse(5000000);
+  TEST_ASSERT_EQUAL_UINT64(5002000000ull, meter.energyUwh());
+  meter.setImpPerKwh(0);
+  TEST_ASSERT_EQUAL_UINT32(EnergyMeter::kDefaultImpPerKwh, meter.impPerKwh());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_remainder_rolls_over_without_drift);
+  RUN_TEST(test_energy_accumulates_past_32_bits);
+  RUN_TEST(test_power_from_pulse_interval);
+  RUN_TEST(test_power_decays_when_pulses_stop);
+  RUN_TEST(test_backwards_timestamp_keeps_power);
+  RUN_TEST(test_on_power_integrates_with_remainder);
+  RUN_TEST(test_restore_and_constant_change);
+  return UNITY_END();
+}
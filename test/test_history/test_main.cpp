@@ -0,0 +1,120 @@
+/**
+ * @file test_main.cpp
+ * @brief HistoryCursor på host: skridt, beskæring og kanttilfælde mod en lille Rollup.
+ *
+ * Svarene tømmes med små buffere, så et svar også skal kunne deles midt i
+ * en række. Køres med pio test -e native.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <unity.h>
+
+#include "history.h"
+
+static const uint32_t kT0 = 1700000000; ///< Første sample (s)
+
+static Rollup rollup;
+
+/**
+ * @brief Tømmer en cursor i bidder på 7 bytes, som HTTP-svaret gør.
+ * @return Hele svaret; fejler testen hvis cursoren ikke bliver færdig.
+ */
+static std::string drain(HistoryCursor& cursor) {
+  std::string out;
+  uint8_t buf[7];
+  for (uint32_t calls = 0; !cursor.done(); calls++) {
+    TEST_ASSERT_TRUE(calls < 100000);
+    size_t n = cursor.fill(buf, sizeof(buf));
+    out.append((const char*)buf, n);
+  }
+  return out;
+}
+
+/** @brief Antal rækker i et CSV-svar, uden header. */
+static size_t csvRows(const std::string& csv) {
+  size_t lines = 0;
+  for (char c : csv) {
+    lines += c == '\n';
+  }
+  return lines - 1;
+}
+
+void setUp(void) {
+  rollup.clear();
+}
+
+void tearDown(void) {}
+
+/** @brief Skridt 0 bliver 1 s og giver én række pr. sample i sekundniveauet. */
+void test_step_zero_is_one_second(void) {
+  for (uint32_t i = 0; i < 10; i++) {
+    rollup.add(kT0 + i, (int32_t)i);
+  }
+  HistoryCursor cursor(rollup, kT0, kT0 + 9, 0, HISTORY_CSV);
+  TEST_ASSERT_EQUAL_UINT32(1, cursor.step());
+  std::string csv = drain(cursor);
+  TEST_ASSERT_EQUAL_UINT32(10, csvRows(csv));
+  TEST_ASSERT_TRUE(csv.find("1700000009,9,9,9,1\n") != std::string::npos);
+}
+
+/** @brief Et kæmpe skridt begrænses til dagsniveauets vindue i stedet for at løbe over til 0. */
+void test_huge_step_is_clamped(void) {
+  rollup.add(kT0, 5);
+  const uint32_t steps[] = {4294880897u, 4294967295u};
+  for (uint32_t step : steps) {
+    HistoryCursor cursor(rollup, 0, UINT32_MAX, step, HISTORY_JSON);
+    TEST_ASSERT_EQUAL_UINT32(86400u * Rollup::kDayBuckets, cursor.step());
+    std::string json = drain(cursor);
+    TEST_ASSERT_TRUE(json.find(",5,5,5,1]]}") != std::string::npos);
+  }
+}
+
+/** @brief Skridt rundes op til et multiplum af niveauets opløsning. */
+void test_step_rounds_up_to_tier(void) {
+  for (uint32_t i = 0; i < 600; i += 10) {
+    rollup.add(kT0 + i, 1);
+  }
+  HistoryCursor cursor(rollup, kT0, kT0 + 599, 90, HISTORY_CSV);
+  TEST_ASSERT_EQUAL_UINT32(120, cursor.step());
+  std::string csv = drain(cursor);
+  TEST_ASSERT_EQUAL_UINT32(6, csvRows(csv)); // skridtene starter på hele 120 s, kT0 ligger 80 s inde
+  TEST_ASSERT_TRUE(csv.find("1700000040,12,1,1,12\n") != std::string::npos);
+}
+
+/** @brief from > to giver et tomt, men gyldigt svar. */
+void test_from_after_to_is_empty(void) {
+  rollup.add(kT0, 1);
+  HistoryCursor cursor(rollup, kT0 + 10, kT0, 1, HISTORY_JSON);
+  char expected[96];
+  snprintf(expected, sizeof(expected), "{\"from\":%lu,\"to\":%lu,\"step\":1,\"points\":[]}\n",
+           (unsigned long)(kT0 + 10), (unsigned long)kT0);
+  TEST_ASSERT_EQUAL_STRING(expected, drain(cursor).c_str());
+}
+
+/** @brief Intervaller før eller efter vinduet og en tom rollup giver ingen rækker. */
+void test_range_outside_window_is_empty(void) {
+  HistoryCursor none(rollup, 0, UINT32_MAX, 60, HISTORY_CSV);
+  TEST_ASSERT_EQUAL_STRING("time,sum,min,max,count\n", drain(none).c_str());
+
+  rollup.add(kT0, 1);
+  HistoryCursor before(rollup, 0, kT0 - 86400, 60, HISTORY_CSV);
+  TEST_ASSERT_EQUAL_UINT32(0, csvRows(drain(before)));
+  HistoryCursor after(rollup, kT0 + 86400, UINT32_MAX, 60, HISTORY_CSV);
+  TEST_ASSERT_EQUAL_UINT32(0, csvRows(drain(after)));
+
+  // Hele tidsaksen i sekundskridt: beskæres til vinduet og går i højst
+  // kHistoryMaxEmptySteps tomme skridt pr. fill()
+  HistoryCursor all(rollup, 0, UINT32_MAX, 1, HISTORY_CSV);
+  TEST_ASSERT_EQUAL_UINT32(1, csvRows(drain(all)));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_step_zero_is_one_second);
+  RUN_TEST(test_huge_step_is_clamped);
+  RUN_TEST(test_step_rounds_up_to_tier);
+  RUN_TEST(test_from_after_to_is_empty);
+  RUN_TEST(test_range_outside_window_is_empty);
+  return UNITY_END();
+}
@@ -0,0 +1,132 @@
+/**
+ * @file test_main.cpp
+ * @brief LogBlockSource på host: skip() og læsning over afbrudte blokke i en fil i RAM.
+ *
+ * Historikfilen appendes blok for blok, så strømsvigt kan efterlade en halv
+ * blok midt i filen. Den må hverken tælles med af skip() eller give poster.
+ * Køres med pio test -e native.
+ */
+
+#include <string.h>
+#include <vector>
+#include <unity.h>
+
+#include "log_export.h"
+
+/** @brief Blokfil i RAM. */
+class RamBlocks : public LogBlockSource {
+public:
+  RamBlocks(const std::vector<uint8_t>& bytes) : LogBlockSource(0, UINT32_MAX), bytes_(bytes) {}
+
+protected:
+  size_t readBytes(uint32_t offset, uint8_t* buf, size_t len) override {
+    if (offset >= bytes_.size()) {
+      return 0;
+    }
+    size_t n = bytes_.size() - offset < len ? bytes_.size() - offset : len;
+    memcpy(buf, bytes_.data() + offset, n);
+    return n;
+  }
+
+private:
+  const std::vector<uint8_t>& bytes_;
+};
+
+/**
+ * @brief Appender en blok med count poster, der starter ved tidspunktet first.
+ * @param keep Antal bytes af blokken der skrives; 0 for hele
+ */
+static void appendBlock(std::vector<uint8_t>& file, uint32_t first, uint16_t count, size_t keep = 0) {
+  TsBlockEncoder encoder;
+  for (uint16_t i = 0; i < count; i++) {
+    LogRecord record = {first + i, 0, 0, LOG_EVENT_COUNTER, (int32_t)(first + i)};
+    TEST_ASSERT_TRUE(encoder.add(record));
+  }
+  uint8_t block[kTsBlockHeaderSize + kTsBlockMaxPayload];
+  size_t len = encoder.seal(block);
+  file.insert(file.end(), block, block + (keep > 0 ? keep : len));
+}
+
+/** @brief Alle poster i filen. */
+static std::vector<LogRecord> readAll(const std::vector<uint8_t>& file) {
+  RamBlocks source(file);
+  std::vector<LogRecord> out;
+  LogRecord batch[16];
+  while (size_t n = source.read(batch, 16)) {
+    out.insert(out.end(), batch, batch + n);
+  }
+  return out;
+}
+
+/** @brief Antal poster skip() når frem til gennem hele filen. */
+static uint32_t countBySkip(const std::vector<uint8_t>& file) {
+  RamBlocks source(file);
+  source.skip(UINT32_MAX);
+  LogRecord record;
+  TEST_ASSERT_EQUAL_UINT32(0, source.read(&record, 1));
+  return source.recordsSkipped();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/** @brief Hele blokke tælles ud fra headerne alene. */
+void test_skip_counts_whole_blocks(void) {
+  std::vector<uint8_t> file;
+  appendBlock(file, 1000, 10);
+  appendBlock(file, 2000, 20);
+  TEST_ASSERT_EQUAL_UINT32(30, countBySkip(file));
+  TEST_ASSERT_EQUAL_UINT32(30, readAll(file).size());
+}
+
+/** @brief En blok afbrudt efter headeren i slutningen af filen tælles ikke. */
+void test_torn_block_at_end_is_not_counted(void) {
+  std::vector<uint8_t> file;
+  appendBlock(file, 1000, 10);
+  appendBlock(file, 2000, 20, kTsBlockHeaderSize + 5);
+  TEST_ASSERT_EQUAL_UINT32(10, countBySkip(file));
+  TEST_ASSERT_EQUAL_UINT32(10, readAll(file).size());
+}
+
+/** @brief En afbrudt blok midt i filen koster kun sine egne poster, også for skip(). */
+void test_torn_block_in_the_middle_is_not_counted(void) {
+  std::vector<uint8_t> file;
+  appendBlock(file, 1000, 10);
+  appendBlock(file, 2000, 20, kTsBlockHeaderSize + 5);
+  appendBlock(file, 2000, 20);
+  appendBlock(file, 3000, 5);
+  TEST_ASSERT_EQUAL_UINT32(35, countBySkip(file));
+  std::vector<LogRecord> records = readAll(file);
+  TEST_ASSERT_EQUAL_UINT32(35, records.size());
+  TEST_ASSERT_EQUAL_UINT32(2000, records[10].time);
+  TEST_ASSERT_EQUAL_UINT32(3004, records[34].time);
+
+  // skip() ind i blokken efter den afbrudte giver de rigtige poster
+  RamBlocks source(file);
+  source.skip(12);
+  LogRecord record;
+  TEST_ASSERT_EQUAL_UINT32(1, source.read(&record, 1));
+  TEST_ASSERT_EQUAL_UINT32(2002, record.time);
+  TEST_ASSERT_EQUAL_UINT32(12, source.recordsSkipped());
+}
+
+/** @brief Affald efter en hel blok gør den ikke ugyldig. */
+void test_garbage_after_whole_block(void) {
+  std::vector<uint8_t> file;
+  appendBlock(file, 1000, 10);
+  appendBlock(file, 2000, 20, 2);
+  TEST_ASSERT_EQUAL_UINT32(10, countBySkip(file));
+  appendBlock(file, 3000, 5);
+  TEST_ASSERT_EQUAL_UINT32(15, countBySkip(file));
+  TEST_ASSERT_EQUAL_UINT32(15, readAll(file).size());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_skip_counts_whole_blocks);
+  RUN_TEST(test_torn_block_at_end_is_not_counted);
+  RUN_TEST(test_torn_block_in_the_middle_is_not_counted);
+  RUN_TEST(test_garbage_after_whole_block);
+  return UNITY_END();
+}
@@ -0,0 +1,52 @@
+/**
+ * @file test_main.cpp
+ * @brief Histogram på host: spande, antal og 64-bit summen.
+ *
+ * Summen ligger i to par af 32-bit-ord; her tjekkes at den går forbi 2^32
+ * og altid læses fra det senest skrevne par. Køres med pio test -e native.
+ */
+
+#include <unity.h>
+
+#include "metrics.h"
+
+static const uint32_t kBounds[] = {10, 100, 1000}; ///< Spandgrænser (µs)
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/** @brief Værdier lig en grænse ligger i dens spand; større værdier i +Inf. */
+void test_buckets_are_inclusive(void) {
+  Histogram hist(kBounds, 3);
+  const uint32_t values[] = {0, 10, 11, 100, 1000, 1001, 4000000000u};
+  for (uint32_t value : values) {
+    hist.observe(value);
+  }
+  TEST_ASSERT_EQUAL_UINT32(2, hist.bucket(0));
+  TEST_ASSERT_EQUAL_UINT32(2, hist.bucket(1));
+  TEST_ASSERT_EQUAL_UINT32(1, hist.bucket(2));
+  TEST_ASSERT_EQUAL_UINT32(2, hist.bucket(3));
+  TEST_ASSERT_EQUAL_UINT32(7, hist.observations());
+}
+
+/** @brief Summen går forbi 2^32 uden at løbe rundt og følger hver måling. */
+void test_sum_passes_32_bits(void) {
+  Histogram hist(kBounds, 3);
+  TEST_ASSERT_EQUAL_UINT64(0, hist.sum());
+  uint64_t expected = 0;
+  for (uint32_t i = 0; i < 5; i++) {
+    hist.observe(UINT32_MAX);
+    expected += UINT32_MAX;
+    TEST_ASSERT_EQUAL_UINT64(expected, hist.sum());
+  }
+  hist.observe(7);
+  TEST_ASSERT_EQUAL_UINT64(expected + 7, hist.sum());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_buckets_are_inclusive);
+  RUN_TEST(test_sum_passes_32_bits);
+  return UNITY_END();
+}
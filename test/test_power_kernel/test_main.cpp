@@ -0,0 +1,196 @@
+/**
+ * @file test_main.cpp
+ * @brief power_kernel på host: genererede sinuskurver og harmoniske mod analytiske værdier.
+ *
+ * Hver kurve er én netperiode på 400 samples omkring ADC-midten 2048.
+ * Resultaterne sammenlignes dels med den analytiske værdi for den ideelle
+ * kurve (inden for kvantiseringen), dels med samme beregning i double på
+ * de afrundede samples, hvor kernen kun må afvige med sin afrunding nedad.
+ * Køres med pio test -e native.
+ */
+
+#include <math.h>
+#include <unity.h>
+
+#include "power_kernel.h"
+
+static const size_t kSamples = 400;     ///< Samples pr. periode (20 kHz ved 50 Hz)
+static const double kMid = 2048;        ///< ADC-midten, fjernes af kernen som DC
+static const double kVoltsPeak = 1800;  ///< Spændingens amplitude (tællinger)
+static const double kAmpsPeak = 1200;   ///< Strømmens grundtone (tællinger)
+
+static int16_t v[kSamples];
+static int16_t i[kSamples];
+
+/** @brief 230 V og 10 A effektivt ved grundtonens amplituder. */
+static const PowerCalibration cal = {
+  (uint32_t)lround(230000.0 * sqrt(2.0) / kVoltsPeak * 65536),
+  (uint32_t)lround(10000.0 * sqrt(2.0) / kAmpsPeak * 65536),
+};
+
+static double mvPerCount() { return cal.mvPerCountQ16 / 65536.0; }
+static double maPerCount() { return cal.maPerCountQ16 / 65536.0; }
+
+/**
+ * @brief Fylder v og i: sinus, strøm forskudt phi med en tredje harmonisk af relativ størrelse h3.
+ */
+static void generate(double phi, double h3) {
+  for (size_t k = 0; k < kSamples; k++) {
+    double t = 2 * M_PI * k / kSamples;
+    v[k] = (int16_t)lround(kMid + kVoltsPeak * sin(t));
+    i[k] = (int16_t)lround(kMid + kAmpsPeak * sin(t - phi) + h3 * kAmpsPeak * sin(3 * t));
+  }
+}
+
+static PowerReading measure() {
+  PowerSums sums;
+  powerAccumulate(v, i, kSamples, sums);
+  return powerFinish(sums, cal, 20000);
+}
+
+/**
+ * @brief Samme beregning i double på de afrundede samples.
+ */
+struct Exact {
+  double vrmsMv;
+  double irmsMa;
+  double realMw;
+};
+
+static Exact exact() {
+  double meanV = 0, meanI = 0;
+  for (size_t k = 0; k < kSamples; k++) {
+    meanV += v[k];
+    meanI += i[k];
+  }
+  meanV /= kSamples;
+  meanI /= kSamples;
+  double vv = 0, ii = 0, vi = 0;
+  for (size_t k = 0; k < kSamples; k++) {
+    vv += (v[k] - meanV) * (v[k] - meanV);
+    ii += (i[k] - meanI) * (i[k] - meanI);
+    vi += (v[k] - meanV) * (i[k] - meanI);
+  }
+  return {sqrt(vv / kSamples) * mvPerCount(), sqrt(ii / kSamples) * maPerCount(),
+          vi / kSamples * mvPerCount() * maPerCount() / 1000};
+}
+
+/** @brief Kernen runder nedad: højst én enhed under den eksakte værdi og aldrig over. */
+static void assertFloor(double expected, int64_t actual) {
+  TEST_ASSERT_TRUE(actual <= (int64_t)floor(expected));
+  TEST_ASSERT_TRUE(actual >= (int64_t)floor(expected) - 1);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/** @brief Ren sinus i fase: 230 V, 10 A, 2300 W og effektfaktor 1. */
+void test_sine_in_phase(void) {
+  generate(0, 0);
+  PowerReading r = measure();
+  Exact e = exact();
+  assertFloor(e.vrmsMv, r.vrmsMv);
+  assertFloor(e.irmsMa, r.irmsMa);
+  // Kvantiseringen på ±½ tælling flytter højst 0,01 % fra den ideelle kurve
+  TEST_ASSERT_UINT32_WITHIN(23, 230000, r.vrmsMv);
+  TEST_ASSERT_UINT32_WITHIN(1, 10000, r.irmsMa);
+  TEST_ASSERT_INT_WITHIN(230, 2300000, r.realMw);
+  TEST_ASSERT_INT_WITHIN(1, 1000, r.pfPermille);
+  TEST_ASSERT_UINT32_WITHIN(230, 2300000, r.apparentMva);
+  TEST_ASSERT_EQUAL_UINT32(20000, r.durationUs);
+}
+
+/** @brief Strøm forskudt 60°: P = Vrms·Irms·cos 60° = 1150 W, effektfaktor 0,5. */
+void test_phase_shift(void) {
+  generate(M_PI / 3, 0);
+  PowerReading r = measure();
+  Exact e = exact();
+  TEST_ASSERT_INT_WITHIN(1, (int32_t)floor(e.realMw), r.realMw);
+  TEST_ASSERT_INT_WITHIN(230, 1150000, r.realMw);
+  TEST_ASSERT_INT_WITHIN(1, 500, r.pfPermille);
+}
+
+/** @brief Eksport (180°) giver negativ effekt og effektfaktor med samme fortegn. */
+void test_export_is_negative(void) {
+  generate(M_PI, 0);
+  PowerReading r = measure();
+  TEST_ASSERT_INT_WITHIN(230, -2300000, r.realMw);
+  TEST_ASSERT_INT_WITHIN(1, -1000, r.pfPermille);
+}
+
+/**
+ * @brief 30 % tredje harmonisk i strømmen.
+ *
+ * Irms = √(1 + 0,3²) · 10 A = 10,440 A. Harmonisken er ortogonal på
+ * spændingen, så P er uændret 2300 W, og effektfaktoren falder til
+ * 1 / √(1,09) = 0,958.
+ */
+void test_third_harmonic(void) {
+  generate(0, 0.3);
+  PowerReading r = measure();
+  Exact e = exact();
+  assertFloor(e.irmsMa, r.irmsMa);
+  TEST_ASSERT_UINT32_WITHIN(2, (uint32_t)lround(10000 * sqrt(1.09)), r.irmsMa);
+  TEST_ASSERT_INT_WITHIN(230, 2300000, r.realMw);
+  TEST_ASSERT_INT_WITHIN(1, (int32_t)(1000 / sqrt(1.09)), r.pfPermille);
+}
+
+/** @brief Blokvis akkumulering, også med ulige blokke, giver samme summer som én blok. */
+void test_blocks_match_single_pass(void) {
+  generate(0.4, 0.1);
+  PowerSums whole;
+  powerAccumulate(v, i, kSamples, whole);
+  PowerSums parts;
+  const size_t blocks[] = {1, 3, 7, 64, 125, 200};
+  size_t at = 0;
+  for (size_t b : blocks) {
+    powerAccumulate(v + at, i + at, b, parts);
+    at += b;
+  }
+  TEST_ASSERT_EQUAL_UINT32(kSamples, at);
+  TEST_ASSERT_TRUE(whole.sumV == parts.sumV && whole.sumI == parts.sumI);
+  TEST_ASSERT_TRUE(whole.sumVV == parts.sumVV && whole.sumII == parts.sumII && whole.sumVI == parts.sumVI);
+  TEST_ASSERT_EQUAL_UINT32(whole.count, parts.count);
+}
+
+/** @brief DC og tomme summer: ren DC har ingen effektiv værdi, tomme summer giver nul. */
+void test_dc_and_empty(void) {
+  for (size_t k = 0; k < kSamples; k++) {
+    v[k] = 3000;
+    i[k] = 100;
+  }
+  PowerReading r = measure();
+  TEST_ASSERT_EQUAL_UINT32(0, r.vrmsMv);
+  TEST_ASSERT_EQUAL_UINT32(0, r.irmsMa);
+  TEST_ASSERT_EQUAL_INT32(0, r.realMw);
+  TEST_ASSERT_EQUAL_INT32(0, r.pfPermille);
+
+  PowerReading empty = powerFinish(PowerSums(), cal, 123);
+  TEST_ASSERT_EQUAL_UINT32(0, empty.vrmsMv);
+  TEST_ASSERT_EQUAL_UINT32(123, empty.durationUs);
+}
+
+/** @brief isqrt64 er eksakt på kvadrater og runder nedad lige under dem. */
+void test_isqrt64(void) {
+  const uint64_t roots[] = {0, 1, 2, 3, 255, 65535, 65536, 1000003, 0xFFFFFFFFull};
+  for (uint64_t r : roots) {
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)r, isqrt64(r * r));
+    if (r > 0) {
+      TEST_ASSERT_EQUAL_UINT32((uint32_t)r - 1, isqrt64(r * r - 1));
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFu, isqrt64(UINT64_MAX));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sine_in_phase);
+  RUN_TEST(test_phase_shift);
+  RUN_TEST(test_export_is_negative);
+  RUN_TEST(test_third_harmonic);
+  RUN_TEST(test_blocks_match_single_pass);
+  RUN_TEST(test_dc_and_empty);
+  RUN_TEST(test_isqrt64);
+  return UNITY_END();
+}
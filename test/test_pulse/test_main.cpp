@@ -0,0 +1,192 @@
+/**
+ * @file test_main.cpp
+ * @brief Pulsstien på host: syntetiske pulstog gennem ChannelBank::sampleInto() og SpscRing.
+ *
+ * Samme kode som sample-tasken kører (samplePulses() i main.cpp); uret og
+ * touchRead() kommer fra bench/fakes. Køres med pio test -e native.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "channel_bank.h"
+#include "config_record.h"
+#include "spsc_ring.h"
+
+/**
+ * @brief Pulstog som en målers LED set gennem touchRead(): hvile 100, puls 10.
+ */
+struct Train {
+  uint64_t startUs = 500000; ///< Første stigende flanke, efter indsvingningen
+  uint64_t periodUs = 1000000;
+  uint64_t widthUs = 40000;
+};
+
+static Train train;
+
+static uint16_t trainValue(uint8_t, uint64_t nowUs) {
+  if (nowUs < train.startUs) {
+    return 100;
+  }
+  return (nowUs - train.startUs) % train.periodUs < train.widthUs ? 10 : 100;
+}
+
+/**
+ * @brief Sampler i durationUs og tømmer ringen efter hver sample, som I/O-tasken.
+ * @return Antal pulser; tidsstemplerne lægges i stamps (højst max).
+ */
+template <size_t N>
+static uint32_t run(ChannelBank<N>& bank, uint32_t sampleIntervalUs, uint64_t durationUs,
+                    uint64_t* stamps = nullptr, size_t max = 0) {
+  SpscRing<PulseEvent, 64> ring;
+  uint32_t count = 0;
+  uint64_t endUs = fakeHw.nowUs + durationUs;
+  while (fakeHw.nowUs < endUs) {
+    fakeHw.advanceUs(sampleIntervalUs);
+    bank.sampleInto(touchRead, esp_timer_get_time(), ring);
+    PulseEvent event;
+    while (ring.pop(event)) {
+      if (count < max) {
+        stamps[count] = event.us;
+      }
+      count++;
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, ring.overflows());
+  return count;
+}
+
+void setUp(void) {
+  fakeHw.nowUs = 0;
+  fakeHw.touchFn = trainValue;
+  train = Train();
+}
+
+void tearDown(void) {
+  fakeHw.touchFn = nullptr;
+}
+
+/** @brief 1 Hz med 40 ms puls, standardopsætningen: hver puls tælles én gang. */
+void test_one_hz_counts_every_pulse(void) {
+  ChannelBank<kConfigMaxChannels> bank;
+  bank.setChannel(0, 15, 1000, 20000, 2000);
+  uint64_t stamps[64];
+  uint32_t count = run(bank, 2000, 60500000, stamps, 64);
+  TEST_ASSERT_EQUAL_UINT32(60, count);
+  for (uint32_t i = 1; i < count; i++) {
+    TEST_ASSERT_UINT32_WITHIN(2000, 1000000, stamps[i] - stamps[i - 1]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(60, bank.stats(0).pulses);
+}
+
+/** @brief Udsving på én sample er støj og tælles som afvist, ikke som puls. */
+void test_single_sample_glitch_is_rejected(void) {
+  ChannelBank<kConfigMaxChannels> bank;
+  bank.setChannel(0, 15, 1000, 20000, 2000);
+  train.widthUs = 1000; // kortere end to samples à 2 ms
+  uint32_t count = run(bank, 2000, 10500000);
+  TEST_ASSERT_EQUAL_UINT32(0, count);
+  TEST_ASSERT_GREATER_THAN(0, bank.stats(0).rejectedShort);
+}
+
+/** @brief 50 Hz med 5 ms puls, samplet hver 500 µs: 500 pulser på 10 s, 20 ms imellem. */
+void test_fifty_hz_counts_every_pulse(void) {
+  ChannelBank<kConfigMaxChannels> bank;
+  // 10000 imp/kWh ved 20 kW giver højst 55 Hz
+  bank.setChannel(0, 15, 10000, 20000, 500);
+  train.periodUs = 20000;
+  train.widthUs = 5000;
+  uint64_t stamps[512];
+  uint32_t count = run(bank, 500, 10495000, stamps, 512);
+  TEST_ASSERT_EQUAL_UINT32(500, count);
+  for (uint32_t i = 1; i < count; i++) {
+    TEST_ASSERT_UINT32_WITHIN(500, 20000, stamps[i] - stamps[i - 1]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, bank.stats(0).rejectedInterval);
+}
+
+/** @brief 100 Hz på to kanaler med forskudt fase; hver kanal tæller sine egne pulser. */
+void test_hundred_hz_two_channels(void) {
+  ChannelBank<kConfigMaxChannels> bank;
+  bank.setChannel(0, 15, 10000, 40000, 500);
+  bank.setChannel(1, 4, 10000, 40000, 500);
+  bank.setCount(2);
+  train.periodUs = 10000;
+  train.widthUs = 3000;
+  // Kanal 1 (pin 4) er forskudt en halv periode
+  fakeHw.touchFn = [](uint8_t pin, uint64_t nowUs) {
+    return trainValue(pin, pin == 4 ? nowUs + 5000 : nowUs);
+  };
+  uint32_t count = run(bank, 500, 5495000);
+  TEST_ASSERT_EQUAL_UINT32(1000, count);
+  TEST_ASSERT_EQUAL_UINT32(500, bank.stats(0).pulses);
+  TEST_ASSERT_EQUAL_UINT32(500, bank.stats(1).pulses);
+}
+
+/** @brief En puls der starter før minIntervalUs efter forrige, afvises. */
+void test_too_fast_train_is_rejected_on_interval(void) {
+  ChannelBank<kConfigMaxChannels> bank;
+  // 1000 imp/kWh ved 20 kW: mindst 90 ms mellem pulser, toget har 50 ms
+  bank.setChannel(0, 15, 1000, 20000, 2000);
+  train.periodUs = 50000;
+  train.widthUs = 20000;
+  uint32_t count = run(bank, 2000, 2490000);
+  TEST_ASSERT_EQUAL_UINT32(20, count);
+  TEST_ASSERT_EQUAL_UINT32(20, bank.stats(0).rejectedInterval);
+}
+
+/** @brief Målerkonstant 0 giver samme tidsgrænser som 1000, ligesom i EnergyMeter. */
+void test_zero_constant_uses_default_timing(void) {
+  PulseTiming zero = pulseTimingFor(0, 20000, 2000);
+  PulseTiming standard = pulseTimingFor(1000, 20000, 2000);
+  TEST_ASSERT_EQUAL_UINT32(90000, standard.minIntervalUs);
+  TEST_ASSERT_EQUAL_UINT32(standard.minIntervalUs, zero.minIntervalUs);
+  TEST_ASSERT_EQUAL_UINT32(standard.minWidthUs, zero.minWidthUs);
+}
+
+/** @brief Råværdier over 32767 mættes i stedet for at løbe rundt i Q16; pulserne tælles stadig. */
+void test_high_raw_values_saturate(void) {
+  ChannelBank<kConfigMaxChannels> bank;
+  bank.setChannel(0, 15, 1000, 20000, 2000);
+  fakeHw.touchFn = [](uint8_t pin, uint64_t nowUs) {
+    return (uint16_t)(trainValue(pin, nowUs) == 100 ? 60000 : 30000);
+  };
+  uint32_t count = run(bank, 2000, 10500000);
+  TEST_ASSERT_EQUAL_UINT32(10, count);
+  TEST_ASSERT_EQUAL_INT32(0x7FFF << 16, bank.stats(0).baselineQ16);
+}
+
+/** @brief Uden forbruger fyldes ringen; resten tælles som overflow og tabes. */
+void test_stalled_consumer_counts_overflows(void) {
+  ChannelBank<kConfigMaxChannels> bank;
+  bank.setChannel(0, 15, 10000, 20000, 500);
+  train.periodUs = 20000;
+  train.widthUs = 5000;
+  SpscRing<PulseEvent, 64> ring;
+  while (fakeHw.nowUs < 2495000) {
+    fakeHw.advanceUs(500);
+    bank.sampleInto(touchRead, esp_timer_get_time(), ring);
+  }
+  TEST_ASSERT_EQUAL_UINT32(64, ring.size());
+  TEST_ASSERT_EQUAL_UINT32(100 - 64, ring.overflows());
+  // De ældste pulser er bevaret i rækkefølge
+  PulseEvent event;
+  uint64_t previous = 0;
+  while (ring.pop(event)) {
+    TEST_ASSERT_TRUE(event.us > previous);
+    previous = event.us;
+  }
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_one_hz_counts_every_pulse);
+  RUN_TEST(test_single_sample_glitch_is_rejected);
+  RUN_TEST(test_fifty_hz_counts_every_pulse);
+  RUN_TEST(test_hundred_hz_two_channels);
+  RUN_TEST(test_too_fast_train_is_rejected_on_interval);
+  RUN_TEST(test_zero_constant_uses_default_timing);
+  RUN_TEST(test_high_raw_values_saturate);
+  RUN_TEST(test_stalled_consumer_counts_overflows);
+  return UNITY_END();
+}
@@ -0,0 +1,204 @@
+/**
+ * @file test_main.cpp
+ * @brief Alarmregler på host: parseRules(), formatRule() og RuleEngine med syntetiske prøver.
+ *
+ * Prøverne har tid og døgn sat direkte, så ventetider og døgnskift kan
+ * rammes præcist. Køres med pio test -e native.
+ */
+
+#include <string.h>
+#include <unity.h>
+
+#include "rule_engine.h"
+
+/** @brief Én regel som RuleEngine tager imod. */
+static RuleConfig makeRule(uint8_t kind, uint32_t threshold, uint32_t holdS) {
+  RuleConfig rule = {};
+  rule.kind = kind;
+  rule.channel = 0;
+  rule.actions = RULE_ACTION_EVENT;
+  rule.threshold = threshold;
+  rule.holdS = holdS;
+  return rule;
+}
+
+/** @brief Prøve for kanal 0. */
+static RuleSample makeSample(uint32_t nowMs, uint32_t day, uint32_t counter, uint32_t energyWh, int32_t powerW) {
+  RuleSample sample;
+  sample.nowMs = nowMs;
+  sample.day = day;
+  sample.channel = 0;
+  sample.counter = counter;
+  sample.energyWh = energyWh;
+  sample.powerW = powerW;
+  return sample;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/** @brief Alle tre typer læses med kanal, tærskel, ventetid og handlinger. */
+void test_parse_rules(void) {
+  RuleConfig rules[kConfigMaxRules];
+  const char* end;
+  size_t n = parseRules(" power:0:3000:60:led+event;\nidle:1:0:1800:event ; energy:7:12000:0:push;",
+                        rules, kConfigMaxRules, &end);
+  TEST_ASSERT_EQUAL_UINT32(3, n);
+  TEST_ASSERT_EQUAL_STRING("", end);
+  TEST_ASSERT_EQUAL_UINT8(RULE_POWER_ABOVE, rules[0].kind);
+  TEST_ASSERT_EQUAL_UINT32(3000, rules[0].threshold);
+  TEST_ASSERT_EQUAL_UINT32(60, rules[0].holdS);
+  TEST_ASSERT_EQUAL_UINT8(RULE_ACTION_LED | RULE_ACTION_EVENT, rules[0].actions);
+  TEST_ASSERT_EQUAL_UINT8(RULE_NO_PULSES, rules[1].kind);
+  TEST_ASSERT_EQUAL_UINT8(1, rules[1].channel);
+  TEST_ASSERT_EQUAL_UINT8(RULE_DAILY_ENERGY, rules[2].kind);
+  TEST_ASSERT_EQUAL_UINT8(7, rules[2].channel);
+  TEST_ASSERT_EQUAL_UINT8(RULE_ACTION_PUSH, rules[2].actions);
+
+  // Tom tekst er nul regler og en fuldt læst tekst
+  TEST_ASSERT_EQUAL_UINT32(0, parseRules(" ; ", rules, kConfigMaxRules, &end));
+  TEST_ASSERT_EQUAL_STRING("", end);
+}
+
+/** @brief Læsningen stopper ved første ugyldige regel, og end peger på dens start. */
+void test_parse_rules_stops_at_invalid(void) {
+  const char* invalid[] = {
+    "power:0:3000:60:led;bogus:0:1:1:led",
+    "power:0:3000:60:led;power:8:1:1:led",    // kanal uden for kConfigMaxChannels
+    "power:0:3000:60:led;idle:0:0:0:event",   // idle uden ventetid
+    "power:0:3000:60:led;power:0:1:1:beep",   // ukendt handling
+    "power:0:3000:60:led;power:0:1:2592001:led", // over kRuleMaxHoldS
+  };
+  for (const char* text : invalid) {
+    RuleConfig rules[kConfigMaxRules];
+    const char* end;
+    TEST_ASSERT_EQUAL_UINT32(1, parseRules(text, rules, kConfigMaxRules, &end));
+    TEST_ASSERT_EQUAL_STRING(strchr(text, ';') + 1, end);
+  }
+
+  // Regler ud over max læses ikke, og end peger på den første af dem
+  RuleConfig two[2];
+  const char* text = "idle:0:0:10:led;idle:1:0:10:led;idle:2:0:10:led";
+  const char* end;
+  TEST_ASSERT_EQUAL_UINT32(2, parseRules(text, two, 2, &end));
+  TEST_ASSERT_EQUAL_STRING("idle:2:0:10:led", end);
+}
+
+/** @brief formatRule() skriver det parseRules() læser. */
+void test_format_round_trip(void) {
+  RuleConfig rule = makeRule(RULE_POWER_ABOVE, 4294967295u, kRuleMaxHoldS);
+  rule.channel = 7;
+  rule.actions = RULE_ACTION_LED | RULE_ACTION_EVENT | RULE_ACTION_PUSH;
+  char text[kRuleTextMaxBytes];
+  TEST_ASSERT_TRUE(formatRule(rule, text, sizeof(text)) > 0);
+  TEST_ASSERT_EQUAL_STRING("power:7:4294967295:2592000:led+event+push", text);
+  RuleConfig parsed;
+  TEST_ASSERT_EQUAL_UINT32(1, parseRules(text, &parsed, 1));
+  TEST_ASSERT_EQUAL_MEMORY(&rule, &parsed, sizeof(rule));
+  TEST_ASSERT_EQUAL_UINT32(0, formatRule(rule, text, 10));
+}
+
+/** @brief Effektreglen slår til efter præcis holdS over tærsklen og fra med det samme. */
+void test_power_rule_hold_timing(void) {
+  RuleConfig rule = makeRule(RULE_POWER_ABOVE, 3000, 60);
+  RuleEngine engine;
+  engine.configure(&rule, 1);
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(1000, 0, 0, 0, 3000))); // lig tærsklen er ikke over
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(2000, 0, 0, 0, 3001)));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(61999, 0, 0, 0, 3500)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(62000, 0, 0, 0, 3500)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.activeMask());
+  TEST_ASSERT_EQUAL_INT32(3500, engine.value(0));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(90000, 0, 0, 0, 4000)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(91000, 0, 0, 0, 100)));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.activeMask());
+  TEST_ASSERT_EQUAL_INT32(100, engine.value(0));
+
+  // Et dyk under tærsklen starter ventetiden forfra
+  engine.update(makeSample(100000, 0, 0, 0, 5000));
+  engine.update(makeSample(150000, 0, 0, 0, 0));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(151000, 0, 0, 0, 5000)));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(210999, 0, 0, 0, 5000)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(211000, 0, 0, 0, 5000)));
+
+  // Prøver for andre kanaler rører ikke reglen
+  RuleSample other = makeSample(300000, 0, 0, 0, 0);
+  other.channel = 1;
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(other));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.activeMask());
+}
+
+/** @brief Idle-reglen slår til når tælleren har stået stille i holdS og fra ved næste puls. */
+void test_idle_rule(void) {
+  RuleConfig rule = makeRule(RULE_NO_PULSES, 0, 1800);
+  RuleEngine engine;
+  engine.configure(&rule, 1);
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(0, 0, 42, 0, 0)));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(1000000, 0, 43, 0, 0))); // puls
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(2799999, 0, 43, 0, 0)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(2800000, 0, 43, 0, 0)));
+  TEST_ASSERT_EQUAL_INT32(1800, engine.value(0));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(5000000, 0, 43, 0, 0)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(5000500, 0, 44, 0, 0)));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.activeMask());
+  TEST_ASSERT_EQUAL_INT32(4000, engine.value(0));
+
+  // Ventetiden regnes fra seneste puls, også hen over millis()-overløb
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(0xFFFFFC18u, 0, 45, 0, 0)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(1800000 - 1000, 0, 45, 0, 0)));
+}
+
+/** @brief Døgnreglen venter på uret, tæller fra døgnets første prøve og slår fra ved døgnskift. */
+void test_daily_energy_day_rollover(void) {
+  RuleConfig rule = makeRule(RULE_DAILY_ENERGY, 12000, 0);
+  RuleEngine engine;
+  engine.configure(&rule, 1);
+  const uint32_t day = 20000;
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(0, 0, 0, 50000, 0))); // uret er ikke sat
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(1000, day, 0, 100000, 0)));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(2000, day, 0, 112000, 0))); // lig tærsklen
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(3000, day, 0, 112001, 0)));
+  TEST_ASSERT_EQUAL_INT32(12001, engine.value(0));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(4000, day, 0, 130000, 0)));
+
+  // Nyt døgn: reglen slår fra og tæller fra døgnets første prøve
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(5000, day + 1, 0, 131000, 0)));
+  TEST_ASSERT_EQUAL_INT32(31000, engine.value(0));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(6000, day + 1, 0, 143000, 0)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(7000, day + 1, 0, 143001, 0)));
+
+  // Nulstillet energi midt i døgnet giver en ny startværdi
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(8000, day + 1, 0, 10, 0)));
+  TEST_ASSERT_EQUAL_UINT32(0, engine.update(makeSample(9000, day + 1, 0, 12010, 0)));
+  TEST_ASSERT_EQUAL_UINT32(1, engine.update(makeSample(10000, day + 1, 0, 12011, 0)));
+}
+
+/** @brief actionMask() og configure() med RULE_OFF og flere regler end der er plads til. */
+void test_configure_and_action_mask(void) {
+  RuleConfig rules[kConfigMaxRules + 2];
+  for (size_t i = 0; i < kConfigMaxRules + 2; i++) {
+    rules[i] = makeRule(RULE_POWER_ABOVE, 0, 0);
+    rules[i].actions = i % 2 ? RULE_ACTION_LED : RULE_ACTION_PUSH;
+  }
+  rules[1].kind = RULE_OFF;
+  RuleEngine engine;
+  engine.configure(rules, kConfigMaxRules + 2);
+  TEST_ASSERT_EQUAL_UINT32(kConfigMaxRules, engine.count());
+  TEST_ASSERT_EQUAL_HEX32(0xA8, engine.actionMask(RULE_ACTION_LED));
+  TEST_ASSERT_EQUAL_HEX32(0x55, engine.actionMask(RULE_ACTION_PUSH));
+  // Alle regler uden ventetid slår til på første prøve over tærsklen, undtagen RULE_OFF
+  TEST_ASSERT_EQUAL_HEX32(0xFD, engine.update(makeSample(0, 0, 0, 0, 1)));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_rules);
+  RUN_TEST(test_parse_rules_stops_at_invalid);
+  RUN_TEST(test_format_round_trip);
+  RUN_TEST(test_power_rule_hold_timing);
+  RUN_TEST(test_idle_rule);
+  RUN_TEST(test_daily_energy_day_rollover);
+  RUN_TEST(test_configure_and_action_mask);
+  return UNITY_END();
+}
@@ -0,0 +1,48 @@
+"""
+Sammenligner to kørsler af mikrobenchmarks (bench/microbench.cpp).
+
+Læser to JSON-lines-filer og skriver ns/op før og efter for hver
+benchmark. Afslutter med status 1 hvis en benchmark er blevet mere end
+tærsklen langsommere, så den kan bruges i et CI-trin.
+
+Brug: python tools/bench_compare.py baseline.jsonl current.jsonl [tærskel i %]
+"""
+
+import json
+import sys
+
+
+def load(path):
+    """Returnerer {navn: ns_per_op} for filen."""
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                entry = json.loads(line)
+                results[entry["bench"]] = entry["ns_per_op"]
+    return results
+
+
+def compare(baseline, current, threshold):
+    """Skriver tabellen og returnerer antal regressioner."""
+    regressions = 0
+    print("%-24s %12s %12s %8s" % ("bench", "base ns/op", "ns/op", "change"))
+    for name in sorted(set(baseline) | set(current)):
+        if name not in baseline or name not in current:
+            print("%-24s %12s %12s %8s" % (name, baseline.get(name, "-"), current.get(name, "-"), "n/a"))
+            continue
+        change = (current[name] - baseline[name]) * 100.0 / baseline[name]
+        flag = ""
+        if change > threshold:
+            regressions += 1
+            flag = "  REGRESSION"
+        print("%-24s %12.2f %12.2f %+7.1f%%%s" % (name, baseline[name], current[name], change, flag))
+    return regressions
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (3, 4):
+        sys.exit("usage: bench_compare.py <baseline.jsonl> <current.jsonl> [threshold %]")
+    threshold = float(sys.argv[3]) if len(sys.argv) == 4 else 10.0
+    sys.exit(1 if compare(load(sys.argv[1]), load(sys.argv[2]), threshold) else 0)
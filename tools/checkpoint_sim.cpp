@@ -0,0 +1,119 @@
+/**
+ * @file checkpoint_sim.cpp
+ * @brief Tester checkpoint-journalen (checkpoint_journal.h) med simuleret strømsvigt.
+ *
+ * Byg på en PC med:
+ *   g++ -std=c++11 -O2 -Iinclude tools/checkpoint_sim.cpp src/checkpoint_journal.cpp \
+ *       src/crc32.cpp -o checkpoint_sim
+ *
+ * Brug:
+ *   checkpoint_sim [genstarter [sektorer]]
+ *
+ * Hver runde skriver et tilfældigt antal checkpoints og afbryder strømmen
+ * på et tilfældigt sted, også midt i en skrivning eller en sletning.
+ * Derefter gendannes journalen som ved opstart, og det kontrolleres at
+ * resultatet er det seneste bekræftede checkpoint eller det der var ved at
+ * blive skrevet, med det indhold der blev skrevet. Hver fjerde runde er
+ * svigtet kortvarigt: strømmen kommer tilbage og der skrives videre, så en
+ * fejlet skrivning (også i en sektors første slot) efterfølges af nye
+ * checkpoints før genstarten. Til sidst skrives én
+ * JSON-linje med antal genstarter, checkpoints, sletninger, flest læsninger
+ * ved gendannelse og den estimerede levetid ved et checkpoint hvert 5. s.
+ * Afslutter med status 1 ved første fejl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+
+#include "checkpoint_journal.h"
+
+const uint32_t kSectorSize = 4096;          ///< Som ESP32'ens flash
+const uint32_t kCheckpointIntervalS = 5;    ///< Som firmwarens standard
+
+static uint32_t rng = 2463534242u;
+static uint32_t next() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static bool same(const Checkpoint& a, const Checkpoint& b) {
+  for (size_t ch = 0; ch < kCheckpointChannels; ch++) {
+    if (a.counters[ch] != b.counters[ch] || a.energyUwh[ch] != b.energyUwh[ch]) {
+      return false;
+    }
+  }
+  return a.sequence == b.sequence;
+}
+
+int main(int argc, char** argv) {
+  uint32_t restarts = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+  uint32_t sectors = argc > 2 ? strtoul(argv[2], nullptr, 10) : 16;
+
+  RamFlashRegion flash(sectors, kSectorSize);
+  std::map<uint32_t, Checkpoint> attempted; ///< Indhold pr. sekvensnummer der er forsøgt skrevet
+  Checkpoint state;
+  uint32_t confirmed = 0;
+  uint32_t written = 0;
+  uint32_t maxRecoveryReads = 0;
+  uint32_t estimatedErases = 0;
+
+  for (uint32_t restart = 0; restart < restarts; restart++) {
+    flash.cutAfter(-1);
+    CheckpointJournal journal(flash);
+    Checkpoint recovered;
+    bool found = journal.recover(recovered);
+    if (journal.stats().recoveryReads > maxRecoveryReads) {
+      maxRecoveryReads = journal.stats().recoveryReads;
+    }
+    if (confirmed > 0) {
+      if (!found || recovered.sequence < confirmed || recovered.sequence > confirmed + 1 ||
+          !same(recovered, attempted[recovered.sequence])) {
+        printf("{\"error\":\"restart %u recovered %u, confirmed %u\"}\n", restart,
+               found ? recovered.sequence : 0, confirmed);
+        return 1;
+      }
+      state = recovered;
+    }
+    confirmed = found ? recovered.sequence : 0;
+
+    // Strømmen går et sted i de næste op til 2 sektorers skrivninger
+    flash.cutAfter(next() % (2 * kSectorSize + 2 * kSectorSize / kCheckpointSlotSize * kCheckpointSlotSize));
+    bool transient = false;
+    uint32_t extra = 0;
+    for (;;) {
+      for (size_t ch = 0; ch < kCheckpointChannels; ch++) {
+        uint32_t pulses = next() % 4;
+        state.counters[ch] += pulses;
+        state.energyUwh[ch] += pulses * 1000000ull;
+      }
+      Checkpoint attempt = state;
+      attempt.sequence = journal.sequence() + 1;
+      attempted[attempt.sequence] = attempt;
+      if (!journal.write(state)) {
+        if (restart % 4 != 0 || transient) {
+          break;
+        }
+        transient = true;
+        flash.cutAfter(-1);
+        extra = next() % (2 * kSectorSize / kCheckpointSlotSize);
+        continue;
+      }
+      if (transient && extra-- == 0) {
+        break;
+      }
+      confirmed = state.sequence;
+      written++;
+    }
+    estimatedErases = journal.estimatedSectorErases();
+  }
+
+  double slots = (double)sectors * (kSectorSize / kCheckpointSlotSize);
+  double lifetimeYears = slots * kFlashEnduranceCycles * kCheckpointIntervalS / (365.0 * 86400.0);
+  printf("{\"restarts\":%u,\"sectors\":%u,\"slots\":%.0f,\"checkpoints\":%u,\"erases\":%u,"
+         "\"estimated_sector_erases\":%u,\"max_recovery_reads\":%u,\"lifetime_years_at_5s\":%.1f}\n",
+         restarts, sectors, slots, written, flash.erases(), estimatedErases, maxRecoveryReads, lifetimeYears);
+  return 0;
+}
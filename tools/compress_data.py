@@ -0,0 +1,47 @@
+"""
+Gzip-komprimerer filerne i data/ før SPIFFS-billedet bygges.
+
+Bruges som PlatformIO extra_script (pre:), hvor den omdirigerer
+PROJECT_DATA_DIR til en mappe under build-mappen med <navn>.gz for hver
+fil. Komprimeringen er deterministisk (mtime = 0), så uændrede filer
+giver samme gzip-trailer og dermed samme ETag på enheden.
+
+Kan også køres direkte: python tools/compress_data.py data out
+"""
+
+import gzip
+import os
+import shutil
+import sys
+
+
+def compress_dir(src, dst):
+    """Skriver src/<navn> som dst/<navn>.gz og returnerer antal filer."""
+    if os.path.isdir(dst):
+        shutil.rmtree(dst)
+    os.makedirs(dst)
+    count = 0
+    for name in sorted(os.listdir(src)):
+        path = os.path.join(src, name)
+        if not os.path.isfile(path):
+            continue
+        with open(path, "rb") as f:
+            data = f.read()
+        with open(os.path.join(dst, name + ".gz"), "wb") as f:
+            with gzip.GzipFile(filename="", mode="wb", compresslevel=9, fileobj=f, mtime=0) as gz:
+                gz.write(data)
+        count += 1
+    return count
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: compress_data.py <data dir> <output dir>")
+    print("compressed %d files" % compress_dir(sys.argv[1], sys.argv[2]))
+else:
+    Import("env")  # noqa: F821 - leveres af PlatformIO
+
+    src_dir = env.subst("$PROJECT_DATA_DIR")  # noqa: F821
+    dst_dir = os.path.join(env.subst("$BUILD_DIR"), "data_gz")  # noqa: F821
+    print("Compressing %s -> %s (%d files)" % (src_dir, dst_dir, compress_dir(src_dir, dst_dir)))
+    env.Replace(PROJECT_DATA_DIR=dst_dir)  # noqa: F821
@@ -0,0 +1,161 @@
+/**
+ * @file detector_sim.cpp
+ * @brief Kører pulsdetektoren (pulse_detector.h) mod syntetiske eller optagne spor.
+ *
+ * Byg på en PC med:
+ *   g++ -std=c++11 -O2 -Iinclude tools/detector_sim.cpp -o detector_sim
+ *
+ * Brug:
+ *   detector_sim                          syntetiske scenarier
+ *   detector_sim spor.csv [imp [maxW]]    optaget spor, linjer "tid_us,værdi"
+ *
+ * For hvert syntetisk scenarie skrives én JSON-linje med antal genererede
+ * pulser, antal fundet af den gamle faste tærskel (40 og 5 ms debounce) og
+ * af den adaptive detektor samt dens signalkvalitet. Pulser der starter
+ * mens detektoren finder hvileniveauet, tælles ikke med som forventede.
+ * Afslutter med status 1 hvis den adaptive detektor misser flere pulser
+ * end scenariet tillader eller finder pulser der ikke findes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pulse_debounce.h"
+#include "pulse_detector.h"
+
+const uint32_t kSampleUs = 2000;   ///< Samme sampleperiode som firmwarens standard
+const uint16_t kLegacyThreshold = 40;
+const uint32_t kLegacyDebounceUs = 5000;
+
+static uint32_t rng = 2463534242u;
+static int32_t noise(int32_t amplitude) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return amplitude ? (int32_t)(rng % (2 * amplitude + 1)) - amplitude : 0;
+}
+
+/**
+ * @brief Beskrivelse af et syntetisk spor.
+ */
+struct Scenario {
+  const char* name;
+  uint32_t impPerKwh;
+  uint32_t maxPowerW;
+  uint32_t periodUs;     ///< Tid mellem pulser
+  uint32_t widthUs;      ///< Pulsens bredde
+  int32_t baseline;      ///< Hvileværdi ved start
+  int32_t depth;         ///< Hvor meget værdien falder under en puls
+  int32_t noise;         ///< Støj, ± råværdier
+  int32_t driftEnd;      ///< Hvileværdi ved slut (lineær drift)
+  int32_t stepAt;        ///< Spring i hvileværdi midtvejs (0 = intet)
+  uint32_t spikeEveryUs; ///< Enkelt-sample-udsving med dette interval (0 = ingen)
+  uint32_t durationS;
+  uint32_t allowedMisses; ///< Pulser der må mistes, f.eks. mens et spring i lyset afventer maxWidthUs
+};
+
+static const Scenario scenarios[] = {
+  // navn          imp    maxW   periode  bredde  base dybde støj drift spring spikes  varighed miss
+  {"steady",      1000, 20000, 1000000, 30000,  70,  45,   3,   70,    0,      0,  600, 0},
+  {"drift",       1000, 20000, 1000000, 30000,  70,  30,   3,   48,    0,      0,  600, 0},
+  {"weak",        1000, 20000, 1000000, 30000,  70,  15,   1,   70,    0,      0,  600, 0},
+  {"spikes",      1000, 20000, 1000000, 30000,  70,  45,   3,   70,    0, 333000,  600, 0},
+  {"ambient_step",1000, 20000, 1000000, 30000,  70,  25,   2,   70,  -22,      0,  600, 2},
+  {"high_load",  10000, 25000,   20000,  5000,  70,  45,   3,   70,    0,      0,   60, 0},
+};
+
+/**
+ * @brief Råværdi for scenariet på et tidspunkt.
+ * @param pulse Sættes til true hvis en puls er aktiv
+ */
+static uint16_t sample(const Scenario& s, uint64_t t, bool& pulse) {
+  uint64_t duration = (uint64_t)s.durationS * 1000000;
+  int32_t base = s.baseline + (int32_t)((int64_t)(s.driftEnd - s.baseline) * (int64_t)t / (int64_t)duration);
+  if (s.stepAt && t >= duration / 2) {
+    base += s.stepAt;
+  }
+  // Første puls efter en halv periode, så detektoren kan falde til ro
+  uint64_t phase = (t + s.periodUs / 2) % s.periodUs;
+  pulse = t >= s.periodUs / 2 && phase < s.widthUs;
+  int32_t v = base + noise(s.noise) - (pulse ? s.depth : 0);
+  if (s.spikeEveryUs && t % s.spikeEveryUs < kSampleUs && !pulse) {
+    v -= 45;
+  }
+  return v < 0 ? 0 : (uint16_t)v;
+}
+
+static PulseDetectorConfig configFor(uint32_t impPerKwh, uint32_t maxPowerW) {
+  PulseTiming timing = pulseTimingFor(impPerKwh, maxPowerW, kSampleUs);
+  PulseDetectorConfig config;
+  config.minWidthUs = timing.minWidthUs;
+  config.minIntervalUs = timing.minIntervalUs;
+  return config;
+}
+
+static void printStats(const PulseDetectorStats& st) {
+  printf("\"rejected_short\":%u,\"rejected_interval\":%u,\"baseline_resets\":%u,"
+         "\"baseline\":%.1f,\"noise\":%.2f,\"min_amplitude\":%.1f,\"snr\":%.1f",
+         st.rejectedShort, st.rejectedInterval, st.baselineResets, st.baselineQ16 / 65536.0,
+         st.noiseQ16 / 65536.0, st.minAmplitudeQ16 / 65536.0,
+         st.noiseQ16 ? (double)st.minAmplitudeQ16 / st.noiseQ16 : 0.0);
+}
+
+static bool runScenario(const Scenario& s) {
+  PulseDetector detector(configFor(s.impPerKwh, s.maxPowerW));
+  PulseDebouncer legacy(kLegacyDebounceUs);
+  uint32_t expected = 0;
+  uint32_t legacyCount = 0;
+  uint32_t adaptiveCount = 0;
+  bool wasPulse = false;
+  for (uint64_t t = 0; t < (uint64_t)s.durationS * 1000000; t += kSampleUs) {
+    bool pulse;
+    uint16_t v = sample(s, t, pulse);
+    if (pulse && !wasPulse && t >= PulseDetector::kSettleSamples * kSampleUs) {
+      expected++;
+    }
+    wasPulse = pulse;
+    legacyCount += legacy.update(v < kLegacyThreshold, t);
+    adaptiveCount += detector.update(v, t);
+  }
+  printf("{\"scenario\":\"%s\",\"expected\":%u,\"legacy\":%u,\"adaptive\":%u,", s.name, expected, legacyCount,
+         adaptiveCount);
+  printStats(detector.stats());
+  printf("}\n");
+  return adaptiveCount <= expected && adaptiveCount + s.allowedMisses >= expected;
+}
+
+static int runTrace(const char* path, uint32_t impPerKwh, uint32_t maxPowerW) {
+  FILE* in = fopen(path, "r");
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+  PulseDetector detector(configFor(impPerKwh, maxPowerW));
+  unsigned long long t;
+  unsigned v;
+  uint32_t pulses = 0;
+  char line[64];
+  while (fgets(line, sizeof(line), in)) {
+    if (sscanf(line, "%llu,%u", &t, &v) == 2 && detector.update(v, t)) {
+      pulses++;
+      printf("pulse %llu\n", (unsigned long long)detector.pulseStartUs());
+    }
+  }
+  fclose(in);
+  printf("{\"trace\":\"%s\",\"adaptive\":%u,", path, pulses);
+  printStats(detector.stats());
+  printf("}\n");
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    return runTrace(argv[1], argc > 2 ? strtoul(argv[2], NULL, 10) : 1000,
+                    argc > 3 ? strtoul(argv[3], NULL, 10) : 20000);
+  }
+  bool ok = true;
+  for (const Scenario& s : scenarios) {
+    ok = runScenario(s) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file log2csv.cpp
+ * @brief Host-værktøj der konverterer en binær logfil (log.bin) eller en
+ * fil med komprimerede blokke (history.blk) til CSV.
+ *
+ * Byg på en PC med:
+ *   g++ -std=c++11 -Iinclude tools/log2csv.cpp src/log_format.cpp src/log_export.cpp src/ts_block.cpp src/crc32.cpp -o log2csv
+ *
+ * Brug:
+ *   log2csv log.bin|history.blk [fra [til]] > log.csv
+ * hvor fra/til er tidsstempler i sekunder. I log.bin findes starten med
+ * binær søgning; i history.blk springes blokke uden for intervallet over.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log_format.h"
+#include "log_export.h"
+
+/**
+ * @brief Blokfil læst med stdio.
+ */
+class FileBlockSource : public LogBlockSource {
+public:
+  FileBlockSource(FILE* in, uint32_t from, uint32_t to) : LogBlockSource(from, to), in_(in) {}
+
+protected:
+  size_t readBytes(uint32_t offset, uint8_t* buf, size_t len) override {
+    return fseek(in_, offset, SEEK_SET) == 0 ? fread(buf, 1, len, in_) : 0;
+  }
+
+private:
+  FILE* in_;
+};
+
+/**
+ * @brief Skriver alle blokposter i [from, to] som CSV.
+ */
+static int blocksToCsv(FILE* in, uint32_t from, uint32_t to) {
+  FileBlockSource source(in, from, to);
+  fputs(kLogCsvHeader, stdout);
+  LogRecord record;
+  char line[64];
+  while (source.read(&record, 1) == 1) {
+    if (record.time < from) {
+      continue;
+    }
+    if (record.time > to) {
+      break;
+    }
+    if (formatLogCsv(record, line, sizeof(line)) > 0) {
+      fputs(line, stdout);
+    }
+  }
+  fprintf(stderr, "%u blocks read, %u skipped, %u resyncs\n", source.blocksRead(), source.blocksSkipped(),
+          source.resyncs());
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s log.bin|history.blk [from [to]]\n", argv[0]);
+    return 2;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  uint32_t from = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+  uint32_t to = argc > 3 ? strtoul(argv[3], NULL, 10) : UINT32_MAX;
+
+  uint8_t magic[2];
+  if (fread(magic, 1, 2, in) == 2 && (magic[0] | (magic[1] << 8)) == kTsBlockMagic) {
+    int result = blocksToCsv(in, from, to);
+    fclose(in);
+    return result;
+  }
+  rewind(in);
+
+  LogHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 || !logHeaderValid(header)) {
+    fprintf(stderr, "%s: not a version %u log file\n", argv[1], kLogVersion);
+    fclose(in);
+    return 1;
+  }
+  fseek(in, 0, SEEK_END);
+  uint32_t count = logRecordCount(ftell(in));
+
+  auto readAt = [in](uint32_t index, LogRecord& record) {
+    return fseek(in, logRecordOffset(index), SEEK_SET) == 0 &&
+           fread(&record, sizeof(record), 1, in) == 1;
+  };
+  uint32_t index = logLowerBound(readAt, count, from);
+
+  fputs(kLogCsvHeader, stdout);
+  fseek(in, logRecordOffset(index), SEEK_SET);
+  LogRecord record;
+  char line[64];
+  for (; index < count && fread(&record, sizeof(record), 1, in) == 1; index++) {
+    if (record.time > to) {
+      break;
+    }
+    if (formatLogCsv(record, line, sizeof(line)) > 0) {
+      fputs(line, stdout);
+    }
+  }
+  fclose(in);
+  return 0;
+}
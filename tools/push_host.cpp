@@ -0,0 +1,212 @@
+/**
+ * @file push_host.cpp
+ * @brief Kører eksportøren (push_exporter.h) på en PC mod en lokal modtager.
+ *
+ * Byg på en PC med:
+ *   g++ -std=c++11 -O2 -Iinclude tools/push_host.cpp src/push_exporter.cpp src/mqtt_packet.cpp src/rule_engine.cpp \
+ *       src/storage_stdio.cpp -o push_host
+ *
+ * Brug:
+ *   push_host udp|mqtt vært port [timer [udfald_fra_min udfald_til_min]]
+ *
+ * Simulerer timer (standard 24) med et punkt pr. kanal hvert 10. s for to
+ * kanaler i simuleret tid, men sender rigtigt over UDP eller MQTT (QoS 1).
+ * I udfaldsvinduet (standard 60-90 min) melder transporten sig ikke klar,
+ * så batches spooles i en ny mappe under /tmp og sendes bagefter med
+ * eksportørens hastighedsgrænse. Til sidst skrives én JSON-linje med
+ * eksportørens tællere og antal genererede punkter. Modtageren kan være
+ * tools/push_listener.py, InfluxDB (UDP) eller en MQTT-broker som mosquitto.
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "mqtt_packet.h"
+#include "push_exporter.h"
+#include "storage_stdio.h"
+
+const uint32_t kStepMs = 250;           ///< Simuleret tid pr. gennemløb
+const uint32_t kPointIntervalMs = 10000; ///< Som firmwarens standard
+const uint8_t kChannels = 2;
+const uint32_t kStartTime = 1700000000; ///< Unix-tid for første punkt
+
+/**
+ * @brief Slår en vært op og forbinder en socket.
+ * @return Socket, eller -1.
+ */
+static int openSocket(const char* host, const char* port, int type) {
+  struct addrinfo hints = {};
+  struct addrinfo* res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = type;
+  if (getaddrinfo(host, port, &hints, &res) != 0) {
+    return -1;
+  }
+  int fd = socket(res->ai_family, res->ai_socktype, 0);
+  if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd >= 0) {
+    struct timeval tv = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+  if (fd >= 0 && type == SOCK_STREAM) {
+    // Header og payload sendes hver for sig; uden dette venter Nagle på ACK
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+/**
+ * @brief Basis for transporterne: et simuleret udfald gør dem ikke klar.
+ */
+class HostTransport : public PushTransport {
+public:
+  uint32_t outageFromMs = 0;
+  uint32_t outageToMs = 0;
+
+protected:
+  bool inOutage(uint32_t nowMs) const { return nowMs >= outageFromMs && nowMs < outageToMs; }
+};
+
+class UdpHostTransport : public HostTransport {
+public:
+  UdpHostTransport(const char* host, const char* port) : fd_(openSocket(host, port, SOCK_DGRAM)) {}
+  const char* name() const override { return "udp"; }
+  bool ready(uint32_t nowMs) override { return fd_ >= 0 && !inOutage(nowMs); }
+  bool send(const uint8_t* data, size_t len) override {
+    // Simuleret tid løber tusindvis af gange hurtigere end ægte; uden en
+    // pause løber modtagerens socketbuffer over
+    usleep(500);
+    return ::send(fd_, data, len, 0) == (ssize_t)len;
+  }
+
+private:
+  int fd_;
+};
+
+class MqttHostTransport : public HostTransport {
+public:
+  MqttHostTransport(const char* host, const char* port, const char* topic)
+    : host_(host), port_(port), topic_(topic) {}
+  const char* name() const override { return "mqtt"; }
+
+  bool ready(uint32_t nowMs) override {
+    if (inOutage(nowMs)) {
+      disconnect();
+      return false;
+    }
+    if (fd_ >= 0) {
+      return true;
+    }
+    fd_ = openSocket(host_, port_, SOCK_STREAM);
+    uint8_t packet[64];
+    size_t len = mqttConnect("energi-host", 0, packet, sizeof(packet));
+    uint8_t ack[kMqttAckSize];
+    if (fd_ < 0 || ::send(fd_, packet, len, 0) != (ssize_t)len ||
+        recv(fd_, ack, sizeof(ack), MSG_WAITALL) != (ssize_t)sizeof(ack) || !mqttConnackOk(ack)) {
+      disconnect();
+      return false;
+    }
+    return true;
+  }
+
+  bool send(const uint8_t* data, size_t len) override {
+    uint8_t header[kMqttMaxHeaderSize + 64];
+    packetId_ = packetId_ == 0xFFFF ? 1 : packetId_ + 1;
+    size_t headerLen = mqttPublishHeader(topic_, packetId_, len, header, sizeof(header));
+    uint8_t ack[kMqttAckSize];
+    if (headerLen == 0 || ::send(fd_, header, headerLen, 0) != (ssize_t)headerLen ||
+        ::send(fd_, data, len, 0) != (ssize_t)len ||
+        recv(fd_, ack, sizeof(ack), MSG_WAITALL) != (ssize_t)sizeof(ack) || mqttPubackId(ack) != packetId_) {
+      disconnect();
+      return false;
+    }
+    return true;
+  }
+
+private:
+  void disconnect() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  const char* host_;
+  const char* port_;
+  const char* topic_;
+  int fd_ = -1;
+  uint16_t packetId_ = 0;
+};
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    fprintf(stderr, "usage: push_host udp|mqtt host port [hours [outage_from_min outage_to_min]]\n");
+    return 2;
+  }
+  uint32_t hours = argc > 4 ? strtoul(argv[4], nullptr, 10) : 24;
+  uint32_t outageFrom = argc > 6 ? strtoul(argv[5], nullptr, 10) : 60;
+  uint32_t outageTo = argc > 6 ? strtoul(argv[6], nullptr, 10) : 90;
+
+  HostTransport* transport;
+  if (strcmp(argv[1], "mqtt") == 0) {
+    transport = new MqttHostTransport(argv[2], argv[3], "energi/host/lp");
+  } else {
+    transport = new UdpHostTransport(argv[2], argv[3]);
+  }
+  transport->outageFromMs = outageFrom * 60000;
+  transport->outageToMs = outageTo * 60000;
+
+  char dir[] = "/tmp/push_host.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+  StdioStorage storage(dir, 0x160000);
+  storage.mount(false);
+  PushExporterConfig config;
+  PushExporter exporter(*transport, storage, config);
+  exporter.begin("host");
+
+  uint32_t generated = 0;
+  uint32_t counters[kChannels] = {};
+  uint32_t endMs = hours * 3600000;
+  for (uint32_t nowMs = 0; nowMs < endMs; nowMs += kStepMs) {
+    if (nowMs % kPointIntervalMs == 0) {
+      for (uint8_t ch = 0; ch < kChannels; ch++) {
+        counters[ch] += 1 + ch;
+        PushPoint point = {kStartTime + nowMs / 1000, ch, counters[ch], (int32_t)counters[ch], (int32_t)(100 * (ch + 1))};
+        exporter.add(point, nowMs);
+        generated++;
+      }
+    }
+    exporter.poll(nowMs);
+  }
+  // Giv spoolen tid til at blive tømt
+  uint32_t nowMs = endMs;
+  exporter.flush(nowMs);
+  for (uint32_t i = 0; i < 100000 && exporter.stats().spoolBytes > 0; i++) {
+    nowMs += kStepMs;
+    exporter.poll(nowMs);
+  }
+
+  const PushExporterStats& s = exporter.stats();
+  printf("{\"transport\":\"%s\",\"points\":%u,\"queued\":%u,\"batches\":%u,\"sent\":%u,\"drained\":%u,"
+         "\"bytes_sent\":%u,\"send_failures\":%u,\"spooled\":%u,\"spool_failures\":%u,"
+         "\"discarded_bytes\":%u,\"spool_bytes\":%u}\n",
+         transport->name(), generated, s.points, s.batches, s.sent, s.drained, s.bytesSent,
+         s.sendFailures, s.spooled, s.spoolFailures, s.discardedBytes, s.spoolBytes);
+  return 0;
+}
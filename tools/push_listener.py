@@ -0,0 +1,140 @@
+"""
+Lokal modtager til at teste eksportøren (include/push_exporter.h) uden InfluxDB.
+
+Lytter enten på UDP som InfluxDB's UDP-service eller som en minimal MQTT
+3.1.1-broker, der svarer på CONNECT, PUBLISH med QoS 0/1 og PINGREQ. Alle
+modtagne linjer line protocol tælles, og når der ikke er kommet noget i
+--idle sekunder, skrives én JSON-linje med antal pakker, linjer og
+forskellige linjer (gentagelser fra spoolen tælles kun én gang).
+Med --out gemmes linjerne også i en fil.
+
+Brug: python tools/push_listener.py udp|mqtt [port] [--idle s] [--out fil]
+"""
+
+import json
+import socket
+import sys
+
+
+class Tally:
+    """Tæller pakker og linjer."""
+
+    def __init__(self, out):
+        self.packets = 0
+        self.lines = 0
+        self.distinct = set()
+        self.out = out
+
+    def add(self, payload):
+        self.packets += 1
+        for line in payload.decode("utf-8", "replace").splitlines():
+            if line:
+                self.lines += 1
+                self.distinct.add(line)
+                if self.out:
+                    self.out.write(line + "\n")
+
+    def report(self, transport):
+        print(json.dumps({"transport": transport, "packets": self.packets,
+                          "lines": self.lines, "distinct": len(self.distinct)}))
+
+
+def serve_udp(port, idle, tally):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", port))
+    sock.settimeout(idle)
+    try:
+        while True:
+            data, _ = sock.recvfrom(65535)
+            tally.add(data)
+    except socket.timeout:
+        pass
+
+
+def recv_exact(conn, n):
+    data = b""
+    while len(data) < n:
+        chunk = conn.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("closed")
+        data += chunk
+    return data
+
+
+def read_packet(conn):
+    """Returnerer (første byte, resten) for én MQTT-pakke."""
+    first = recv_exact(conn, 1)[0]
+    remaining, shift = 0, 0
+    while True:
+        digit = recv_exact(conn, 1)[0]
+        remaining |= (digit & 0x7F) << shift
+        shift += 7
+        if not digit & 0x80:
+            break
+    return first, recv_exact(conn, remaining)
+
+
+def serve_mqtt(port, idle, tally):
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("127.0.0.1", port))
+    server.listen(1)
+    server.settimeout(idle)
+    try:
+        while True:
+            conn, _ = server.accept()
+            conn.settimeout(idle)
+            try:
+                while True:
+                    first, body = read_packet(conn)
+                    kind = first >> 4
+                    if kind == 1:    # CONNECT
+                        conn.sendall(bytes([0x20, 2, 0, 0]))
+                    elif kind == 3:  # PUBLISH
+                        qos = (first >> 1) & 3
+                        topic_len = (body[0] << 8) | body[1]
+                        offset = 2 + topic_len
+                        if qos > 0:
+                            conn.sendall(bytes([0x40, 2]) + body[offset:offset + 2])
+                            offset += 2
+                        tally.add(body[offset:])
+                    elif kind == 12:  # PINGREQ
+                        conn.sendall(bytes([0xD0, 0]))
+                    elif kind == 14:  # DISCONNECT
+                        break
+            except (ConnectionError, socket.timeout):
+                pass
+            finally:
+                conn.close()
+    except socket.timeout:
+        pass
+
+
+def main():
+    args = sys.argv[1:]
+    if not args or args[0] not in ("udp", "mqtt"):
+        print(__doc__.strip())
+        return 2
+    transport = args.pop(0)
+    idle = 5.0
+    out = None
+    port = 8089 if transport == "udp" else 1883
+    while args:
+        arg = args.pop(0)
+        if arg == "--idle":
+            idle = float(args.pop(0))
+        elif arg == "--out":
+            out = open(args.pop(0), "w")
+        else:
+            port = int(arg)
+    tally = Tally(out)
+    if transport == "udp":
+        serve_udp(port, idle, tally)
+    else:
+        serve_mqtt(port, idle, tally)
+    tally.report(transport)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,62 @@
+/**
+ * @file storage_bench.cpp
+ * @brief Host-benchmark af RamStorage og StdioStorage (se storage_bench.h).
+ *
+ * Byg på en PC med:
+ *   g++ -std=c++11 -O2 -Iinclude tools/storage_bench.cpp src/storage_bench.cpp src/storage_ram.cpp src/storage_stdio.cpp -o storage_bench
+ *
+ * Brug:
+ *   storage_bench [mappe]
+ * StdioStorage måles i mappen (standard: en ny mappe under /tmp). Output er
+ * én JSON-linje pr. backend, samme format som /api/storage/bench på enheden
+ * (kun i builds med -D ENERGI_STORAGE_BENCH).
+ * SPIFFS og LittleFS måles på enheden med den build.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "storage_bench.h"
+#include "storage_ram.h"
+#include "storage_stdio.h"
+
+const uint32_t kCapacity = 0x160000; ///< Samme størrelse som SPIFFS-partitionen på esp32doit-devkit-v1
+
+static uint32_t clockUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+}
+
+static void run(Storage& storage) {
+  static const uint8_t fills[] = {0, 50, 90, 99};
+  StorageBenchResult results[sizeof(fills)];
+  char json[1024];
+  if (!storage.mount(false)) {
+    fprintf(stderr, "%s: mount failed\n", storage.name());
+    return;
+  }
+  storageBench(storage, clockUs, fills, sizeof(fills), results);
+  storageBenchJson(storage.name(), results, sizeof(fills), json, sizeof(json));
+  puts(json);
+}
+
+int main(int argc, char** argv) {
+  char tmpl[] = "/tmp/storage_bench.XXXXXX";
+  const char* dir = argc > 1 ? argv[1] : mkdtemp(tmpl);
+  if (dir == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  RamStorage ram(kCapacity);
+  run(ram);
+  StdioStorage stdio(dir, kCapacity);
+  run(stdio);
+  if (argc <= 1) {
+    rmdir(dir);
+  }
+  return 0;
+}
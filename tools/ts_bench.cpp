@@ -0,0 +1,135 @@
+/**
+ * @file ts_bench.cpp
+ * @brief Host-benchmark af det komprimerede blokformat (ts_block.h).
+ *
+ * Genererer realistiske målerspor og rapporterer kompressionsforhold og
+ * gennemløb for kodning og afkodning. Byg på en PC med:
+ *   g++ -std=c++11 -O2 -Iinclude tools/ts_bench.cpp src/ts_block.cpp src/crc32.cpp src/log_format.cpp -o ts_bench
+ *
+ * Output er én linje pr. spor med felterne
+ *   trace records raw_bytes packed_bytes ratio encode_MBps decode_MBps
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "ts_block.h"
+
+/** @brief Deterministisk pseudotilfældig generator (xorshift32). */
+static uint32_t rng = 2463534242u;
+static uint32_t nextRandom() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static double nowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Pulsmåler: tæller og effekt hvert minut med lidt jitter, sjældne LED-hændelser.
+ */
+static std::vector<LogRecord> pulseTrace(size_t days) {
+  std::vector<LogRecord> out;
+  uint32_t t = 1700000000;
+  int32_t counter = 0;
+  for (size_t minute = 0; minute < days * 1440; minute++) {
+    uint32_t watts = 300 + (nextRandom() % 2500);
+    counter += watts / 60;
+    uint16_t millis = nextRandom() % 20;
+    LogRecord c = {t, millis, 0, LOG_EVENT_COUNTER, counter};
+    LogRecord p = {t, millis, 0, LOG_EVENT_POWER, (int32_t)watts};
+    out.push_back(c);
+    out.push_back(p);
+    if (nextRandom() % 500 == 0) {
+      LogRecord led = {t, (uint16_t)(millis + 3), 0, LOG_EVENT_LED_ON, 1};
+      out.push_back(led);
+    }
+    t += 60;
+  }
+  return out;
+}
+
+/**
+ * @brief CT-måler: effekt hvert sekund med langsom drift og støj.
+ */
+static std::vector<LogRecord> ctTrace(size_t hours) {
+  std::vector<LogRecord> out;
+  uint32_t t = 1700000000;
+  int32_t watts = 800;
+  for (size_t s = 0; s < hours * 3600; s++) {
+    watts += (int32_t)(nextRandom() % 41) - 20;
+    if (watts < 0) watts = 0;
+    LogRecord p = {t++, 0, 0, LOG_EVENT_POWER, watts};
+    out.push_back(p);
+  }
+  return out;
+}
+
+/**
+ * @brief Koder og afkoder et spor og skriver én resultatlinje.
+ */
+static void bench(const char* name, const std::vector<LogRecord>& trace) {
+  std::vector<uint8_t> packed(trace.size() * kTsRecordMaxEncoded + kTsBlockHeaderSize * (trace.size() / 64 + 2));
+  const int rounds = 20;
+  size_t packedLen = 0;
+
+  double start = nowSeconds();
+  for (int r = 0; r < rounds; r++) {
+    TsBlockEncoder encoder;
+    packedLen = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+      if (!encoder.add(trace[i])) {
+        packedLen += encoder.seal(&packed[packedLen]);
+        encoder.reset();
+        encoder.add(trace[i]);
+      }
+    }
+    packedLen += encoder.seal(&packed[packedLen]);
+  }
+  double encodeSeconds = (nowSeconds() - start) / rounds;
+
+  size_t decoded = 0;
+  bool ok = true;
+  start = nowSeconds();
+  for (int r = 0; r < rounds; r++) {
+    decoded = 0;
+    size_t pos = 0;
+    while (pos < packedLen) {
+      TsBlockHeader header;
+      if (!tsBlockReadHeader(&packed[pos], header) || !tsBlockVerify(header, &packed[pos + kTsBlockHeaderSize])) {
+        ok = false;
+        break;
+      }
+      TsBlockDecoder decoder(header, &packed[pos + kTsBlockHeaderSize]);
+      LogRecord record;
+      while (decoder.next(record)) {
+        const LogRecord& expected = trace[decoded++];
+        if (memcmp(&record, &expected, sizeof(record)) != 0) {
+          ok = false;
+        }
+      }
+      pos += kTsBlockHeaderSize + header.payloadBytes;
+    }
+  }
+  double decodeSeconds = (nowSeconds() - start) / rounds;
+
+  size_t raw = trace.size() * sizeof(LogRecord);
+  printf("%s %zu %zu %zu %.2f %.1f %.1f%s\n", name, trace.size(), raw, packedLen,
+         (double)raw / packedLen, raw / encodeSeconds / 1e6, raw / decodeSeconds / 1e6,
+         ok && decoded == trace.size() ? "" : " MISMATCH");
+}
+
+int main() {
+  printf("trace records raw_bytes packed_bytes ratio encode_MBps decode_MBps\n");
+  bench("pulse_30d", pulseTrace(30));
+  bench("ct_24h", ctTrace(24));
+  return 0;
+}